@@ -12,6 +12,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "pkcs11types.h"
 #include "regress.h"
@@ -1489,6 +1492,268 @@ void process_time(SYSTEMTIME t1, SYSTEMTIME t2)
     printf("Time:  %u msec\n", (unsigned int) ms);
 }
 
+long elapsed_usec(SYSTEMTIME t1, SYSTEMTIME t2)
+{
+    return (t2.tv_sec - t1.tv_sec) * 1000000L + (t2.tv_usec - t1.tv_usec);
+}
+
+uint64_t perf_now_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void perf_atomic_max(uint64_t *val, uint64_t new)
+{
+    uint64_t old = __atomic_load_n(val, __ATOMIC_RELAXED);
+
+    while (old < new &&
+           !__atomic_compare_exchange_n(val, &old, new, 1, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED))
+        ;
+}
+
+static unsigned int perf_hist_index(uint64_t ns)
+{
+    unsigned int msb;
+
+    if (ns < 2 * PERF_HIST_SUB)
+        return (unsigned int)ns;
+
+    msb = 63 - __builtin_clzll(ns);
+    if (msb > PERF_HIST_MAX_MSB)
+        return PERF_HIST_BUCKETS - 1;
+
+    return (msb - PERF_HIST_SUB_BITS + 1) * PERF_HIST_SUB +
+           ((ns >> (msb - PERF_HIST_SUB_BITS)) & (PERF_HIST_SUB - 1));
+}
+
+/* Returns the middle of the range of a histogram bucket */
+static double perf_hist_value(unsigned int index)
+{
+    unsigned int msb, sub;
+
+    if (index < 2 * PERF_HIST_SUB)
+        return index;
+
+    msb = index / PERF_HIST_SUB + PERF_HIST_SUB_BITS - 1;
+    sub = index % PERF_HIST_SUB;
+
+    return (double)((uint64_t)(PERF_HIST_SUB + sub) <<
+                                        (msb - PERF_HIST_SUB_BITS)) +
+           (double)((uint64_t)1 << (msb - PERF_HIST_SUB_BITS)) / 2;
+}
+
+void perf_hist_add(struct perf_hist *hist, uint64_t ns)
+{
+    hist->ops++;
+    hist->buckets[perf_hist_index(ns)]++;
+    if (ns > hist->max_ns)
+        hist->max_ns = ns;
+}
+
+/*
+ * Adds the latencies of src to dst. dst may be shared with other threads or
+ * processes, it is updated with atomic operations only.
+ */
+void perf_hist_merge(struct perf_hist *dst, const struct perf_hist *src)
+{
+    unsigned int i;
+
+    __atomic_add_fetch(&dst->ops, src->ops, __ATOMIC_RELAXED);
+    perf_atomic_max(&dst->max_ns, src->max_ns);
+    for (i = 0; i < PERF_HIST_BUCKETS; i++) {
+        if (src->buckets[i] != 0)
+            __atomic_add_fetch(&dst->buckets[i], src->buckets[i],
+                               __ATOMIC_RELAXED);
+    }
+}
+
+/* Returns the latency in nanoseconds below which the fraction q of calls is */
+double perf_hist_percentile(const struct perf_hist *hist, double q)
+{
+    uint64_t target, sum = 0;
+    unsigned int i;
+
+    if (hist->ops == 0)
+        return 0;
+
+    target = (uint64_t)(q * hist->ops);
+    if (target == 0)
+        target = 1;
+
+    for (i = 0; i < PERF_HIST_BUCKETS; i++) {
+        sum += hist->buckets[i];
+        if (sum >= target)
+            return perf_hist_value(i);
+    }
+
+    return hist->max_ns;
+}
+
+/* The threads of one perf_run_in_threads() call */
+struct perf_group {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned int ready;         /* threads that have opened their session */
+    unsigned int failed;        /* threads that failed to open it */
+    int go;                     /* 1: call func, -1: give up, 0: not yet */
+    perf_thread_func_t func;
+    void *arg;
+};
+
+struct perf_thread {
+    pthread_t tid;
+    unsigned int index;
+    struct perf_group *group;
+    CK_RV rc;
+};
+
+static void *perf_thread_main(void *arg)
+{
+    struct perf_thread *t = arg;
+    struct perf_group *g = t->group;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    int go;
+
+    t->rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION, NULL, NULL,
+                                 &session);
+
+    pthread_mutex_lock(&g->mutex);
+    if (t->rc == CKR_OK)
+        g->ready++;
+    else
+        g->failed++;
+    pthread_cond_broadcast(&g->cond);
+    while (g->go == 0)
+        pthread_cond_wait(&g->cond, &g->mutex);
+    go = g->go;
+    pthread_mutex_unlock(&g->mutex);
+
+    if (t->rc == CKR_OK) {
+        if (go > 0)
+            t->rc = g->func(session, t->index, g->arg);
+        funcs->C_CloseSession(session);
+    }
+
+    return NULL;
+}
+
+/*
+ * Calls func in each of num_threads threads, each thread using its own
+ * session, and waits until all of them have returned. func is called with
+ * the index of the thread, from 0 to num_threads - 1. It is either called in
+ * all threads, after all of them have opened their session, or in none.
+ * Returns the return code of the first failing thread.
+ */
+CK_RV perf_run_in_threads(unsigned int num_threads, perf_thread_func_t func,
+                          void *arg)
+{
+    struct perf_group group;
+    struct perf_thread *threads;
+    unsigned int i, started;
+    CK_RV rc = CKR_OK;
+
+    threads = calloc(num_threads, sizeof(*threads));
+    if (threads == NULL)
+        return CKR_HOST_MEMORY;
+
+    memset(&group, 0, sizeof(group));
+    pthread_mutex_init(&group.mutex, NULL);
+    pthread_cond_init(&group.cond, NULL);
+    group.func = func;
+    group.arg = arg;
+
+    for (started = 0; started < num_threads; started++) {
+        threads[started].index = started;
+        threads[started].group = &group;
+        if (pthread_create(&threads[started].tid, NULL, perf_thread_main,
+                           &threads[started]) != 0) {
+            rc = CKR_FUNCTION_FAILED;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&group.mutex);
+    while (group.ready + group.failed < started)
+        pthread_cond_wait(&group.cond, &group.mutex);
+    group.go = (started == num_threads && group.failed == 0) ? 1 : -1;
+    pthread_cond_broadcast(&group.cond);
+    pthread_mutex_unlock(&group.mutex);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].tid, NULL);
+        if (threads[i].rc != CKR_OK && rc == CKR_OK)
+            rc = threads[i].rc;
+    }
+
+    pthread_cond_destroy(&group.cond);
+    pthread_mutex_destroy(&group.mutex);
+    free(threads);
+    return rc;
+}
+
+struct perf_loop {
+    perf_op_func_t op;
+    void *arg;
+    unsigned int seconds;
+    unsigned long *ops;         /* [thread] */
+};
+
+static CK_RV perf_loop_func(CK_SESSION_HANDLE session, unsigned int index,
+                            void *arg)
+{
+    struct perf_loop *loop = arg;
+    SYSTEMTIME t1, t2;
+    CK_RV rc;
+
+    GetSystemTime(&t1);
+    do {
+        rc = loop->op(session, loop->arg);
+        if (rc != CKR_OK)
+            return rc;
+
+        loop->ops[index]++;
+        GetSystemTime(&t2);
+    } while (elapsed_usec(t1, t2) < loop->seconds * 1000000L);
+
+    return CKR_OK;
+}
+
+/*
+ * Calls op in a loop for the given number of seconds in each of num_threads
+ * threads, each thread using its own session. On success, the total number
+ * of calls of all threads is returned in total. Otherwise the return code of
+ * the first failing thread is returned.
+ */
+CK_RV perf_run_threads(unsigned int num_threads, unsigned int seconds,
+                       perf_op_func_t op, void *arg, unsigned long *total)
+{
+    struct perf_loop loop;
+    unsigned int i;
+    CK_RV rc;
+
+    *total = 0;
+
+    loop.op = op;
+    loop.arg = arg;
+    loop.seconds = seconds;
+    loop.ops = calloc(num_threads, sizeof(*loop.ops));
+    if (loop.ops == NULL)
+        return CKR_HOST_MEMORY;
+
+    rc = perf_run_in_threads(num_threads, perf_loop_func, &loop);
+
+    for (i = 0; i < num_threads; i++)
+        *total += loop.ops[i];
+
+    free(loop.ops);
+    return rc;
+}
+
 
 
 //
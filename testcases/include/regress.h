@@ -30,6 +30,7 @@
 
 #define MIN(a, b)       ( (a) < (b) ? (a) : (b) )
 
+#include <stdint.h>
 #include <sys/time.h>
 #define SYSTEMTIME   struct timeval
 #define GetSystemTime(x) gettimeofday((x), NULL)
@@ -68,6 +69,42 @@ extern CK_ULONG t_skipped;      // number of assertions skipped
 extern CK_ULONG t_errors;       // number of errors
 
 void process_time(SYSTEMTIME t1, SYSTEMTIME t2);
+long elapsed_usec(SYSTEMTIME t1, SYSTEMTIME t2);
+
+/* A single call of a *_bench performance test, see perf_run_threads() */
+typedef CK_RV (*perf_op_func_t)(CK_SESSION_HANDLE session, void *arg);
+
+/* The work of one benchmark thread, see perf_run_in_threads() */
+typedef CK_RV (*perf_thread_func_t)(CK_SESSION_HANDLE session,
+                                    unsigned int index, void *arg);
+
+CK_RV perf_run_threads(unsigned int num_threads, unsigned int seconds,
+                       perf_op_func_t op, void *arg, unsigned long *total);
+CK_RV perf_run_in_threads(unsigned int num_threads, perf_thread_func_t func,
+                          void *arg);
+
+/*
+ * Latency histogram in nanoseconds: exact below 64ns, above that 32 buckets
+ * per power of 2, i.e. a resolution of about 3%.
+ */
+#define PERF_HIST_SUB_BITS      5
+#define PERF_HIST_SUB           (1 << PERF_HIST_SUB_BITS)
+#define PERF_HIST_MAX_MSB       47
+#define PERF_HIST_BUCKETS       ((PERF_HIST_MAX_MSB - PERF_HIST_SUB_BITS + 2) \
+                                 * PERF_HIST_SUB)
+
+struct perf_hist {
+    uint64_t ops;
+    uint64_t max_ns;
+    uint64_t buckets[PERF_HIST_BUCKETS];
+};
+
+uint64_t perf_now_nsec(void);
+void perf_atomic_max(uint64_t *val, uint64_t new);
+void perf_hist_add(struct perf_hist *hist, uint64_t ns);
+void perf_hist_merge(struct perf_hist *dst, const struct perf_hist *src);
+double perf_hist_percentile(const struct perf_hist *hist, double q);
+
 void show_error(char *str, CK_RV rc);
 void print_hex(CK_BYTE * buf, CK_ULONG len);
 
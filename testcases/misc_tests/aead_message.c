@@ -0,0 +1,485 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: aead_message.c
+ *
+ * Tests the message based encryption and decryption functions of PKCS#11
+ * v3.0 (C_MessageEncryptInit, C_EncryptMessage, ...) with CKM_AES_GCM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define MSG_DATA_LEN        100
+#define MSG_AAD_LEN         20
+#define MSG_IV_LEN          12
+#define MSG_TAG_LEN         16
+#define MSG_PART_LEN        33
+
+static CK_BYTE msg_data[MSG_DATA_LEN];
+static CK_BYTE msg_aad[MSG_AAD_LEN];
+
+static void init_msg_params(CK_GCM_MESSAGE_PARAMS *params, CK_BYTE *iv,
+                            CK_ULONG fixed_bits, CK_GENERATOR_FUNCTION gen,
+                            CK_BYTE *tag)
+{
+    params->pIv = iv;
+    params->ulIvLen = MSG_IV_LEN;
+    params->ulIvFixedBits = fixed_bits;
+    params->ivGenerator = gen;
+    params->pTag = tag;
+    params->ulTagBits = MSG_TAG_LEN * 8;
+}
+
+/*
+ * Decrypts a message encrypted with C_EncryptMessage with C_Decrypt, which
+ * expects the tag appended to the cipher text.
+ */
+static CK_RV check_with_decrypt(CK_SESSION_HANDLE session,
+                                CK_OBJECT_HANDLE key, CK_BYTE *iv,
+                                CK_BYTE *cipher, CK_BYTE *tag)
+{
+    CK_GCM_PARAMS gcm_params = { iv, MSG_IV_LEN, MSG_IV_LEN * 8, msg_aad,
+                                 MSG_AAD_LEN, MSG_TAG_LEN * 8 };
+    CK_MECHANISM mech = { CKM_AES_GCM, &gcm_params, sizeof(gcm_params) };
+    CK_BYTE in[MSG_DATA_LEN + MSG_TAG_LEN], out[MSG_DATA_LEN + MSG_TAG_LEN];
+    CK_ULONG out_len = sizeof(out);
+    CK_RV rc;
+
+    memcpy(in, cipher, MSG_DATA_LEN);
+    memcpy(in + MSG_DATA_LEN, tag, MSG_TAG_LEN);
+
+    rc = funcs->C_DecryptInit(session, &mech, key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_DecryptInit rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    rc = funcs->C_Decrypt(session, in, sizeof(in), out, &out_len);
+    if (rc != CKR_OK) {
+        testcase_fail("C_Decrypt rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    if (out_len != MSG_DATA_LEN || memcmp(out, msg_data, MSG_DATA_LEN) != 0) {
+        testcase_fail("C_Decrypt returned wrong plain text");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return CKR_OK;
+}
+
+static CK_RV decrypt_message(CK_SESSION_HANDLE session, CK_BYTE *iv,
+                             CK_BYTE *cipher, CK_BYTE *tag, CK_RV exp_rc)
+{
+    CK_GCM_MESSAGE_PARAMS params;
+    CK_BYTE out[MSG_DATA_LEN];
+    CK_ULONG out_len = sizeof(out);
+    CK_RV rc;
+
+    init_msg_params(&params, iv, 0, CKG_NO_GENERATE, tag);
+    memset(out, 0, sizeof(out));
+
+    rc = funcs3->C_DecryptMessage(session, &params, sizeof(params),
+                                  msg_aad, MSG_AAD_LEN, cipher, MSG_DATA_LEN,
+                                  out, &out_len);
+    if (rc != exp_rc) {
+        testcase_fail("C_DecryptMessage rc=%s, expected %s", p11_get_ckr(rc),
+                      p11_get_ckr(exp_rc));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (rc == CKR_OK &&
+        (out_len != MSG_DATA_LEN || memcmp(out, msg_data, MSG_DATA_LEN) != 0)) {
+        testcase_fail("C_DecryptMessage returned wrong plain text");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (rc != CKR_OK && memcmp(out, msg_data, MSG_DATA_LEN) == 0) {
+        testcase_fail("C_DecryptMessage returned plain text with a bad tag");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return CKR_OK;
+}
+
+static CK_RV do_single_part(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key)
+{
+    CK_GCM_MESSAGE_PARAMS params;
+    CK_BYTE iv[MSG_IV_LEN], tag[MSG_TAG_LEN], cipher[MSG_DATA_LEN];
+    CK_ULONG cipher_len, i;
+    CK_RV rc;
+
+    testcase_begin("Single-part messages with caller supplied IVs");
+    testcase_new_assertion();
+
+    for (i = 0; i < 3; i++) {
+        memset(iv, (int)i, sizeof(iv));
+        init_msg_params(&params, iv, 0, CKG_NO_GENERATE, tag);
+
+        cipher_len = 0;
+        rc = funcs3->C_EncryptMessage(session, &params, sizeof(params),
+                                      msg_aad, MSG_AAD_LEN,
+                                      msg_data, MSG_DATA_LEN,
+                                      NULL, &cipher_len);
+        if (rc != CKR_OK || cipher_len != MSG_DATA_LEN) {
+            testcase_fail("C_EncryptMessage (length only) rc=%s len=%lu",
+                          p11_get_ckr(rc), cipher_len);
+            return CKR_FUNCTION_FAILED;
+        }
+
+        cipher_len = sizeof(cipher);
+        rc = funcs3->C_EncryptMessage(session, &params, sizeof(params),
+                                      msg_aad, MSG_AAD_LEN,
+                                      msg_data, MSG_DATA_LEN,
+                                      cipher, &cipher_len);
+        if (rc != CKR_OK) {
+            testcase_fail("C_EncryptMessage rc=%s", p11_get_ckr(rc));
+            return rc;
+        }
+
+        rc = check_with_decrypt(session, key, iv, cipher, tag);
+        if (rc != CKR_OK)
+            return rc;
+
+        rc = decrypt_message(session, iv, cipher, tag, CKR_OK);
+        if (rc != CKR_OK)
+            return rc;
+    }
+
+    /* A bad tag fails the message, but not the operation */
+    tag[0] ^= 0x01;
+    rc = decrypt_message(session, iv, cipher, tag, CKR_AEAD_DECRYPT_FAILED);
+    if (rc != CKR_OK)
+        return rc;
+    tag[0] ^= 0x01;
+    rc = decrypt_message(session, iv, cipher, tag, CKR_OK);
+    if (rc != CKR_OK)
+        return rc;
+
+    testcase_pass("Single-part messages with caller supplied IVs");
+
+    return CKR_OK;
+}
+
+static CK_RV do_generated_iv(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key,
+                             CK_GENERATOR_FUNCTION gen)
+{
+    CK_GCM_MESSAGE_PARAMS params;
+    CK_BYTE iv[MSG_IV_LEN], prev_iv[MSG_IV_LEN];
+    CK_BYTE tag[MSG_TAG_LEN], cipher[MSG_DATA_LEN];
+    CK_ULONG cipher_len, i;
+    CK_RV rc;
+
+    testcase_begin("Single-part messages with %s IVs",
+                   gen == CKG_GENERATE_COUNTER ? "counter" : "random");
+    testcase_new_assertion();
+
+    for (i = 0; i < 3; i++) {
+        /* The first 4 bytes are the fixed part of the IV */
+        memset(iv, 0xa5, sizeof(iv));
+        init_msg_params(&params, iv, 32, gen, tag);
+
+        cipher_len = sizeof(cipher);
+        rc = funcs3->C_EncryptMessage(session, &params, sizeof(params),
+                                      msg_aad, MSG_AAD_LEN,
+                                      msg_data, MSG_DATA_LEN,
+                                      cipher, &cipher_len);
+        if (rc != CKR_OK) {
+            testcase_fail("C_EncryptMessage rc=%s", p11_get_ckr(rc));
+            return rc;
+        }
+
+        if (memcmp(iv, "\xa5\xa5\xa5\xa5", 4) != 0) {
+            testcase_fail("Fixed part of the IV was changed");
+            return CKR_FUNCTION_FAILED;
+        }
+
+        if (i > 0 && memcmp(iv, prev_iv, sizeof(iv)) == 0) {
+            testcase_fail("Generated IV was reused");
+            return CKR_FUNCTION_FAILED;
+        }
+
+        if (gen == CKG_GENERATE_COUNTER &&
+            (iv[MSG_IV_LEN - 1] != i || iv[MSG_IV_LEN - 2] != 0)) {
+            testcase_fail("Generated IV is not the message counter");
+            return CKR_FUNCTION_FAILED;
+        }
+        memcpy(prev_iv, iv, sizeof(iv));
+
+        rc = check_with_decrypt(session, key, iv, cipher, tag);
+        if (rc != CKR_OK)
+            return rc;
+    }
+
+    testcase_pass("Single-part messages with %s IVs",
+                  gen == CKG_GENERATE_COUNTER ? "counter" : "random");
+
+    return CKR_OK;
+}
+
+static CK_RV do_multi_part(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key)
+{
+    CK_GCM_MESSAGE_PARAMS params;
+    CK_BYTE iv[MSG_IV_LEN], tag[MSG_TAG_LEN];
+    CK_BYTE cipher[MSG_DATA_LEN], plain[MSG_DATA_LEN];
+    CK_ULONG ofs, len, out_len;
+    CK_FLAGS flags;
+    CK_RV rc;
+
+    testcase_begin("Multi-part messages");
+    testcase_new_assertion();
+
+    memset(iv, 0x11, sizeof(iv));
+    init_msg_params(&params, iv, 0, CKG_NO_GENERATE, tag);
+
+    rc = funcs3->C_EncryptMessageBegin(session, &params, sizeof(params),
+                                       msg_aad, MSG_AAD_LEN);
+    if (rc != CKR_OK) {
+        testcase_fail("C_EncryptMessageBegin rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    /* A single-part message can not be started in the middle of one */
+    out_len = sizeof(plain);
+    rc = funcs3->C_EncryptMessage(session, &params, sizeof(params),
+                                  msg_aad, MSG_AAD_LEN, msg_data, MSG_DATA_LEN,
+                                  plain, &out_len);
+    if (rc != CKR_OPERATION_ACTIVE) {
+        testcase_fail("C_EncryptMessage rc=%s, expected %s", p11_get_ckr(rc),
+                      p11_get_ckr(CKR_OPERATION_ACTIVE));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    for (ofs = 0; ofs < MSG_DATA_LEN; ofs += len) {
+        len = MSG_DATA_LEN - ofs < MSG_PART_LEN ?
+                                    MSG_DATA_LEN - ofs : MSG_PART_LEN;
+        flags = ofs + len == MSG_DATA_LEN ? CKF_END_OF_MESSAGE : 0;
+        out_len = sizeof(cipher) - ofs;
+        rc = funcs3->C_EncryptMessageNext(session, &params, sizeof(params),
+                                          msg_data + ofs, len, cipher + ofs,
+                                          &out_len, flags);
+        if (rc != CKR_OK || out_len != len) {
+            testcase_fail("C_EncryptMessageNext rc=%s len=%lu",
+                          p11_get_ckr(rc), out_len);
+            return CKR_FUNCTION_FAILED;
+        }
+    }
+
+    rc = check_with_decrypt(session, key, iv, cipher, tag);
+    if (rc != CKR_OK)
+        return rc;
+
+    rc = funcs3->C_DecryptMessageBegin(session, &params, sizeof(params),
+                                       msg_aad, MSG_AAD_LEN);
+    if (rc != CKR_OK) {
+        testcase_fail("C_DecryptMessageBegin rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    for (ofs = 0; ofs < MSG_DATA_LEN; ofs += len) {
+        len = MSG_DATA_LEN - ofs < MSG_PART_LEN ?
+                                    MSG_DATA_LEN - ofs : MSG_PART_LEN;
+        flags = ofs + len == MSG_DATA_LEN ? CKF_END_OF_MESSAGE : 0;
+        out_len = sizeof(plain) - ofs;
+        rc = funcs3->C_DecryptMessageNext(session, &params, sizeof(params),
+                                          cipher + ofs, len, plain + ofs,
+                                          &out_len, flags);
+        if (rc != CKR_OK || out_len != len) {
+            testcase_fail("C_DecryptMessageNext rc=%s len=%lu",
+                          p11_get_ckr(rc), out_len);
+            return CKR_FUNCTION_FAILED;
+        }
+    }
+
+    if (memcmp(plain, msg_data, MSG_DATA_LEN) != 0) {
+        testcase_fail("C_DecryptMessageNext returned wrong plain text");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    /* The multi-part message is finished, a single-part one is allowed */
+    rc = decrypt_message(session, iv, cipher, tag, CKR_OK);
+    if (rc != CKR_OK)
+        return rc;
+
+    testcase_pass("Multi-part messages");
+
+    return CKR_OK;
+}
+
+static CK_RV do_aead_message_tests(CK_SESSION_HANDLE session)
+{
+    CK_MECHANISM mech = { CKM_AES_GCM, NULL, 0 };
+    CK_MECHANISM_INFO info;
+    CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
+    CK_BYTE key_value[32];
+    CK_ULONG i;
+    CK_RV rc, rc2;
+
+    rc = funcs->C_GetMechanismInfo(SLOT_ID, CKM_AES_GCM, &info);
+    if (rc != CKR_OK ||
+        (info.flags & (CKF_MESSAGE_ENCRYPT | CKF_MESSAGE_DECRYPT)) !=
+                                (CKF_MESSAGE_ENCRYPT | CKF_MESSAGE_DECRYPT)) {
+        testcase_skip("Slot %u doesn't support message based CKM_AES_GCM",
+                      (unsigned int)SLOT_ID);
+        return CKR_OK;
+    }
+
+    for (i = 0; i < sizeof(key_value); i++)
+        key_value[i] = i;
+    for (i = 0; i < sizeof(msg_data); i++)
+        msg_data[i] = i * 3;
+    for (i = 0; i < sizeof(msg_aad); i++)
+        msg_aad[i] = i * 7;
+
+    rc = create_AESKey(session, TRUE, key_value, sizeof(key_value), CKK_AES,
+                       &key);
+    if (rc != CKR_OK) {
+        if (rc == CKR_POLICY_VIOLATION) {
+            testcase_skip("AES key not allowed by policy");
+            return CKR_OK;
+        }
+        testcase_error("create_AESKey rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    rc = funcs3->C_MessageEncryptInit(session, &mech, key);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageEncryptInit rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs3->C_MessageEncryptInit(session, &mech, key);
+    if (rc != CKR_OPERATION_ACTIVE) {
+        testcase_error("C_MessageEncryptInit rc=%s, expected %s",
+                       p11_get_ckr(rc), p11_get_ckr(CKR_OPERATION_ACTIVE));
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    rc = funcs3->C_MessageDecryptInit(session, &mech, key);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageDecryptInit rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = do_single_part(session, key);
+    if (rc != CKR_OK)
+        goto out;
+
+    rc = do_generated_iv(session, key, CKG_GENERATE_COUNTER);
+    if (rc != CKR_OK)
+        goto out;
+
+    rc = do_generated_iv(session, key, CKG_GENERATE_RANDOM);
+    if (rc != CKR_OK)
+        goto out;
+
+    rc = do_multi_part(session, key);
+
+out:
+    rc2 = funcs3->C_MessageEncryptFinal(session);
+    if (rc == CKR_OK && rc2 != CKR_OK) {
+        testcase_fail("C_MessageEncryptFinal rc=%s", p11_get_ckr(rc2));
+        rc = rc2;
+    }
+    rc2 = funcs3->C_MessageDecryptFinal(session);
+    if (rc == CKR_OK && rc2 != CKR_OK) {
+        testcase_fail("C_MessageDecryptFinal rc=%s", p11_get_ckr(rc2));
+        rc = rc2;
+    }
+
+    funcs->C_DestroyObject(session, key);
+
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    int ret = 1;
+    CK_RV rv;
+
+    rv = do_ParseArgs(argc, argv);
+    if (rv != 1)
+        return rv;
+
+    if (get_user_pin(user_pin))
+        return CKR_FUNCTION_FAILED;
+    user_pin_len = (CK_ULONG) strlen((char *) user_pin);
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rv = do_GetFunctionList();
+    if (rv != TRUE) {
+        testcase_fail("do_GetFunctionList() rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    testcase_setup();
+    testcase_begin("Starting...");
+
+    if (funcs3 == NULL) {
+        testcase_skip("Interface 'PKCS 11' version 3.0 not available");
+        ret = 0;
+        goto out;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    if ((rv = funcs->C_Initialize(&cinit_args))) {
+        testcase_fail("C_Initialize rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    rv = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_OpenSession rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    rv = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Login rc = %s", p11_get_ckr(rv));
+        goto close_session;
+    }
+
+    rv = do_aead_message_tests(session);
+    if (rv == CKR_OK)
+        ret = 0;
+
+close_session:
+    rv = funcs->C_CloseSession(session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_CloseSession rc = %s", p11_get_ckr(rv));
+        ret = 1;
+    }
+finalize:
+    rv = funcs->C_Finalize(NULL);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Finalize rc = %s", p11_get_ckr(rv));
+        ret = 1;
+    }
+out:
+    testcase_print_result();
+    return testcase_return(ret);
+}
@@ -0,0 +1,409 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: batch_sign.c
+ *
+ * Tests C_IBM_SignBatch, C_IBM_VerifyBatch, C_IBM_DigestBatch and
+ * C_IBM_GenerateRandom of the 'Vendor IBM' interface version 1.1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "mech_to_str.h"
+#include "ec_curves.h"
+#include "common.c"
+
+#define BATCH_COUNT         100
+#define BATCH_DATA_LEN      32
+#define BATCH_MAX_SIG_LEN   512
+#define BATCH_BAD_ITEM      7
+#define BATCH_HASH_LEN      32
+
+static CK_IBM_FUNCTION_LIST_1_1 *ibm_funcs;
+
+static CK_BYTE prime256v1[] = OCK_PRIME256V1;
+
+static CK_RV do_batch_test(CK_SESSION_HANDLE session, CK_MECHANISM_TYPE type,
+                           CK_OBJECT_HANDLE publ_key,
+                           CK_OBJECT_HANDLE priv_key)
+{
+    CK_MECHANISM mech = { type, NULL, 0 };
+    CK_IBM_BATCH_ITEM items[BATCH_COUNT];
+    CK_BYTE (*data)[BATCH_DATA_LEN] = NULL;
+    CK_BYTE (*sig)[BATCH_MAX_SIG_LEN] = NULL;
+    CK_ULONG i;
+    CK_RV rc, exp_rc;
+
+    testcase_begin("Batch sign and verify with %s", mech_to_str(type));
+    testcase_new_assertion();
+
+    data = calloc(BATCH_COUNT, sizeof(*data));
+    sig = calloc(BATCH_COUNT, sizeof(*sig));
+    if (data == NULL || sig == NULL) {
+        testcase_error("calloc failed");
+        rc = CKR_HOST_MEMORY;
+        goto out;
+    }
+
+    /* Query the signature lengths */
+    for (i = 0; i < BATCH_COUNT; i++) {
+        memset(data[i], (int)i, BATCH_DATA_LEN);
+        items[i].pData = data[i];
+        items[i].ulDataLen = BATCH_DATA_LEN;
+        items[i].pSignature = NULL;
+        items[i].ulSignatureLen = 0;
+        items[i].rv = CKR_GENERAL_ERROR;
+    }
+
+    rc = ibm_funcs->C_IBM_SignBatch(session, &mech, priv_key, items,
+                                    BATCH_COUNT);
+    if (rc != CKR_OK) {
+        testcase_fail("C_IBM_SignBatch (length only) rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    for (i = 0; i < BATCH_COUNT; i++) {
+        if (items[i].rv != CKR_OK || items[i].ulSignatureLen == 0 ||
+            items[i].ulSignatureLen > BATCH_MAX_SIG_LEN) {
+            testcase_fail("C_IBM_SignBatch (length only) item %lu: rv=%s "
+                          "len=%lu", i, p11_get_ckr(items[i].rv),
+                          items[i].ulSignatureLen);
+            rc = CKR_FUNCTION_FAILED;
+            goto out;
+        }
+        items[i].pSignature = sig[i];
+        items[i].ulSignatureLen = BATCH_MAX_SIG_LEN;
+        items[i].rv = CKR_GENERAL_ERROR;
+    }
+
+    rc = ibm_funcs->C_IBM_SignBatch(session, &mech, priv_key, items,
+                                    BATCH_COUNT);
+    if (rc != CKR_OK) {
+        testcase_fail("C_IBM_SignBatch rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    for (i = 0; i < BATCH_COUNT; i++) {
+        if (items[i].rv != CKR_OK) {
+            testcase_fail("C_IBM_SignBatch item %lu: rv=%s", i,
+                          p11_get_ckr(items[i].rv));
+            rc = CKR_FUNCTION_FAILED;
+            goto out;
+        }
+        items[i].rv = CKR_GENERAL_ERROR;
+    }
+
+    /* The signatures must be verifiable with C_Verify, too */
+    rc = funcs->C_VerifyInit(session, &mech, publ_key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_VerifyInit rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_Verify(session, data[0], BATCH_DATA_LEN, sig[0],
+                         items[0].ulSignatureLen);
+    if (rc != CKR_OK) {
+        testcase_fail("C_Verify rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    sig[BATCH_BAD_ITEM][0] ^= 0x01;
+
+    rc = ibm_funcs->C_IBM_VerifyBatch(session, &mech, publ_key, items,
+                                      BATCH_COUNT);
+    if (rc != CKR_OK) {
+        testcase_fail("C_IBM_VerifyBatch rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    for (i = 0; i < BATCH_COUNT; i++) {
+        exp_rc = (i == BATCH_BAD_ITEM) ? CKR_SIGNATURE_INVALID : CKR_OK;
+        if (items[i].rv != exp_rc) {
+            testcase_fail("C_IBM_VerifyBatch item %lu: rv=%s, expected %s",
+                          i, p11_get_ckr(items[i].rv), p11_get_ckr(exp_rc));
+            rc = CKR_FUNCTION_FAILED;
+            goto out;
+        }
+    }
+
+    testcase_pass("Batch sign and verify with %s", mech_to_str(type));
+
+out:
+    free(data);
+    free(sig);
+
+    return rc;
+}
+
+static CK_RV do_digest_batch_test(CK_SESSION_HANDLE session)
+{
+    CK_MECHANISM mech = { CKM_SHA256, NULL, 0 };
+    CK_IBM_DIGEST_ITEM items[BATCH_COUNT];
+    CK_BYTE data[BATCH_COUNT][BATCH_DATA_LEN];
+    CK_BYTE hash[BATCH_COUNT][BATCH_HASH_LEN];
+    CK_BYTE exp_hash[BATCH_HASH_LEN];
+    CK_BYTE random[BATCH_DATA_LEN] = { 0 };
+    CK_BYTE zero[BATCH_DATA_LEN] = { 0 };
+    CK_ULONG i, exp_hash_len;
+    CK_RV rc;
+
+    testcase_begin("Batch digest with CKM_SHA256 and generate random");
+    testcase_new_assertion();
+
+    if (!mech_supported(SLOT_ID, CKM_SHA256)) {
+        testcase_skip("Slot %u doesn't support CKM_SHA256",
+                      (unsigned int)SLOT_ID);
+        return CKR_OK;
+    }
+
+    rc = ibm_funcs->C_IBM_DigestBatch(SLOT_ID, &mech, NULL, 0);
+    if (rc == CKR_FUNCTION_NOT_SUPPORTED) {
+        testcase_skip("Slot %lu does not support C_IBM_DigestBatch", SLOT_ID);
+        return CKR_OK;
+    }
+
+    /* Item 0 queries the length only, item 1 digests empty data */
+    for (i = 0; i < BATCH_COUNT; i++) {
+        memset(data[i], (int)i, BATCH_DATA_LEN);
+        items[i].pData = (i == 1) ? NULL : data[i];
+        items[i].ulDataLen = (i == 1) ? 0 : BATCH_DATA_LEN;
+        items[i].pDigest = (i == 0) ? NULL : hash[i];
+        items[i].ulDigestLen = (i == 0) ? 0 : BATCH_HASH_LEN;
+        items[i].rv = CKR_GENERAL_ERROR;
+    }
+
+    rc = ibm_funcs->C_IBM_DigestBatch(SLOT_ID, &mech, items, BATCH_COUNT);
+    if (rc != CKR_OK) {
+        testcase_fail("C_IBM_DigestBatch rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    for (i = 0; i < BATCH_COUNT; i++) {
+        if (items[i].rv != CKR_OK || items[i].ulDigestLen != BATCH_HASH_LEN) {
+            testcase_fail("C_IBM_DigestBatch item %lu: rv=%s len=%lu", i,
+                          p11_get_ckr(items[i].rv), items[i].ulDigestLen);
+            return CKR_FUNCTION_FAILED;
+        }
+        if (i == 0)
+            continue;
+
+        rc = funcs->C_DigestInit(session, &mech);
+        if (rc != CKR_OK) {
+            testcase_fail("C_DigestInit rc=%s", p11_get_ckr(rc));
+            return rc;
+        }
+
+        exp_hash_len = sizeof(exp_hash);
+        rc = funcs->C_Digest(session, data[i], items[i].ulDataLen, exp_hash,
+                             &exp_hash_len);
+        if (rc != CKR_OK) {
+            testcase_fail("C_Digest rc=%s", p11_get_ckr(rc));
+            return rc;
+        }
+
+        if (exp_hash_len != items[i].ulDigestLen ||
+            memcmp(exp_hash, hash[i], exp_hash_len) != 0) {
+            testcase_fail("C_IBM_DigestBatch item %lu: digest differs from "
+                          "C_Digest", i);
+            return CKR_FUNCTION_FAILED;
+        }
+    }
+
+    /* A too small digest buffer fails that item only */
+    items[2].ulDigestLen = BATCH_HASH_LEN - 1;
+    rc = ibm_funcs->C_IBM_DigestBatch(SLOT_ID, &mech, &items[2], 2);
+    if (rc != CKR_OK || items[2].rv != CKR_BUFFER_TOO_SMALL ||
+        items[3].rv != CKR_OK) {
+        testcase_fail("C_IBM_DigestBatch (buffer too small) rc=%s, "
+                      "rv=%s/%s", p11_get_ckr(rc), p11_get_ckr(items[2].rv),
+                      p11_get_ckr(items[3].rv));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = ibm_funcs->C_IBM_GenerateRandom(SLOT_ID, random, sizeof(random));
+    if (rc != CKR_OK) {
+        testcase_fail("C_IBM_GenerateRandom rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    if (memcmp(random, zero, sizeof(random)) == 0) {
+        testcase_fail("C_IBM_GenerateRandom returned no random data");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    testcase_pass("Batch digest with CKM_SHA256 and generate random");
+
+    return CKR_OK;
+}
+
+static CK_RV do_batch_tests(CK_SESSION_HANDLE session)
+{
+    CK_BYTE exp[] = { 0x01, 0x00, 0x01 };
+    CK_OBJECT_HANDLE publ_key = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE priv_key = CK_INVALID_HANDLE;
+    CK_MECHANISM_TYPE rsa_mechs[] = { CKM_RSA_PKCS, CKM_SHA256_RSA_PKCS };
+    CK_ULONG i;
+    CK_RV rc = CKR_OK;
+
+    if (!mech_supported(SLOT_ID, CKM_RSA_PKCS_KEY_PAIR_GEN)) {
+        testcase_skip("Slot %u doesn't support CKM_RSA_PKCS_KEY_PAIR_GEN",
+                      (unsigned int)SLOT_ID);
+    } else {
+        rc = generate_RSA_PKCS_KeyPair_cached(session,
+                                              CKM_RSA_PKCS_KEY_PAIR_GEN, 2048,
+                                              exp, sizeof(exp), &publ_key,
+                                              &priv_key);
+        if (rc != CKR_OK) {
+            testcase_error("generate_RSA_PKCS_KeyPair_cached rc=%s",
+                           p11_get_ckr(rc));
+            return rc;
+        }
+
+        for (i = 0; i < sizeof(rsa_mechs) / sizeof(rsa_mechs[0]); i++) {
+            if (!mech_supported(SLOT_ID, rsa_mechs[i])) {
+                testcase_skip("Slot %u doesn't support %s",
+                              (unsigned int)SLOT_ID,
+                              mech_to_str(rsa_mechs[i]));
+                continue;
+            }
+
+            rc = do_batch_test(session, rsa_mechs[i], publ_key, priv_key);
+            if (rc != CKR_OK)
+                break;
+        }
+
+        free_rsa_key_cache(session);
+        if (rc != CKR_OK)
+            return rc;
+    }
+
+    if (!mech_supported(SLOT_ID, CKM_EC_KEY_PAIR_GEN) ||
+        !mech_supported(SLOT_ID, CKM_ECDSA)) {
+        testcase_skip("Slot %u doesn't support CKM_ECDSA",
+                      (unsigned int)SLOT_ID);
+        return CKR_OK;
+    }
+
+    publ_key = CK_INVALID_HANDLE;
+    priv_key = CK_INVALID_HANDLE;
+    rc = generate_EC_KeyPair(session, prime256v1, sizeof(prime256v1),
+                             &publ_key, &priv_key, FALSE);
+    if (rc != CKR_OK) {
+        testcase_error("generate_EC_KeyPair rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    rc = do_batch_test(session, CKM_ECDSA, publ_key, priv_key);
+
+    funcs->C_DestroyObject(session, publ_key);
+    funcs->C_DestroyObject(session, priv_key);
+
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session;
+    CK_INTERFACE *interface;
+    CK_VERSION version = { 1, 1 };
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_MECHANISM mech = { CKM_RSA_PKCS, NULL, 0 };
+    int ret = 1;
+    CK_RV rv;
+
+    rv = do_ParseArgs(argc, argv);
+    if (rv != 1)
+        return rv;
+
+    if (get_user_pin(user_pin))
+        return CKR_FUNCTION_FAILED;
+    user_pin_len = (CK_ULONG) strlen((char *) user_pin);
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rv = do_GetFunctionList();
+    if (rv != TRUE) {
+        testcase_fail("do_GetFunctionList() rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    testcase_setup();
+    testcase_begin("Starting...");
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    if ((rv = funcs->C_Initialize(&cinit_args))) {
+        testcase_fail("C_Initialize rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    rv = funcs3->C_GetInterface((CK_UTF8CHAR *)"Vendor IBM", &version,
+                                &interface, 0);
+    if (rv != CKR_OK) {
+        testcase_skip("Interface 'Vendor IBM' version 1.1 not available");
+        ret = 0;
+        goto finalize;
+    }
+    ibm_funcs = interface->pFunctionList;
+
+    rv = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_OpenSession rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    rv = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Login rc = %s", p11_get_ckr(rv));
+        goto close_session;
+    }
+
+    rv = do_digest_batch_test(session);
+    if (rv != CKR_OK)
+        goto close_session;
+
+    rv = ibm_funcs->C_IBM_SignBatch(session, &mech, CK_INVALID_HANDLE, NULL,
+                                    0);
+    if (rv == CKR_FUNCTION_NOT_SUPPORTED) {
+        testcase_skip("Slot %lu does not support C_IBM_SignBatch", SLOT_ID);
+        ret = 0;
+        goto close_session;
+    }
+
+    rv = do_batch_tests(session);
+    if (rv == CKR_OK)
+        ret = 0;
+
+close_session:
+    rv = funcs->C_CloseSession(session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_CloseSession rc = %s", p11_get_ckr(rv));
+        ret = 1;
+    }
+finalize:
+    rv = funcs->C_Finalize(NULL);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Finalize rc = %s", p11_get_ckr(rv));
+        ret = 1;
+    }
+out:
+    testcase_print_result();
+    return testcase_return(ret);
+}
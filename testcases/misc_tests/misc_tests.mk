@@ -3,13 +3,15 @@ noinst_PROGRAMS +=							\
 	testcases/misc_tests/obj_mgmt_lock_tests			\
 	testcases/misc_tests/speed testcases/misc_tests/threadmkobj	\
 	testcases/misc_tests/tok_obj testcases/misc_tests/tok_rsa	\
+	testcases/misc_tests/tok_obj_reset				\
 	testcases/misc_tests/tok_des					\
 	testcases/misc_tests/fork testcases/misc_tests/multi_instance   \
 	testcases/misc_tests/obj_lock testcases/misc_tests/tok2tok_transport \
 	testcases/misc_tests/obj_lock testcases/misc_tests/reencrypt    \
 	testcases/misc_tests/cca_ep11_export_import_test			\
 	testcases/misc_tests/events testcases/misc_tests/dual_functions \
-	testcases/misc_tests/always_auth
+	testcases/misc_tests/always_auth testcases/misc_tests/batch_sign \
+	testcases/misc_tests/aead_message
 
 EXTRA_DIST += testcases/misc_tests/dh-key.pem				\
 	testcases/misc_tests/dsa-key.pem				\
@@ -70,6 +72,11 @@ testcases_misc_tests_tok_obj_LDADD = testcases/common/libcommon.la
 testcases_misc_tests_tok_obj_SOURCES =					\
 	usr/lib/common/p11util.c testcases/misc_tests/tok_obj.c
 
+testcases_misc_tests_tok_obj_reset_CFLAGS = ${testcases_inc}
+testcases_misc_tests_tok_obj_reset_LDADD = testcases/common/libcommon.la
+testcases_misc_tests_tok_obj_reset_SOURCES =				\
+	testcases/misc_tests/tok_obj_reset.c
+
 testcases_misc_tests_tok_rsa_CFLAGS = ${testcases_inc}
 testcases_misc_tests_tok_rsa_LDADD = testcases/common/libcommon.la
 testcases_misc_tests_tok_rsa_SOURCES = testcases/misc_tests/tok_rsa.c
@@ -102,6 +109,16 @@ testcases_misc_tests_reencrypt_LDADD = testcases/common/libcommon.la
 testcases_misc_tests_reencrypt_SOURCES = 			\
 	testcases/misc_tests/reencrypt.c
 
+testcases_misc_tests_batch_sign_CFLAGS = ${testcases_inc}
+testcases_misc_tests_batch_sign_LDADD = testcases/common/libcommon.la
+testcases_misc_tests_batch_sign_SOURCES = 			\
+	testcases/misc_tests/batch_sign.c
+
+testcases_misc_tests_aead_message_CFLAGS = ${testcases_inc}
+testcases_misc_tests_aead_message_LDADD = testcases/common/libcommon.la
+testcases_misc_tests_aead_message_SOURCES = 			\
+	testcases/misc_tests/aead_message.c
+
 testcases_misc_tests_cca_ep11_export_import_test_CFLAGS = ${testcases_inc}
 testcases_misc_tests_cca_ep11_export_import_test_LDADD =		\
 	testcases/common/libcommon.la
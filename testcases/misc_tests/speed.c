@@ -18,6 +18,11 @@
  *    DES3 encrypt and decrypt (with modes ECB and CBC)
  *    AES encrypt and decrypt (with modes ECB and CBC, with keylength 128, 192,
  *    256), SHA1, SHA256, SHA512
+ *    SHA1, SHA256, SHA512 of small messages with C_Digest and with
+ *    C_IBM_DigestBatch of the 'Vendor IBM' interface 1.1
+ *    HMAC sign and verify (with SHA256 and SHA512, short messages)
+ *    AES and DES3 CBC multi-part encrypt and decrypt with a sweep over the
+ *    size of the parts passed to C_EncryptUpdate/C_DecryptUpdate
  */
 
 
@@ -37,6 +42,8 @@
 #define SHA512_HASH_LEN 64
 #define MAX_HASH_LEN SHA512_HASH_LEN
 
+#define STREAM_DATA_LEN (1024 * 1024)
+
 
 // the GetSystemTime and SYSTEMTIME implementation
 // from regress.h only has a ms resolution
@@ -886,6 +893,188 @@ testcase_cleanup:
     return TRUE;
 }
 
+static CK_RV stream_crypt(CK_SESSION_HANDLE session, CK_MECHANISM *mech,
+                          CK_OBJECT_HANDLE h_key, CK_BBOOL encrypt,
+                          CK_BYTE *in, CK_BYTE *out, CK_ULONG chunk,
+                          unsigned long *usec)
+{
+    CK_ULONG i, part_len, total = 0;
+    SYSTEMTIME t1, t2;
+    CK_RV rc;
+
+    GetSystemTime(&t1);
+
+    if (encrypt)
+        rc = funcs->C_EncryptInit(session, mech, h_key);
+    else
+        rc = funcs->C_DecryptInit(session, mech, h_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_%sInit rc=%s", encrypt ? "Encrypt" : "Decrypt",
+                       p11_get_ckr(rc));
+        return rc;
+    }
+
+    for (i = 0; i < STREAM_DATA_LEN; i += chunk) {
+        part_len = STREAM_DATA_LEN - total;
+        if (encrypt)
+            rc = funcs->C_EncryptUpdate(session, in + i, chunk,
+                                        out + total, &part_len);
+        else
+            rc = funcs->C_DecryptUpdate(session, in + i, chunk,
+                                        out + total, &part_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_%sUpdate rc=%s",
+                           encrypt ? "Encrypt" : "Decrypt", p11_get_ckr(rc));
+            return rc;
+        }
+        total += part_len;
+    }
+
+    part_len = STREAM_DATA_LEN - total;
+    if (encrypt)
+        rc = funcs->C_EncryptFinal(session, out + total, &part_len);
+    else
+        rc = funcs->C_DecryptFinal(session, out + total, &part_len);
+    if (rc != CKR_OK) {
+        testcase_error("C_%sFinal rc=%s", encrypt ? "Encrypt" : "Decrypt",
+                       p11_get_ckr(rc));
+        return rc;
+    }
+    total += part_len;
+
+    GetSystemTime(&t2);
+    *usec = delta_time_us(&t1, &t2);
+
+    if (total != STREAM_DATA_LEN) {
+        testcase_error("%s produced %lu bytes, expected %d",
+                       encrypt ? "encrypt" : "decrypt", total,
+                       STREAM_DATA_LEN);
+        return CKR_GENERAL_ERROR;
+    }
+
+    return CKR_OK;
+}
+
+// alg: AES (256 bit key) or DES3, both in CBC mode
+int do_Stream_EncrDecr(const char *alg)
+{
+    CK_SESSION_HANDLE session;
+    CK_MECHANISM mech;
+    CK_FLAGS flags;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_RV rc;
+
+    CK_OBJECT_HANDLE h_key;
+    CK_MECHANISM_TYPE keygen_mech, crypt_mech;
+    CK_BYTE *original = NULL, *cipher = NULL, *clear = NULL;
+    CK_BYTE init_v[16] = {
+        0x01, 0x02, 0x03, 0x04, 0x05,
+        0x06, 0x07, 0x08, 0x09, 0x0A,
+        0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+        0x10
+    };
+    const CK_ULONG chunks[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+    unsigned long enc_time, dec_time;
+    CK_ULONG i;
+
+    if (strcmp(alg, "AES") == 0) {
+        keygen_mech = CKM_AES_KEY_GEN;
+        crypt_mech = CKM_AES_CBC;
+        mech.ulParameterLen = 16;
+    } else {
+        keygen_mech = CKM_DES3_KEY_GEN;
+        crypt_mech = CKM_DES3_CBC;
+        mech.ulParameterLen = 8;
+    }
+
+    testcase_begin("%s CBC multi-part Encrypt/Decrypt datalen=%d",
+                   alg, STREAM_DATA_LEN);
+
+    if (!mech_supported(SLOT_ID, keygen_mech) ||
+        !mech_supported(SLOT_ID, crypt_mech)) {
+        testcase_skip("Slot %lu doesn't support %s CBC", SLOT_ID, alg);
+        return TRUE;
+    }
+
+    testcase_new_assertion();
+
+    original = malloc(STREAM_DATA_LEN);
+    cipher = malloc(STREAM_DATA_LEN);
+    clear = malloc(STREAM_DATA_LEN);
+    if (original == NULL || cipher == NULL || clear == NULL) {
+        testcase_error("malloc failed");
+        free(original);
+        free(cipher);
+        free(clear);
+        return FALSE;
+    }
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    mech.mechanism = keygen_mech;
+    mech.ulParameterLen = 0;
+    mech.pParameter = NULL;
+
+    if (keygen_mech == CKM_AES_KEY_GEN)
+        rc = generate_AESKey(session, 32, CK_TRUE, &mech, &h_key);
+    else
+        rc = funcs->C_GenerateKey(session, &mech, NULL, 0, &h_key);
+    if (rc != CKR_OK) {
+        if (rc == CKR_POLICY_VIOLATION) {
+            testcase_skip("%s key generation is not allowed by policy", alg);
+            goto testcase_cleanup;
+        }
+        testcase_error("C_GenerateKey rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < STREAM_DATA_LEN; i++)
+        original[i] = i % 255;
+
+    mech.mechanism = crypt_mech;
+    mech.ulParameterLen = keygen_mech == CKM_AES_KEY_GEN ? 16 : 8;
+    mech.pParameter = init_v;
+
+    for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        rc = stream_crypt(session, &mech, h_key, TRUE, original, cipher,
+                          chunks[i], &enc_time);
+        if (rc != CKR_OK)
+            goto testcase_cleanup;
+
+        rc = stream_crypt(session, &mech, h_key, FALSE, cipher, clear,
+                          chunks[i], &dec_time);
+        if (rc != CKR_OK)
+            goto testcase_cleanup;
+
+        if (memcmp(original, clear, STREAM_DATA_LEN) != 0) {
+            testcase_error("decrypted data differs with %lu byte parts",
+                           chunks[i]);
+            rc = CKR_GENERAL_ERROR;
+            goto testcase_cleanup;
+        }
+
+        printf("part=%6lu bytes: encrypt=%luus %.3fMB/s "
+               "decrypt=%luus %.3fMB/s\n", chunks[i],
+               enc_time, (double) STREAM_DATA_LEN / (double) enc_time,
+               dec_time, (double) STREAM_DATA_LEN / (double) dec_time);
+    }
+
+    testcase_pass("%s CBC multi-part Encrypt/Decrypt datalen=%d",
+                  alg, STREAM_DATA_LEN);
+
+testcase_cleanup:
+    testcase_closeall_session();
+    free(original);
+    free(cipher);
+    free(clear);
+    if (rc != CKR_OK)
+        return FALSE;
+
+    return TRUE;
+}
+
 int do_SHA(const char *mode)
 {
     CK_SESSION_HANDLE session;
@@ -1009,11 +1198,301 @@ testcase_cleanup:
     return TRUE;
 }
 
+#define DIGEST_BATCH_ITEMS      64
+#define DIGEST_BATCH_DATA_LEN   64
+
+/*
+ * Digests DIGEST_BATCH_ITEMS small messages per iteration, once with
+ * C_DigestInit/C_Digest for each message as do_SHA() does, and once with a
+ * single C_IBM_DigestBatch call, which needs no session and no digest
+ * context. The digests of both must be the same.
+ */
+int do_SHA_Batch(const char *mode)
+{
+    CK_SESSION_HANDLE session;
+    CK_MECHANISM mech;
+    CK_FLAGS flags;
+    CK_RV rc;
+
+    CK_IBM_FUNCTION_LIST_1_1 *ibm_funcs;
+    CK_INTERFACE *interface;
+    CK_VERSION version = { 1, 1 };
+    CK_IBM_DIGEST_ITEM items[DIGEST_BATCH_ITEMS];
+    CK_BYTE data[DIGEST_BATCH_ITEMS][DIGEST_BATCH_DATA_LEN];
+    CK_BYTE hash[DIGEST_BATCH_ITEMS][MAX_HASH_LEN];
+    CK_BYTE batch_hash[DIGEST_BATCH_ITEMS][MAX_HASH_LEN];
+    CK_ULONG hash_len, h_len;
+
+    SYSTEMTIME t1, t2;
+    CK_ULONG digest_time, batch_time, digests;
+    CK_ULONG i, j, iterations = 2000;
+
+    testcase_begin("SHA (%s) batch of %d with datalen=%d", mode,
+                   DIGEST_BATCH_ITEMS, DIGEST_BATCH_DATA_LEN);
+
+    mech.ulParameterLen = 0;
+    mech.pParameter = NULL;
+
+    if (strcmp(mode, "SHA1") == 0) {
+        mech.mechanism = CKM_SHA_1;
+        hash_len = SHA1_HASH_LEN;
+    } else if (strcmp(mode, "SHA256") == 0) {
+        mech.mechanism = CKM_SHA256;
+        hash_len = SHA256_HASH_LEN;
+    } else if (strcmp(mode, "SHA512") == 0) {
+        mech.mechanism = CKM_SHA512;
+        hash_len = SHA512_HASH_LEN;
+    } else {
+        testcase_error("unknown mode %s in do_SHA_Batch()", mode);
+        return FALSE;
+    }
+
+    if (!mech_supported(SLOT_ID, mech.mechanism)) {
+        testcase_skip("Slot %lu doesn't support %s", SLOT_ID, mode);
+        return TRUE;
+    }
+
+    if (funcs3 == NULL ||
+        funcs3->C_GetInterface((CK_UTF8CHAR *)"Vendor IBM", &version,
+                               &interface, 0) != CKR_OK) {
+        testcase_skip("Interface 'Vendor IBM' version 1.1 not available");
+        return TRUE;
+    }
+    ibm_funcs = interface->pFunctionList;
+
+    rc = ibm_funcs->C_IBM_DigestBatch(SLOT_ID, &mech, NULL, 0);
+    if (rc == CKR_FUNCTION_NOT_SUPPORTED) {
+        testcase_skip("Slot %lu does not support C_IBM_DigestBatch", SLOT_ID);
+        return TRUE;
+    }
+
+    testcase_new_assertion();
+
+    testcase_rw_session();
+
+    // generate some data to hash
+    //
+    for (j = 0; j < DIGEST_BATCH_ITEMS; j++) {
+        for (i = 0; i < DIGEST_BATCH_DATA_LEN; i++)
+            data[j][i] = (i + j) % 255;
+        items[j].pData = data[j];
+        items[j].ulDataLen = DIGEST_BATCH_DATA_LEN;
+        items[j].pDigest = batch_hash[j];
+    }
+
+    GetSystemTime(&t1);
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < DIGEST_BATCH_ITEMS; j++) {
+            rc = funcs->C_DigestInit(session, &mech);
+            if (rc != CKR_OK) {
+                testcase_error("C_DigestInit rc=%s", p11_get_ckr(rc));
+                goto testcase_cleanup;
+            }
+
+            h_len = sizeof(hash[j]);
+            rc = funcs->C_Digest(session, data[j], DIGEST_BATCH_DATA_LEN,
+                                 hash[j], &h_len);
+            if (rc != CKR_OK) {
+                testcase_error("C_Digest rc=%s", p11_get_ckr(rc));
+                goto testcase_cleanup;
+            }
+        }
+    }
+
+    GetSystemTime(&t2);
+    digest_time = delta_time_us(&t1, &t2);
+
+    GetSystemTime(&t1);
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < DIGEST_BATCH_ITEMS; j++)
+            items[j].ulDigestLen = sizeof(batch_hash[j]);
+
+        rc = ibm_funcs->C_IBM_DigestBatch(SLOT_ID, &mech, items,
+                                          DIGEST_BATCH_ITEMS);
+        if (rc != CKR_OK) {
+            testcase_error("C_IBM_DigestBatch rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+
+    GetSystemTime(&t2);
+    batch_time = delta_time_us(&t1, &t2);
+
+    for (j = 0; j < DIGEST_BATCH_ITEMS; j++) {
+        if (items[j].rv != CKR_OK || items[j].ulDigestLen != hash_len ||
+            memcmp(hash[j], batch_hash[j], hash_len) != 0) {
+            testcase_fail("C_IBM_DigestBatch item %lu: rv=%s len=%lu, "
+                          "digest differs from C_Digest", j,
+                          p11_get_ckr(items[j].rv), items[j].ulDigestLen);
+            rc = CKR_FUNCTION_FAILED;
+            goto testcase_cleanup;
+        }
+    }
+
+    digests = iterations * DIGEST_BATCH_ITEMS;
+    printf("%lu digests: C_Digest avg=%.3fus op/s=%.0f, "
+           "C_IBM_DigestBatch avg=%.3fus op/s=%.0f, speedup=%.2f\n",
+           digests, (double)digest_time / digests,
+           (double)digests * 1000000.0 / digest_time,
+           (double)batch_time / digests,
+           (double)digests * 1000000.0 / batch_time,
+           (double)digest_time / batch_time);
+
+    testcase_pass("SHA (%s) batch of %d with datalen=%d", mode,
+                  DIGEST_BATCH_ITEMS, DIGEST_BATCH_DATA_LEN);
+
+testcase_cleanup:
+    testcase_closeall_session();
+    if (rc != CKR_OK)
+        return FALSE;
+
+    return TRUE;
+}
+
+#define HMAC_DATA_LEN   64
+
+// mode: SHA256 SHA512
+int do_HMAC_SignVerify(const char *mode)
+{
+    CK_SESSION_HANDLE session;
+    CK_MECHANISM mech;
+    CK_MECHANISM keygen_mech = { CKM_GENERIC_SECRET_KEY_GEN, NULL, 0 };
+    CK_FLAGS flags;
+    CK_RV rc;
+
+    CK_OBJECT_HANDLE h_key;
+    CK_ULONG key_len = 32;
+    CK_BBOOL true = TRUE;
+    CK_ATTRIBUTE key_tmpl[] = {
+        {CKA_VALUE_LEN, &key_len, sizeof(key_len)},
+        {CKA_SIGN, &true, sizeof(true)},
+        {CKA_VERIFY, &true, sizeof(true)}
+    };
+
+    CK_BYTE data[HMAC_DATA_LEN];
+    CK_BYTE mac[MAX_HASH_LEN];
+    CK_ULONG mac_len;
+
+    SYSTEMTIME t1, t2;
+    CK_ULONG diff, avg_time, tot_time, min_time, max_time;
+    CK_ULONG i, iterations = 20000;
+    int pass;
+
+    testcase_begin("HMAC (%s) with datalen=%d", mode, HMAC_DATA_LEN);
+
+    if (strcmp(mode, "SHA256") == 0) {
+        mech.mechanism = CKM_SHA256_HMAC;
+    } else if (strcmp(mode, "SHA512") == 0) {
+        mech.mechanism = CKM_SHA512_HMAC;
+    } else {
+        testcase_error("unknown mode %s in do_HMAC_SignVerify()", mode);
+        return FALSE;
+    }
+    mech.ulParameterLen = 0;
+    mech.pParameter = NULL;
+
+    if (!mech_supported(SLOT_ID, mech.mechanism)) {
+        testcase_skip("Slot %lu doesn't support %s HMAC (0x%lx)",
+                      SLOT_ID, mode, mech.mechanism);
+        return TRUE;
+    }
+    if (!mech_supported(SLOT_ID, CKM_GENERIC_SECRET_KEY_GEN)) {
+        testcase_skip("Slot %lu doesn't support CKM_GENERIC_SECRET_KEY_GEN "
+                      "(0x%x)", SLOT_ID, CKM_GENERIC_SECRET_KEY_GEN);
+        return TRUE;
+    }
+
+    testcase_new_assertion();
+
+    testcase_rw_session();
+
+    rc = funcs->C_GenerateKey(session, &keygen_mech, key_tmpl,
+                              sizeof(key_tmpl) / sizeof(CK_ATTRIBUTE), &h_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateKey rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < HMAC_DATA_LEN; i++)
+        data[i] = i % 255;
+
+    /* pass 0: sign, pass 1: verify */
+    for (pass = 0; pass < 2; pass++) {
+        tot_time = 0;
+        max_time = 0;
+        min_time = 0xFFFFFFFF;
+
+        for (i = 0; i < iterations + 2; i++) {
+            GetSystemTime(&t1);
+
+            if (pass == 0) {
+                rc = funcs->C_SignInit(session, &mech, h_key);
+                if (rc != CKR_OK) {
+                    testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+                    goto testcase_cleanup;
+                }
+
+                mac_len = sizeof(mac);
+                rc = funcs->C_Sign(session, data, sizeof(data), mac, &mac_len);
+                if (rc != CKR_OK) {
+                    testcase_error("C_Sign rc=%s", p11_get_ckr(rc));
+                    goto testcase_cleanup;
+                }
+            } else {
+                rc = funcs->C_VerifyInit(session, &mech, h_key);
+                if (rc != CKR_OK) {
+                    testcase_error("C_VerifyInit rc=%s", p11_get_ckr(rc));
+                    goto testcase_cleanup;
+                }
+
+                rc = funcs->C_Verify(session, data, sizeof(data), mac,
+                                     mac_len);
+                if (rc != CKR_OK) {
+                    testcase_error("C_Verify rc=%s", p11_get_ckr(rc));
+                    goto testcase_cleanup;
+                }
+            }
+
+            GetSystemTime(&t2);
+            diff = delta_time_us(&t1, &t2);
+            tot_time += diff;
+            if (diff < min_time)
+                min_time = diff;
+
+            if (diff > max_time)
+                max_time = diff;
+        }
+
+        tot_time -= min_time;
+        tot_time -= max_time;
+        avg_time = tot_time / iterations;
+
+        // us -> ms
+        tot_time /= 1000;
+
+        printf("%s: %lu iterations: total=%lums min=%luus max=%luus "
+               "avg=%luus op/s=%.3f\n", pass == 0 ? "sign" : "verify",
+               iterations, tot_time, min_time, max_time, avg_time,
+               (double) (iterations * 1000) / (double) tot_time);
+    }
+
+    testcase_pass("HMAC (%s) with datalen=%d", mode, HMAC_DATA_LEN);
+
+testcase_cleanup:
+    testcase_closeall_session();
+    if (rc != CKR_OK)
+        return FALSE;
+
+    return TRUE;
+}
+
 void speed_usage(char *fct)
 {
     printf("usage:  %s -slot <num>", fct);
     printf(" [-rsa_keygen] [-rsa_signverify]");
-    printf(" [-rsa_endecrypt] [-des3] [-aes] [-sha]");
+    printf(" [-rsa_endecrypt] [-des3] [-aes] [-sha] [-hmac] [-stream]");
     printf(" [-h] \n\n");
 
     return;
@@ -1029,6 +1508,8 @@ int main(int argc, char **argv)
     int do_des3_endecrypt = 0;
     int do_aes_endecrypt = 0;
     int do_sha = 0;
+    int do_hmac = 0;
+    int do_stream = 0;
 
     SLOT_ID = 1000;
 
@@ -1054,6 +1535,10 @@ int main(int argc, char **argv)
             do_aes_endecrypt = 1;
         } else if (strcmp(argv[i], "-sha") == 0) {
             do_sha = 1;
+        } else if (strcmp(argv[i], "-hmac") == 0) {
+            do_hmac = 1;
+        } else if (strcmp(argv[i], "-stream") == 0) {
+            do_stream = 1;
         } else if (strcmp(argv[i], "-h") == 0) {
             speed_usage(argv[0]);
             return 0;
@@ -1072,13 +1557,16 @@ int main(int argc, char **argv)
     }
 
     if (do_rsa_keygen + do_rsa_signverify + do_rsa_endecrypt
-        + do_des3_endecrypt + do_aes_endecrypt + do_sha == 0) {
+        + do_des3_endecrypt + do_aes_endecrypt + do_sha + do_hmac
+        + do_stream == 0) {
         do_rsa_keygen = 1;
         do_rsa_signverify = 1;
         do_rsa_endecrypt = 1;
         do_des3_endecrypt = 1;
         do_aes_endecrypt = 1;
         do_sha = 1;
+        do_hmac = 1;
+        do_stream = 1;
     }
 
     printf("Using slot #%lu...\n\n", SLOT_ID);
@@ -1176,6 +1664,35 @@ int main(int argc, char **argv)
         rc = do_SHA("SHA512");
         if (!rc)
             goto out;
+        rc = do_SHA_Batch("SHA1");
+        if (!rc)
+            goto out;
+        rc = do_SHA_Batch("SHA256");
+        if (!rc)
+            goto out;
+        rc = do_SHA_Batch("SHA512");
+        if (!rc)
+            goto out;
+    }
+
+    if (do_hmac) {
+        testsuite_begin("HMAC Sign/Verify.");
+        rc = do_HMAC_SignVerify("SHA256");
+        if (!rc)
+            goto out;
+        rc = do_HMAC_SignVerify("SHA512");
+        if (!rc)
+            goto out;
+    }
+
+    if (do_stream) {
+        testsuite_begin("Multi-part Encrypt/Decrypt.");
+        rc = do_Stream_EncrDecr("AES");
+        if (!rc)
+            goto out;
+        rc = do_Stream_EncrDecr("DES3");
+        if (!rc)
+            goto out;
     }
 
 out:
@@ -0,0 +1,284 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2026
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: tok_obj_reset.c
+ *
+ * Test driver. Checks that the token objects destroyed by a C_InitToken in
+ * one process are also gone in another process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+
+#include <dlfcn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define TOK_OBJ_RESET_LABEL     "tok_obj_reset test object"
+
+CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+CK_ULONG user_pin_len;
+CK_BYTE so_pin[PKCS11_MAX_PIN_LEN];
+CK_ULONG so_pin_len;
+CK_SLOT_ID slot_id = 0;
+
+static CK_RV count_objects(CK_SESSION_HANDLE session, CK_ULONG *count)
+{
+    CK_UTF8CHAR label[] = TOK_OBJ_RESET_LABEL;
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_LABEL, label, sizeof(label) - 1},
+    };
+    CK_OBJECT_HANDLE obj_list[20];
+    CK_RV rv;
+
+    rv = funcs->C_FindObjectsInit(session, tmpl, 1);
+    if (rv != CKR_OK) {
+        testcase_fail("C_FindObjectsInit rc = %s", p11_get_ckr(rv));
+        return rv;
+    }
+
+    rv = funcs->C_FindObjects(session, obj_list, 20, count);
+    if (rv != CKR_OK) {
+        testcase_fail("C_FindObjects rc = %s", p11_get_ckr(rv));
+        funcs->C_FindObjectsFinal(session);
+        return rv;
+    }
+
+    rv = funcs->C_FindObjectsFinal(session);
+    if (rv != CKR_OK)
+        testcase_fail("C_FindObjectsFinal rc = %s", p11_get_ckr(rv));
+
+    return rv;
+}
+
+/*
+ * Runs in the child process: initializes the token, and sets the user PIN
+ * again, so that the token can still be used afterwards.
+ */
+static CK_RV do_init_token(void)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session;
+    CK_UTF8CHAR label[32];
+    CK_TOKEN_INFO info;
+    CK_RV rv;
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+    rv = funcs->C_Initialize(&cinit_args);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Initialize (client) rc = %s", p11_get_ckr(rv));
+        return rv;
+    }
+
+    rv = funcs->C_GetTokenInfo(slot_id, &info);
+    if (rv != CKR_OK) {
+        testcase_fail("C_GetTokenInfo (client) rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+    memcpy(label, info.label, sizeof(label));
+
+    rv = funcs->C_InitToken(slot_id, so_pin, so_pin_len, label);
+    if (rv != CKR_OK) {
+        testcase_fail("C_InitToken (client) rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    rv = funcs->C_OpenSession(slot_id, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_OpenSession (client) rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    rv = funcs->C_Login(session, CKU_SO, so_pin, so_pin_len);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Login (client) rc = %s", p11_get_ckr(rv));
+        goto close_session;
+    }
+
+    rv = funcs->C_InitPIN(session, user_pin, user_pin_len);
+    if (rv != CKR_OK)
+        testcase_fail("C_InitPIN (client) rc = %s", p11_get_ckr(rv));
+
+close_session:
+    funcs->C_CloseSession(session);
+finalize:
+    funcs->C_Finalize(NULL);
+
+    return rv;
+}
+
+static CK_RV do_fork_init_token(void)
+{
+    pid_t child_pid;
+    int status;
+
+    child_pid = fork();
+    if (child_pid == -1) {
+        testcase_fail("fork failed");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (child_pid == 0)
+        exit(do_init_token() == CKR_OK ? 0 : 1);
+
+    if (waitpid(child_pid, &status, 0) != child_pid ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return CKR_FUNCTION_FAILED;
+
+    return CKR_OK;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session;
+    CK_OBJECT_HANDLE h_obj;
+    CK_OBJECT_CLASS class = CKO_DATA;
+    CK_UTF8CHAR label[] = TOK_OBJ_RESET_LABEL;
+    CK_BYTE data[] = "Sample data";
+    CK_BBOOL true = CK_TRUE;
+    CK_BBOOL false = CK_FALSE;
+    CK_ATTRIBUTE attrs[] = {
+        {CKA_CLASS, &class, sizeof(class)},
+        {CKA_TOKEN, &true, sizeof(true)},
+        {CKA_PRIVATE, &false, sizeof(false)},
+        {CKA_LABEL, label, sizeof(label) - 1},
+        {CKA_VALUE, data, sizeof(data)}
+    };
+    CK_ULONG count;
+    int i, ret = 1;
+    CK_RV rv;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-slot") == 0) {
+            ++i;
+            if (i >= argc) {
+                printf("Slot number missing\n");
+                return -1;
+            }
+            slot_id = atoi(argv[i]);
+        }
+
+        if (strcmp(argv[i], "-h") == 0) {
+            printf("usage:  %s [-slot <num>] [-h]\n\n", argv[0]);
+            printf("By default, Slot #1 is used\n\n");
+            printf("WARNING: This test reinitializes the token, all token "
+                   "objects are lost!\n\n");
+            return -1;
+        }
+    }
+
+    if (get_user_pin(user_pin))
+        return CKR_FUNCTION_FAILED;
+    user_pin_len = (CK_ULONG) strlen((char *) user_pin);
+
+    if (get_so_pin(so_pin))
+        return CKR_FUNCTION_FAILED;
+    so_pin_len = (CK_ULONG) strlen((char *) so_pin);
+
+    printf("Using slot #%lu...\n\n", slot_id);
+
+    rv = do_GetFunctionList();
+    if (rv != TRUE) {
+        testcase_fail("do_GetFunctionList() rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    testcase_setup();
+    testcase_begin("Token objects after C_InitToken in another process");
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+    rv = funcs->C_Initialize(&cinit_args);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Initialize rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    rv = funcs->C_OpenSession(slot_id, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_OpenSession rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    rv = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Login rc = %s", p11_get_ckr(rv));
+        goto close_session;
+    }
+
+    rv = funcs->C_CreateObject(session, attrs,
+                               sizeof(attrs) / sizeof(CK_ATTRIBUTE), &h_obj);
+    if (rv != CKR_OK) {
+        testcase_fail("C_CreateObject rc = %s", p11_get_ckr(rv));
+        goto close_session;
+    }
+
+    /* Brings the local token objects up to date with the SHM */
+    rv = count_objects(session, &count);
+    if (rv != CKR_OK)
+        goto close_session;
+    if (count != 1) {
+        testcase_fail("Found %lu objects before C_InitToken, expected 1",
+                      count);
+        goto close_session;
+    }
+
+    /* C_InitToken fails with CKR_SESSION_EXISTS if any session is open */
+    rv = funcs->C_CloseSession(session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_CloseSession rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    testcase_new_assertion();
+    rv = do_fork_init_token();
+    if (rv != CKR_OK) {
+        testcase_fail("C_InitToken in the client process failed");
+        goto finalize;
+    }
+
+    rv = funcs->C_OpenSession(slot_id, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_OpenSession rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    rv = count_objects(session, &count);
+    if (rv != CKR_OK)
+        goto close_session;
+    if (count != 0) {
+        testcase_fail("Found %lu objects after C_InitToken, expected 0",
+                      count);
+        goto close_session;
+    }
+    testcase_pass("Token objects destroyed by C_InitToken in another "
+                  "process are gone");
+
+    ret = 0;
+
+close_session:
+    funcs->C_CloseSession(session);
+finalize:
+    funcs->C_Finalize(NULL);
+out:
+    testcase_print_result();
+    return testcase_return(ret);
+}
@@ -0,0 +1,235 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: aead_perf.c */
+
+/*
+ * Measures the per packet cost of AES-GCM encryption for a range of packet
+ * sizes. It compares C_EncryptInit/C_Encrypt, which sets up the key for each
+ * packet, with the message based C_EncryptMessage of PKCS#11 v3.0, where the
+ * key is set up once by C_MessageEncryptInit and each packet only passes its
+ * IV, AAD and tag.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define AEAD_BENCH_SECONDS      2
+#define AEAD_IV_LEN             12
+#define AEAD_AAD_LEN            16
+#define AEAD_TAG_LEN            16
+#define AEAD_MAX_DATA_LEN       16384
+
+static const CK_ULONG bench_sizes[] = { 64, 256, 1024, 4096, 16384 };
+
+static CK_BYTE data[AEAD_MAX_DATA_LEN];
+static CK_BYTE encrypted[AEAD_MAX_DATA_LEN + AEAD_TAG_LEN];
+
+static CK_RV run_encrypt(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE hkey,
+                         CK_ULONG data_len, unsigned long *ops, long *usecs)
+{
+    CK_BYTE iv[AEAD_IV_LEN] = { 0 };
+    CK_BYTE aad[AEAD_AAD_LEN] = { 0 };
+    CK_GCM_PARAMS params = { iv, sizeof(iv), sizeof(iv) * 8, aad,
+                             sizeof(aad), AEAD_TAG_LEN * 8 };
+    CK_MECHANISM mech = { CKM_AES_GCM, &params, sizeof(params) };
+    CK_ULONG encrypted_len;
+    SYSTEMTIME t1, t2;
+    CK_RV rc;
+
+    *ops = 0;
+
+    GetSystemTime(&t1);
+    do {
+        /* A new IV for each packet, as with C_EncryptMessage */
+        iv[AEAD_IV_LEN - 1]++;
+
+        rc = funcs->C_EncryptInit(session, &mech, hkey);
+        if (rc != CKR_OK) {
+            testcase_error("C_EncryptInit rc=%s", p11_get_ckr(rc));
+            return rc;
+        }
+
+        encrypted_len = sizeof(encrypted);
+        rc = funcs->C_Encrypt(session, data, data_len, encrypted,
+                              &encrypted_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_Encrypt rc=%s", p11_get_ckr(rc));
+            return rc;
+        }
+
+        (*ops)++;
+        GetSystemTime(&t2);
+    } while (elapsed_usec(t1, t2) < AEAD_BENCH_SECONDS * 1000000L);
+
+    *usecs = elapsed_usec(t1, t2);
+
+    return CKR_OK;
+}
+
+static CK_RV run_encrypt_message(CK_SESSION_HANDLE session,
+                                 CK_OBJECT_HANDLE hkey, CK_ULONG data_len,
+                                 unsigned long *ops, long *usecs)
+{
+    CK_MECHANISM mech = { CKM_AES_GCM, NULL, 0 };
+    CK_BYTE iv[AEAD_IV_LEN] = { 0 };
+    CK_BYTE aad[AEAD_AAD_LEN] = { 0 };
+    CK_BYTE tag[AEAD_TAG_LEN];
+    CK_GCM_MESSAGE_PARAMS params = { iv, sizeof(iv), 0, CKG_GENERATE_COUNTER,
+                                     tag, AEAD_TAG_LEN * 8 };
+    CK_ULONG encrypted_len;
+    SYSTEMTIME t1, t2;
+    CK_RV rc;
+
+    *ops = 0;
+
+    rc = funcs3->C_MessageEncryptInit(session, &mech, hkey);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageEncryptInit rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    GetSystemTime(&t1);
+    do {
+        encrypted_len = sizeof(encrypted);
+        rc = funcs3->C_EncryptMessage(session, &params, sizeof(params),
+                                      aad, sizeof(aad), data, data_len,
+                                      encrypted, &encrypted_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_EncryptMessage rc=%s", p11_get_ckr(rc));
+            break;
+        }
+
+        (*ops)++;
+        GetSystemTime(&t2);
+    } while (elapsed_usec(t1, t2) < AEAD_BENCH_SECONDS * 1000000L);
+
+    *usecs = elapsed_usec(t1, t2);
+
+    funcs3->C_MessageEncryptFinal(session);
+
+    return rc;
+}
+
+int do_AeadPerformance(void)
+{
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_MECHANISM keygen_mech = { CKM_AES_KEY_GEN, NULL, 0 };
+    CK_OBJECT_HANDLE hkey = CK_INVALID_HANDLE;
+    CK_MECHANISM_INFO info;
+    unsigned long ops, msg_ops;
+    long usecs, msg_usecs;
+    double per_op, msg_per_op;
+    unsigned int i;
+    CK_RV rc;
+
+    if (funcs3 == NULL) {
+        testcase_skip("Interface 'PKCS 11' version 3.0 not available");
+        return TRUE;
+    }
+
+    rc = funcs->C_GetMechanismInfo(SLOT_ID, CKM_AES_GCM, &info);
+    if (rc != CKR_OK || (info.flags & CKF_MESSAGE_ENCRYPT) == 0) {
+        testcase_skip("Slot %u doesn't support message based CKM_AES_GCM",
+                      (unsigned int)SLOT_ID);
+        return TRUE;
+    }
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rc != CKR_OK) {
+        testcase_error("C_OpenSession rc=%s", p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    rc = generate_AESKey(session, 32, TRUE, &keygen_mech, &hkey);
+    if (rc != CKR_OK) {
+        if (rc == CKR_POLICY_VIOLATION)
+            testcase_skip("AES key generation is not allowed by policy");
+        goto out;
+    }
+
+    printf("%10s %16s %16s %16s %16s %10s\n", "bytes", "Encrypt ops/sec",
+           "Encrypt usec/op", "EncMsg ops/sec", "EncMsg usec/op", "speedup");
+
+    for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+        rc = run_encrypt(session, hkey, bench_sizes[i], &ops, &usecs);
+        if (rc != CKR_OK)
+            goto out;
+
+        rc = run_encrypt_message(session, hkey, bench_sizes[i], &msg_ops,
+                                 &msg_usecs);
+        if (rc != CKR_OK)
+            goto out;
+
+        per_op = ops != 0 ? (double)usecs / ops : 0.0;
+        msg_per_op = msg_ops != 0 ? (double)msg_usecs / msg_ops : 0.0;
+
+        printf("%10lu %16.0f %16.2f %16.0f %16.2f %10.2f\n", bench_sizes[i],
+               usecs != 0 ? ops * 1000000.0 / usecs : 0.0, per_op,
+               msg_usecs != 0 ? msg_ops * 1000000.0 / msg_usecs : 0.0,
+               msg_per_op, msg_per_op != 0.0 ? per_op / msg_per_op : 0.0);
+    }
+
+out:
+    if (hkey != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, hkey);
+    funcs->C_CloseSession(session);
+
+    return rc == CKR_OK || rc == CKR_POLICY_VIOLATION;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    testcase_begin("do_AeadPerformance");
+    testcase_new_assertion();
+
+    do_AeadPerformance();
+
+    if (t_errors > 0)
+        testcase_notice("do_AeadPerformance ran with %ld error(s)",
+                        t_errors);
+    else
+        testcase_pass("do_AeadPerformance passed");
+
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return 0;
+}
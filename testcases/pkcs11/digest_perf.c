@@ -0,0 +1,187 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: digest_perf.c */
+
+/*
+ * Measures the throughput of small SHA-256 digest and SHA-256 HMAC requests
+ * (C_DigestInit/C_Digest and C_SignInit/C_Sign) with up to 64 threads, each
+ * using its own session. With small requests, the cost is dominated by the
+ * per-operation setup of the algorithm, e.g. fetching the OpenSSL algorithm
+ * implementation from its provider, which takes a lock of the OpenSSL library
+ * context. Running the benchmark under 'perf record -g' shows how much time
+ * is spent waiting for that lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define DIGEST_BENCH_SECONDS    2
+#define DIGEST_DATA_LEN         64
+#define DIGEST_MAX_HASH_SIZE    64
+
+static const unsigned int bench_threads[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+struct digest_args {
+    CK_MECHANISM_TYPE mech;
+    CK_OBJECT_HANDLE hkey;
+};
+
+static CK_RV digest_op(CK_SESSION_HANDLE session, void *arg)
+{
+    struct digest_args *a = arg;
+    CK_MECHANISM mech = { a->mech, NULL, 0 };
+    CK_BYTE data[DIGEST_DATA_LEN] = { 0 };
+    CK_BYTE out[DIGEST_MAX_HASH_SIZE];
+    CK_ULONG out_len = sizeof(out);
+    CK_RV rc;
+
+    if (a->hkey == CK_INVALID_HANDLE) {
+        rc = funcs->C_DigestInit(session, &mech);
+        if (rc != CKR_OK)
+            return rc;
+        return funcs->C_Digest(session, data, sizeof(data), out, &out_len);
+    }
+
+    rc = funcs->C_SignInit(session, &mech, a->hkey);
+    if (rc != CKR_OK)
+        return rc;
+    return funcs->C_Sign(session, data, sizeof(data), out, &out_len);
+}
+
+static int run_mech_bench(const char *name, CK_MECHANISM_TYPE mech,
+                          CK_OBJECT_HANDLE hkey)
+{
+    struct digest_args args = { mech, hkey };
+    unsigned long total, single = 0;
+    unsigned int i;
+    CK_RV rc;
+
+    printf("%s:\n", name);
+    printf("%10s %14s %14s %10s\n", "threads", "calls", "calls/sec",
+           "speedup");
+
+    for (i = 0; i < sizeof(bench_threads) / sizeof(bench_threads[0]); i++) {
+        rc = perf_run_threads(bench_threads[i], DIGEST_BENCH_SECONDS,
+                              digest_op, &args, &total);
+        if (rc != CKR_OK) {
+            testcase_error("%s rc=%s", hkey == CK_INVALID_HANDLE ?
+                           "C_DigestInit/C_Digest" : "C_SignInit/C_Sign",
+                           p11_get_ckr(rc));
+            return FALSE;
+        }
+
+        if (i == 0)
+            single = total;
+
+        printf("%10u %14lu %14.0f %10.2f\n", bench_threads[i], total,
+               (double)total / DIGEST_BENCH_SECONDS,
+               single != 0 ? (double)total / single : 0.0);
+    }
+    printf("\n");
+
+    return TRUE;
+}
+
+int do_DigestPerformance(void)
+{
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE hkey = CK_INVALID_HANDLE;
+    CK_BYTE key[32] = { 0 };
+    CK_RV rc;
+
+    if (!mech_supported(SLOT_ID, CKM_SHA256)) {
+        testcase_skip("Slot %u doesn't support CKM_SHA256", (unsigned int)
+                      SLOT_ID);
+    } else if (!run_mech_bench("CKM_SHA256", CKM_SHA256, CK_INVALID_HANDLE)) {
+        return FALSE;
+    }
+
+    if (!mech_supported(SLOT_ID, CKM_SHA256_HMAC)) {
+        testcase_skip("Slot %u doesn't support CKM_SHA256_HMAC",
+                      (unsigned int)SLOT_ID);
+        return TRUE;
+    }
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rc != CKR_OK) {
+        testcase_error("C_OpenSession rc=%s", p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    rc = create_GenericSecretKey(session, CKK_GENERIC_SECRET, key,
+                                 sizeof(key), &hkey);
+    if (rc != CKR_OK) {
+        if (rc == CKR_POLICY_VIOLATION)
+            testcase_skip("Generic secret key not allowed by policy");
+        else
+            testcase_error("create_GenericSecretKey rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    if (!run_mech_bench("CKM_SHA256_HMAC", CKM_SHA256_HMAC, hkey))
+        rc = CKR_FUNCTION_FAILED;
+
+out:
+    if (hkey != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, hkey);
+    funcs->C_CloseSession(session);
+
+    return rc == CKR_OK || rc == CKR_POLICY_VIOLATION;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    testcase_begin("do_DigestPerformance");
+    testcase_new_assertion();
+
+    do_DigestPerformance();
+
+    if (t_errors > 0)
+        testcase_notice("do_DigestPerformance ran with %ld error(s)",
+                        t_errors);
+    else
+        testcase_pass("do_DigestPerformance passed");
+
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return 0;
+}
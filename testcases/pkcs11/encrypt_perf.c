@@ -0,0 +1,149 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: encrypt_perf.c */
+
+/*
+ * Measures the C_EncryptInit/C_Encrypt throughput of small AES-CBC requests
+ * with a varying number of threads. Each thread uses its own session, but all
+ * threads use the same session key object. With small requests, the cost is
+ * dominated by the session and object handle lookups of each call, so this
+ * shows how well these scale with the number of threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define ENCRYPT_BENCH_SECONDS   2
+#define ENCRYPT_DATA_LEN        64
+
+static const unsigned int bench_threads[] = { 1, 2, 4, 8, 16 };
+
+static CK_RV encrypt_op(CK_SESSION_HANDLE session, void *arg)
+{
+    CK_OBJECT_HANDLE *hkey = arg;
+    CK_BYTE iv[16] = { 0 };
+    CK_MECHANISM mech = { CKM_AES_CBC, iv, sizeof(iv) };
+    CK_BYTE data[ENCRYPT_DATA_LEN] = { 0 };
+    CK_BYTE encrypted[ENCRYPT_DATA_LEN];
+    CK_ULONG encrypted_len = sizeof(encrypted);
+    CK_RV rc;
+
+    rc = funcs->C_EncryptInit(session, &mech, *hkey);
+    if (rc != CKR_OK)
+        return rc;
+
+    return funcs->C_Encrypt(session, data, sizeof(data), encrypted,
+                            &encrypted_len);
+}
+
+int do_EncryptPerformance(void)
+{
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_MECHANISM keygen_mech = { CKM_AES_KEY_GEN, NULL, 0 };
+    CK_OBJECT_HANDLE hkey = CK_INVALID_HANDLE;
+    unsigned long total, single = 0;
+    unsigned int i;
+    CK_RV rc;
+
+    if (!mech_supported(SLOT_ID, CKM_AES_CBC)) {
+        testcase_skip("Slot %u doesn't support CKM_AES_CBC", (unsigned int)
+                      SLOT_ID);
+        return TRUE;
+    }
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rc != CKR_OK) {
+        testcase_error("C_OpenSession rc=%s", p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    rc = generate_AESKey(session, 32, TRUE, &keygen_mech, &hkey);
+    if (rc != CKR_OK) {
+        if (rc == CKR_POLICY_VIOLATION)
+            testcase_skip("AES key generation is not allowed by policy");
+        goto out;
+    }
+
+    printf("%10s %14s %14s %10s\n", "threads", "calls", "calls/sec",
+           "speedup");
+
+    for (i = 0; i < sizeof(bench_threads) / sizeof(bench_threads[0]); i++) {
+        rc = perf_run_threads(bench_threads[i], ENCRYPT_BENCH_SECONDS,
+                              encrypt_op, &hkey, &total);
+        if (rc != CKR_OK) {
+            testcase_error("C_EncryptInit/C_Encrypt rc=%s", p11_get_ckr(rc));
+            goto out;
+        }
+
+        if (i == 0)
+            single = total;
+
+        printf("%10u %14lu %14.0f %10.2f\n", bench_threads[i], total,
+               (double)total / ENCRYPT_BENCH_SECONDS,
+               single != 0 ? (double)total / single : 0.0);
+    }
+
+out:
+    if (hkey != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, hkey);
+    funcs->C_CloseSession(session);
+
+    return rc == CKR_OK || rc == CKR_POLICY_VIOLATION;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    testcase_begin("do_EncryptPerformance");
+    testcase_new_assertion();
+
+    do_EncryptPerformance();
+
+    if (t_errors > 0)
+        testcase_notice("do_EncryptPerformance ran with %ld error(s)",
+                        t_errors);
+    else
+        testcase_pass("do_EncryptPerformance passed");
+
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: find_perf.c */
+
+/*
+ * Times C_FindObjectsInit/C_FindObjects/C_FindObjectsFinal for an increasing
+ * number of session objects, once with an empty search template and once with
+ * a template that needs to be compared against every object. The time per
+ * found object should stay roughly constant with the number of objects.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "defs.h"
+
+#define FIND_CHUNK      64
+#define MAX_OBJECTS     12800
+
+static int create_objects(CK_SESSION_HANDLE hsess, CK_OBJECT_HANDLE *objs,
+                          unsigned int from, unsigned int to)
+{
+    CK_OBJECT_CLASS key_class = CKO_SECRET_KEY;
+    CK_KEY_TYPE key_type = CKK_AES;
+    CK_BBOOL false = FALSE;
+    CK_BYTE value[16] = { 0 };
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_CLASS, &key_class, sizeof(key_class)},
+        {CKA_KEY_TYPE, &key_type, sizeof(key_type)},
+        {CKA_TOKEN, &false, sizeof(false)},
+        {CKA_VALUE, value, sizeof(value)},
+    };
+    unsigned int i;
+    CK_RV rc;
+
+    for (i = from; i < to; i++) {
+        memcpy(value, &i, sizeof(i));
+        rc = funcs->C_CreateObject(hsess, tmpl, 4, &objs[i]);
+        if (rc != CKR_OK) {
+            testcase_error("C_CreateObject #%u, rc=%lx, %s", i, rc,
+                           p11_get_ckr(rc));
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static int find_all_objects(CK_SESSION_HANDLE hsess, CK_ATTRIBUTE *tmpl,
+                            CK_ULONG tmpl_len, CK_ULONG *found)
+{
+    CK_OBJECT_HANDLE list[FIND_CHUNK];
+    CK_ULONG count;
+    CK_RV rc;
+
+    *found = 0;
+
+    rc = funcs->C_FindObjectsInit(hsess, tmpl, tmpl_len);
+    if (rc != CKR_OK) {
+        testcase_error("C_FindObjectsInit, rc=%lx, %s", rc, p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    do {
+        rc = funcs->C_FindObjects(hsess, list, FIND_CHUNK, &count);
+        if (rc != CKR_OK) {
+            testcase_error("C_FindObjects, rc=%lx, %s", rc, p11_get_ckr(rc));
+            funcs->C_FindObjectsFinal(hsess);
+            return FALSE;
+        }
+        *found += count;
+    } while (count == FIND_CHUNK);
+
+    rc = funcs->C_FindObjectsFinal(hsess);
+    if (rc != CKR_OK) {
+        testcase_error("C_FindObjectsFinal, rc=%lx, %s", rc, p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int do_FindObjectsPerformance(void)
+{
+    CK_SESSION_HANDLE hsess = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE *objs;
+    CK_OBJECT_CLASS key_class = CKO_SECRET_KEY;
+    CK_KEY_TYPE key_type = CKK_AES;
+    CK_BBOOL false = FALSE;
+    CK_ATTRIBUTE search_tmpl[] = {
+        {CKA_CLASS, &key_class, sizeof(key_class)},
+        {CKA_KEY_TYPE, &key_type, sizeof(key_type)},
+        {CKA_TOKEN, &false, sizeof(false)},
+    };
+    SYSTEMTIME t1, t2;
+    unsigned int count, created = 0;
+    CK_ULONG found, found_tmpl;
+    long usec, usec_tmpl;
+    int rc = FALSE;
+
+    objs = calloc(MAX_OBJECTS, sizeof(CK_OBJECT_HANDLE));
+    if (objs == NULL) {
+        testcase_error("do_FindObjectsPerformance: insufficient memory");
+        return FALSE;
+    }
+
+    if (funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                             NULL, NULL, &hsess) != CKR_OK) {
+        testcase_error("C_OpenSession failed");
+        goto ret;
+    }
+
+    printf("%10s | %10s %12s %12s | %10s %12s %12s\n", "",
+           "empty", "", "", "template", "", "");
+    printf("%10s | %10s %12s %12s | %10s %12s %12s\n", "objects",
+           "found", "time (usec)", "usec/object",
+           "found", "time (usec)", "usec/object");
+
+    for (count = 100; count <= MAX_OBJECTS; count *= 2) {
+        if (!create_objects(hsess, objs, created, count))
+            goto ret;
+        created = count;
+
+        GetSystemTime(&t1);
+        if (!find_all_objects(hsess, NULL, 0, &found))
+            goto ret;
+        GetSystemTime(&t2);
+        usec = elapsed_usec(t1, t2);
+
+        GetSystemTime(&t1);
+        if (!find_all_objects(hsess, search_tmpl,
+                              sizeof(search_tmpl) / sizeof(CK_ATTRIBUTE),
+                              &found_tmpl))
+            goto ret;
+        GetSystemTime(&t2);
+        usec_tmpl = elapsed_usec(t1, t2);
+
+        if (found < count || found_tmpl < count) {
+            testcase_error("found %lu/%lu objects, expected at least %u",
+                           found, found_tmpl, count);
+            goto ret;
+        }
+
+        printf("%10u | %10lu %12ld %12.2f | %10lu %12ld %12.2f\n", count,
+               found, usec, (double)usec / found,
+               found_tmpl, usec_tmpl, (double)usec_tmpl / found_tmpl);
+    }
+
+    rc = TRUE;
+ret:
+    if (hsess != CK_INVALID_HANDLE)
+        funcs->C_CloseSession(hsess);   /* destroys the session objects */
+    free(objs);
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    testcase_begin("do_FindObjectsPerformance");
+    testcase_new_assertion();
+
+    do_FindObjectsPerformance();
+
+    if (t_errors > 0)
+        testcase_notice("do_FindObjectsPerformance ran with %ld error(s)",
+                        t_errors);
+    else
+        testcase_pass("do_FindObjectsPerformance passed");
+
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: init_perf.c */
+
+/*
+ * Measures the startup latency of a short-lived application that only uses
+ * one slot: C_Initialize, the first C_GetTokenInfo and C_OpenSession for that
+ * slot, and C_Finalize. Run it once with and once without 'lazy-slot-init'
+ * in opencryptoki.conf to see how much of the startup time is spent loading
+ * and initializing the STDLLs of all the other configured slots.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define INIT_BENCH_ITERATIONS   20
+
+int do_InitPerformance(void)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session;
+    CK_TOKEN_INFO tokinfo;
+    CK_ULONG num_slots = 0;
+    SYSTEMTIME t1, t2, t3, t4, t5;
+    long init = 0, tokinfo_usecs = 0, open = 0, fini = 0;
+    unsigned int i;
+    CK_RV rc;
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    for (i = 0; i < INIT_BENCH_ITERATIONS; i++) {
+        GetSystemTime(&t1);
+        rc = funcs->C_Initialize(&cinit_args);
+        if (rc != CKR_OK) {
+            testcase_error("C_Initialize rc=%s", p11_get_ckr(rc));
+            return FALSE;
+        }
+        GetSystemTime(&t2);
+
+        rc = funcs->C_GetTokenInfo(SLOT_ID, &tokinfo);
+        if (rc != CKR_OK) {
+            testcase_error("C_GetTokenInfo rc=%s", p11_get_ckr(rc));
+            funcs->C_Finalize(NULL);
+            return FALSE;
+        }
+        GetSystemTime(&t3);
+
+        rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION, NULL, NULL,
+                                  &session);
+        if (rc != CKR_OK) {
+            testcase_error("C_OpenSession rc=%s", p11_get_ckr(rc));
+            funcs->C_Finalize(NULL);
+            return FALSE;
+        }
+        GetSystemTime(&t4);
+
+        if (i == 0)
+            funcs->C_GetSlotList(FALSE, NULL, &num_slots);
+
+        rc = funcs->C_Finalize(NULL);
+        if (rc != CKR_OK) {
+            testcase_error("C_Finalize rc=%s", p11_get_ckr(rc));
+            return FALSE;
+        }
+        GetSystemTime(&t5);
+
+        init += elapsed_usec(t1, t2);
+        tokinfo_usecs += elapsed_usec(t2, t3);
+        open += elapsed_usec(t3, t4);
+        fini += elapsed_usec(t4, t5);
+    }
+
+    printf("%lu slot(s) configured, average over %u runs:\n", num_slots,
+           INIT_BENCH_ITERATIONS);
+    printf("%24s %12s\n", "", "usec");
+    printf("%24s %12.0f\n", "C_Initialize",
+           (double)init / INIT_BENCH_ITERATIONS);
+    printf("%24s %12.0f\n", "first C_GetTokenInfo",
+           (double)tokinfo_usecs / INIT_BENCH_ITERATIONS);
+    printf("%24s %12.0f\n", "first C_OpenSession",
+           (double)open / INIT_BENCH_ITERATIONS);
+    printf("%24s %12.0f\n", "C_Finalize",
+           (double)fini / INIT_BENCH_ITERATIONS);
+    printf("%24s %12.0f\n", "total",
+           (double)(init + tokinfo_usecs + open + fini) /
+           INIT_BENCH_ITERATIONS);
+
+    return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    int rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    testcase_setup();
+    testcase_begin("do_InitPerformance");
+    testcase_new_assertion();
+
+    do_InitPerformance();
+
+    if (t_errors > 0)
+        testcase_notice("do_InitPerformance ran with %ld error(s)",
+                        t_errors);
+    else
+        testcase_pass("do_InitPerformance passed");
+
+    testcase_print_result();
+
+    return 0;
+}
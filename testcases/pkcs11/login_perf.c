@@ -0,0 +1,262 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: login_perf.c */
+
+/*
+ * Times C_Login for an increasing number of private token objects. The
+ * private token objects are loaded from disk at each user login, so the login
+ * latency grows with the number of objects. Use objects=<n> to time a single
+ * number of objects only, and the environment variable
+ * OPENCRYPTOKI_LOAD_THREADS to compare different numbers of load threads.
+ * The created token objects are destroyed at the end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define LOGIN_ROUNDS        3
+
+static const unsigned int bench_objects[] = { 100, 1000, 5000 };
+
+static int create_objects(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE *objs,
+                          unsigned int from, unsigned int to)
+{
+    CK_OBJECT_CLASS key_class = CKO_SECRET_KEY;
+    CK_KEY_TYPE key_type = CKK_AES;
+    CK_BBOOL true = TRUE;
+    CK_BYTE value[32] = { 0 };
+    CK_BYTE label[] = "login_perf";
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_CLASS, &key_class, sizeof(key_class)},
+        {CKA_KEY_TYPE, &key_type, sizeof(key_type)},
+        {CKA_TOKEN, &true, sizeof(true)},
+        {CKA_PRIVATE, &true, sizeof(true)},
+        {CKA_LABEL, label, sizeof(label) - 1},
+        {CKA_VALUE, value, sizeof(value)},
+    };
+    unsigned int i;
+    CK_RV rc;
+
+    for (i = from; i < to; i++) {
+        memcpy(value, &i, sizeof(i));
+        rc = funcs->C_CreateObject(session, tmpl,
+                                   sizeof(tmpl) / sizeof(CK_ATTRIBUTE),
+                                   &objs[i]);
+        if (rc != CKR_OK) {
+            testcase_error("C_CreateObject #%u, rc=%s", i, p11_get_ckr(rc));
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static int count_objects(CK_SESSION_HANDLE session, CK_ULONG *found)
+{
+    CK_BYTE label[] = "login_perf";
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_LABEL, label, sizeof(label) - 1},
+    };
+    CK_OBJECT_HANDLE list[64];
+    CK_ULONG count;
+    CK_RV rc;
+
+    *found = 0;
+
+    rc = funcs->C_FindObjectsInit(session, tmpl, 1);
+    if (rc != CKR_OK) {
+        testcase_error("C_FindObjectsInit rc=%s", p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    do {
+        rc = funcs->C_FindObjects(session, list, 64, &count);
+        if (rc != CKR_OK) {
+            testcase_error("C_FindObjects rc=%s", p11_get_ckr(rc));
+            funcs->C_FindObjectsFinal(session);
+            return FALSE;
+        }
+        *found += count;
+    } while (count == 64);
+
+    funcs->C_FindObjectsFinal(session);
+    return TRUE;
+}
+
+/*
+ * Logs out and in again LOGIN_ROUNDS times, and returns the average login
+ * time. The session stays open, so that the token is not finalized.
+ */
+static int time_login(CK_SESSION_HANDLE session, CK_BYTE *user_pin,
+                      CK_ULONG user_pin_len, long *usec)
+{
+    SYSTEMTIME t1, t2;
+    unsigned int i;
+    CK_RV rc;
+
+    *usec = 0;
+
+    for (i = 0; i < LOGIN_ROUNDS; i++) {
+        rc = funcs->C_Logout(session);
+        if (rc != CKR_OK) {
+            testcase_error("C_Logout rc=%s", p11_get_ckr(rc));
+            return FALSE;
+        }
+
+        GetSystemTime(&t1);
+        rc = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+        GetSystemTime(&t2);
+        if (rc != CKR_OK) {
+            testcase_error("C_Login rc=%s", p11_get_ckr(rc));
+            return FALSE;
+        }
+
+        *usec += elapsed_usec(t1, t2);
+    }
+
+    *usec /= LOGIN_ROUNDS;
+    return TRUE;
+}
+
+int do_LoginPerformance(unsigned int num_objects)
+{
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE *objs = NULL;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len, found;
+    unsigned int i, max, created = 0, count;
+    long usec;
+    int rc = FALSE;
+
+    if (get_user_pin(user_pin))
+        return FALSE;
+    user_pin_len = (CK_ULONG)strlen((char *)user_pin);
+
+    max = num_objects;
+    if (max == 0)
+        max = bench_objects[sizeof(bench_objects) /
+                            sizeof(bench_objects[0]) - 1];
+
+    objs = calloc(max, sizeof(CK_OBJECT_HANDLE));
+    if (objs == NULL) {
+        testcase_error("calloc failed");
+        return FALSE;
+    }
+
+    if (funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                             NULL, NULL, &session) != CKR_OK) {
+        testcase_error("C_OpenSession failed");
+        goto out;
+    }
+
+    if (funcs->C_Login(session, CKU_USER, user_pin, user_pin_len) !=
+        CKR_OK) {
+        testcase_error("C_Login failed");
+        goto out;
+    }
+
+    printf("%10s %14s %14s\n", "objects", "login (usec)", "usec/object");
+
+    for (i = 0; i < sizeof(bench_objects) / sizeof(bench_objects[0]); i++) {
+        count = num_objects != 0 ? num_objects : bench_objects[i];
+
+        if (!create_objects(session, objs, created, count))
+            goto out;
+        created = count;
+
+        if (!time_login(session, user_pin, user_pin_len, &usec))
+            goto out;
+
+        if (!count_objects(session, &found))
+            goto out;
+        if (found != count) {
+            testcase_fail("found %lu objects after login, expected %u",
+                          found, count);
+            goto out;
+        }
+
+        printf("%10u %14ld %14.2f\n", count, usec, (double)usec / count);
+
+        if (num_objects != 0)
+            break;
+    }
+
+    rc = TRUE;
+
+out:
+    for (i = 0; i < created; i++)
+        funcs->C_DestroyObject(session, objs[i]);
+    if (session != CK_INVALID_HANDLE) {
+        funcs->C_Logout(session);
+        funcs->C_CloseSession(session);
+    }
+    free(objs);
+
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    unsigned int num_objects = 0;
+    int rc, i, j;
+
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "objects=", 8) == 0) {
+            sscanf(argv[i] + 8, "%u", &num_objects);
+            for (j = i; j < argc; j++)
+                argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        }
+    }
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    testcase_begin("do_LoginPerformance");
+    testcase_new_assertion();
+
+    rc = do_LoginPerformance(num_objects);
+
+    if (t_errors > 0)
+        testcase_notice("do_LoginPerformance ran with %ld error(s)",
+                        t_errors);
+    else if (rc)
+        testcase_pass("do_LoginPerformance passed");
+
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return 0;
+}
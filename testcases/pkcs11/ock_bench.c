@@ -0,0 +1,1132 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: ock_bench.c
+ *
+ * ock-bench: load generator and benchmark for a slot.
+ *
+ * Runs a weighted mix of operations (digest, HMAC, AES-CBC, AES-GCM, RSA,
+ * ECDSA, Ed25519 and Dilithium sign/verify, encrypt/decrypt, and RSA-PSS and
+ * RSA-OAEP operation initialization alone) from N threads in each of M
+ * processes against one slot, for a sweep of data sizes. Keys are generated
+ * per process, either as session or as token objects. The threads, the
+ * clock and the latency histogram of every single operation come from the
+ * shared perf test harness in testcases/common. The throughput and the
+ * p50/p99/p99.9 latencies of each operation and data size are reported as
+ * text and optionally as JSON. Two JSON reports can be compared with
+ * -compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "ec_curves.h"
+#include "common.c"
+
+#define BENCH_MAX_OPS           16
+#define BENCH_MAX_SIZES         16
+#define BENCH_MAX_WEIGHT        100
+#define BENCH_MAX_THREADS       256
+#define BENCH_MAX_PROCS         256
+#define BENCH_MAX_KEYS          64
+#define BENCH_MAX_DATA_LEN      (1024 * 1024)
+#define BENCH_MAX_SIG_LEN       8192
+#define BENCH_OUT_LEN           (BENCH_MAX_DATA_LEN + BENCH_MAX_SIG_LEN)
+#define BENCH_NAME_LEN          64
+
+#define BENCH_DEFAULT_DURATION  5
+#define BENCH_DEFAULT_SIZE      1024
+
+enum bench_kind {
+    BENCH_DIGEST,
+    BENCH_SIGN,
+    BENCH_VERIFY,
+    BENCH_ENCRYPT,
+    BENCH_DECRYPT,
+    BENCH_SIGN_INIT,            /* C_SignInit only, canceled right away */
+    BENCH_ENCRYPT_INIT,         /* C_EncryptInit only, canceled right away */
+};
+
+enum bench_keytype {
+    BENCH_KEY_NONE,
+    BENCH_KEY_AES,
+    BENCH_KEY_GENERIC,
+    BENCH_KEY_RSA,
+    BENCH_KEY_EC,
+    BENCH_KEY_DILITHIUM,
+};
+
+static const CK_BYTE bench_prime256v1[] = OCK_PRIME256V1;
+static const CK_BYTE bench_secp384r1[] = OCK_SECP384R1;
+static const CK_BYTE bench_ed25519[] = OCK_ED25519;
+
+struct bench_op_def {
+    const char *name;
+    CK_MECHANISM_TYPE mech;
+    enum bench_kind kind;
+    enum bench_keytype keytype;
+    CK_ULONG keysize;           /* bytes for secret keys, bits for RSA */
+    const CK_BYTE *ec_params;
+    CK_ULONG ec_params_len;
+};
+
+#define EC_PARAMS(p)    p, sizeof(p)
+
+static const struct bench_op_def bench_op_defs[] = {
+    { "sha256", CKM_SHA256, BENCH_DIGEST, BENCH_KEY_NONE, 0, NULL, 0 },
+    { "sha512", CKM_SHA512, BENCH_DIGEST, BENCH_KEY_NONE, 0, NULL, 0 },
+    { "sha3-256", CKM_SHA3_256, BENCH_DIGEST, BENCH_KEY_NONE, 0, NULL, 0 },
+    { "hmac-sha256-sign", CKM_SHA256_HMAC, BENCH_SIGN, BENCH_KEY_GENERIC,
+      32, NULL, 0 },
+    { "hmac-sha256-verify", CKM_SHA256_HMAC, BENCH_VERIFY, BENCH_KEY_GENERIC,
+      32, NULL, 0 },
+    { "aes-cbc-encrypt", CKM_AES_CBC_PAD, BENCH_ENCRYPT, BENCH_KEY_AES,
+      32, NULL, 0 },
+    { "aes-cbc-decrypt", CKM_AES_CBC_PAD, BENCH_DECRYPT, BENCH_KEY_AES,
+      32, NULL, 0 },
+    { "aes-gcm-encrypt", CKM_AES_GCM, BENCH_ENCRYPT, BENCH_KEY_AES,
+      32, NULL, 0 },
+    { "aes-gcm-decrypt", CKM_AES_GCM, BENCH_DECRYPT, BENCH_KEY_AES,
+      32, NULL, 0 },
+    { "rsa2048-sign", CKM_SHA256_RSA_PKCS, BENCH_SIGN, BENCH_KEY_RSA,
+      2048, NULL, 0 },
+    { "rsa2048-verify", CKM_SHA256_RSA_PKCS, BENCH_VERIFY, BENCH_KEY_RSA,
+      2048, NULL, 0 },
+    { "rsa2048-pss-sign", CKM_SHA256_RSA_PKCS_PSS, BENCH_SIGN, BENCH_KEY_RSA,
+      2048, NULL, 0 },
+    { "rsa2048-pss-verify", CKM_SHA256_RSA_PKCS_PSS, BENCH_VERIFY,
+      BENCH_KEY_RSA, 2048, NULL, 0 },
+    { "rsa2048-pss-sign-init", CKM_SHA256_RSA_PKCS_PSS, BENCH_SIGN_INIT,
+      BENCH_KEY_RSA, 2048, NULL, 0 },
+    { "rsa2048-oaep-encrypt-init", CKM_RSA_PKCS_OAEP, BENCH_ENCRYPT_INIT,
+      BENCH_KEY_RSA, 2048, NULL, 0 },
+    { "rsa4096-sign", CKM_SHA256_RSA_PKCS, BENCH_SIGN, BENCH_KEY_RSA,
+      4096, NULL, 0 },
+    { "rsa4096-verify", CKM_SHA256_RSA_PKCS, BENCH_VERIFY, BENCH_KEY_RSA,
+      4096, NULL, 0 },
+    { "ecdsa-p256-sign", CKM_ECDSA_SHA256, BENCH_SIGN, BENCH_KEY_EC,
+      0, EC_PARAMS(bench_prime256v1) },
+    { "ecdsa-p256-verify", CKM_ECDSA_SHA256, BENCH_VERIFY, BENCH_KEY_EC,
+      0, EC_PARAMS(bench_prime256v1) },
+    { "ecdsa-p384-sign", CKM_ECDSA_SHA384, BENCH_SIGN, BENCH_KEY_EC,
+      0, EC_PARAMS(bench_secp384r1) },
+    { "ecdsa-p384-verify", CKM_ECDSA_SHA384, BENCH_VERIFY, BENCH_KEY_EC,
+      0, EC_PARAMS(bench_secp384r1) },
+    { "ed25519-sign", CKM_IBM_ED25519_SHA512, BENCH_SIGN, BENCH_KEY_EC,
+      0, EC_PARAMS(bench_ed25519) },
+    { "ed25519-verify", CKM_IBM_ED25519_SHA512, BENCH_VERIFY, BENCH_KEY_EC,
+      0, EC_PARAMS(bench_ed25519) },
+    { "dilithium-sign", CKM_IBM_DILITHIUM, BENCH_SIGN, BENCH_KEY_DILITHIUM,
+      CK_IBM_DILITHIUM_KEYFORM_ROUND3_65, NULL, 0 },
+    { "dilithium-verify", CKM_IBM_DILITHIUM, BENCH_VERIFY,
+      BENCH_KEY_DILITHIUM, CK_IBM_DILITHIUM_KEYFORM_ROUND3_65, NULL, 0 },
+};
+
+#define BENCH_NUM_OP_DEFS (sizeof(bench_op_defs) / sizeof(bench_op_defs[0]))
+
+struct bench_op {
+    const struct bench_op_def *def;
+    unsigned int weight;
+};
+
+struct bench_key {
+    CK_OBJECT_HANDLE priv;      /* secret or private key */
+    CK_OBJECT_HANDLE publ;      /* public key, same as priv for secret keys */
+};
+
+/* Shared between the parent and all worker processes */
+struct bench_shared {
+    int failed;
+    unsigned int ready[BENCH_MAX_SIZES];
+    uint64_t elapsed_ns[BENCH_MAX_SIZES];
+    struct perf_hist results[];         /* [size][op], all threads */
+};
+
+struct bench_opts {
+    unsigned int procs;
+    unsigned int threads;
+    unsigned int duration;
+    unsigned int nkeys;
+    CK_BBOOL token;
+    struct bench_op ops[BENCH_MAX_OPS];
+    unsigned int nops;
+    CK_ULONG sizes[BENCH_MAX_SIZES];
+    unsigned int nsizes;
+    const char *json;
+};
+
+/* Per thread mechanism parameters and buffers */
+struct bench_thread {
+    unsigned int index;
+    CK_SESSION_HANDLE session;
+    CK_BYTE iv[16];
+    CK_BYTE aad[16];
+    CK_GCM_PARAMS gcm;
+    CK_RSA_PKCS_PSS_PARAMS pss;
+    CK_RSA_PKCS_OAEP_PARAMS oaep;
+    CK_BYTE *data;
+    CK_BYTE *out;
+    /* Signatures (verify) or ciphertexts (decrypt) of data, [op][key] */
+    CK_BYTE *aux[BENCH_MAX_OPS][BENCH_MAX_KEYS];
+    CK_ULONG aux_len[BENCH_MAX_OPS][BENCH_MAX_KEYS];
+    struct perf_hist *results;          /* [op] of the current size */
+};
+
+static struct bench_opts opts;
+static struct bench_shared *shared;
+static struct bench_key *keys;          /* [op][key] of this process */
+static CK_BBOOL logged_in;
+
+static void bench_fail(void)
+{
+    __atomic_store_n(&shared->failed, 1, __ATOMIC_RELEASE);
+}
+
+static int bench_failed(void)
+{
+    return __atomic_load_n(&shared->failed, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Waits until all threads of all processes are ready for the given phase.
+ * Returns FALSE if any thread has failed in the meantime.
+ */
+static int bench_barrier(unsigned int phase)
+{
+    unsigned int total = opts.procs * opts.threads;
+
+    __atomic_add_fetch(&shared->ready[phase], 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&shared->ready[phase], __ATOMIC_ACQUIRE) < total) {
+        if (bench_failed())
+            return FALSE;
+        usleep(50);
+    }
+
+    return !bench_failed();
+}
+
+static void bench_mech(struct bench_thread *th, const struct bench_op_def *def,
+                       CK_MECHANISM *mech)
+{
+    mech->mechanism = def->mech;
+    mech->pParameter = NULL;
+    mech->ulParameterLen = 0;
+
+    switch (def->mech) {
+    case CKM_AES_CBC_PAD:
+        mech->pParameter = th->iv;
+        mech->ulParameterLen = sizeof(th->iv);
+        break;
+    case CKM_AES_GCM:
+        th->gcm.pIv = th->iv;
+        th->gcm.ulIvLen = 12;
+        th->gcm.ulIvBits = 12 * 8;
+        th->gcm.pAAD = th->aad;
+        th->gcm.ulAADLen = sizeof(th->aad);
+        th->gcm.ulTagBits = 128;
+        mech->pParameter = &th->gcm;
+        mech->ulParameterLen = sizeof(th->gcm);
+        break;
+    case CKM_SHA256_RSA_PKCS_PSS:
+        th->pss.hashAlg = CKM_SHA256;
+        th->pss.mgf = CKG_MGF1_SHA256;
+        th->pss.sLen = 32;
+        mech->pParameter = &th->pss;
+        mech->ulParameterLen = sizeof(th->pss);
+        break;
+    case CKM_RSA_PKCS_OAEP:
+        th->oaep.hashAlg = CKM_SHA256;
+        th->oaep.mgf = CKG_MGF1_SHA256;
+        th->oaep.source = CKZ_DATA_SPECIFIED;
+        th->oaep.pSourceData = NULL;
+        th->oaep.ulSourceDataLen = 0;
+        mech->pParameter = &th->oaep;
+        mech->ulParameterLen = sizeof(th->oaep);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Performs one single-part operation. For BENCH_VERIFY and BENCH_DECRYPT,
+ * in/in_len is the signature or ciphertext of the thread's data.
+ */
+static CK_RV bench_do_op(struct bench_thread *th,
+                         const struct bench_op_def *def, enum bench_kind kind,
+                         const struct bench_key *key, CK_ULONG data_len,
+                         CK_BYTE *in, CK_ULONG in_len, CK_ULONG *out_len)
+{
+    CK_MECHANISM mech;
+    CK_RV rc;
+
+    bench_mech(th, def, &mech);
+    *out_len = BENCH_OUT_LEN;
+
+    switch (kind) {
+    case BENCH_DIGEST:
+        rc = funcs->C_DigestInit(th->session, &mech);
+        if (rc != CKR_OK)
+            return rc;
+        return funcs->C_Digest(th->session, th->data, data_len, th->out,
+                               out_len);
+    case BENCH_SIGN:
+        rc = funcs->C_SignInit(th->session, &mech, key->priv);
+        if (rc != CKR_OK)
+            return rc;
+        return funcs->C_Sign(th->session, th->data, data_len, th->out,
+                             out_len);
+    case BENCH_VERIFY:
+        rc = funcs->C_VerifyInit(th->session, &mech, key->publ);
+        if (rc != CKR_OK)
+            return rc;
+        return funcs->C_Verify(th->session, th->data, data_len, in, in_len);
+    case BENCH_ENCRYPT:
+        rc = funcs->C_EncryptInit(th->session, &mech, key->priv);
+        if (rc != CKR_OK)
+            return rc;
+        return funcs->C_Encrypt(th->session, th->data, data_len, th->out,
+                                out_len);
+    case BENCH_DECRYPT:
+        rc = funcs->C_DecryptInit(th->session, &mech, key->priv);
+        if (rc != CKR_OK)
+            return rc;
+        return funcs->C_Decrypt(th->session, in, in_len, th->out, out_len);
+    case BENCH_SIGN_INIT:
+        rc = funcs->C_SignInit(th->session, &mech, key->priv);
+        if (rc != CKR_OK)
+            return rc;
+        /* Init with a NULL mechanism cancels the operation */
+        return funcs->C_SignInit(th->session, NULL, key->priv);
+    case BENCH_ENCRYPT_INIT:
+        rc = funcs->C_EncryptInit(th->session, &mech, key->publ);
+        if (rc != CKR_OK)
+            return rc;
+        return funcs->C_EncryptInit(th->session, NULL, key->publ);
+    }
+
+    return CKR_FUNCTION_FAILED;
+}
+
+/* Computes the signatures and ciphertexts needed by verify and decrypt */
+static CK_RV bench_prepare(struct bench_thread *th, CK_ULONG data_len)
+{
+    const struct bench_op_def *def;
+    enum bench_kind kind;
+    unsigned int i, k;
+    CK_ULONG out_len;
+    CK_RV rc;
+
+    for (i = 0; i < opts.nops; i++) {
+        def = opts.ops[i].def;
+        if (def->kind == BENCH_VERIFY)
+            kind = BENCH_SIGN;
+        else if (def->kind == BENCH_DECRYPT)
+            kind = BENCH_ENCRYPT;
+        else
+            continue;
+
+        for (k = 0; k < opts.nkeys; k++) {
+            rc = bench_do_op(th, def, kind, &keys[i * opts.nkeys + k],
+                             data_len, NULL, 0, &out_len);
+            if (rc != CKR_OK) {
+                fprintf(stderr, "%s: preparing %s failed, rc=%s\n",
+                        __func__, def->name, p11_get_ckr(rc));
+                return rc;
+            }
+
+            free(th->aux[i][k]);
+            th->aux[i][k] = malloc(out_len);
+            if (th->aux[i][k] == NULL)
+                return CKR_HOST_MEMORY;
+            memcpy(th->aux[i][k], th->out, out_len);
+            th->aux_len[i][k] = out_len;
+        }
+    }
+
+    return CKR_OK;
+}
+
+static CK_RV bench_run_phase(struct bench_thread *th, unsigned int phase)
+{
+    CK_ULONG data_len = opts.sizes[phase];
+    unsigned int schedule[BENCH_MAX_OPS * BENCH_MAX_WEIGHT];
+    unsigned int next_key[BENCH_MAX_OPS] = { 0 };
+    unsigned int nschedule = 0, pos, i, w, k;
+    struct perf_hist *res;
+    uint64_t start, end, t1, t2;
+    CK_ULONG out_len;
+    CK_RV rc = CKR_OK;
+
+    /* Operation i appears weight times in the schedule */
+    for (i = 0; i < opts.nops; i++) {
+        for (w = 0; w < opts.ops[i].weight; w++)
+            schedule[nschedule++] = i;
+    }
+    /* Let the threads start at different places of the schedule */
+    pos = th->index % nschedule;
+
+    rc = bench_prepare(th, data_len);
+    if (rc != CKR_OK) {
+        bench_fail();
+        return rc;
+    }
+
+    if (!bench_barrier(phase))
+        return CKR_FUNCTION_FAILED;
+
+    start = perf_now_nsec();
+    end = start + (uint64_t)opts.duration * 1000000000ull;
+    t2 = start;
+    while (t2 < end) {
+        i = schedule[pos];
+        pos = (pos + 1) % nschedule;
+        k = next_key[i];
+        next_key[i] = (k + 1) % opts.nkeys;
+
+        t1 = perf_now_nsec();
+        rc = bench_do_op(th, opts.ops[i].def, opts.ops[i].def->kind,
+                         &keys[i * opts.nkeys + k], data_len,
+                         th->aux[i][k], th->aux_len[i][k], &out_len);
+        t2 = perf_now_nsec();
+        if (rc != CKR_OK) {
+            fprintf(stderr, "%s: %s failed, rc=%s\n", __func__,
+                    opts.ops[i].def->name, p11_get_ckr(rc));
+            bench_fail();
+            return rc;
+        }
+
+        res = &th->results[i];
+        perf_hist_add(res, t2 - t1);
+        if ((res->ops & 0xff) == 0 && bench_failed())
+            return CKR_FUNCTION_FAILED;
+    }
+
+    perf_atomic_max(&shared->elapsed_ns[phase], t2 - start);
+
+    /* Add the results of this thread to the shared ones */
+    for (i = 0; i < opts.nops; i++)
+        perf_hist_merge(&shared->results[phase * opts.nops + i],
+                        &th->results[i]);
+
+    return CKR_OK;
+}
+
+static CK_RV bench_thread_main(CK_SESSION_HANDLE session, unsigned int index,
+                               void *arg)
+{
+    struct bench_thread *th = &((struct bench_thread *)arg)[index];
+    unsigned int phase, i, k;
+    CK_RV rc = CKR_OK;
+
+    th->session = session;
+    th->data = malloc(BENCH_MAX_DATA_LEN);
+    th->out = malloc(BENCH_OUT_LEN);
+    th->results = calloc(opts.nops, sizeof(struct perf_hist));
+    if (th->data == NULL || th->out == NULL || th->results == NULL) {
+        fprintf(stderr, "%s: malloc failed\n", __func__);
+        rc = CKR_HOST_MEMORY;
+        bench_fail();
+        goto out;
+    }
+    for (i = 0; i < BENCH_MAX_DATA_LEN; i++)
+        th->data[i] = (CK_BYTE)(i * 7 + th->index);
+    memset(th->iv, 0x5a, sizeof(th->iv));
+    memset(th->aad, 0xa5, sizeof(th->aad));
+
+    for (phase = 0; phase < opts.nsizes; phase++) {
+        memset(th->results, 0, opts.nops * sizeof(struct perf_hist));
+        rc = bench_run_phase(th, phase);
+        if (rc != CKR_OK)
+            break;
+    }
+
+out:
+    for (i = 0; i < BENCH_MAX_OPS; i++) {
+        for (k = 0; k < BENCH_MAX_KEYS; k++)
+            free(th->aux[i][k]);
+    }
+    free(th->data);
+    free(th->out);
+    free(th->results);
+
+    return rc;
+}
+
+static CK_RV bench_generate_key(CK_SESSION_HANDLE session,
+                                const struct bench_op_def *def,
+                                struct bench_key *key)
+{
+    CK_BBOOL true = CK_TRUE, false = CK_FALSE;
+    CK_BBOOL token = opts.token, private = logged_in;
+    CK_BYTE pubexp[] = { 0x01, 0x00, 0x01 };
+    CK_ULONG keyform = def->keysize;
+    CK_ATTRIBUTE publ_tmpl[8], priv_tmpl[8];
+    CK_ULONG publ_num = 0, priv_num = 0;
+    CK_MECHANISM mech = { 0, NULL, 0 };
+    CK_RV rc;
+
+#define ADD_ATTR(t, n, atype, ptr, len)                                 \
+    do {                                                                \
+        t[n].type = (atype);                                            \
+        t[n].pValue = (ptr);                                            \
+        t[n].ulValueLen = (len);                                        \
+        n++;                                                            \
+    } while (0)
+
+    ADD_ATTR(publ_tmpl, publ_num, CKA_TOKEN, &token, sizeof(token));
+    ADD_ATTR(publ_tmpl, publ_num, CKA_PRIVATE, &false, sizeof(false));
+    ADD_ATTR(priv_tmpl, priv_num, CKA_TOKEN, &token, sizeof(token));
+    ADD_ATTR(priv_tmpl, priv_num, CKA_PRIVATE, &private, sizeof(private));
+    ADD_ATTR(priv_tmpl, priv_num, CKA_SENSITIVE, &true, sizeof(true));
+
+    switch (def->keytype) {
+    case BENCH_KEY_AES:
+    case BENCH_KEY_GENERIC:
+        mech.mechanism = def->keytype == BENCH_KEY_AES ?
+                                CKM_AES_KEY_GEN : CKM_GENERIC_SECRET_KEY_GEN;
+        ADD_ATTR(priv_tmpl, priv_num, CKA_VALUE_LEN, (CK_ULONG *)&def->keysize,
+                 sizeof(CK_ULONG));
+        if (def->keytype == BENCH_KEY_AES) {
+            ADD_ATTR(priv_tmpl, priv_num, CKA_ENCRYPT, &true, sizeof(true));
+            ADD_ATTR(priv_tmpl, priv_num, CKA_DECRYPT, &true, sizeof(true));
+        } else {
+            ADD_ATTR(priv_tmpl, priv_num, CKA_SIGN, &true, sizeof(true));
+            ADD_ATTR(priv_tmpl, priv_num, CKA_VERIFY, &true, sizeof(true));
+        }
+        rc = funcs->C_GenerateKey(session, &mech, priv_tmpl, priv_num,
+                                  &key->priv);
+        key->publ = key->priv;
+        return rc;
+    case BENCH_KEY_RSA:
+        mech.mechanism = CKM_RSA_PKCS_KEY_PAIR_GEN;
+        ADD_ATTR(publ_tmpl, publ_num, CKA_MODULUS_BITS,
+                 (CK_ULONG *)&def->keysize, sizeof(CK_ULONG));
+        ADD_ATTR(publ_tmpl, publ_num, CKA_PUBLIC_EXPONENT, pubexp,
+                 sizeof(pubexp));
+        ADD_ATTR(publ_tmpl, publ_num, CKA_ENCRYPT, &true, sizeof(true));
+        ADD_ATTR(priv_tmpl, priv_num, CKA_DECRYPT, &true, sizeof(true));
+        break;
+    case BENCH_KEY_EC:
+        mech.mechanism = CKM_EC_KEY_PAIR_GEN;
+        ADD_ATTR(publ_tmpl, publ_num, CKA_EC_PARAMS, (CK_BYTE *)def->ec_params,
+                 def->ec_params_len);
+        break;
+    case BENCH_KEY_DILITHIUM:
+        mech.mechanism = CKM_IBM_DILITHIUM;
+        ADD_ATTR(publ_tmpl, publ_num, CKA_IBM_DILITHIUM_KEYFORM, &keyform,
+                 sizeof(keyform));
+        ADD_ATTR(priv_tmpl, priv_num, CKA_IBM_DILITHIUM_KEYFORM, &keyform,
+                 sizeof(keyform));
+        break;
+    default:
+        key->priv = key->publ = CK_INVALID_HANDLE;
+        return CKR_OK;
+    }
+
+    ADD_ATTR(publ_tmpl, publ_num, CKA_VERIFY, &true, sizeof(true));
+    ADD_ATTR(priv_tmpl, priv_num, CKA_SIGN, &true, sizeof(true));
+
+#undef ADD_ATTR
+
+    return funcs->C_GenerateKeyPair(session, &mech, publ_tmpl, publ_num,
+                                    priv_tmpl, priv_num, &key->publ,
+                                    &key->priv);
+}
+
+static void bench_destroy_keys(CK_SESSION_HANDLE session, unsigned int num)
+{
+    unsigned int i;
+
+    for (i = 0; i < num; i++) {
+        if (keys[i].priv != CK_INVALID_HANDLE)
+            funcs->C_DestroyObject(session, keys[i].priv);
+        if (keys[i].publ != CK_INVALID_HANDLE && keys[i].publ != keys[i].priv)
+            funcs->C_DestroyObject(session, keys[i].publ);
+    }
+}
+
+/* Main function of a worker process */
+static int bench_worker(unsigned int proc)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_MECHANISM_INFO mech_info;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    struct bench_thread *threads = NULL;
+    unsigned int i, num_keys = 0;
+    int ret = 1;
+    CK_RV rc;
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+    rc = funcs->C_Initialize(&cinit_args);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "process %u: C_Initialize failed, rc=%s\n", proc,
+                p11_get_ckr(rc));
+        bench_fail();
+        return 1;
+    }
+
+    for (i = 0; i < opts.nops; i++) {
+        rc = funcs->C_GetMechanismInfo(SLOT_ID, opts.ops[i].def->mech,
+                                       &mech_info);
+        if (rc != CKR_OK) {
+            fprintf(stderr, "process %u: %s is not supported by slot %lu\n",
+                    proc, opts.ops[i].def->name, SLOT_ID);
+            goto out;
+        }
+    }
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "process %u: C_OpenSession failed, rc=%s\n", proc,
+                p11_get_ckr(rc));
+        goto out;
+    }
+
+    if (getenv(PKCS11_USER_PIN_ENV_VAR) != NULL) {
+        if (get_user_pin(user_pin))
+            goto out;
+        rc = funcs->C_Login(session, CKU_USER, user_pin,
+                            strlen((char *)user_pin));
+        if (rc != CKR_OK && rc != CKR_USER_ALREADY_LOGGED_IN) {
+            fprintf(stderr, "process %u: C_Login failed, rc=%s\n", proc,
+                    p11_get_ckr(rc));
+            goto out;
+        }
+        logged_in = CK_TRUE;
+    }
+
+    keys = calloc(opts.nops * opts.nkeys, sizeof(struct bench_key));
+    threads = calloc(opts.threads, sizeof(struct bench_thread));
+    if (keys == NULL || threads == NULL) {
+        fprintf(stderr, "process %u: calloc failed\n", proc);
+        goto out;
+    }
+
+    for (num_keys = 0; num_keys < opts.nops * opts.nkeys; num_keys++) {
+        rc = bench_generate_key(session, opts.ops[num_keys / opts.nkeys].def,
+                                &keys[num_keys]);
+        if (rc != CKR_OK) {
+            fprintf(stderr, "process %u: generating a key for %s failed, "
+                    "rc=%s\n", proc, opts.ops[num_keys / opts.nkeys].def->name,
+                    p11_get_ckr(rc));
+            goto out;
+        }
+    }
+
+    for (i = 0; i < opts.threads; i++)
+        threads[i].index = proc * opts.threads + i;
+
+    rc = perf_run_in_threads(opts.threads, bench_thread_main, threads);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "process %u: running the threads failed, rc=%s\n",
+                proc, p11_get_ckr(rc));
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    if (ret != 0)
+        bench_fail();
+    if (session != CK_INVALID_HANDLE) {
+        if (keys != NULL)
+            bench_destroy_keys(session, num_keys);
+        if (logged_in)
+            funcs->C_Logout(session);
+        funcs->C_CloseSession(session);
+    }
+    free(threads);
+    free(keys);
+    funcs->C_Finalize(NULL);
+
+    return ret;
+}
+
+static void bench_print_json(FILE *fp)
+{
+    struct perf_hist *res;
+    unsigned int s, i;
+    double secs;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"tool\": \"ock-bench\",\n");
+    fprintf(fp, "  \"format\": 1,\n");
+    fprintf(fp, "  \"slot\": %lu,\n", SLOT_ID);
+    fprintf(fp, "  \"procs\": %u,\n", opts.procs);
+    fprintf(fp, "  \"threads\": %u,\n", opts.threads);
+    fprintf(fp, "  \"duration\": %u,\n", opts.duration);
+    fprintf(fp, "  \"keys\": %u,\n", opts.nkeys);
+    fprintf(fp, "  \"token_objects\": %s,\n", opts.token ? "true" : "false");
+    fprintf(fp, "  \"results\": [\n");
+    for (s = 0; s < opts.nsizes; s++) {
+        secs = shared->elapsed_ns[s] / 1e9;
+        for (i = 0; i < opts.nops; i++) {
+            res = &shared->results[s * opts.nops + i];
+            /* One result per line, see bench_compare */
+            fprintf(fp, "    { \"op\": \"%s\", \"weight\": %u, "
+                    "\"size\": %lu, \"ops\": %llu, \"ops_per_sec\": %.1f, "
+                    "\"mb_per_sec\": %.3f, \"p50_us\": %.3f, "
+                    "\"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f }"
+                    "%s\n", opts.ops[i].def->name, opts.ops[i].weight,
+                    opts.sizes[s], (unsigned long long)res->ops,
+                    secs > 0 ? res->ops / secs : 0,
+                    secs > 0 ? res->ops * opts.sizes[s] / secs / 1e6 : 0,
+                    perf_hist_percentile(res, 0.5) / 1000,
+                    perf_hist_percentile(res, 0.99) / 1000,
+                    perf_hist_percentile(res, 0.999) / 1000,
+                    res->max_ns / 1000.0,
+                    s + 1 == opts.nsizes && i + 1 == opts.nops ? "" : ",");
+        }
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+}
+
+static void bench_print_text(void)
+{
+    struct perf_hist *res;
+    unsigned int s, i;
+    double secs;
+
+    printf("%u process(es) x %u thread(s), %u s per size, %u key(s) per "
+           "operation, %s objects\n\n", opts.procs, opts.threads,
+           opts.duration, opts.nkeys, opts.token ? "token" : "session");
+    printf("%-20s %8s %12s %12s %10s %10s %10s %10s %10s\n", "operation",
+           "size", "ops", "ops/s", "MB/s", "p50 us", "p99 us", "p99.9 us",
+           "max us");
+    for (s = 0; s < opts.nsizes; s++) {
+        secs = shared->elapsed_ns[s] / 1e9;
+        for (i = 0; i < opts.nops; i++) {
+            res = &shared->results[s * opts.nops + i];
+            printf("%-20s %8lu %12llu %12.1f %10.3f %10.3f %10.3f %10.3f "
+                   "%10.3f\n", opts.ops[i].def->name, opts.sizes[s],
+                   (unsigned long long)res->ops,
+                   secs > 0 ? res->ops / secs : 0,
+                   secs > 0 ? res->ops * opts.sizes[s] / secs / 1e6 : 0,
+                   perf_hist_percentile(res, 0.5) / 1000,
+                   perf_hist_percentile(res, 0.99) / 1000,
+                   perf_hist_percentile(res, 0.999) / 1000,
+                   res->max_ns / 1000.0);
+        }
+    }
+}
+
+struct bench_entry {
+    char op[BENCH_NAME_LEN];
+    unsigned int weight;
+    unsigned long size;
+    unsigned long long ops;
+    double ops_per_sec, mb_per_sec, p50, p99, p999, max;
+};
+
+/* Reads the results of a JSON report written by bench_print_json */
+static int bench_read_json(const char *file, struct bench_entry **entries,
+                           unsigned int *num)
+{
+    struct bench_entry e, *tmp;
+    char line[1024];
+    FILE *fp;
+
+    *entries = NULL;
+    *num = 0;
+
+    fp = fopen(file, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open '%s': %s\n", file, strerror(errno));
+        return FALSE;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, " { \"op\": \"%63[^\"]\", \"weight\": %u, "
+                   "\"size\": %lu, \"ops\": %llu, \"ops_per_sec\": %lf, "
+                   "\"mb_per_sec\": %lf, \"p50_us\": %lf, \"p99_us\": %lf, "
+                   "\"p999_us\": %lf, \"max_us\": %lf }",
+                   e.op, &e.weight, &e.size, &e.ops, &e.ops_per_sec,
+                   &e.mb_per_sec, &e.p50, &e.p99, &e.p999, &e.max) != 10)
+            continue;
+
+        tmp = realloc(*entries, (*num + 1) * sizeof(struct bench_entry));
+        if (tmp == NULL) {
+            fprintf(stderr, "realloc failed\n");
+            fclose(fp);
+            return FALSE;
+        }
+        *entries = tmp;
+        (*entries)[(*num)++] = e;
+    }
+
+    fclose(fp);
+
+    if (*num == 0) {
+        fprintf(stderr, "No ock-bench results found in '%s'\n", file);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static double bench_delta(double old, double new)
+{
+    return old != 0 ? (new - old) * 100 / old : 0;
+}
+
+static int bench_compare(const char *old_file, const char *new_file)
+{
+    struct bench_entry *old = NULL, *new = NULL, *o;
+    unsigned int num_old, num_new, i, j;
+    int ret = 1;
+
+    if (!bench_read_json(old_file, &old, &num_old) ||
+        !bench_read_json(new_file, &new, &num_new))
+        goto out;
+
+    printf("%-20s %8s %12s %12s %8s %10s %10s %8s %10s %10s %8s\n",
+           "operation", "size", "old ops/s", "new ops/s", "delta",
+           "old p50", "new p50", "delta", "old p99", "new p99", "delta");
+    for (i = 0; i < num_new; i++) {
+        o = NULL;
+        for (j = 0; j < num_old; j++) {
+            if (strcmp(old[j].op, new[i].op) == 0 &&
+                old[j].size == new[i].size) {
+                o = &old[j];
+                break;
+            }
+        }
+        if (o == NULL) {
+            printf("%-20s %8lu %12s %12.1f\n", new[i].op, new[i].size, "-",
+                   new[i].ops_per_sec);
+            continue;
+        }
+
+        printf("%-20s %8lu %12.1f %12.1f %+7.1f%% %10.3f %10.3f %+7.1f%% "
+               "%10.3f %10.3f %+7.1f%%\n", new[i].op, new[i].size,
+               o->ops_per_sec, new[i].ops_per_sec,
+               bench_delta(o->ops_per_sec, new[i].ops_per_sec),
+               o->p50, new[i].p50, bench_delta(o->p50, new[i].p50),
+               o->p99, new[i].p99, bench_delta(o->p99, new[i].p99));
+    }
+
+    ret = 0;
+
+out:
+    free(old);
+    free(new);
+
+    return ret;
+}
+
+static const struct bench_op_def *bench_find_op(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < BENCH_NUM_OP_DEFS; i++) {
+        if (strcmp(bench_op_defs[i].name, name) == 0)
+            return &bench_op_defs[i];
+    }
+
+    return NULL;
+}
+
+/* Parses a list like "ecdsa-p256-sign:3,sha256" */
+static int bench_parse_ops(const char *arg)
+{
+    char *list, *tok, *save = NULL, *colon, *endp;
+    unsigned long weight;
+    int ret = FALSE;
+
+    list = strdup(arg);
+    if (list == NULL)
+        return FALSE;
+
+    opts.nops = 0;
+    for (tok = strtok_r(list, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (opts.nops >= BENCH_MAX_OPS) {
+            printf("Too many operations, at most %u are allowed\n",
+                   BENCH_MAX_OPS);
+            goto out;
+        }
+
+        weight = 1;
+        colon = strchr(tok, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            weight = strtoul(colon + 1, &endp, 10);
+            if (*endp != '\0' || weight == 0 || weight > BENCH_MAX_WEIGHT) {
+                printf("Invalid weight for '%s', it must be between 1 and "
+                       "%u\n", tok, BENCH_MAX_WEIGHT);
+                goto out;
+            }
+        }
+
+        opts.ops[opts.nops].def = bench_find_op(tok);
+        if (opts.ops[opts.nops].def == NULL) {
+            printf("Unknown operation '%s'\n", tok);
+            goto out;
+        }
+        opts.ops[opts.nops].weight = weight;
+        opts.nops++;
+    }
+
+    ret = opts.nops > 0;
+
+out:
+    free(list);
+
+    return ret;
+}
+
+/* Parses a list like "64,1024,65536" */
+static int bench_parse_sizes(const char *arg)
+{
+    char *list, *tok, *save = NULL, *endp;
+    unsigned long size;
+    int ret = FALSE;
+
+    list = strdup(arg);
+    if (list == NULL)
+        return FALSE;
+
+    opts.nsizes = 0;
+    for (tok = strtok_r(list, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        size = strtoul(tok, &endp, 10);
+        if (*endp != '\0' || size == 0 || size > BENCH_MAX_DATA_LEN) {
+            printf("Invalid data size '%s', it must be between 1 and %u\n",
+                   tok, BENCH_MAX_DATA_LEN);
+            goto out;
+        }
+        if (opts.nsizes >= BENCH_MAX_SIZES) {
+            printf("Too many data sizes, at most %u are allowed\n",
+                   BENCH_MAX_SIZES);
+            goto out;
+        }
+        opts.sizes[opts.nsizes++] = size;
+    }
+
+    ret = opts.nsizes > 0;
+
+out:
+    free(list);
+
+    return ret;
+}
+
+static int bench_parse_uint(const char *opt, const char *arg,
+                            unsigned int max, unsigned int *val)
+{
+    unsigned long v;
+    char *endp;
+
+    v = strtoul(arg, &endp, 10);
+    if (*arg == '\0' || *endp != '\0' || v == 0 || v > max) {
+        printf("Invalid value for %s: '%s', it must be between 1 and %u\n",
+               opt, arg, max);
+        return FALSE;
+    }
+    *val = v;
+
+    return TRUE;
+}
+
+static void bench_usage(char *fct)
+{
+    unsigned int i;
+
+    printf("usage:  %s -slot <num> [-procs <num>] [-threads <num>]"
+           " [-duration <sec>] [-ops <op[:weight],...>]"
+           " [-sizes <bytes,...>] [-keys <num>] [-token] [-json <file>]"
+           " [-h]\n", fct);
+    printf("        %s -compare <old.json> <new.json>\n\n", fct);
+    printf("Operations:\n");
+    for (i = 0; i < BENCH_NUM_OP_DEFS; i++)
+        printf("  %s\n", bench_op_defs[i].name);
+    printf("\nThe user PIN is taken from the environment variable %s. "
+           "If it is not\nset, the benchmark runs without logging in.\n",
+           PKCS11_USER_PIN_ENV_VAR);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int procs_started = 0, procs_left;
+    size_t shared_len;
+    int i, status, ret = 1;
+    pid_t pid;
+    FILE *fp;
+
+    SLOT_ID = 1000;
+    opts.procs = 1;
+    opts.threads = 1;
+    opts.duration = BENCH_DEFAULT_DURATION;
+    opts.nkeys = 1;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            bench_usage(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "-compare") == 0) {
+            if (i + 2 >= argc) {
+                printf("Two reports are needed for -compare\n");
+                return 1;
+            }
+            return bench_compare(argv[i + 1], argv[i + 2]);
+        } else if (strcmp(argv[i], "-token") == 0) {
+            opts.token = CK_TRUE;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            printf("Value missing for '%s'\n", argv[i]);
+            bench_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-slot") == 0) {
+            SLOT_ID = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-procs") == 0) {
+            if (!bench_parse_uint(argv[i], argv[i + 1], BENCH_MAX_PROCS,
+                                  &opts.procs))
+                return 1;
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            if (!bench_parse_uint(argv[i], argv[i + 1], BENCH_MAX_THREADS,
+                                  &opts.threads))
+                return 1;
+        } else if (strcmp(argv[i], "-duration") == 0) {
+            if (!bench_parse_uint(argv[i], argv[i + 1], 3600,
+                                  &opts.duration))
+                return 1;
+        } else if (strcmp(argv[i], "-keys") == 0) {
+            if (!bench_parse_uint(argv[i], argv[i + 1], BENCH_MAX_KEYS,
+                                  &opts.nkeys))
+                return 1;
+        } else if (strcmp(argv[i], "-ops") == 0) {
+            if (!bench_parse_ops(argv[i + 1]))
+                return 1;
+        } else if (strcmp(argv[i], "-sizes") == 0) {
+            if (!bench_parse_sizes(argv[i + 1]))
+                return 1;
+        } else if (strcmp(argv[i], "-json") == 0) {
+            opts.json = argv[i + 1];
+        } else {
+            printf("unknown option '%s'\n", argv[i]);
+            bench_usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    // error if slot has not been identified.
+    if (SLOT_ID == 1000) {
+        printf("Please specify the slot to be tested.\n");
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    if (opts.nops == 0) {
+        opts.ops[0].def = bench_find_op("sha256");
+        opts.ops[0].weight = 1;
+        opts.nops = 1;
+    }
+    if (opts.nsizes == 0) {
+        opts.sizes[0] = BENCH_DEFAULT_SIZE;
+        opts.nsizes = 1;
+    }
+
+    if (opts.token && getenv(PKCS11_USER_PIN_ENV_VAR) == NULL) {
+        printf("Token objects require the user PIN in the environment "
+               "variable %s\n", PKCS11_USER_PIN_ENV_VAR);
+        return 1;
+    }
+
+    if (!do_GetFunctionList())
+        return 1;
+
+    shared_len = sizeof(struct bench_shared) +
+                 opts.nsizes * opts.nops * sizeof(struct perf_hist);
+    shared = mmap(NULL, shared_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        return 1;
+    }
+    memset(shared, 0, shared_len);
+
+    /* The library is not initialized here, each worker initializes it. */
+    for (procs_started = 0; procs_started < opts.procs; procs_started++) {
+        pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "fork failed: %s\n", strerror(errno));
+            bench_fail();
+            break;
+        }
+        if (pid == 0)
+            _exit(bench_worker(procs_started));
+    }
+
+    /*
+     * Wait for all workers. If one of them dies, let the others know, so
+     * that they do not wait for it at the next phase.
+     */
+    ret = 0;
+    for (procs_left = procs_started; procs_left > 0; procs_left--) {
+        pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            fprintf(stderr, "waitpid failed: %s\n", strerror(errno));
+            bench_fail();
+            ret = 1;
+            break;
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "worker process %d failed\n", (int)pid);
+            bench_fail();
+            ret = 1;
+        }
+    }
+
+    if (procs_started != opts.procs || bench_failed())
+        ret = 1;
+
+    if (ret == 0) {
+        bench_print_text();
+
+        if (opts.json != NULL) {
+            if (strcmp(opts.json, "-") == 0) {
+                bench_print_json(stdout);
+            } else {
+                fp = fopen(opts.json, "w");
+                if (fp == NULL) {
+                    fprintf(stderr, "Could not open '%s': %s\n", opts.json,
+                            strerror(errno));
+                    ret = 1;
+                } else {
+                    bench_print_json(fp);
+                    fclose(fp);
+                }
+            }
+        }
+    }
+
+    munmap(shared, shared_len);
+
+    return ret;
+}
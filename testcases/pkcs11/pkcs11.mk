@@ -1,11 +1,15 @@
 noinst_PROGRAMS +=							\
 	testcases/pkcs11/hw_fn testcases/pkcs11/sess_mgmt_tests		\
 	testcases/pkcs11/sess_bench testcases/pkcs11/sess_opstate	\
+	testcases/pkcs11/findobjects_bench testcases/pkcs11/sign_bench	\
+	testcases/pkcs11/rng_bench testcases/pkcs11/encrypt_bench	\
+	testcases/pkcs11/login_bench testcases/pkcs11/digest_bench	\
 	testcases/pkcs11/attribute testcases/pkcs11/findobjects		\
 	testcases/pkcs11/destroyobjects	testcases/pkcs11/copyobjects	\
 	testcases/pkcs11/generate_keypair testcases/pkcs11/gen_purpose	\
-	testcases/pkcs11/getobjectsize					\
-	testcases/pkcs11/get_interface
+	testcases/pkcs11/getobjectsize testcases/pkcs11/aead_bench	\
+	testcases/pkcs11/get_interface testcases/pkcs11/init_bench	\
+	testcases/pkcs11/ock-bench
 
 testcases_pkcs11_hw_fn_CFLAGS = ${testcases_inc}
 testcases_pkcs11_hw_fn_LDADD = testcases/common/libcommon.la
@@ -20,6 +24,42 @@ testcases_pkcs11_sess_bench_CFLAGS = ${testcases_inc}
 testcases_pkcs11_sess_bench_LDADD = testcases/common/libcommon.la
 testcases_pkcs11_sess_bench_SOURCES = testcases/pkcs11/sess_perf.c
 
+testcases_pkcs11_findobjects_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_findobjects_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_findobjects_bench_SOURCES = testcases/pkcs11/find_perf.c
+
+testcases_pkcs11_sign_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_sign_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_sign_bench_SOURCES = testcases/pkcs11/sign_perf.c
+
+testcases_pkcs11_rng_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_rng_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_rng_bench_SOURCES = testcases/pkcs11/rng_perf.c
+
+testcases_pkcs11_encrypt_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_encrypt_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_encrypt_bench_SOURCES = testcases/pkcs11/encrypt_perf.c
+
+testcases_pkcs11_login_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_login_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_login_bench_SOURCES = testcases/pkcs11/login_perf.c
+
+testcases_pkcs11_digest_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_digest_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_digest_bench_SOURCES = testcases/pkcs11/digest_perf.c
+
+testcases_pkcs11_aead_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_aead_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_aead_bench_SOURCES = testcases/pkcs11/aead_perf.c
+
+testcases_pkcs11_init_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_init_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_init_bench_SOURCES = testcases/pkcs11/init_perf.c
+
+testcases_pkcs11_ock_bench_CFLAGS = ${testcases_inc}
+testcases_pkcs11_ock_bench_LDADD = testcases/common/libcommon.la
+testcases_pkcs11_ock_bench_SOURCES = testcases/pkcs11/ock_bench.c
+
 testcases_pkcs11_sess_opstate_CFLAGS = ${testcases_inc}
 testcases_pkcs11_sess_opstate_LDADD = testcases/common/libcommon.la
 testcases_pkcs11_sess_opstate_SOURCES = testcases/pkcs11/sess_opstate.c
@@ -0,0 +1,210 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: rng_perf.c */
+
+/*
+ * Measures the C_GenerateRandom throughput for small requests, as used for
+ * IVs and nonces, and for large ones, with a varying number of threads that
+ * each use their own session. Also checks that a forked child does not get
+ * the same random data as its parent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define RNG_BENCH_SECONDS   1
+#define RNG_MAX_LEN         65536
+#define RNG_FORK_LEN        32
+
+static const CK_ULONG bench_sizes[] = { 16, 32, 64, 256, 4096, 65536 };
+static const unsigned int bench_threads[] = { 1, 2, 4, 8 };
+
+static CK_RV rng_op(CK_SESSION_HANDLE session, void *arg)
+{
+    CK_ULONG *len = arg;
+    CK_BYTE data[RNG_MAX_LEN];
+
+    return funcs->C_GenerateRandom(session, data, *len);
+}
+
+int do_RandomPerformance(void)
+{
+    unsigned long total;
+    unsigned int s, t;
+    CK_ULONG len;
+    CK_RV rc;
+
+    printf("%10s %10s %14s %14s %14s\n", "bytes", "threads", "calls",
+           "calls/sec", "MB/sec");
+
+    for (s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+        for (t = 0; t < sizeof(bench_threads) / sizeof(bench_threads[0]);
+             t++) {
+            len = bench_sizes[s];
+            rc = perf_run_threads(bench_threads[t], RNG_BENCH_SECONDS,
+                                  rng_op, &len, &total);
+            if (rc != CKR_OK) {
+                testcase_error("C_GenerateRandom rc=%s", p11_get_ckr(rc));
+                return FALSE;
+            }
+
+            printf("%10lu %10u %14lu %14.0f %14.2f\n", bench_sizes[s],
+                   bench_threads[t], total,
+                   (double)total / RNG_BENCH_SECONDS,
+                   (double)total * bench_sizes[s] /
+                                    (RNG_BENCH_SECONDS * 1024.0 * 1024.0));
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Random data generated by the parent and by a forked child after the fork
+ * must differ, even if the parent generated random data right before.
+ */
+int do_RandomFork(void)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_BYTE parent[RNG_FORK_LEN], child[RNG_FORK_LEN];
+    int fds[2], status;
+    pid_t pid;
+    CK_RV rc;
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION, NULL, NULL,
+                              &session);
+    if (rc != CKR_OK) {
+        testcase_error("C_OpenSession rc=%s", p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    rc = funcs->C_GenerateRandom(session, parent, sizeof(parent));
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateRandom rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    if (pipe(fds) != 0) {
+        testcase_error("pipe failed");
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        testcase_error("fork failed");
+        close(fds[0]);
+        close(fds[1]);
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        memset(child, 0, sizeof(child));
+
+        memset(&cinit_args, 0x0, sizeof(cinit_args));
+        cinit_args.flags = CKF_OS_LOCKING_OK;
+        if (funcs->C_Initialize(&cinit_args) == CKR_OK &&
+            funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION, NULL, NULL,
+                                 &session) == CKR_OK)
+            funcs->C_GenerateRandom(session, child, sizeof(child));
+        funcs->C_Finalize(NULL);
+
+        if (write(fds[1], child, sizeof(child)) != sizeof(child))
+            fprintf(stderr, "child write failed\n");
+        close(fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    rc = funcs->C_GenerateRandom(session, parent, sizeof(parent));
+    if (read(fds[0], child, sizeof(child)) != sizeof(child)) {
+        testcase_error("reading the child's random data failed");
+        rc = CKR_FUNCTION_FAILED;
+    }
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateRandom rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    if (memcmp(parent, child, sizeof(parent)) == 0) {
+        testcase_fail("forked child generated the same random data as its "
+                      "parent");
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    testcase_pass("forked child generated different random data");
+
+out:
+    funcs->C_CloseSession(session);
+    return rc == CKR_OK;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    testcase_begin("do_RandomPerformance");
+    testcase_new_assertion();
+
+    do_RandomPerformance();
+
+    if (t_errors > 0)
+        testcase_notice("do_RandomPerformance ran with %ld error(s)",
+                        t_errors);
+    else
+        testcase_pass("do_RandomPerformance passed");
+
+    testcase_begin("do_RandomFork");
+    testcase_new_assertion();
+
+    do_RandomFork();
+
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return 0;
+}
@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <memory.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "pkcs11types.h"
 #include "regress.h"
@@ -1392,6 +1394,160 @@ CK_RV do_SessionCancel(void)
     return rc;
 }
 
+#define CANCEL_DATA_LEN         (64 * 1024 * 1024)
+#define CANCEL_MAX_SECONDS      20
+
+struct cancel_thread {
+    CK_SESSION_HANDLE session;
+    CK_FLAGS op;
+    CK_BYTE *data;
+    volatile int done;
+    CK_RV rc;
+};
+
+static void *cancel_thread_func(void *arg)
+{
+    struct cancel_thread *t = arg;
+    CK_MECHANISM mech = { CKM_RSA_PKCS_KEY_PAIR_GEN, NULL, 0 };
+    CK_ULONG bits = 4096;
+    CK_BYTE pub_exp[] = { 0x01, 0x00, 0x01 };
+    CK_ATTRIBUTE pub_tmpl[] = {
+        {CKA_MODULUS_BITS, &bits, sizeof(bits)},
+        {CKA_PUBLIC_EXPONENT, pub_exp, sizeof(pub_exp)},
+    };
+    CK_OBJECT_HANDLE publ_key, priv_key;
+    SYSTEMTIME t1, t2;
+
+    GetSystemTime(&t1);
+    do {
+        if (t->op == CKF_DIGEST) {
+            t->rc = funcs->C_DigestUpdate(t->session, t->data,
+                                          CANCEL_DATA_LEN);
+        } else {
+            t->rc = funcs->C_GenerateKeyPair(t->session, &mech, pub_tmpl, 2,
+                                             NULL, 0, &publ_key, &priv_key);
+            if (t->rc == CKR_OK) {
+                funcs->C_DestroyObject(t->session, publ_key);
+                funcs->C_DestroyObject(t->session, priv_key);
+            }
+        }
+        GetSystemTime(&t2);
+    } while (t->rc == CKR_OK && t2.tv_sec - t1.tv_sec < CANCEL_MAX_SECONDS);
+
+    t->done = 1;
+    return NULL;
+}
+
+/*
+ * Cancels a long running operation from another thread: a loop of large
+ * C_DigestUpdate calls, and RSA key pair generation.
+ */
+CK_RV do_SessionCancelRunning(CK_FLAGS op)
+{
+    CK_MECHANISM mech = { CKM_SHA256, NULL, 0 };
+    struct cancel_thread t = { 0 };
+    CK_BYTE digest[32];
+    CK_ULONG digest_len = sizeof(digest);
+    pthread_t tid;
+    CK_RV rc;
+
+    testcase_begin("do_SessionCancelRunning %s",
+                   op == CKF_DIGEST ? "C_DigestUpdate" : "C_GenerateKeyPair");
+    testcase_new_assertion();
+
+    if (funcs3 == NULL) {
+        testcase_skip("Interface 'PKCS 11' version 3.0 not available");
+        return CKR_OK;
+    }
+
+    if (!mech_supported(SLOT_ID, op == CKF_DIGEST ? CKM_SHA256 :
+                                 CKM_RSA_PKCS_KEY_PAIR_GEN)) {
+        testcase_skip("Mechanism not supported. (skipped)");
+        return CKR_OK;
+    }
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &t.session);
+    if (rc != CKR_OK) {
+        testcase_fail("C_OpenSession, rc=%lx, %s", rc, p11_get_ckr(rc));
+        return rc;
+    }
+
+    t.op = op;
+    if (op == CKF_DIGEST) {
+        t.data = calloc(1, CANCEL_DATA_LEN);
+        if (t.data == NULL) {
+            testcase_error("calloc failed");
+            rc = CKR_HOST_MEMORY;
+            goto out;
+        }
+
+        rc = funcs->C_DigestInit(t.session, &mech);
+        if (rc != CKR_OK) {
+            testcase_fail("C_DigestInit, rc=%lx, %s", rc, p11_get_ckr(rc));
+            goto out;
+        }
+    }
+
+    if (pthread_create(&tid, NULL, cancel_thread_func, &t) != 0) {
+        testcase_error("pthread_create failed");
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    while (!t.done) {
+        usleep(50000);
+        rc = funcs3->C_SessionCancel(t.session, op);
+        if (rc != CKR_OK) {
+            testcase_fail("C_SessionCancel, rc=%lx, %s", rc, p11_get_ckr(rc));
+            break;
+        }
+    }
+
+    pthread_join(tid, NULL);
+    if (rc != CKR_OK)
+        goto out;
+
+    switch (t.rc) {
+    case CKR_FUNCTION_CANCELED:
+        break;
+    case CKR_OPERATION_NOT_INITIALIZED:
+        /* Canceled in between two C_DigestUpdate calls */
+        if (op == CKF_DIGEST)
+            break;
+        /* fall through */
+    case CKR_OK:
+        testcase_skip("The operation is not cancelable with this token");
+        goto out;
+    case CKR_POLICY_VIOLATION:
+        testcase_skip("The operation is not allowed by policy");
+        goto out;
+    default:
+        testcase_fail("Operation rc=%lx, %s", t.rc, p11_get_ckr(t.rc));
+        rc = t.rc;
+        goto out;
+    }
+
+    if (op == CKF_DIGEST) {
+        rc = funcs->C_DigestFinal(t.session, digest, &digest_len);
+        if (rc != CKR_OPERATION_NOT_INITIALIZED) {
+            testcase_fail("C_DigestFinal after cancel, rc=%lx, %s", rc,
+                          p11_get_ckr(rc));
+            rc = CKR_FUNCTION_FAILED;
+            goto out;
+        }
+        rc = CKR_OK;
+    }
+
+    testcase_pass("do_SessionCancelRunning passed");
+
+out:
+    free(t.data);
+    funcs->C_CloseSession(t.session);
+
+    return rc;
+}
+
 CK_RV sess_mgmt_functions(void)
 {
     SYSTEMTIME t1, t2;
@@ -1481,6 +1637,26 @@ CK_RV sess_mgmt_functions(void)
     GetSystemTime(&t2);
     process_time(t1, t2);
 
+    GetSystemTime(&t1);
+    rc = do_SessionCancelRunning(CKF_DIGEST);
+    if (rc && !no_stop) {
+        testcase_fail("do_SessionCancelRunning, rc=%lx, %s", rc,
+                      p11_get_ckr(rc));
+        return rc;
+    }
+    GetSystemTime(&t2);
+    process_time(t1, t2);
+
+    GetSystemTime(&t1);
+    rc = do_SessionCancelRunning(CKF_GENERATE_KEY_PAIR);
+    if (rc && !no_stop) {
+        testcase_fail("do_SessionCancelRunning, rc=%lx, %s", rc,
+                      p11_get_ckr(rc));
+        return rc;
+    }
+    GetSystemTime(&t2);
+    process_time(t1, t2);
+
     testcase_pass("sess_mgmt_functions passed");
 
     return rc;
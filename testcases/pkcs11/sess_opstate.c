@@ -21,6 +21,7 @@
 
 #include "pkcs11types.h"
 #include "regress.h"
+#include "mech_to_str.h"
 #include "common.c"
 
 
@@ -251,6 +252,209 @@ out:
     return rc;
 }
 
+/*
+ * Parks a multi-part MAC operation after each part, by saving its state in
+ * one session and restoring it in another one, with other operations run in
+ * between. The result must match the MAC of a session that did not park the
+ * operation, and the saved state must not contain the key value.
+ */
+int sess_opstate_mac_funcs(int loops, CK_MECHANISM_TYPE mech_type,
+                           CK_KEY_TYPE key_type)
+{
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE, s2 = CK_INVALID_HANDLE;
+    CK_MECHANISM mech = { mech_type, 0, 0 };
+    CK_OBJECT_CLASS key_class = CKO_SECRET_KEY;
+    CK_OBJECT_HANDLE hkey = CK_INVALID_HANDLE;
+    CK_BBOOL true = TRUE, false = FALSE;
+    CK_BYTE key[32], data[100], mac1[64], mac2[64];
+    CK_ATTRIBUTE key_tmpl[] = {
+        {CKA_CLASS, &key_class, sizeof(key_class)},
+        {CKA_KEY_TYPE, &key_type, sizeof(key_type)},
+        {CKA_TOKEN, &false, sizeof(false)},
+        {CKA_SIGN, &true, sizeof(true)},
+        {CKA_VALUE, key, sizeof(key)},
+    };
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len, flags;
+    CK_ULONG mac1_len, mac2_len, len, opstatelen = 0;
+    CK_BYTE *opstate = NULL;
+    int counter, rbytes;
+    CK_RV rc;
+
+    testcase_begin("Get/SetOperationState %s test", mech_to_str(mech_type));
+
+    if (!mech_supported(SLOT_ID, mech_type)) {
+        testcase_skip("Mechanism %s is not supported with slot %lu",
+                      mech_to_str(mech_type), SLOT_ID);
+        return CKR_OK;
+    }
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    rc = funcs->C_OpenSession(SLOT_ID, flags, NULL, NULL, &s2);
+    if (rc != CKR_OK) {
+        testcase_error("C_OpenSession() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    rc = funcs->C_GenerateRandom(session, key, sizeof(key));
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateRandom() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    rc = funcs->C_CreateObject(session, key_tmpl,
+                               sizeof(key_tmpl) / sizeof(CK_ATTRIBUTE), &hkey);
+    if (rc != CKR_OK) {
+        if (is_rejected_by_policy(rc, session)) {
+            testcase_skip("Key not allowed by policy");
+            rc = CKR_OK;
+        } else {
+            testcase_error("C_CreateObject() rc=%s", p11_get_ckr(rc));
+        }
+        goto testcase_cleanup;
+    }
+
+    rc = funcs->C_SignInit(session, &mech, hkey);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    rc = funcs->C_SignInit(s2, &mech, hkey);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (counter = 0; counter < loops; counter++) {
+        rbytes = 1 + random() % sizeof(data);
+        rc = funcs->C_GenerateRandom(session, data, rbytes);
+        if (rc != CKR_OK) {
+            testcase_error("C_GenerateRandom() rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+
+        rc = funcs->C_SignUpdate(session, data, rbytes);
+        if (rc != CKR_OK) {
+            testcase_error("C_SignUpdate rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+
+        if (opstate != NULL) {
+            rc = funcs->C_SetOperationState(s2, opstate, opstatelen, 0, 0);
+            if (rc != CKR_KEY_NEEDED) {
+                testcase_fail("C_SetOperationState without key rc=%s",
+                              p11_get_ckr(rc));
+                goto testcase_cleanup;
+            }
+
+            rc = funcs->C_SetOperationState(s2, opstate, opstatelen, 0, hkey);
+            if (rc != CKR_OK) {
+                testcase_error("C_SetOperationState rc=%s", p11_get_ckr(rc));
+                goto testcase_cleanup;
+            }
+            free(opstate);
+            opstate = NULL;
+        }
+
+        rc = funcs->C_SignUpdate(s2, data, rbytes);
+        if (rc != CKR_OK) {
+            testcase_error("C_SignUpdate rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+
+        rc = funcs->C_GetOperationState(s2, NULL, &opstatelen);
+        if (rc == CKR_STATE_UNSAVEABLE) {
+            testcase_skip("Get/SetOperationState %s test: state unsavable",
+                          mech_to_str(mech_type));
+            rc = CKR_OK;
+            goto testcase_cleanup;
+        }
+        if (rc != CKR_OK) {
+            testcase_error("C_GetOperationState rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+
+        opstate = malloc(opstatelen);
+        if (opstate == NULL) {
+            testcase_error("malloc(%lu) failed", opstatelen);
+            goto testcase_cleanup;
+        }
+
+        rc = funcs->C_GetOperationState(s2, opstate, &opstatelen);
+        if (rc != CKR_OK) {
+            testcase_error("C_GetOperationState rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+
+        if (memmem(opstate, opstatelen, key, sizeof(key)) != NULL) {
+            testcase_fail("Saved operation state contains the key");
+            goto testcase_cleanup;
+        }
+
+        /* finish the parked operation and sign something else */
+        mac2_len = sizeof(mac2);
+        rc = funcs->C_SignFinal(s2, mac2, &mac2_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_SignFinal rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+
+        rc = funcs->C_SignInit(s2, &mech, hkey);
+        if (rc != CKR_OK) {
+            testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+
+        mac2_len = sizeof(mac2);
+        rc = funcs->C_Sign(s2, data, rbytes, mac2, &mac2_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_Sign rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+
+    rc = funcs->C_SetOperationState(s2, opstate, opstatelen, 0, hkey);
+    if (rc != CKR_OK) {
+        testcase_error("C_SetOperationState rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    mac1_len = sizeof(mac1);
+    rc = funcs->C_SignFinal(session, mac1, &mac1_len);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    mac2_len = sizeof(mac2);
+    rc = funcs->C_SignFinal(s2, mac2, &mac2_len);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    testcase_new_assertion();
+    len = mac1_len < mac2_len ? mac1_len : mac2_len;
+    if (mac1_len != mac2_len || memcmp(mac1, mac2, len) != 0)
+        testcase_fail("MAC of the parked operation differs");
+    else
+        testcase_pass("Get/SetOperationState %s test",
+                      mech_to_str(mech_type));
+
+testcase_cleanup:
+    if (opstate)
+        free(opstate);
+    if (hkey != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, hkey);
+    testcase_user_logout();
+    testcase_closeall_session();
+
+    return rc;
+}
+
 int main(int argc, char **argv)
 {
     CK_C_INITIALIZE_ARGS cinit_args;
@@ -306,6 +510,11 @@ int main(int argc, char **argv)
     }
     testcase_setup();
     rc = sess_opstate_funcs(loops);
+    if (rc == CKR_OK)
+        rc = sess_opstate_mac_funcs(loops, CKM_SHA256_HMAC,
+                                    CKK_GENERIC_SECRET);
+    if (rc == CKR_OK)
+        rc = sess_opstate_mac_funcs(loops, CKM_AES_CMAC, CKK_AES);
     testcase_print_result();
 
     return testcase_return(rc);
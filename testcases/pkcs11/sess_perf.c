@@ -16,12 +16,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <memory.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "pkcs11types.h"
 #include "regress.h"
 #include "defs.h"
 
 #define DATALEN 1024
+#define CHURN_MAX_PROCS 16
+#define CHURN_SESSIONS  10000
 CK_BYTE DATA[DATALEN];
 CK_BYTE DUMP[DATALEN];
 
@@ -218,6 +223,136 @@ ret:
     return rc;
 }
 
+/*
+ * Child of do_SessionChurn: open and close sessions as fast as possible.
+ * Every other session is a R/W session, so that both the global and the
+ * R/W session counts are exercised.
+ */
+static int churn_sessions(unsigned int count)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE hsess;
+    CK_FLAGS flags;
+    unsigned int i;
+    CK_RV rc;
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+    rc = funcs->C_Initialize(&cinit_args);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "child C_Initialize, rc=%s\n", p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    for (i = 0; i < count; i++) {
+        flags = CKF_SERIAL_SESSION;
+        if (i & 1)
+            flags |= CKF_RW_SESSION;
+
+        rc = funcs->C_OpenSession(SLOT_ID, flags, NULL, NULL, &hsess);
+        if (rc != CKR_OK) {
+            fprintf(stderr, "child C_OpenSession, rc=%s\n", p11_get_ckr(rc));
+            break;
+        }
+
+        rc = funcs->C_CloseSession(hsess);
+        if (rc != CKR_OK) {
+            fprintf(stderr, "child C_CloseSession, rc=%s\n", p11_get_ckr(rc));
+            break;
+        }
+    }
+
+    funcs->C_Finalize(NULL);
+
+    return rc == CKR_OK;
+}
+
+static int get_session_counts(CK_ULONG *sessions, CK_ULONG *rw_sessions)
+{
+    CK_TOKEN_INFO info;
+    CK_RV rc;
+
+    rc = funcs->C_GetTokenInfo(SLOT_ID, &info);
+    if (rc != CKR_OK) {
+        testcase_error("C_GetTokenInfo, rc=%s", p11_get_ckr(rc));
+        return FALSE;
+    }
+
+    *sessions = info.ulSessionCount;
+    *rw_sessions = info.ulRwSessionCount;
+
+    return TRUE;
+}
+
+/*
+ * Open and close sessions concurrently from multiple processes. All
+ * processes update the session counts of the slot in the shared memory of
+ * pkcsslotd, so this measures how well session churn scales with the
+ * number of processes. Afterwards the counts must be back where they were.
+ */
+int do_SessionChurn(unsigned int nprocs, unsigned int count)
+{
+    SYSTEMTIME t1, t2;
+    pid_t pids[CHURN_MAX_PROCS];
+    CK_ULONG sessions_before, rw_sessions_before, sessions_after,
+        rw_sessions_after;
+    unsigned int i, started = 0;
+    int rc = TRUE, status;
+    double secs;
+
+    if (nprocs == 0 || nprocs > CHURN_MAX_PROCS) {
+        testcase_error("do_SessionChurn: invalid process count %u", nprocs);
+        return FALSE;
+    }
+
+    if (!get_session_counts(&sessions_before, &rw_sessions_before))
+        return FALSE;
+
+    GetSystemTime(&t1);
+    for (i = 0; i < nprocs; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            testcase_error("do_SessionChurn: fork failed");
+            rc = FALSE;
+            break;
+        }
+        if (pids[i] == 0)
+            _exit(churn_sessions(count) ? 0 : 1);
+        started++;
+    }
+
+    for (i = 0; i < started; i++) {
+        if (waitpid(pids[i], &status, 0) != pids[i] ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            testcase_error("do_SessionChurn: child %u failed", i);
+            rc = FALSE;
+        }
+    }
+    GetSystemTime(&t2);
+
+    if (rc == FALSE)
+        return FALSE;
+
+    process_time(t1, t2);
+    secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000000.0;
+    if (secs > 0)
+        printf("%u processes: %.0f session open/close pairs per second\n",
+               nprocs, (double)nprocs * count / secs);
+
+    if (!get_session_counts(&sessions_after, &rw_sessions_after))
+        return FALSE;
+
+    if (sessions_after != sessions_before ||
+        rw_sessions_after != rw_sessions_before) {
+        testcase_error("do_SessionChurn: session counts changed from %lu/%lu "
+                       "to %lu/%lu", sessions_before, rw_sessions_before,
+                       sessions_after, rw_sessions_after);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 int main(int argc, char **argv)
 {
     CK_C_INITIALIZE_ARGS cinit_args;
@@ -270,6 +405,20 @@ int main(int argc, char **argv)
     else
         testcase_pass("do_SessionPerformance passed");
 
+    testcase_begin("do_SessionChurn");
+    testcase_new_assertion();
+
+    for (i = 1; i <= CHURN_MAX_PROCS; i *= 2) {
+        printf("timing do_SessionChurn(%d, %d)\n", i, CHURN_SESSIONS);
+        if (!do_SessionChurn(i, CHURN_SESSIONS))
+            break;
+    }
+
+    if (i <= CHURN_MAX_PROCS)
+        testcase_fail("do_SessionChurn failed");
+    else
+        testcase_pass("do_SessionChurn passed");
+
     testcase_print_result();
 
     return 0;
@@ -0,0 +1,288 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: sign_perf.c */
+
+/*
+ * Measures the C_SignInit/C_Sign throughput with a private token key that is
+ * used concurrently by several processes, each running several threads. Every
+ * use of a token object checks its state in the token's shared memory, so this
+ * mostly shows how well that check scales with the number of users.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define SIGN_BENCH_LABEL    "SIGN_BENCH_KEY"
+#define SIGN_BENCH_SECONDS  2
+#define SIGN_DATA_LEN       64
+
+static const unsigned int bench_procs[] = { 1, 2, 4 };
+static const unsigned int bench_threads[] = { 1, 2, 4, 8 };
+
+static CK_RV find_bench_key(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE *hkey)
+{
+    CK_CHAR label[] = SIGN_BENCH_LABEL;
+    CK_BBOOL true = TRUE;
+    CK_ULONG count = 0;
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_TOKEN, &true, sizeof(true)},
+        {CKA_LABEL, label, sizeof(label) - 1},
+    };
+    CK_RV rc;
+
+    rc = funcs->C_FindObjectsInit(session, tmpl, 2);
+    if (rc != CKR_OK)
+        return rc;
+
+    rc = funcs->C_FindObjects(session, hkey, 1, &count);
+    if (rc == CKR_OK && count != 1)
+        rc = CKR_OBJECT_HANDLE_INVALID;
+
+    funcs->C_FindObjectsFinal(session);
+    return rc;
+}
+
+static CK_RV sign_op(CK_SESSION_HANDLE session, void *arg)
+{
+    CK_OBJECT_HANDLE *hkey = arg;
+    CK_MECHANISM mech = { CKM_SHA256_HMAC, NULL, 0 };
+    CK_BYTE data[SIGN_DATA_LEN];
+    CK_BYTE mac[32];
+    CK_ULONG mac_len = sizeof(mac);
+    CK_RV rc;
+
+    memset(data, 0x5a, sizeof(data));
+
+    rc = funcs->C_SignInit(session, &mech, *hkey);
+    if (rc != CKR_OK)
+        return rc;
+
+    return funcs->C_Sign(session, data, sizeof(data), mac, &mac_len);
+}
+
+/*
+ * Runs in a forked child: initializes the library, logs in and signs with the
+ * benchmark key from num_threads threads. The total number of operations is
+ * written to fd, or 0 on failure.
+ */
+static void sign_child(int fd, unsigned int num_threads)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_OBJECT_HANDLE hkey;
+    unsigned long total = 0;
+    CK_RV rc;
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+    rc = funcs->C_Initialize(&cinit_args);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "child C_Initialize rc=%s\n", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION, NULL, NULL,
+                              &session);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "child C_OpenSession rc=%s\n", p11_get_ckr(rc));
+        goto finalize;
+    }
+
+    if (get_user_pin(user_pin))
+        goto finalize;
+    user_pin_len = (CK_ULONG) strlen((char *) user_pin);
+    rc = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+    if (rc != CKR_OK && rc != CKR_USER_ALREADY_LOGGED_IN) {
+        fprintf(stderr, "child C_Login rc=%s\n", p11_get_ckr(rc));
+        goto finalize;
+    }
+
+    rc = find_bench_key(session, &hkey);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "child find key rc=%s\n", p11_get_ckr(rc));
+        goto finalize;
+    }
+
+    rc = perf_run_threads(num_threads, SIGN_BENCH_SECONDS, sign_op, &hkey,
+                          &total);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "child sign rc=%s\n", p11_get_ckr(rc));
+        total = 0;
+    }
+
+finalize:
+    funcs->C_Finalize(NULL);
+out:
+    if (write(fd, &total, sizeof(total)) != sizeof(total))
+        fprintf(stderr, "child write failed\n");
+    close(fd);
+    _exit(0);
+}
+
+static int run_sign_bench(unsigned int num_procs, unsigned int num_threads,
+                          unsigned long *total)
+{
+    int fds[2], rc = TRUE;
+    unsigned long ops;
+    unsigned int i;
+    pid_t pid;
+
+    *total = 0;
+
+    if (pipe(fds) != 0) {
+        testcase_error("pipe failed");
+        return FALSE;
+    }
+
+    for (i = 0; i < num_procs; i++) {
+        pid = fork();
+        if (pid < 0) {
+            testcase_error("fork failed");
+            num_procs = i;
+            rc = FALSE;
+            break;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            sign_child(fds[1], num_threads);
+        }
+    }
+    close(fds[1]);
+
+    for (i = 0; i < num_procs; i++) {
+        if (read(fds[0], &ops, sizeof(ops)) != sizeof(ops) || ops == 0)
+            rc = FALSE;
+        else
+            *total += ops;
+    }
+    close(fds[0]);
+
+    while (wait(NULL) > 0)
+        ;
+
+    return rc;
+}
+
+int do_SignPerformance(void)
+{
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE hkey = CK_INVALID_HANDLE;
+    CK_MECHANISM keygen_mech = { CKM_GENERIC_SECRET_KEY_GEN, NULL, 0 };
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_FLAGS flags;
+    CK_CHAR label[] = SIGN_BENCH_LABEL;
+    CK_ULONG key_len = 32;
+    CK_BBOOL true = TRUE;
+    CK_ATTRIBUTE key_tmpl[] = {
+        {CKA_VALUE_LEN, &key_len, sizeof(key_len)},
+        {CKA_TOKEN, &true, sizeof(true)},
+        {CKA_PRIVATE, &true, sizeof(true)},
+        {CKA_SIGN, &true, sizeof(true)},
+        {CKA_LABEL, label, sizeof(label) - 1},
+    };
+    unsigned long total;
+    unsigned int p, t;
+    CK_RV rc;
+
+    if (!mech_supported(SLOT_ID, CKM_SHA256_HMAC) ||
+        !mech_supported(SLOT_ID, CKM_GENERIC_SECRET_KEY_GEN)) {
+        testcase_skip("Slot %u doesn't support CKM_SHA256_HMAC",
+                      (unsigned int) SLOT_ID);
+        return TRUE;
+    }
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    rc = funcs->C_GenerateKey(session, &keygen_mech, key_tmpl,
+                              sizeof(key_tmpl) / sizeof(CK_ATTRIBUTE), &hkey);
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateKey rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    printf("%10s %10s %14s %14s\n", "processes", "threads", "signs",
+           "signs/sec");
+
+    for (p = 0; p < sizeof(bench_procs) / sizeof(bench_procs[0]); p++) {
+        for (t = 0; t < sizeof(bench_threads) / sizeof(bench_threads[0]);
+             t++) {
+            if (!run_sign_bench(bench_procs[p], bench_threads[t], &total)) {
+                testcase_error("%u processes x %u threads failed",
+                               bench_procs[p], bench_threads[t]);
+                goto testcase_cleanup;
+            }
+
+            printf("%10u %10u %14lu %14.0f\n", bench_procs[p],
+                   bench_threads[t], total,
+                   (double)total / SIGN_BENCH_SECONDS);
+        }
+    }
+
+testcase_cleanup:
+    if (hkey != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, hkey);
+    testcase_user_logout();
+    testcase_close_session();
+    return rc == CKR_OK;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        PRINT_ERR("ERROR do_GetFunctionList() Failed , rc = 0x%0x\n", rc);
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    testcase_begin("do_SignPerformance");
+    testcase_new_assertion();
+
+    do_SignPerformance();
+
+    if (t_errors > 0)
+        testcase_notice("do_SignPerformance ran with %ld error(s)", t_errors);
+    else
+        testcase_pass("do_SignPerformance passed");
+
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2025
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#include "local_types.h"
+#include "unittest.h"
+
+#define NUM_VALUES          1000
+#define NUM_READERS         4
+#define NUM_HANDLES         16
+#define STRESS_ROUNDS       20000
+
+#define VALUE_ALIVE         0x414c495645UL
+#define VALUE_DELETED       0x44454c4554UL
+
+struct test_value {
+    struct bt_ref_hdr hdr;
+    volatile unsigned long magic;
+    unsigned long id;
+};
+
+static volatile unsigned long num_deleted;
+
+/*
+ * Values are not freed but only marked as deleted, so that a reader that got
+ * a deleted value can be detected.
+ */
+static void delete_value(void *value)
+{
+    ((struct test_value *)value)->magic = VALUE_DELETED;
+    __sync_add_and_fetch(&num_deleted, 1);
+}
+
+static void count_node(STDLL_TokData_t *tokdata, void *value,
+                       unsigned long handle, void *private)
+{
+    unsigned long *count = private;
+
+    (void)tokdata;
+    (void)value;
+    (void)handle;
+
+    (*count)++;
+}
+
+static int test_add_get_free(void)
+{
+    struct test_value *values, *v;
+    struct btree t;
+    unsigned long i, h, count;
+    int res = -1;
+
+    values = calloc(NUM_VALUES, sizeof(*values));
+    if (values == NULL)
+        return -1;
+
+    num_deleted = 0;
+    if (bt_init(&t, delete_value) != CKR_OK) {
+        free(values);
+        return -1;
+    }
+
+    /* Enough values to use several chunks */
+    for (i = 0; i < NUM_VALUES; i++) {
+        values[i].magic = VALUE_ALIVE;
+        values[i].id = i;
+        h = bt_node_add(&t, &values[i]);
+        if (h != i + 1) {
+            fprintf(stderr, "bt_node_add returned handle %lu, expected %lu\n",
+                    h, i + 1);
+            goto out;
+        }
+    }
+
+    for (i = 0; i < NUM_VALUES; i++) {
+        v = bt_get_node_value(&t, i + 1);
+        if (v != &values[i] || v->hdr.ref != 2) {
+            fprintf(stderr, "bt_get_node_value(%lu) returned a wrong value\n",
+                    i + 1);
+            goto out;
+        }
+        bt_put_node_value(&t, v);
+    }
+
+    if (bt_get_node_value(&t, 0) != NULL ||
+        bt_get_node_value(&t, NUM_VALUES + 1) != NULL) {
+        fprintf(stderr, "bt_get_node_value returned a value for an invalid "
+                "handle\n");
+        goto out;
+    }
+
+    /* Free every other handle */
+    for (i = 0; i < NUM_VALUES; i += 2) {
+        if (bt_node_free(&t, i + 1, 1) != &values[i]) {
+            fprintf(stderr, "bt_node_free(%lu) failed\n", i + 1);
+            goto out;
+        }
+        if (bt_node_free(&t, i + 1, 1) != NULL) {
+            fprintf(stderr, "bt_node_free(%lu) freed a free handle\n", i + 1);
+            goto out;
+        }
+        if (bt_get_node_value(&t, i + 1) != NULL) {
+            fprintf(stderr, "bt_get_node_value(%lu) returned a freed value\n",
+                    i + 1);
+            goto out;
+        }
+    }
+
+    if (num_deleted != NUM_VALUES / 2 ||
+        bt_nodes_in_use(&t) != NUM_VALUES / 2) {
+        fprintf(stderr, "%lu values deleted, %lu nodes in use\n",
+                num_deleted, bt_nodes_in_use(&t));
+        goto out;
+    }
+
+    count = 0;
+    bt_for_each_node(NULL, &t, count_node, &count);
+    if (count != NUM_VALUES / 2) {
+        fprintf(stderr, "bt_for_each_node visited %lu nodes\n", count);
+        goto out;
+    }
+
+    /* Freed handles are reused before new ones are allocated */
+    for (i = 0; i < NUM_VALUES; i += 2) {
+        values[i].magic = VALUE_ALIVE;
+        h = bt_node_add(&t, &values[i]);
+        if (h == 0 || h > NUM_VALUES || (h - 1) % 2 != 0) {
+            fprintf(stderr, "bt_node_add did not reuse a freed handle: %lu\n",
+                    h);
+            goto out;
+        }
+    }
+
+    if (bt_is_empty(&t) || bt_nodes_in_use(&t) != NUM_VALUES) {
+        fprintf(stderr, "%lu nodes in use, expected %u\n",
+                bt_nodes_in_use(&t), NUM_VALUES);
+        goto out;
+    }
+
+    res = 0;
+
+out:
+    num_deleted = 0;
+    bt_destroy(&t);
+    if (res == 0 && num_deleted != NUM_VALUES) {
+        fprintf(stderr, "bt_destroy deleted %lu values\n", num_deleted);
+        res = -1;
+    }
+    free(values);
+    return res;
+}
+
+struct stress_data {
+    struct btree t;
+    volatile int stop;
+    volatile unsigned long errors;
+};
+
+static void *stress_reader(void *arg)
+{
+    struct stress_data *sd = arg;
+    struct test_value *v;
+    unsigned long i = 0;
+
+    while (!sd->stop) {
+        v = bt_get_node_value(&sd->t, i % NUM_HANDLES + 1);
+        if (v != NULL) {
+            if (v->magic != VALUE_ALIVE)
+                __sync_add_and_fetch(&sd->errors, 1);
+            bt_put_node_value(&sd->t, v);
+        }
+        i++;
+    }
+
+    return NULL;
+}
+
+/*
+ * Readers get and put the values of all handles, while the handles are
+ * freed and added again. A reader must never get a value that was deleted.
+ */
+static int test_concurrent(void)
+{
+    struct test_value *values;
+    struct stress_data sd;
+    pthread_t readers[NUM_READERS];
+    unsigned long i, h, num_readers = 0;
+    int res = -1;
+
+    values = calloc(STRESS_ROUNDS + NUM_HANDLES, sizeof(*values));
+    if (values == NULL)
+        return -1;
+
+    memset(&sd, 0, sizeof(sd));
+    if (bt_init(&sd.t, delete_value) != CKR_OK) {
+        free(values);
+        return -1;
+    }
+
+    for (i = 0; i < NUM_HANDLES; i++) {
+        values[i].magic = VALUE_ALIVE;
+        if (bt_node_add(&sd.t, &values[i]) == 0)
+            goto out;
+    }
+
+    for (num_readers = 0; num_readers < NUM_READERS; num_readers++) {
+        if (pthread_create(&readers[num_readers], NULL, stress_reader,
+                           &sd) != 0)
+            goto out;
+    }
+
+    for (i = 0; i < STRESS_ROUNDS; i++) {
+        h = i % NUM_HANDLES + 1;
+        bt_node_free(&sd.t, h, 1);
+
+        values[NUM_HANDLES + i].magic = VALUE_ALIVE;
+        if (bt_node_add(&sd.t, &values[NUM_HANDLES + i]) != h) {
+            fprintf(stderr, "bt_node_add did not reuse handle %lu\n", h);
+            goto out;
+        }
+    }
+
+    res = 0;
+
+out:
+    sd.stop = 1;
+    for (i = 0; i < num_readers; i++)
+        pthread_join(readers[i], NULL);
+
+    if (sd.errors != 0) {
+        fprintf(stderr, "Readers got %lu deleted values\n", sd.errors);
+        res = -1;
+    }
+
+    bt_destroy(&sd.t);
+    free(values);
+    return res;
+}
+
+int main(void)
+{
+    if (test_add_get_free())
+        return TEST_FAIL;
+    if (test_concurrent())
+        return TEST_FAIL;
+    return TEST_PASS;
+}
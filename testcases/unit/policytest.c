@@ -122,6 +122,23 @@ static const char policymgfnone[] =
     "strength = 0\n"
     "allowedmgfs ()\n";
 
+static const char policycachedefault[] =
+    "version policy-0\n"
+    "strength = 0\n"
+    "allowedmgfs ( CKG_MGF1_SHA1, CKG_MGF1_SHA512 )\n";
+
+static const char policycacheone[] =
+    "version policy-0\n"
+    "strength = 0\n"
+    "allowedmgfs ( CKG_MGF1_SHA1, CKG_MGF1_SHA512 )\n"
+    "decisioncache = 1\n";
+
+static const char policycacheoff[] =
+    "version policy-0\n"
+    "strength = 0\n"
+    "allowedmgfs ( CKG_MGF1_SHA1, CKG_MGF1_SHA512 )\n"
+    "decisioncache = 0\n";
+
 static const char policykdfnosha1[] =
     "version policy-0\n"
     "strength = 0\n"
@@ -143,6 +160,9 @@ extern CK_RV policy_load_policy_cfg(struct policy_private *pp,
 extern struct policy_private *policy_private_alloc(void);
 extern struct policy_private *policy_private_free(struct policy_private *pp);
 extern void policy_private_deactivate(struct policy_private *pp);
+extern void policy_private_get_decision_stats(struct policy_private *pp,
+                                              CK_ULONG *hits,
+                                              CK_ULONG *misses);
 
 struct keytest {
     CK_ULONG keytype;
@@ -976,6 +996,115 @@ static int runpolicydeepchecktests(void)
     return runpolicydeepcheckmgftests() | runpolicydeepcheckkdftests();
 }
 
+#define POLICYDECISIONCACHENUM 4
+
+static int runpolicydecisioncachetests(void)
+{
+    static const CK_ULONG mgfs[POLICYDECISIONCACHENUM] =
+        { CKG_MGF1_SHA1, CKG_MGF1_SHA512,
+          CKG_MGF1_SHA256, CKG_IBM_MGF1_SHA3_384 };
+    static const CK_RV exprc[POLICYDECISIONCACHENUM] =
+        { CKR_OK, CKR_OK, CKR_FUNCTION_FAILED, CKR_FUNCTION_FAILED };
+    static const struct {
+        const char *policy;
+        size_t policylen;
+        CK_BBOOL cached;
+    } policies[] =
+          {
+           { policycachedefault, sizeof(policycachedefault), CK_TRUE },
+           { policycacheone, sizeof(policycacheone), CK_TRUE },
+           { policycacheoff, sizeof(policycacheoff), CK_FALSE }
+          };
+    struct objstrength strength;
+    struct policy_private *pp;
+    CK_MECHANISM oaepmech, pssmech;
+    struct policy p;
+    unsigned int i, j, o;
+    CK_ULONG hits, misses, exphits;
+    CK_RV rc;
+    int res;
+    CK_RSA_PKCS_OAEP_PARAMS oaepparams;
+    CK_RSA_PKCS_PSS_PARAMS pssparams;
+
+    fprintf(stderr, "Running policydecisioncachetests\n");
+    res = 0;
+    policy_init_policy(&p);
+    oaepparams.hashAlg = CKM_SHA_1;
+    oaepparams.source = CKZ_DATA_SPECIFIED;
+    oaepparams.pSourceData = NULL;
+    oaepparams.ulSourceDataLen = 0;
+    pssparams.hashAlg = CKM_SHA_1;
+    pssparams.sLen = 0;
+    strength.strength = 0;
+    strength.siglen = 0;
+    strength.allowed = CK_TRUE;
+    oaepmech.mechanism = CKM_RSA_PKCS_OAEP;
+    oaepmech.pParameter = &oaepparams;
+    oaepmech.ulParameterLen = sizeof(oaepparams);
+    pssmech.mechanism = CKM_RSA_PKCS_PSS;
+    pssmech.pParameter = &pssparams;
+    pssmech.ulParameterLen = sizeof(pssparams);
+
+    for (o = 0; o < ARRAYSIZE(policies); ++o) {
+        pp = policy_private_alloc();
+        if (pp == NULL) {
+            fprintf(stderr, "Test %u: Failed to allocate policy_private\n", o);
+            return -1;
+        }
+        p.priv = pp;
+        if (test_load_strength_cfg(pp,(void *)niststrength,
+                                   sizeof(niststrength))) {
+            policy_private_free(pp);
+            fprintf(stderr, "Test %u: Failed to load strength configuration\n",
+                    o);
+            return -1;
+        }
+        if (test_load_policy_cfg(pp, (void *)policies[o].policy,
+                                 policies[o].policylen)) {
+            policy_private_free(pp);
+            fprintf(stderr, "Test %u: Failed to load policy configuration\n",
+                    o);
+            return -1;
+        }
+        /* Every check is done twice in a row.  The second one has to
+           be answered from the cache if it is enabled, even if the
+           cache only has a single entry. */
+        for (i = 0; i < 2 * ARRAYSIZE(mgfs); ++i) {
+            oaepparams.mgf = pssparams.mgf = mgfs[i % ARRAYSIZE(mgfs)];
+            for (j = 0; j < 2; ++j) {
+                rc = p.is_mech_allowed(&p, &oaepmech, &strength,
+                                       POLICY_CHECK_ENCRYPT, NULL);
+                if (rc != exprc[i % ARRAYSIZE(mgfs)]) {
+                    fprintf(stderr,
+                            "Test %u, case %u, OAEP: unexpected result 0x%lx (expected 0x%lx)\n",
+                            o, i, rc, exprc[i % ARRAYSIZE(mgfs)]);
+                    res = -1;
+                }
+            }
+            for (j = 0; j < 2; ++j) {
+                rc = p.is_mech_allowed(&p, &pssmech, &strength,
+                                       POLICY_CHECK_ENCRYPT, NULL);
+                if (rc != exprc[i % ARRAYSIZE(mgfs)]) {
+                    fprintf(stderr,
+                            "Test %u, case %u, PSS: unexpected result 0x%lx (expected 0x%lx)\n",
+                            o, i, rc, exprc[i % ARRAYSIZE(mgfs)]);
+                    res = -1;
+                }
+            }
+        }
+        policy_private_get_decision_stats(pp, &hits, &misses);
+        exphits = policies[o].cached ? 4 * ARRAYSIZE(mgfs) : 0;
+        if (hits < exphits || hits + misses != 2 * exphits) {
+            fprintf(stderr,
+                    "Test %u: unexpected cache statistics: %lu hits, %lu misses\n",
+                    o, hits, misses);
+            res = -1;
+        }
+        p.priv = pp = policy_private_free(pp);
+    }
+    return res;
+}
+
 static int runstrengthtests(void)
 {
     return runstrengthdettests() | runstrengthenforcetests();
@@ -984,7 +1113,7 @@ static int runstrengthtests(void)
 static int runpolicytests(void)
 {
     return runpolicyenforcetests() | runpolicyhashtests() |
-        runpolicydeepchecktests();
+        runpolicydeepchecktests() | runpolicydecisioncachetests();
 }
 
 int main(void)
@@ -1,12 +1,12 @@
 check_PROGRAMS = testcases/unit/policytest testcases/unit/hashmaptest	\
 	testcases/unit/mechtabletest testcases/unit/configdump		\
 	testcases/unit/buffertest testcases/unit/uritest		\
-	testcases/unit/pintest
+	testcases/unit/pintest testcases/unit/btreetest
 
 TESTS = testcases/unit/policytest testcases/unit/hashmaptest		\
 	testcases/unit/mechtabletest testcases/unit/configdump		\
 	testcases/unit/buffertest testcases/unit/uritest		\
-	testcases/unit/pintest.sh
+	testcases/unit/pintest.sh testcases/unit/btreetest
 
 EXTRA_DIST += testcases/unit/pintest.sh
 noinst_HEADERS += testcases/unit/unittest.h
@@ -84,3 +84,10 @@ testcases_unit_pintest_SOURCES=testcases/unit/pintest.c		\
 testcases_unit_pintest_CFLAGS=-I${top_srcdir}/usr/lib/common \
 	-I${top_srcdir}/usr/include
 testcases_unit_pintest_LDFLAGS=-lcrypto
+
+testcases_unit_btreetest_SOURCES=testcases/unit/btreetest.c		\
+	usr/lib/common/btree.c usr/lib/common/trace.c
+
+testcases_unit_btreetest_CFLAGS=-I${top_srcdir}/usr/lib/common	\
+	-I${top_srcdir}/usr/include -DSTDLL_NAME=\"btreetest\"
+testcases_unit_btreetest_LDFLAGS=-lpthread
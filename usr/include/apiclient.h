@@ -285,6 +285,17 @@ extern "C" {
                                 CK_OBJECT_HANDLE, CK_MECHANISM_PTR,
                                 CK_OBJECT_HANDLE, CK_BYTE_PTR,
                                 CK_ULONG, CK_BYTE_PTR, CK_ULONG_PTR);
+
+    CK_RV C_IBM_SignBatch(CK_SESSION_HANDLE, CK_MECHANISM_PTR,
+                          CK_OBJECT_HANDLE, CK_IBM_BATCH_ITEM_PTR, CK_ULONG);
+
+    CK_RV C_IBM_VerifyBatch(CK_SESSION_HANDLE, CK_MECHANISM_PTR,
+                            CK_OBJECT_HANDLE, CK_IBM_BATCH_ITEM_PTR, CK_ULONG);
+
+    CK_RV C_IBM_DigestBatch(CK_SLOT_ID, CK_MECHANISM_PTR,
+                            CK_IBM_DIGEST_ITEM_PTR, CK_ULONG);
+
+    CK_RV C_IBM_GenerateRandom(CK_SLOT_ID, CK_BYTE_PTR, CK_ULONG);
 #ifdef __cplusplus
 }
 #endif
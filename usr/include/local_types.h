@@ -27,25 +27,32 @@ struct bt_ref_hdr {
     volatile unsigned long ref;
 };
 
-#define BT_FLAG_FREE 1
+/*
+ * Handle table slot. A slot is free if its value is NULL. Readers announce
+ * themselves in 'readers' while they obtain a reference to the value, so that
+ * bt_node_free() can wait for them before it drops the table's reference.
+ * Slots are cache line aligned, so that threads using different handles do
+ * not contend on the same cache lines.
+ */
+struct bt_slot {
+    void *volatile value;
+    volatile unsigned long readers;
+    unsigned long next_free;
+} __attribute__((aligned(64)));
 
-/* Binary tree node
- * - 20 bytes on 32bit platform
- * - 40 bytes on 64bit platform
+/*
+ * The slots are kept in chunks that are allocated when needed and never
+ * moved or freed until bt_destroy(), so that readers can access them without
+ * locking. Chunk n holds BT_CHUNK_SLOTS * 2^n slots.
  */
-struct btnode {
-    struct btnode *left;
-    struct btnode *right;
-    struct btnode *parent;
-    unsigned long flags;
-    void *value;
-};
+#define BT_CHUNK_SLOTS      64
+#define BT_NUM_CHUNKS       32
 
-/* Binary tree root */
+/* Handle table root (the name is historical, this used to be a binary tree) */
 struct btree {
-    struct btnode *free_list;
-    struct btnode *top;
-    unsigned long size;
+    struct bt_slot *volatile chunks[BT_NUM_CHUNKS];
+    volatile unsigned long size;
+    unsigned long free_list;
     unsigned long free_nodes;
     pthread_mutex_t mutex;
     void (*delete_func)(void *);
@@ -55,7 +62,6 @@ typedef struct _STDLL_TokData_t STDLL_TokData_t;
 typedef struct _LW_SHM_TYPE LW_SHM_TYPE;
 typedef struct API_Slot API_Slot_t;
 
-struct btnode *bt_get_node(struct btree *t, unsigned long node_num);
 void *bt_get_node_value(struct btree *t, unsigned long node_num);
 int bt_put_node_value(struct btree *t, void *value);
 int bt_is_empty(struct btree *t);
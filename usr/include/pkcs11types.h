@@ -1135,6 +1135,9 @@ typedef struct CK_MECHANISM_INFO {
 #define CKF_MULTI_MESSAGE      0x00000020
 #define CKF_FIND_OBJECTS       0x00000040
 
+/* flags for C_EncryptMessageNext and C_DecryptMessageNext (new for v3.0) */
+#define CKF_END_OF_MESSAGE     0x00000001
+
 /* The flags CKF_ENCRYPT, CKF_DECRYPT, CKF_DIGEST, CKF_SIGN,
  * CKG_SIGN_RECOVER, CKF_VERIFY, CKF_VERIFY_RECOVER,
  * CKF_GENERATE, CKF_GENERATE_KEY_PAIR, CKF_WRAP, CKF_UNWRAP,
@@ -1459,6 +1462,25 @@ typedef struct CK_GCM_PARAMS {
 
 typedef CK_GCM_PARAMS CK_PTR CK_GCM_PARAMS_PTR;
 
+/* new for PKCS#11 v3.0 */
+typedef CK_ULONG CK_GENERATOR_FUNCTION;
+
+#define CKG_NO_GENERATE             0x00000000
+#define CKG_GENERATE                0x00000001
+#define CKG_GENERATE_COUNTER        0x00000002
+#define CKG_GENERATE_RANDOM         0x00000003
+
+typedef struct CK_GCM_MESSAGE_PARAMS {
+    CK_BYTE_PTR pIv;
+    CK_ULONG ulIvLen;
+    CK_ULONG ulIvFixedBits;
+    CK_GENERATOR_FUNCTION ivGenerator;
+    CK_BYTE_PTR pTag;
+    CK_ULONG ulTagBits;
+} CK_GCM_MESSAGE_PARAMS;
+
+typedef CK_GCM_MESSAGE_PARAMS CK_PTR CK_GCM_MESSAGE_PARAMS_PTR;
+
 /*
  * There is a discrepancy between what the PKCS#11 v2.40 standard states in the
  * documentation and the official header file about structure CK_GCM_PARAMS:
@@ -1813,6 +1835,42 @@ typedef struct CK_IBM_FUNCTION_LIST_1_0 CK_IBM_FUNCTION_LIST_1_0;
 typedef struct CK_IBM_FUNCTION_LIST_1_0 CK_PTR CK_IBM_FUNCTION_LIST_1_0_PTR;
 typedef CK_IBM_FUNCTION_LIST_1_0_PTR CK_PTR CK_IBM_FUNCTION_LIST_1_0_PTR_PTR;
 
+typedef struct CK_IBM_FUNCTION_LIST_1_1 CK_IBM_FUNCTION_LIST_1_1;
+typedef struct CK_IBM_FUNCTION_LIST_1_1 CK_PTR CK_IBM_FUNCTION_LIST_1_1_PTR;
+typedef CK_IBM_FUNCTION_LIST_1_1_PTR CK_PTR CK_IBM_FUNCTION_LIST_1_1_PTR_PTR;
+
+/*
+ * One item of C_IBM_SignBatch and C_IBM_VerifyBatch. For C_IBM_SignBatch,
+ * ulSignatureLen is the size of the pSignature buffer on input and the length
+ * of the signature on output. If pSignature is NULL, only the length of the
+ * signature is returned. The result of the item is returned in rv.
+ */
+typedef struct CK_IBM_BATCH_ITEM {
+    CK_BYTE_PTR pData;
+    CK_ULONG ulDataLen;
+    CK_BYTE_PTR pSignature;
+    CK_ULONG ulSignatureLen;
+    CK_RV rv;
+} CK_IBM_BATCH_ITEM;
+
+typedef CK_IBM_BATCH_ITEM CK_PTR CK_IBM_BATCH_ITEM_PTR;
+
+/*
+ * One item of C_IBM_DigestBatch. ulDigestLen is the size of the pDigest
+ * buffer on input and the length of the digest on output. If pDigest is NULL,
+ * only the length of the digest is returned. The result of the item is
+ * returned in rv.
+ */
+typedef struct CK_IBM_DIGEST_ITEM {
+    CK_BYTE_PTR pData;
+    CK_ULONG ulDataLen;
+    CK_BYTE_PTR pDigest;
+    CK_ULONG ulDigestLen;
+    CK_RV rv;
+} CK_IBM_DIGEST_ITEM;
+
+typedef CK_IBM_DIGEST_ITEM CK_PTR CK_IBM_DIGEST_ITEM_PTR;
+
 typedef CK_RV (CK_PTR CK_C_Initialize) (CK_VOID_PTR pReserved);
 typedef CK_RV (CK_PTR CK_C_Finalize) (CK_VOID_PTR pReserved);
 typedef CK_RV (CK_PTR CK_C_Terminate) (void);
@@ -2176,6 +2234,23 @@ typedef CK_RV (CK_PTR CK_C_IBM_ReencryptSingle) (CK_SESSION_HANDLE hSession,
                                                  CK_ULONG ulEncryptedDataLen,
                                                  CK_BYTE_PTR pReencryptedData,
                                                  CK_ULONG_PTR pulReencryptedDataLen);
+typedef CK_RV (CK_PTR CK_C_IBM_SignBatch) (CK_SESSION_HANDLE hSession,
+                                           CK_MECHANISM_PTR pMechanism,
+                                           CK_OBJECT_HANDLE hKey,
+                                           CK_IBM_BATCH_ITEM_PTR pItems,
+                                           CK_ULONG ulCount);
+typedef CK_RV (CK_PTR CK_C_IBM_VerifyBatch) (CK_SESSION_HANDLE hSession,
+                                             CK_MECHANISM_PTR pMechanism,
+                                             CK_OBJECT_HANDLE hKey,
+                                             CK_IBM_BATCH_ITEM_PTR pItems,
+                                             CK_ULONG ulCount);
+typedef CK_RV (CK_PTR CK_C_IBM_DigestBatch) (CK_SLOT_ID slotID,
+                                             CK_MECHANISM_PTR pMechanism,
+                                             CK_IBM_DIGEST_ITEM_PTR pItems,
+                                             CK_ULONG ulCount);
+typedef CK_RV (CK_PTR CK_C_IBM_GenerateRandom) (CK_SLOT_ID slotID,
+                                                CK_BYTE_PTR pRandomData,
+                                                CK_ULONG ulRandomLen);
 
 struct CK_FUNCTION_LIST {
     CK_VERSION version;
@@ -2351,6 +2426,15 @@ struct CK_IBM_FUNCTION_LIST_1_0 {
     CK_C_IBM_ReencryptSingle C_IBM_ReencryptSingle;
 };
 
+struct CK_IBM_FUNCTION_LIST_1_1 {
+    CK_VERSION version;
+    CK_C_IBM_ReencryptSingle C_IBM_ReencryptSingle;
+    CK_C_IBM_SignBatch C_IBM_SignBatch;
+    CK_C_IBM_VerifyBatch C_IBM_VerifyBatch;
+    CK_C_IBM_DigestBatch C_IBM_DigestBatch;
+    CK_C_IBM_GenerateRandom C_IBM_GenerateRandom;
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -138,6 +138,7 @@ typedef struct {
 #define FLAG_STATISTICS_ENABLED       0x02
 #define FLAG_STATISTICS_IMPLICIT      0x04
 #define FLAG_STATISTICS_INTERNAL      0x08
+#define FLAG_LAZY_SLOT_INIT           0x10
 
 #ifdef PKCS64
 
@@ -230,8 +231,12 @@ typedef struct {
     LW_SHM_TYPE *shm_addr;      // token specific shm address
     uint32_t version; // version: major<<16|minor
     char usergroup[LOGIN_NAME_MAX]; // group of users having access to the token
+    uint32_t objstore; // token object store: OBJSTORE_xxx
 } Slot_Info_t_64;
 
+#define OBJSTORE_FILES  0   // one file per token object plus OBJ.IDX
+#define OBJSTORE_LOG    1   // single log-structured file OBJ.LOG
+
 typedef Slot_Info_t_64 SLOT_INFO;
 
 typedef struct {
@@ -324,5 +329,33 @@ static inline int ock_snprintf(char *buf, size_t buflen, const char *fmt, ...)
     return 0;
 }
 
+/*
+ * The session and tokspec counters in Slot_Mgr_Shr_t are updated by all
+ * client processes and by pkcsslotd without holding a lock, so they must
+ * only be changed with these functions.  A counter never drops below 0.
+ */
+static inline uint32 slot_mgr_counter_get(uint32 *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static inline void slot_mgr_counter_add(uint32 *counter, uint32 val)
+{
+    __atomic_add_fetch(counter, val, __ATOMIC_RELAXED);
+}
+
+static inline uint32 slot_mgr_counter_sub(uint32 *counter, uint32 val)
+{
+    uint32 old, res;
+
+    old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    do {
+        res = old > val ? old - val : 0;
+    } while (!__atomic_compare_exchange_n(counter, &old, res, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return res;
+}
+
 
 #endif                          /* _SLOTMGR_H */
@@ -343,6 +343,69 @@ typedef CK_RV (CK_PTR ST_C_SessionCancel)(STDLL_TokData_t *tokdata,
                                           ST_SESSION_T *hSession,
                                           CK_FLAGS flags);
 
+typedef CK_RV (CK_PTR ST_C_MessageEncryptInit)(STDLL_TokData_t *tokdata,
+                                               ST_SESSION_T *hSession,
+                                               CK_MECHANISM_PTR pMechanism,
+                                               CK_OBJECT_HANDLE hKey);
+typedef CK_RV (CK_PTR ST_C_EncryptMessage)(STDLL_TokData_t *tokdata,
+                                           ST_SESSION_T *hSession,
+                                           CK_VOID_PTR pParameter,
+                                           CK_ULONG ulParameterLen,
+                                           CK_BYTE_PTR pAssociatedData,
+                                           CK_ULONG ulAssociatedDataLen,
+                                           CK_BYTE_PTR pPlaintext,
+                                           CK_ULONG ulPlaintextLen,
+                                           CK_BYTE_PTR pCiphertext,
+                                           CK_ULONG_PTR pulCiphertextLen);
+typedef CK_RV (CK_PTR ST_C_EncryptMessageBegin)(STDLL_TokData_t *tokdata,
+                                                ST_SESSION_T *hSession,
+                                                CK_VOID_PTR pParameter,
+                                                CK_ULONG ulParameterLen,
+                                                CK_BYTE_PTR pAssociatedData,
+                                                CK_ULONG ulAssociatedDataLen);
+typedef CK_RV (CK_PTR ST_C_EncryptMessageNext)(STDLL_TokData_t *tokdata,
+                                               ST_SESSION_T *hSession,
+                                               CK_VOID_PTR pParameter,
+                                               CK_ULONG ulParameterLen,
+                                               CK_BYTE_PTR pPlaintextPart,
+                                               CK_ULONG ulPlaintextPartLen,
+                                               CK_BYTE_PTR pCiphertextPart,
+                                            CK_ULONG_PTR pulCiphertextPartLen,
+                                               CK_FLAGS flags);
+typedef CK_RV (CK_PTR ST_C_MessageEncryptFinal)(STDLL_TokData_t *tokdata,
+                                                ST_SESSION_T *hSession);
+typedef CK_RV (CK_PTR ST_C_MessageDecryptInit)(STDLL_TokData_t *tokdata,
+                                               ST_SESSION_T *hSession,
+                                               CK_MECHANISM_PTR pMechanism,
+                                               CK_OBJECT_HANDLE hKey);
+typedef CK_RV (CK_PTR ST_C_DecryptMessage)(STDLL_TokData_t *tokdata,
+                                           ST_SESSION_T *hSession,
+                                           CK_VOID_PTR pParameter,
+                                           CK_ULONG ulParameterLen,
+                                           CK_BYTE_PTR pAssociatedData,
+                                           CK_ULONG ulAssociatedDataLen,
+                                           CK_BYTE_PTR pCiphertext,
+                                           CK_ULONG ulCiphertextLen,
+                                           CK_BYTE_PTR pPlaintext,
+                                           CK_ULONG_PTR pulPlaintextLen);
+typedef CK_RV (CK_PTR ST_C_DecryptMessageBegin)(STDLL_TokData_t *tokdata,
+                                                ST_SESSION_T *hSession,
+                                                CK_VOID_PTR pParameter,
+                                                CK_ULONG ulParameterLen,
+                                                CK_BYTE_PTR pAssociatedData,
+                                                CK_ULONG ulAssociatedDataLen);
+typedef CK_RV (CK_PTR ST_C_DecryptMessageNext)(STDLL_TokData_t *tokdata,
+                                               ST_SESSION_T *hSession,
+                                               CK_VOID_PTR pParameter,
+                                               CK_ULONG ulParameterLen,
+                                               CK_BYTE_PTR pCiphertextPart,
+                                               CK_ULONG ulCiphertextPartLen,
+                                               CK_BYTE_PTR pPlaintextPart,
+                                            CK_ULONG_PTR pulPlaintextPartLen,
+                                               CK_FLAGS flags);
+typedef CK_RV (CK_PTR ST_C_MessageDecryptFinal)(STDLL_TokData_t *tokdata,
+                                                ST_SESSION_T *hSession);
+
 typedef CK_RV (CK_PTR ST_C_IBM_ReencryptSingle)(STDLL_TokData_t *tokdata,
                                                 ST_SESSION_T *hSession,
                                                 CK_MECHANISM_PTR pDecrMech,
@@ -353,6 +416,25 @@ typedef CK_RV (CK_PTR ST_C_IBM_ReencryptSingle)(STDLL_TokData_t *tokdata,
                                                 CK_ULONG ulEncryptedDataLen,
                                                 CK_BYTE_PTR pReencryptedData,
                                             CK_ULONG_PTR pulReencryptedDataLen);
+typedef CK_RV (CK_PTR ST_C_IBM_SignBatch)(STDLL_TokData_t *tokdata,
+                                          ST_SESSION_T *hSession,
+                                          CK_MECHANISM_PTR pMechanism,
+                                          CK_OBJECT_HANDLE hKey,
+                                          CK_IBM_BATCH_ITEM_PTR pItems,
+                                          CK_ULONG ulCount);
+typedef CK_RV (CK_PTR ST_C_IBM_VerifyBatch)(STDLL_TokData_t *tokdata,
+                                            ST_SESSION_T *hSession,
+                                            CK_MECHANISM_PTR pMechanism,
+                                            CK_OBJECT_HANDLE hKey,
+                                            CK_IBM_BATCH_ITEM_PTR pItems,
+                                            CK_ULONG ulCount);
+typedef CK_RV (CK_PTR ST_C_IBM_DigestBatch)(STDLL_TokData_t *tokdata,
+                                            CK_MECHANISM_PTR pMechanism,
+                                            CK_IBM_DIGEST_ITEM_PTR pItems,
+                                            CK_ULONG ulCount);
+typedef CK_RV (CK_PTR ST_C_IBM_GenerateRandom)(STDLL_TokData_t *tokdata,
+                                               CK_BYTE_PTR pRandomData,
+                                               CK_ULONG ulRandomLen);
 
 typedef CK_RV (CK_PTR ST_C_HandleEvent)(STDLL_TokData_t *tokdata,
                                         unsigned int event_type,
@@ -433,7 +515,22 @@ struct ST_FCN_LIST {
     ST_C_CancelFunction ST_CancelFunction;
     ST_C_SessionCancel ST_SessionCancel;
 
+    ST_C_MessageEncryptInit ST_MessageEncryptInit;
+    ST_C_EncryptMessage ST_EncryptMessage;
+    ST_C_EncryptMessageBegin ST_EncryptMessageBegin;
+    ST_C_EncryptMessageNext ST_EncryptMessageNext;
+    ST_C_MessageEncryptFinal ST_MessageEncryptFinal;
+    ST_C_MessageDecryptInit ST_MessageDecryptInit;
+    ST_C_DecryptMessage ST_DecryptMessage;
+    ST_C_DecryptMessageBegin ST_DecryptMessageBegin;
+    ST_C_DecryptMessageNext ST_DecryptMessageNext;
+    ST_C_MessageDecryptFinal ST_MessageDecryptFinal;
+
     ST_C_IBM_ReencryptSingle ST_IBM_ReencryptSingle;
+    ST_C_IBM_SignBatch ST_IBM_SignBatch;
+    ST_C_IBM_VerifyBatch ST_IBM_VerifyBatch;
+    ST_C_IBM_DigestBatch ST_IBM_DigestBatch;
+    ST_C_IBM_GenerateRandom ST_IBM_GenerateRandom;
 
     /* The functions defined below are not part of the external API */
     ST_C_HandleEvent ST_HandleEvent;
@@ -110,6 +110,15 @@ static CK_IBM_FUNCTION_LIST_1_0 func_list_ibm_1_0 = {
     C_IBM_ReencryptSingle
 };
 
+static CK_IBM_FUNCTION_LIST_1_1 func_list_ibm_1_1 = {
+    {1, 1},
+    C_IBM_ReencryptSingle,
+    C_IBM_SignBatch,
+    C_IBM_VerifyBatch,
+    C_IBM_DigestBatch,
+    C_IBM_GenerateRandom
+};
+
 static CK_FUNCTION_LIST func_list_pkcs11_2_40 = {
     {2, 40},
     C_Initialize,
@@ -281,6 +290,8 @@ static CK_FUNCTION_LIST_3_0 func_list_pkcs11_3_0 = {
 
 int slot_loaded[NUMBER_SLOTS_MANAGED];  // Array of flags to indicate
                                        // if the STDLL loaded
+static CK_BBOOL slot_load_pending[NUMBER_SLOTS_MANAGED]; // STDLL to be
+                                                        // loaded on first use
 
 CK_BBOOL in_child_fork_initializer = FALSE;
 CK_BBOOL in_destructor = FALSE;
@@ -300,6 +311,11 @@ static CK_INTERFACE interface_list[] = {
         &func_list_pkcs11_2_40,
         CKF_INTERFACE_FORK_SAFE /*XXX*/
     },
+    {
+        (CK_UTF8CHAR *)"Vendor IBM",
+        &func_list_ibm_1_1,
+        CKF_INTERFACE_FORK_SAFE /*XXX*/
+    },
     {
         (CK_UTF8CHAR *)"Vendor IBM",
         &func_list_ibm_1_0,
@@ -314,6 +330,9 @@ void child_fork_initializer(void)
      * process's trace file, and not in the parent process's once.
      * C_Finalize will pass the new trace handle to the tokens, so that their
      * finalization code will also trace into the new trace file.
+     * Until then, the tokens still use the trace writer of the parent, which
+     * trace_finalize() does not free in a forked child, and trace
+     * synchronously.
      */
     trace_finalize();
     trace_initialize();
@@ -381,6 +400,48 @@ CK_RV C_CancelFunction(CK_SESSION_HANDLE hSession)
     return CKR_FUNCTION_NOT_PARALLEL;   // PER PKCS#11v2.20,Sec 11.16
 }
 
+/*
+ * Checks if the STDLL of a slot is loaded. If opencryptoki.conf specifies
+ * lazy-slot-init, C_Initialize only reports the slots, and the STDLL is
+ * loaded and initialized here on the first use of the slot, i.e. by
+ * C_OpenSession, C_GetTokenInfo, C_GetMechanismList, and the like.
+ */
+static CK_BBOOL slot_dll_loaded(API_Slot_t *sltp, CK_SLOT_ID slotID)
+{
+    CK_RV rc = CKR_OK;
+
+    if (__atomic_load_n(&sltp->DLLoaded, __ATOMIC_ACQUIRE))
+        return TRUE;
+
+    if (!__atomic_load_n(&slot_load_pending[slotID], __ATOMIC_ACQUIRE))
+        return FALSE;
+
+    if (pthread_mutex_lock(&GlobMutex)) {
+        TRACE_ERROR("Global Mutex Lock failed.\n");
+        return FALSE;
+    }
+
+    /* Only try once, a slot that fails to load stays unavailable */
+    if (slot_load_pending[slotID]) {
+        TRACE_DEVEL("Loading STDLL of slot %lu on first use\n", slotID);
+
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rc)
+        slot_loaded[slotID] = DL_Load_and_Init(sltp, slotID, &policy,
+                                               &statistics);
+        END_OPENSSL_LIBCTX(rc)
+
+        if (!slot_loaded[slotID])
+            Anchor->SocketDataP.slot_info[slotID].pk_slot.flags &=
+                                                        ~CKF_TOKEN_PRESENT;
+        __atomic_store_n(&slot_load_pending[slotID], FALSE,
+                         __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&GlobMutex);
+
+    return __atomic_load_n(&sltp->DLLoaded, __ATOMIC_ACQUIRE) && rc == CKR_OK;
+}
+
 //------------------------------------------------------------------------
 // API function C_CloseAllSessions
 //------------------------------------------------------------------------
@@ -393,8 +454,10 @@ CK_RV C_CancelFunction(CK_SESSION_HANDLE hSession)
 //
 //------------------------------------------------------------------------
 
+
 CK_RV C_CloseAllSessions(CK_SLOT_ID slotID)
 {
+    API_Slot_t *sltp;
     CK_RV rc = CKR_OK;
     // Although why does modutil do a close all sessions.  It is a single
     // application it can only close its sessions...
@@ -411,6 +474,12 @@ CK_RV C_CloseAllSessions(CK_SLOT_ID slotID)
         return CKR_SLOT_ID_INVALID;
     }
 
+    sltp = &(Anchor->SltList[slotID]);
+    if (!slot_dll_loaded(sltp, slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+
     /* for every node in the API-level session tree, if the session's slot
      * matches slotID, close it
      */
@@ -450,7 +519,7 @@ CK_RV C_CloseSession(CK_SESSION_HANDLE hSession)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -535,7 +604,7 @@ CK_RV C_CopyObject(CK_SESSION_HANDLE hSession,
     }
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -610,7 +679,7 @@ CK_RV C_CreateObject(CK_SESSION_HANDLE hSession,
     }
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -667,7 +736,7 @@ CK_RV C_Decrypt(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -721,7 +790,7 @@ CK_RV C_DecryptDigestUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -778,7 +847,7 @@ CK_RV C_DecryptFinal(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -833,7 +902,7 @@ CK_RV C_DecryptInit(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -889,7 +958,7 @@ CK_RV C_DecryptUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -943,7 +1012,7 @@ CK_RV C_DecryptVerifyUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1015,7 +1084,7 @@ CK_RV C_DeriveKey(CK_SESSION_HANDLE hSession,
     }
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1070,7 +1139,7 @@ CK_RV C_DestroyObject(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1122,7 +1191,7 @@ CK_RV C_Digest(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1176,7 +1245,7 @@ CK_RV C_DigestEncryptUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1229,7 +1298,7 @@ CK_RV C_DigestFinal(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1279,7 +1348,7 @@ CK_RV C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1328,7 +1397,7 @@ CK_RV C_DigestKey(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1378,7 +1447,7 @@ CK_RV C_DigestUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1430,7 +1499,7 @@ CK_RV C_Encrypt(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1482,7 +1551,7 @@ CK_RV C_EncryptFinal(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1533,7 +1602,7 @@ CK_RV C_EncryptInit(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1586,7 +1655,7 @@ CK_RV C_EncryptUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1776,7 +1845,7 @@ CK_RV C_FindObjects(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1831,7 +1900,7 @@ CK_RV C_FindObjectsFinal(CK_SESSION_HANDLE hSession)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1888,7 +1957,7 @@ CK_RV C_FindObjectsInit(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -1950,7 +2019,7 @@ CK_RV C_GenerateKey(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2021,7 +2090,7 @@ CK_RV C_GenerateKeyPair(CK_SESSION_HANDLE hSession,
 
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2081,7 +2150,7 @@ CK_RV C_GenerateRandom(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2145,7 +2214,7 @@ CK_RV C_GetAttributeValue(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2270,7 +2339,7 @@ CK_RV C_GetMechanismInfo(CK_SLOT_ID slotID,
     }
 
     sltp = &(Anchor->SltList[slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2332,7 +2401,7 @@ CK_RV C_GetMechanismList(CK_SLOT_ID slotID,
     }
 
     sltp = &(Anchor->SltList[slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2400,7 +2469,7 @@ CK_RV C_GetObjectSize(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2456,7 +2525,7 @@ CK_RV C_GetOperationState(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2516,7 +2585,7 @@ CK_RV C_GetSessionInfo(CK_SESSION_HANDLE hSession, CK_SESSION_INFO_PTR pInfo)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2834,7 +2903,7 @@ CK_RV C_GetTokenInfo(CK_SLOT_ID slotID, CK_TOKEN_INFO_PTR pInfo)
 
     sltp = &(Anchor->SltList[slotID]);
     TRACE_DEVEL("Slot p = %p id %lu\n", (void *)sltp, slotID);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -2891,6 +2960,11 @@ CK_RV C_Initialize(CK_VOID_PTR pVoid)
     API_Slot_t *sltp;
     CK_ULONG stat_flags = 0;
     API_Proc_Struct_t *before_anchor;
+#ifdef PKCS64
+    Slot_Info_t_64 *sinfp;
+#else
+    Slot_Info_t *sinfp;
+#endif
 
     /*
      * Lock so that only one thread can run C_Initialize or C_Finalize at
@@ -2999,6 +3073,7 @@ CK_RV C_Initialize(CK_VOID_PTR pVoid)
 
     // Clear out the load list
     memset(slot_loaded, 0, sizeof(int) * NUMBER_SLOTS_MANAGED);
+    memset(slot_load_pending, 0, sizeof(slot_load_pending));
 
     // Zero out API_Proc_Struct
     // This must be done prior to all goto error calls, else bt_destroy()
@@ -3234,15 +3309,31 @@ CK_RV C_Initialize(CK_VOID_PTR pVoid)
     }
     //
     // load all the slot DLL's here
-    BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rc)
-    for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
-        sltp = &(Anchor->SltList[slotID]);
-        slot_loaded[slotID] = DL_Load_and_Init(sltp, slotID, &policy,
-                                               &statistics);
+    if (Anchor->SocketDataP.flags & FLAG_LAZY_SLOT_INIT) {
+        /*
+         * Only report the slots now. The STDLL of a slot is loaded and
+         * initialized on the first use of the slot, see slot_dll_loaded().
+         */
+        for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
+            sinfp = &(Anchor->SocketDataP.slot_info[slotID]);
+            if (sinfp->present == FALSE ||
+                check_user_and_group(sinfp->usergroup) != CKR_OK)
+                continue;
+
+            sinfp->pk_slot.flags |= CKF_TOKEN_PRESENT;
+            slot_load_pending[slotID] = TRUE;
+        }
+    } else {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rc)
+        for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
+            sltp = &(Anchor->SltList[slotID]);
+            slot_loaded[slotID] = DL_Load_and_Init(sltp, slotID, &policy,
+                                                   &statistics);
+        }
+        END_OPENSSL_LIBCTX(rc)
+        if (rc != CKR_OK)
+            goto error_shm;
     }
-    END_OPENSSL_LIBCTX(rc)
-    if (rc != CKR_OK)
-        goto error_shm;
 
     /* Start event receiver thread */
     if ((Anchor->SocketDataP.flags & FLAG_EVENT_SUPPORT_DISABLED) == 0 &&
@@ -3348,7 +3439,7 @@ CK_RV C_InitPIN(CK_SESSION_HANDLE hSession, CK_CHAR_PTR pPin, CK_ULONG ulPinLen)
     }
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3420,7 +3511,7 @@ CK_RV C_InitToken(CK_SLOT_ID slotID,
     }
 
     sltp = &(Anchor->SltList[slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3479,7 +3570,7 @@ CK_RV C_Login(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3533,7 +3624,7 @@ CK_RV C_Logout(CK_SESSION_HANDLE hSession)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3605,7 +3696,7 @@ CK_RV C_OpenSession(CK_SLOT_ID slotID,
     }
 
     sltp = &(Anchor->SltList[slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
         //
@@ -3709,7 +3800,7 @@ CK_RV C_SeedRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSeed,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3774,7 +3865,7 @@ CK_RV C_SetAttributeValue(CK_SESSION_HANDLE hSession,
     }
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3833,7 +3924,7 @@ CK_RV C_SetOperationState(CK_SESSION_HANDLE hSession,
     }
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3897,7 +3988,7 @@ CK_RV C_SetPIN(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -3955,7 +4046,7 @@ CK_RV C_Sign(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4009,7 +4100,7 @@ CK_RV C_SignEncryptUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4065,7 +4156,7 @@ CK_RV C_SignFinal(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4120,7 +4211,7 @@ CK_RV C_SignInit(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4172,7 +4263,7 @@ CK_RV C_SignRecover(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4223,7 +4314,7 @@ CK_RV C_SignRecoverInit(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4278,7 +4369,7 @@ CK_RV C_SignUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4345,7 +4436,7 @@ CK_RV C_UnwrapKey(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4401,7 +4492,7 @@ CK_RV C_Verify(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4452,7 +4543,7 @@ CK_RV C_VerifyFinal(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4503,7 +4594,7 @@ CK_RV C_VerifyInit(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4556,7 +4647,7 @@ CK_RV C_VerifyRecover(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4607,7 +4698,7 @@ CK_RV C_VerifyRecoverInit(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4658,7 +4749,7 @@ CK_RV C_VerifyUpdate(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -4862,7 +4953,7 @@ CK_RV C_WrapKey(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -5018,7 +5109,7 @@ CK_RV C_SessionCancel(CK_SESSION_HANDLE hSession, CK_FLAGS flags)
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -5043,22 +5134,46 @@ CK_RV C_MessageEncryptInit(CK_SESSION_HANDLE hSession,
                            CK_MECHANISM *pMechanism, CK_OBJECT_HANDLE hKey)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pMechanism);
-    UNUSED(hKey);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageEncryptInit\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageEncryptInit) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageEncryptInit(sltp->TokData, &rSession, pMechanism,
+                                        hKey);
+        TRACE_DEVEL("fcn->ST_MessageEncryptInit returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5069,28 +5184,49 @@ CK_RV C_EncryptMessage(CK_SESSION_HANDLE hSession,
                        CK_BYTE *pCiphertext, CK_ULONG *pulCiphertextLen)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pAssociatedData);
-    UNUSED(ulAssociatedDataLen);
-    UNUSED(pPlaintext);
-    UNUSED(ulPlaintextLen);
-    UNUSED(pCiphertext);
-    UNUSED(pulCiphertextLen);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_EncryptMessage\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_EncryptMessage) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_EncryptMessage(sltp->TokData, &rSession, pParameter,
+                                    ulParameterLen, pAssociatedData,
+                                    ulAssociatedDataLen, pPlaintext,
+                                    ulPlaintextLen, pCiphertext,
+                                    pulCiphertextLen);
+        TRACE_DEVEL("fcn->ST_EncryptMessage returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5100,24 +5236,47 @@ CK_RV C_EncryptMessageBegin(CK_SESSION_HANDLE hSession,
                             CK_ULONG ulAssociatedDataLen)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pAssociatedData);
-    UNUSED(ulAssociatedDataLen);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_EncryptMessageBegin\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_EncryptMessageBegin) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_EncryptMessageBegin(sltp->TokData, &rSession, pParameter,
+                                         ulParameterLen, pAssociatedData,
+                                         ulAssociatedDataLen);
+        TRACE_DEVEL("fcn->ST_EncryptMessageBegin returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5130,47 +5289,93 @@ CK_RV C_EncryptMessageNext(CK_SESSION_HANDLE hSession,
                            CK_ULONG flags)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pPlaintextPart);
-    UNUSED(ulPlaintextPartLen);
-    UNUSED(pCiphertextPart);
-    UNUSED(pulCiphertextPartLen);
-    UNUSED(flags);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_EncryptMessageNext\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_EncryptMessageNext) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_EncryptMessageNext(sltp->TokData, &rSession, pParameter,
+                                        ulParameterLen, pPlaintextPart,
+                                        ulPlaintextPartLen, pCiphertextPart,
+                                        pulCiphertextPartLen, flags);
+        TRACE_DEVEL("fcn->ST_EncryptMessageNext returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
 CK_RV C_MessageEncryptFinal(CK_SESSION_HANDLE hSession)
 {
     CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
-    UNUSED(hSession);
-
-    TRACE_INFO("C_EncryptMessageFinal\n");
-
+    TRACE_INFO("C_MessageEncryptFinal\n");
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageEncryptFinal) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageEncryptFinal(sltp->TokData, &rSession);
+        TRACE_DEVEL("fcn->ST_MessageEncryptFinal returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5178,22 +5383,46 @@ CK_RV C_MessageDecryptInit(CK_SESSION_HANDLE hSession,
                            CK_MECHANISM *pMechanism, CK_OBJECT_HANDLE hKey)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pMechanism);
-    UNUSED(hKey);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageDecryptInit\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageDecryptInit) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageDecryptInit(sltp->TokData, &rSession, pMechanism,
+                                        hKey);
+        TRACE_DEVEL("fcn->ST_MessageDecryptInit returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5204,28 +5433,49 @@ CK_RV C_DecryptMessage(CK_SESSION_HANDLE hSession,
                        CK_BYTE *pPlaintext, CK_ULONG *pulPlaintextLen)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pAssociatedData);
-    UNUSED(ulAssociatedDataLen);
-    UNUSED(pCiphertext);
-    UNUSED(ulCiphertextLen);
-    UNUSED(pPlaintext);
-    UNUSED(pulPlaintextLen);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_DecryptMessage\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_DecryptMessage) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_DecryptMessage(sltp->TokData, &rSession, pParameter,
+                                    ulParameterLen, pAssociatedData,
+                                    ulAssociatedDataLen, pCiphertext,
+                                    ulCiphertextLen, pPlaintext,
+                                    pulPlaintextLen);
+        TRACE_DEVEL("fcn->ST_DecryptMessage returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5235,24 +5485,47 @@ CK_RV C_DecryptMessageBegin(CK_SESSION_HANDLE hSession,
                             CK_ULONG ulAssociatedDataLen)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pAssociatedData);
-    UNUSED(ulAssociatedDataLen);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_DecryptMessageBegin\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_DecryptMessageBegin) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_DecryptMessageBegin(sltp->TokData, &rSession, pParameter,
+                                         ulParameterLen, pAssociatedData,
+                                         ulAssociatedDataLen);
+        TRACE_DEVEL("fcn->ST_DecryptMessageBegin returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5265,47 +5538,93 @@ CK_RV C_DecryptMessageNext(CK_SESSION_HANDLE hSession,
                            CK_FLAGS flags)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pCiphertextPart);
-    UNUSED(ulCiphertextPartLen);
-    UNUSED(pPlaintextPart);
-    UNUSED(pulPlaintextPartLen);
-    UNUSED(flags);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_DecryptMessageNext\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_DecryptMessageNext) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_DecryptMessageNext(sltp->TokData, &rSession, pParameter,
+                                        ulParameterLen, pCiphertextPart,
+                                        ulCiphertextPartLen, pPlaintextPart,
+                                        pulPlaintextPartLen, flags);
+        TRACE_DEVEL("fcn->ST_DecryptMessageNext returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
 CK_RV C_MessageDecryptFinal(CK_SESSION_HANDLE hSession)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageDecryptFinal\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageDecryptFinal) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageDecryptFinal(sltp->TokData, &rSession);
+        TRACE_DEVEL("fcn->ST_MessageDecryptFinal returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5591,7 +5910,7 @@ CK_RV C_IBM_ReencryptSingle(CK_SESSION_HANDLE hSession,
     TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
     sltp = &(Anchor->SltList[rSession.slotID]);
-    if (sltp->DLLoaded == FALSE) {
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
         return CKR_TOKEN_NOT_PRESENT;
     }
@@ -5619,6 +5938,223 @@ CK_RV C_IBM_ReencryptSingle(CK_SESSION_HANDLE hSession,
     return rv;
 }
 
+CK_RV C_IBM_SignBatch(CK_SESSION_HANDLE hSession,
+                      CK_MECHANISM_PTR pMechanism,
+                      CK_OBJECT_HANDLE hKey,
+                      CK_IBM_BATCH_ITEM_PTR pItems,
+                      CK_ULONG ulCount)
+{
+    CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
+
+    TRACE_INFO("C_IBM_SignBatch\n");
+    if (API_Initialized() == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+    if (!pItems && ulCount > 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_IBM_SignBatch) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_IBM_SignBatch(sltp->TokData, &rSession, pMechanism,
+                                   hKey, pItems, ulCount);
+        TRACE_DEVEL("fcn->ST_IBM_SignBatch returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
+    }
+
+    return rv;
+}
+
+CK_RV C_IBM_VerifyBatch(CK_SESSION_HANDLE hSession,
+                        CK_MECHANISM_PTR pMechanism,
+                        CK_OBJECT_HANDLE hKey,
+                        CK_IBM_BATCH_ITEM_PTR pItems,
+                        CK_ULONG ulCount)
+{
+    CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
+
+    TRACE_INFO("C_IBM_VerifyBatch\n");
+    if (API_Initialized() == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+    if (!pItems && ulCount > 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (!slot_dll_loaded(sltp, rSession.slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_IBM_VerifyBatch) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        BEGIN_HSM_MK_CHANGE_LOCK(sltp, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_IBM_VerifyBatch(sltp->TokData, &rSession, pMechanism,
+                                     hKey, pItems, ulCount);
+        TRACE_DEVEL("fcn->ST_IBM_VerifyBatch returned: 0x%lx\n", rv);
+        END_HSM_MK_CHANGE_LOCK(sltp, rv)
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
+    }
+
+    return rv;
+}
+
+/*
+ * C_IBM_DigestBatch and C_IBM_GenerateRandom do not use a session and no
+ * keys, so they neither look up a session nor take the HSM MK change lock.
+ */
+CK_RV C_IBM_DigestBatch(CK_SLOT_ID slotID,
+                        CK_MECHANISM_PTR pMechanism,
+                        CK_IBM_DIGEST_ITEM_PTR pItems,
+                        CK_ULONG ulCount)
+{
+    CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+
+    TRACE_INFO("C_IBM_DigestBatch %lu\n", slotID);
+    if (API_Initialized() == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+    if (!pItems && ulCount > 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (slotID >= NUMBER_SLOTS_MANAGED) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SLOT_ID_INVALID));
+        return CKR_SLOT_ID_INVALID;
+    }
+
+    sltp = &(Anchor->SltList[slotID]);
+    if (!slot_dll_loaded(sltp, slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_IBM_DigestBatch) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        rv = fcn->ST_IBM_DigestBatch(sltp->TokData, pMechanism, pItems,
+                                     ulCount);
+        TRACE_DEVEL("fcn->ST_IBM_DigestBatch returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
+    }
+
+    return rv;
+}
+
+CK_RV C_IBM_GenerateRandom(CK_SLOT_ID slotID,
+                           CK_BYTE_PTR pRandomData,
+                           CK_ULONG ulRandomLen)
+{
+    CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+
+    TRACE_INFO("C_IBM_GenerateRandom %lu\n", slotID);
+    if (API_Initialized() == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!pRandomData && ulRandomLen != 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (slotID >= NUMBER_SLOTS_MANAGED) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SLOT_ID_INVALID));
+        return CKR_SLOT_ID_INVALID;
+    }
+
+    sltp = &(Anchor->SltList[slotID]);
+    if (!slot_dll_loaded(sltp, slotID)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_IBM_GenerateRandom) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        rv = fcn->ST_IBM_GenerateRandom(sltp->TokData, pRandomData,
+                                        ulRandomLen);
+        TRACE_DEVEL("fcn->ST_IBM_GenerateRandom returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
+    }
+
+    return rv;
+}
+
 #if defined(__sun) || defined(_AIX)
 #pragma init(api_init)
 #else
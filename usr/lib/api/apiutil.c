@@ -250,12 +250,17 @@ void get_sess_counts(CK_SLOT_ID slotID, CK_ULONG *ret, CK_ULONG *rw_ret)
     Slot_Mgr_Shr_t *shm;
 
     shm = Anchor->SharedMemP;
-    ProcLock();
-    *ret = shm->slot_global_sessions[slotID];
-    *rw_ret = shm->slot_global_rw_sessions[slotID];
-    ProcUnLock();
+    *ret = slot_mgr_counter_get(&shm->slot_global_sessions[slotID]);
+    *rw_ret = slot_mgr_counter_get(&shm->slot_global_rw_sessions[slotID]);
 }
 
+/*
+ * The session and tokspec counters are updated with atomic operations, so
+ * that opening and closing sessions does not serialize all processes on
+ * the ProcLock. The entry of this process in the process table stays valid
+ * until API_UnRegister, and pkcsslotd only cleans up entries of processes
+ * that have exited.
+ */
 void incr_sess_counts(CK_SLOT_ID slotID, CK_BBOOL rw_session)
 {
     Slot_Mgr_Shr_t *shm;
@@ -265,21 +270,16 @@ void incr_sess_counts(CK_SLOT_ID slotID, CK_BBOOL rw_session)
     Slot_Mgr_Proc_t *procp;
 #endif
 
-    // Get the slot mutex
     shm = Anchor->SharedMemP;
 
-    ProcLock();
-
-    shm->slot_global_sessions[slotID]++;
+    slot_mgr_counter_add(&shm->slot_global_sessions[slotID], 1);
     if (rw_session)
-        shm->slot_global_rw_sessions[slotID]++;
+        slot_mgr_counter_add(&shm->slot_global_rw_sessions[slotID], 1);
 
     procp = &shm->proc_table[Anchor->MgrProcIndex];
-    procp->slot_session_count[slotID]++;
+    slot_mgr_counter_add(&procp->slot_session_count[slotID], 1);
     if (rw_session)
-        procp->slot_rw_session_count[slotID]++;
-
-    ProcUnLock();
+        slot_mgr_counter_add(&procp->slot_rw_session_count[slotID], 1);
 }
 
 void decr_sess_counts(CK_SLOT_ID slotID, CK_BBOOL rw_session)
@@ -291,43 +291,26 @@ void decr_sess_counts(CK_SLOT_ID slotID, CK_BBOOL rw_session)
     Slot_Mgr_Proc_t *procp;
 #endif
 
-    // Get the slot mutex
     shm = Anchor->SharedMemP;
 
-    ProcLock();
-
-    if (shm->slot_global_sessions[slotID] > 0) {
-        shm->slot_global_sessions[slotID]--;
-    }
-    if (rw_session && shm->slot_global_rw_sessions[slotID] > 0) {
-        shm->slot_global_rw_sessions[slotID]--;
-    }
+    slot_mgr_counter_sub(&shm->slot_global_sessions[slotID], 1);
+    if (rw_session)
+        slot_mgr_counter_sub(&shm->slot_global_rw_sessions[slotID], 1);
 
     procp = &shm->proc_table[Anchor->MgrProcIndex];
-    if (procp->slot_session_count[slotID] > 0) {
-        procp->slot_session_count[slotID]--;
-    }
-    if (rw_session && procp->slot_rw_session_count[slotID] > 0) {
-        procp->slot_rw_session_count[slotID]--;
-    }
-
-    ProcUnLock();
+    slot_mgr_counter_sub(&procp->slot_session_count[slotID], 1);
+    if (rw_session)
+        slot_mgr_counter_sub(&procp->slot_rw_session_count[slotID], 1);
 }
 
 uint32_t get_tokspec_count(STDLL_TokData_t *tokdata)
 {
     Slot_Mgr_Shr_t *shm;
-    uint32_t ret;
 
     shm = Anchor->SharedMemP;
-    if (ProcLock() != CKR_OK)
-        return 0;
-
-    ret = shm->slot_global_tokspec_count[tokdata->slot_id];
-
-    ProcUnLock();
 
-    return ret;
+    return slot_mgr_counter_get(
+                        &shm->slot_global_tokspec_count[tokdata->slot_id]);
 }
 
 void incr_tokspec_count(STDLL_TokData_t *tokdata)
@@ -339,17 +322,12 @@ void incr_tokspec_count(STDLL_TokData_t *tokdata)
     Slot_Mgr_Proc_t *procp;
 #endif
 
-    // Get the slot mutex
     shm = Anchor->SharedMemP;
 
-    ProcLock();
-
-    shm->slot_global_tokspec_count[tokdata->slot_id]++;
+    slot_mgr_counter_add(&shm->slot_global_tokspec_count[tokdata->slot_id], 1);
 
     procp = &shm->proc_table[Anchor->MgrProcIndex];
-    procp->slot_tokspec_count[tokdata->slot_id]++;
-
-    ProcUnLock();
+    slot_mgr_counter_add(&procp->slot_tokspec_count[tokdata->slot_id], 1);
 }
 
 void decr_tokspec_count(STDLL_TokData_t *tokdata)
@@ -361,19 +339,12 @@ void decr_tokspec_count(STDLL_TokData_t *tokdata)
     Slot_Mgr_Proc_t *procp;
 #endif
 
-    // Get the slot mutex
     shm = Anchor->SharedMemP;
 
-    ProcLock();
-
-    if (shm->slot_global_tokspec_count[tokdata->slot_id] > 0)
-        shm->slot_global_tokspec_count[tokdata->slot_id]--;
+    slot_mgr_counter_sub(&shm->slot_global_tokspec_count[tokdata->slot_id], 1);
 
     procp = &shm->proc_table[Anchor->MgrProcIndex];
-    if (procp->slot_tokspec_count[tokdata->slot_id] > 0)
-        procp->slot_tokspec_count[tokdata->slot_id]--;
-
-    ProcUnLock();
+    slot_mgr_counter_sub(&procp->slot_tokspec_count[tokdata->slot_id], 1);
 }
 
 // Check if any sessions from other applicaitons exist on this particular
@@ -388,12 +359,9 @@ int sessions_exist(CK_SLOT_ID slotID)
     Slot_Mgr_Shr_t *shm;
     uint32 numSessions;
 
-    // Get the slot mutex
     shm = Anchor->SharedMemP;
 
-    ProcLock();
-    numSessions = shm->slot_global_sessions[slotID];
-    ProcUnLock();
+    numSessions = slot_mgr_counter_get(&shm->slot_global_sessions[slotID]);
 
     return numSessions != 0;
 }
@@ -827,12 +795,16 @@ int DL_Load_and_Init(API_Slot_t *sltp, CK_SLOT_ID slotID, policy_t policy,
         sltp->DLLoaded = FALSE;
         return FALSE;
     } else {
-        sltp->DLLoaded = TRUE;
         sinfp->pk_slot.flags |= CKF_TOKEN_PRESENT;
         // Check if a SC_Finalize function has been exported
         *(void **)(&sltp->pSTfini) = dlsym(sltp->dlop_p, "SC_Finalize");
         *(void **)(&sltp->pSTcloseall) =
             dlsym(sltp->dlop_p, "SC_CloseAllSessions");
+        /*
+         * With lazy slot initialization, other threads check DLLoaded
+         * without holding the global mutex.
+         */
+        __atomic_store_n(&sltp->DLLoaded, TRUE, __ATOMIC_RELEASE);
         return TRUE;
     }
 
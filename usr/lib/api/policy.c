@@ -47,6 +47,19 @@ extern CK_RV get_sha_size(CK_ULONG mech, CK_ULONG *hsize);
 
 #define OCK_POLICY_PERMS (0640u)
 
+/* Number of decision cache entries if policy.conf does not specify it */
+#define POLICY_DECISION_CACHE_DEFAULT   64u
+#define POLICY_DECISION_CACHE_MAX       4096u
+
+/* Words of a decision cache key, see policy_decision_key() */
+#define POLICY_DECISION_KEY_WORDS       8
+
+/* Flags in the second word of a decision cache key */
+#define POLICY_DECISION_HAS_STRENGTH    0x100ul
+#define POLICY_DECISION_KEY_ALLOWED     0x200ul
+#define POLICY_DECISION_HAS_PARAM       0x400ul
+#define POLICY_DECISION_HAS_SUBPARAM    0x800ul
+
 struct strength {
     union {
         CK_ULONG arr[5];
@@ -62,6 +75,18 @@ struct strength {
     CK_BBOOL set;
 };
 
+/*
+ * One entry of the policy decision cache.  The entries are protected by a
+ * sequence count that is odd while a writer updates the entry.  Readers
+ * never block: they simply treat an entry that changes under them as a
+ * miss.
+ */
+struct policy_decision {
+    CK_ULONG seq;
+    CK_ULONG key[POLICY_DECISION_KEY_WORDS];
+    CK_ULONG rv;
+};
+
 struct policy_private {
     struct hashmap   *allowedmechs;
     const struct _ec **allowedcurves;
@@ -75,27 +100,73 @@ struct policy_private {
     CK_ULONG           maxcurvesize;
     /* Strength struct ordered from highest to lowest. */
     struct strength strengths[NUM_SUPPORTED_STRENGTHS];
+    /* Results of policy_is_mech_allowed.  Size is 0 or a power of 2. */
+    struct policy_decision *decisions;
+    CK_ULONG           numdecisions;
+    CK_ULONG           decisionhits;
+    CK_ULONG           decisionmisses;
 };
 
 static CK_ULONG policy_get_sym_key_strength(policy_t p, CK_ULONG sym_key_bits);
 
+static CK_RV policy_decision_cache_init(struct policy_private *pp,
+                                        CK_ULONG size)
+{
+    CK_ULONG num = 1;
+
+    free(pp->decisions);
+    pp->decisions = NULL;
+    pp->numdecisions = 0;
+    if (size == 0)
+        return CKR_OK;
+    if (size > POLICY_DECISION_CACHE_MAX)
+        size = POLICY_DECISION_CACHE_MAX;
+    while (num < size)
+        num <<= 1;
+    pp->decisions = calloc(num, sizeof(struct policy_decision));
+    if (pp->decisions == NULL) {
+        TRACE_ERROR("Could not allocate policy decision cache!\n");
+        return CKR_HOST_MEMORY;
+    }
+    pp->numdecisions = num;
+    return CKR_OK;
+}
+
 struct policy_private *policy_private_alloc(void)
 {
-    return calloc(1, sizeof(struct policy_private));
+    struct policy_private *pp;
+
+    pp = calloc(1, sizeof(struct policy_private));
+    if (pp && policy_decision_cache_init(pp, POLICY_DECISION_CACHE_DEFAULT)
+                                                                != CKR_OK) {
+        free(pp);
+        pp = NULL;
+    }
+    return pp;
 }
 
 struct policy_private *policy_private_free(struct policy_private *pp)
 {
     if (pp) {
+        TRACE_DEVEL("POLICY: decision cache hits: %lu, misses: %lu\n",
+                    pp->decisionhits, pp->decisionmisses);
         if (pp->allowedmechs)
             hashmap_free(pp->allowedmechs, NULL);
         if (pp->allowedcurves)
             free(pp->allowedcurves);
+        free(pp->decisions);
         free(pp);
     }
     return NULL;
 }
 
+void policy_private_get_decision_stats(struct policy_private *pp,
+                                       CK_ULONG *hits, CK_ULONG *misses)
+{
+    *hits = __atomic_load_n(&pp->decisionhits, __ATOMIC_RELAXED);
+    *misses = __atomic_load_n(&pp->decisionmisses, __ATOMIC_RELAXED);
+}
+
 void policy_private_deactivate(struct policy_private *pp)
 {
     hashmap_free(pp->allowedmechs, NULL);
@@ -111,6 +182,10 @@ void policy_private_deactivate(struct policy_private *pp)
     pp->allowedvendorkdfs = ~0lu;
     pp->allowedprfs = ~0lu;
     pp->maxcurvesize = 521u;
+    /* Forget decisions taken under the previous settings. */
+    if (pp->decisions)
+        memset(pp->decisions, 0,
+               pp->numdecisions * sizeof(struct policy_decision));
 }
 
 static void policy_compute_strength(struct policy_private *pp,
@@ -902,9 +977,9 @@ static CK_RV policy_store_object_strength(policy_t p, struct objstrength *s,
     return rv;
 }
 
-static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
-                                    struct objstrength *s, int check,
-                                    SESSION *sess)
+static CK_RV policy_check_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
+                                       struct objstrength *s, int check,
+                                       SESSION *sess)
 {
     struct policy_private *pp = p->priv;
     struct objstrength tmp_strength = { 0, 0, CK_TRUE };
@@ -1136,6 +1211,203 @@ static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
         }
     }
  out:
+    return rv;
+}
+
+/*
+ * Build the decision cache key of a policy_is_mech_allowed() call.  It
+ * contains everything the checks above depend on: the mechanism, the kind
+ * of check, the key strength, and the parameter fields inspected by the
+ * deep checks.  For all other mechanisms, a CK_ULONG sized parameter is
+ * taken into the key since it may be the length of a general MAC.
+ */
+static void policy_decision_key(CK_MECHANISM_PTR mech, struct objstrength *s,
+                                int check, CK_ULONG *key)
+{
+    CK_RSA_PKCS_OAEP_PARAMS *oaep_params;
+    void *param = mech->pParameter;
+    CK_ULONG len = mech->ulParameterLen;
+
+    key[0] = mech->mechanism;
+    key[1] = check;
+    key[2] = key[3] = 0;
+    if (s) {
+        key[1] |= POLICY_DECISION_HAS_STRENGTH;
+        if (s->allowed)
+            key[1] |= POLICY_DECISION_KEY_ALLOWED;
+        key[2] = s->strength;
+        key[3] = s->siglen;
+    }
+    key[4] = len;
+    key[5] = key[6] = key[7] = 0;
+    if (param == NULL)
+        return;
+    key[1] |= POLICY_DECISION_HAS_PARAM;
+
+    switch (mech->mechanism) {
+    case CKM_RSA_PKCS_PSS:
+    case CKM_SHA1_RSA_PKCS_PSS:
+    case CKM_SHA224_RSA_PKCS_PSS:
+    case CKM_SHA256_RSA_PKCS_PSS:
+    case CKM_SHA384_RSA_PKCS_PSS:
+    case CKM_SHA512_RSA_PKCS_PSS:
+    case CKM_SHA3_224_RSA_PKCS_PSS:
+    case CKM_SHA3_256_RSA_PKCS_PSS:
+    case CKM_SHA3_384_RSA_PKCS_PSS:
+    case CKM_SHA3_512_RSA_PKCS_PSS:
+        if (len == sizeof(CK_RSA_PKCS_PSS_PARAMS)) {
+            key[5] = ((CK_RSA_PKCS_PSS_PARAMS *)param)->hashAlg;
+            key[6] = ((CK_RSA_PKCS_PSS_PARAMS *)param)->mgf;
+        }
+        break;
+    case CKM_RSA_PKCS_OAEP:
+        if (len == sizeof(CK_RSA_PKCS_OAEP_PARAMS)) {
+            key[5] = ((CK_RSA_PKCS_OAEP_PARAMS *)param)->hashAlg;
+            key[6] = ((CK_RSA_PKCS_OAEP_PARAMS *)param)->mgf;
+        }
+        break;
+    case CKM_ECDH1_DERIVE:
+        if (len == sizeof(CK_ECDH1_DERIVE_PARAMS))
+            key[5] = ((CK_ECDH1_DERIVE_PARAMS *)param)->kdf;
+        break;
+    case CKM_IBM_ECDSA_OTHER:
+        if (len == sizeof(CK_IBM_ECDSA_OTHER_PARAMS))
+            key[5] = ((CK_IBM_ECDSA_OTHER_PARAMS *)param)->submechanism;
+        break;
+    case CKM_IBM_BTC_DERIVE:
+        if (len == sizeof(CK_IBM_BTC_DERIVE_PARAMS)) {
+            key[5] = ((CK_IBM_BTC_DERIVE_PARAMS *)param)->version;
+            key[6] = ((CK_IBM_BTC_DERIVE_PARAMS *)param)->type;
+        }
+        break;
+    case CKM_IBM_KYBER:
+        if (len == sizeof(CK_IBM_KYBER_PARAMS))
+            key[5] = ((CK_IBM_KYBER_PARAMS *)param)->kdf;
+        break;
+    case CKM_RSA_AES_KEY_WRAP:
+        if (len == sizeof(CK_RSA_AES_KEY_WRAP_PARAMS)) {
+            key[5] = ((CK_RSA_AES_KEY_WRAP_PARAMS *)param)->ulAESKeyBits;
+            oaep_params = ((CK_RSA_AES_KEY_WRAP_PARAMS *)param)->pOAEPParams;
+            if (oaep_params != NULL) {
+                key[1] |= POLICY_DECISION_HAS_SUBPARAM;
+                key[6] = oaep_params->hashAlg;
+                key[7] = oaep_params->mgf;
+            }
+        }
+        break;
+    case CKM_ECDH_AES_KEY_WRAP:
+        if (len == sizeof(CK_ECDH_AES_KEY_WRAP_PARAMS)) {
+            key[5] = ((CK_ECDH_AES_KEY_WRAP_PARAMS *)param)->kdf;
+            key[6] = ((CK_ECDH_AES_KEY_WRAP_PARAMS *)param)->ulAESKeyBits;
+        }
+        break;
+    default:
+        if (len == sizeof(CK_MAC_GENERAL_PARAMS))
+            key[5] = *(CK_MAC_GENERAL_PARAMS *)param;
+        break;
+    }
+}
+
+static struct policy_decision *policy_decision_entry(struct policy_private *pp,
+                                                     const CK_ULONG *key)
+{
+    /* Independent multiplications so that the words hash in parallel. */
+    static const CK_ULONG mult[POLICY_DECISION_KEY_WORDS] = {
+        0x9e3779b1u, 0x85ebca77u, 0xc2b2ae3du, 0x27d4eb2fu,
+        0x165667b1u, 0xd3a2646cu, 0xfd7046c5u, 0xb55a4f09u
+    };
+    CK_ULONG h = 0;
+    unsigned int i;
+
+    for (i = 0; i < POLICY_DECISION_KEY_WORDS; ++i)
+        h ^= key[i] * mult[i];
+    h ^= h >> 16;
+    return &pp->decisions[h & (pp->numdecisions - 1)];
+}
+
+static CK_BBOOL policy_decision_lookup(struct policy_private *pp,
+                                       const CK_ULONG *key, CK_RV *rv)
+{
+    struct policy_decision *d = policy_decision_entry(pp, key);
+    CK_ULONG seq, val = 0;
+    CK_BBOOL hit = CK_FALSE;
+    unsigned int i;
+
+    /* A sequence count of 0 denotes a never used entry. */
+    seq = __atomic_load_n(&d->seq, __ATOMIC_ACQUIRE);
+    if (seq != 0 && (seq & 1) == 0) {
+        for (i = 0; i < POLICY_DECISION_KEY_WORDS; ++i) {
+            if (__atomic_load_n(&d->key[i], __ATOMIC_RELAXED) != key[i])
+                break;
+        }
+        val = __atomic_load_n(&d->rv, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        hit = (i == POLICY_DECISION_KEY_WORDS &&
+               __atomic_load_n(&d->seq, __ATOMIC_RELAXED) == seq);
+    }
+    /* The counters are statistics only.  Do not pay for a locked
+       increment; an update lost to a concurrent thread does not matter. */
+    if (hit) {
+        __atomic_store_n(&pp->decisionhits,
+                         __atomic_load_n(&pp->decisionhits,
+                                         __ATOMIC_RELAXED) + 1,
+                         __ATOMIC_RELAXED);
+        *rv = val;
+    } else {
+        __atomic_store_n(&pp->decisionmisses,
+                         __atomic_load_n(&pp->decisionmisses,
+                                         __ATOMIC_RELAXED) + 1,
+                         __ATOMIC_RELAXED);
+    }
+    return hit;
+}
+
+static void policy_decision_store(struct policy_private *pp,
+                                  const CK_ULONG *key, CK_RV rv)
+{
+    struct policy_decision *d = policy_decision_entry(pp, key);
+    CK_ULONG seq;
+    unsigned int i;
+
+    /* If another thread is updating this entry, just leave it to it. */
+    seq = __atomic_load_n(&d->seq, __ATOMIC_RELAXED);
+    if ((seq & 1) != 0 ||
+        !__atomic_compare_exchange_n(&d->seq, &seq, seq + 1, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (i = 0; i < POLICY_DECISION_KEY_WORDS; ++i)
+        __atomic_store_n(&d->key[i], key[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&d->rv, rv, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * The policy cannot change after it was loaded.  Hence the result of the
+ * checks only depends on the decision cache key and can be remembered.
+ * Only allowed decisions are remembered: a denied request runs the checks
+ * again, so that every policy violation is still traced with its reason.
+ */
+static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
+                                    struct objstrength *s, int check,
+                                    SESSION *sess)
+{
+    struct policy_private *pp = p->priv;
+    CK_ULONG key[POLICY_DECISION_KEY_WORDS];
+    CK_RV rv;
+
+    if (pp == NULL)
+        return CKR_OK;
+    if (pp->numdecisions == 0) {
+        rv = policy_check_mech_allowed(p, mech, s, check, sess);
+    } else {
+        policy_decision_key(mech, s, check, key);
+        if (!policy_decision_lookup(pp, key, &rv)) {
+            rv = policy_check_mech_allowed(p, mech, s, check, sess);
+            if (rv == CKR_OK)
+                policy_decision_store(pp, key, rv);
+        }
+    }
     if (rv != CKR_OK && sess)
         sess->session_info.ulDeviceError = CKR_POLICY_VIOLATION;
     return rv;
@@ -1942,7 +2214,7 @@ CK_RV policy_load_policy_cfg(struct policy_private *pp,
                              FILE *fp, CK_BBOOL *restricting)
 {
     struct ConfigBaseNode *cfg, *strength, *allowedmechs, *allowedcurves,
-        *allowedmgfs, *allowedkdfs, *allowedprfs;
+        *allowedmgfs, *allowedkdfs, *allowedprfs, *decisioncache;
     unsigned long reqstrength;
     CK_RV rc = CKR_OK;
     unsigned int vers;
@@ -2074,6 +2346,21 @@ CK_RV policy_load_policy_cfg(struct policy_private *pp,
         if (rc != CKR_OK)
             goto out;
     }
+    decisioncache = confignode_find(cfg, "decisioncache");
+    if (!decisioncache) {
+        TRACE_DEVEL("POLICY: Default decision cache size\n");
+    } else if (!confignode_hastype(decisioncache, CT_INTVAL)) {
+        TRACE_ERROR("POLICY: decisioncache has wrong type!\n");
+        OCK_SYSLOG(LOG_ERR, "POLICY: decisioncache has wrong type!\n");
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    } else {
+        decisioncache->flags = 1;
+        rc = policy_decision_cache_init(pp,
+                               confignode_to_intval(decisioncache)->value);
+        if (rc != CKR_OK)
+            goto out;
+    }
  out:
     if (rc == CKR_OK)
         rc = policy_check_unmarked(cfg);
@@ -244,7 +244,12 @@ static int handle_event(API_Proc_Struct_t *anchor, event_msg_t *event,
 
     for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
         sltp = &anchor->SltList[slotID];
-        if (sltp->DLLoaded == FALSE || sltp->FcnList == NULL)
+        /*
+         * Not via slot_dll_loaded(): an event must not load the STDLL of a
+         * lazily initialized slot. The slot has no state to update yet.
+         */
+        if (!__atomic_load_n(&sltp->DLLoaded, __ATOMIC_ACQUIRE) ||
+            sltp->FcnList == NULL)
             continue;
 
         if (!match_token_label_filter(event, sltp))
@@ -13,6 +13,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <stddef.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -24,6 +27,88 @@
 
 #define COMPARE_SYMMETRIC     2
 
+/*
+ * Returns the counters of the shard of the CPU the caller runs on. The thread
+ * may be moved to another CPU at any time, so the counters are still updated
+ * atomically, but usually without contention.
+ */
+static CK_BYTE *statistics_shard(struct statistics *statistics)
+{
+    int cpu = 0;
+
+#if !defined(_AIX)
+    cpu = sched_getcpu();
+    if (cpu < 0)
+        cpu = 0;
+#endif
+
+    return statistics->shm_data + STAT_SHM_HDR_SIZE +
+                (cpu % statistics->num_shards) * statistics->shard_size;
+}
+
+/*
+ * Returns the number of shards for a new statistics shared memory segment:
+ * one per configured CPU, so that CPUs do not share a shard, but at most
+ * STAT_MAX_SHARDS, since each shard holds the counters of all slots.
+ */
+static CK_ULONG statistics_num_shards(void)
+{
+    long cpus = 1;
+
+#if !defined(_AIX)
+    cpus = sysconf(_SC_NPROCESSORS_CONF);
+#endif
+    if (cpus < 1)
+        return 1;
+    if (cpus > STAT_MAX_SHARDS)
+        return STAT_MAX_SHARDS;
+
+    return cpus;
+}
+
+/*
+ * Checks the header of an existing statistics shared memory segment of the
+ * given size. Returns CKR_OK and takes over its number of shards if it has
+ * the expected layout, or CKR_DATA_INVALID if the segment has no valid
+ * header or counters for another slot configuration and must be initialized.
+ * A segment with the header of another layout version is rejected.
+ */
+static CK_RV statistics_check_header(struct statistics *statistics, int fd,
+                                     CK_ULONG size)
+{
+    struct stat_shm_header hdr;
+
+    if (size < STAT_SHM_HDR_SIZE)
+        return CKR_DATA_INVALID;
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        TRACE_ERROR("Failed to read SHM '%s': %s\n",
+                    statistics->shm_name, strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (hdr.magic != STAT_SHM_MAGIC)
+        return CKR_DATA_INVALID;
+
+    if (hdr.version != STAT_SHM_VERSION) {
+        TRACE_ERROR("SHM '%s' has layout version %lu, expected %u\n",
+                    statistics->shm_name, hdr.version, STAT_SHM_VERSION);
+        OCK_SYSLOG(LOG_ERR, "SHM '%s' has layout version %lu, expected %u, "
+                   "delete it with 'pkcsstats --delete'\n",
+                   statistics->shm_name, hdr.version, STAT_SHM_VERSION);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (hdr.num_shards == 0 || hdr.num_shards > STAT_MAX_SHARDS ||
+        hdr.shard_size != statistics->shard_size ||
+        size != STAT_SHM_HDR_SIZE + hdr.num_shards * hdr.shard_size)
+        return CKR_DATA_INVALID;
+
+    statistics->num_shards = hdr.num_shards;
+
+    return CKR_OK;
+}
+
 static CK_RV statistics_increment(struct statistics *statistics,
                                   CK_SLOT_ID slot,
                                   const CK_MECHANISM *mech,
@@ -42,22 +127,23 @@ static CK_RV statistics_increment(struct statistics *statistics,
         return CKR_ARGUMENTS_BAD;
 
     ofs = statistics->slot_shm_offsets[slot];
-    if (ofs > statistics->shm_size)
+    if (ofs > statistics->shard_size)
         return CKR_SLOT_ID_INVALID;
 
     mech_idx = mechtable_idx_from_numeric(mech->mechanism);
     if (mech_idx < 0)
         return CKR_MECHANISM_INVALID;
 
-    ofs += mech_idx * (NUM_SUPPORTED_STRENGTHS + 1) * sizeof(counter_t);
+    ofs += mech_idx * STAT_MECH_SIZE;
 
     idx = NUM_SUPPORTED_STRENGTHS - strength_idx;
-    ofs += idx * sizeof(counter_t);
+    ofs += offsetof(struct stat_mech_counters, strength) +
+                                                idx * sizeof(counter_t);
 
-    if (ofs > statistics->shm_size)
+    if (ofs > statistics->shard_size)
         return CKR_FUNCTION_FAILED;
 
-    counter = (counter_t*)(statistics->shm_data + ofs);
+    counter = (counter_t*)(statistics_shard(statistics) + ofs);
     __sync_add_and_fetch(counter, 1);
 
     if ((statistics->flags & STATISTICS_FLAG_COUNT_IMPLICIT) == 0)
@@ -251,17 +337,63 @@ static CK_RV statistics_increment(struct statistics *statistics,
     return CKR_OK;
 }
 
+static void statistics_record(struct statistics *statistics,
+                              CK_SLOT_ID slot, CK_MECHANISM_TYPE mech,
+                              CK_ULONG op, CK_ULONG bytes,
+                              const struct timespec *start)
+{
+    struct stat_mech_counters *counters;
+    struct timespec now;
+    long long usec;
+    CK_ULONG ofs, bucket;
+    int mech_idx;
+
+    if (slot >= NUMBER_SLOTS_MANAGED || op >= STAT_NUM_OPS)
+        return;
+
+    ofs = statistics->slot_shm_offsets[slot];
+    if (ofs >= statistics->shard_size)
+        return;
+
+    mech_idx = mechtable_idx_from_numeric(mech);
+    if (mech_idx < 0)
+        return;
+
+    ofs += mech_idx * STAT_MECH_SIZE;
+    if (ofs + STAT_MECH_SIZE > statistics->shard_size)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = (now.tv_sec - start->tv_sec) * 1000000LL +
+                                (now.tv_nsec - start->tv_nsec) / 1000;
+
+    for (bucket = 0; usec > 0 && bucket < STAT_NUM_LATENCY_BUCKETS - 1;
+         bucket++)
+        usec >>= 1;
+
+    counters = (struct stat_mech_counters *)(statistics_shard(statistics) +
+                                             ofs);
+    __sync_add_and_fetch(&counters->ops[op].calls, 1);
+    if (bytes != 0)
+        __sync_add_and_fetch(&counters->ops[op].bytes, bytes);
+    __sync_add_and_fetch(&counters->ops[op].latency[bucket], 1);
+}
+
 /*
  * Open the statistics shared memory segment for the specified user.
  * If user is -1, then it is opened for the current user.
  * If create is TRUE then the shared memory segment is created if it is not
- * already existent.
+ * already existent, and (re-)initialized if it has no valid header or is for
+ * another slot configuration.
  */
 static CK_RV statistics_open_shm(struct statistics *statistics, int user,
                                  CK_BBOOL create)
 {
-    int i, err, clear = 0, fd;
+    int i, err, fd;
     struct stat stat_buf;
+    struct stat_shm_header *hdr;
+    CK_BBOOL init;
+    CK_RV rc;
 
     snprintf(statistics->shm_name, sizeof(statistics->shm_name) - 1,
              "%s_stats_%u", CONFIG_PATH, user == -1 ? geteuid() : (uid_t)user);
@@ -335,23 +467,41 @@ static CK_RV statistics_open_shm(struct statistics *statistics, int user,
         return CKR_FUNCTION_FAILED;
     }
 
-    if ((CK_ULONG)stat_buf.st_size != statistics->shm_size) {
-        if (create) {
-            if (ftruncate(fd, statistics->shm_size) < 0) {
-                err = errno;
-                TRACE_ERROR("Failed to set size of SHM '%s': %s\n",
-                            statistics->shm_name,  strerror(err));
-                OCK_SYSLOG(LOG_ERR, "Failed to set size of SHM '%s': %s\n",
-                           statistics->shm_name, strerror(err));
-                close(fd);
-                return CKR_FUNCTION_FAILED;
-            }
+    /* Serialize checking and initializing the header between processes */
+    if (flock(fd, LOCK_EX) != 0) {
+        err = errno;
+        TRACE_ERROR("Failed to lock SHM '%s': %s\n",
+                    statistics->shm_name,  strerror(err));
+        close(fd);
+        return CKR_FUNCTION_FAILED;
+    }
 
-            clear = 1;
-        } else {
-            TRACE_ERROR("SHM '%s' has wrong size\n", statistics->shm_name);
-            OCK_SYSLOG(LOG_ERR, "SHM '%s' has wrong size\n",
-                       statistics->shm_name);
+    rc = statistics_check_header(statistics, fd, stat_buf.st_size);
+    if (rc == CKR_DATA_INVALID && !create) {
+        TRACE_ERROR("SHM '%s' has wrong size or layout\n",
+                    statistics->shm_name);
+        OCK_SYSLOG(LOG_ERR, "SHM '%s' has wrong size or layout\n",
+                   statistics->shm_name);
+        rc = CKR_FUNCTION_FAILED;
+    }
+    if (rc != CKR_OK && rc != CKR_DATA_INVALID) {
+        close(fd);
+        return rc;
+    }
+    init = (rc == CKR_DATA_INVALID);
+
+    statistics->shm_size = STAT_SHM_HDR_SIZE +
+                            statistics->num_shards * statistics->shard_size;
+
+    if (init) {
+        /* Truncating to zero first clears all counters */
+        if (ftruncate(fd, 0) < 0 ||
+            ftruncate(fd, statistics->shm_size) < 0) {
+            err = errno;
+            TRACE_ERROR("Failed to set size of SHM '%s': %s\n",
+                        statistics->shm_name,  strerror(err));
+            OCK_SYSLOG(LOG_ERR, "Failed to set size of SHM '%s': %s\n",
+                       statistics->shm_name, strerror(err));
             close(fd);
             return CKR_FUNCTION_FAILED;
         }
@@ -360,6 +510,15 @@ static CK_RV statistics_open_shm(struct statistics *statistics, int user,
     statistics->shm_data = (CK_BYTE *)mmap(NULL, statistics->shm_size,
                                            PROT_READ | PROT_WRITE, MAP_SHARED,
                                            fd, 0);
+    if (statistics->shm_data != MAP_FAILED && init) {
+        hdr = (struct stat_shm_header *)statistics->shm_data;
+        hdr->magic = STAT_SHM_MAGIC;
+        hdr->version = STAT_SHM_VERSION;
+        hdr->num_shards = statistics->num_shards;
+        hdr->shard_size = statistics->shard_size;
+    }
+    /* The mapping keeps the file open, so closing it does not unlock it */
+    flock(fd, LOCK_UN);
     close(fd);
     if (statistics->shm_data == MAP_FAILED) {
         err = errno;
@@ -371,9 +530,6 @@ static CK_RV statistics_open_shm(struct statistics *statistics, int user,
         return CKR_FUNCTION_FAILED;
     }
 
-    if (clear)
-        memset(statistics->shm_data, 0, statistics->shm_size);
-
     return CKR_OK;
 }
 
@@ -423,16 +579,20 @@ CK_RV statistics_init(struct statistics *statistics,
             statistics->slot_shm_offsets[i] = (CK_ULONG)-1;
         }
     }
-    statistics->shm_size = statistics->num_slots * STAT_SLOT_SIZE;
+    statistics->shard_size = statistics->num_slots * STAT_SLOT_SIZE;
+    statistics->num_shards = statistics_num_shards();
 
     TRACE_INFO("%lu slots defined\n", statistics->num_slots);
-    TRACE_INFO("Statistics SHM size: %lu\n", statistics->shm_size);
 
     rc = statistics_open_shm(statistics, uid, CK_TRUE);
     if (rc != CKR_OK)
         goto error;
 
+    TRACE_INFO("Statistics SHM size: %lu, %lu shards\n", statistics->shm_size,
+               statistics->num_shards);
+
     statistics->increment_func = statistics_increment;
+    statistics->record_func = statistics_record;
     statistics->policy = policy;
 
     return CKR_OK;
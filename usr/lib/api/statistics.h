@@ -10,6 +10,7 @@
 #ifndef OCK_STATISTICS_H
 #define OCK_STATISTICS_H
 
+#include <time.h>
 #include <pkcs11types.h>
 #include "slotmgr.h"
 #include "mechtable.h"
@@ -19,21 +20,75 @@
 /*
  * Statistics are collected in a shared memory segment per user.
  * The statistics shared memory segment has the following layout:
- * - For each configured slot:
- *    - For each supported mechanism:
- *       - one counter (counter_t) for non-key mechanisms (strength=0)
- *       - one counter for each supported strength (counter_t each)
+ * - A header (struct stat_shm_header) with the layout version, the number of
+ *   shards and the size of a shard
+ * - For each shard (num_shards):
+ *    - For each configured slot:
+ *       - For each supported mechanism (struct stat_mech_counters):
+ *          - one counter (counter_t) for non-key mechanisms (strength=0)
+ *          - one counter for each supported strength (counter_t each)
+ *          - for each operation type (init, update, final, single-part):
+ *             - the number of calls, the number of bytes processed, and a
+ *               latency histogram
  *
  * The size of the shared segment therefore is:
- *   Num configured slots * num supp.mechanisms * (num supp. strength + 1) *
- *                                                  size of a counter
+ *   Header size + num shards * num configured slots * num supp.mechanisms *
+ *                                            size of the mechanism counters
+ *
+ * A process updates the shard of the CPU it is running on, so that processes
+ * and threads running on different CPUs do not update the same cache lines.
+ * The displayed statistics are the sum over all shards. The process creating
+ * the segment uses one shard per configured CPU, up to STAT_MAX_SHARDS, all
+ * others take the number of shards from the header.
  */
 
 typedef CK_ULONG counter_t;
 
-#define STAT_MECH_SIZE  ((NUM_SUPPORTED_STRENGTHS + 1) * sizeof(counter_t))
+#define STAT_MAX_SHARDS             16
+
+#define STAT_OP_INIT                0
+#define STAT_OP_UPDATE              1
+#define STAT_OP_FINAL               2
+#define STAT_OP_SINGLE              3
+#define STAT_NUM_OPS                4
+
+/*
+ * Latency bucket 0 counts calls that took less than 1 microsecond, bucket n
+ * those that took at least 2^(n-1) and less than 2^n microseconds. The last
+ * bucket also counts all slower calls.
+ */
+#define STAT_NUM_LATENCY_BUCKETS    20
+
+struct stat_op_counters {
+    counter_t calls;
+    counter_t bytes;
+    counter_t latency[STAT_NUM_LATENCY_BUCKETS];
+};
+
+struct stat_mech_counters {
+    counter_t strength[NUM_SUPPORTED_STRENGTHS + 1];
+    struct stat_op_counters ops[STAT_NUM_OPS];
+};
+
+#define STAT_MECH_SIZE  sizeof(struct stat_mech_counters)
 #define STAT_SLOT_SIZE  (MECHTABLE_NUM_ELEMS * STAT_MECH_SIZE)
 
+/*
+ * The version must be changed whenever the layout of the header or of the
+ * counters changes, so that no segment of another layout is used.
+ */
+#define STAT_SHM_MAGIC          0x4f434b53UL        /* "OCKS" */
+#define STAT_SHM_VERSION        1
+
+struct stat_shm_header {
+    CK_ULONG magic;
+    CK_ULONG version;
+    CK_ULONG num_shards;
+    CK_ULONG shard_size;
+};
+
+#define STAT_SHM_HDR_SIZE   sizeof(struct stat_shm_header)
+
 struct statistics;
 typedef struct statistics *statistics_t;
 
@@ -41,6 +96,11 @@ typedef CK_RV (*statistics_increment_f)(struct statistics *statistics,
                                         CK_SLOT_ID slot,
                                         const CK_MECHANISM *mech,
                                         CK_ULONG strength);
+typedef void (*statistics_record_f)(struct statistics *statistics,
+                                    CK_SLOT_ID slot,
+                                    CK_MECHANISM_TYPE mech,
+                                    CK_ULONG op, CK_ULONG bytes,
+                                    const struct timespec *start);
 
 #define STATISTICS_FLAG_COUNT_IMPLICIT      (1 << 0)
 #define STATISTICS_FLAG_COUNT_INTERNAL      (1 << 1)
@@ -49,10 +109,13 @@ struct statistics {
     CK_ULONG flags;
     CK_ULONG num_slots;
     CK_ULONG slot_shm_offsets[NUMBER_SLOTS_MANAGED];
+    CK_ULONG num_shards;
+    CK_ULONG shard_size;
     CK_ULONG shm_size;
     char shm_name[PATH_MAX];
-    CK_BYTE *shm_data;
+    CK_BYTE *shm_data;      /* the header, followed by the shards */
     statistics_increment_f increment_func; /* NULL if statistics disabled */
+    statistics_record_f record_func;       /* NULL if statistics disabled */
     struct policy *policy;
 };
 
@@ -64,6 +127,24 @@ struct statistics {
                   ((OBJECT *)(key))->strength.strength : (no_key_strength));\
     } while (0)
 
+/*
+ * Records a call of an operation of a mechanism that was started at the time
+ * taken with STAT_START, the number of bytes it processed and its latency.
+ */
+#define STAT_START(tokdata, start)                                          \
+    do {                                                                    \
+        if ((tokdata)->statistics->record_func != NULL)                     \
+            clock_gettime(CLOCK_MONOTONIC, (start));                        \
+    } while (0)
+
+#define STAT_RECORD(tokdata, sess, mech, op, bytes, start)                  \
+    do {                                                                    \
+        if ((tokdata)->statistics->record_func != NULL)                     \
+            (tokdata)->statistics->record_func((tokdata)->statistics,       \
+                  (sess)->session_info.slotID, (mech), (op), (bytes),       \
+                  (start));                                                 \
+    } while (0)
+
 CK_RV statistics_init(struct statistics *statistics,
                       Slot_Mgr_Socket_t *slots_infos, CK_ULONG flags,
                       uid_t uid, struct policy *policy);
@@ -13,74 +13,51 @@
  * Author: Kent Yoder <yoder1@us.ibm.com>
  *
  * v1 Binary tree functions 4/5/2011
+ * v2 Flat handle table with lock-free lookups
  *
+ * Handles are indexes into a table of slots. Adding and freeing handles is
+ * serialized by the table's mutex, but getting the value of a handle does not
+ * take any lock: the reader increments the slot's reader counter, reads the
+ * value and takes a reference on it, and decrements the reader counter again.
+ * bt_node_free() clears the slot's value and then waits until the slot has no
+ * readers anymore before it drops the table's reference on the value, so that
+ * a reader never takes a reference on a value that is being deleted.
  */
 
 
 #include <stdio.h>
 #include <malloc.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include "pkcs11types.h"
 #include "local_types.h"
 #include "trace.h"
 
-#define GET_NODE_HANDLE(n) get_node_handle(n, 1)
-#define TREE_DUMP(t)  tree_dump((t)->top, 0)
-
 /*
- * __bt_get_node() - Low level function, needs proper locking before invocation.
+ * Returns the slot for handle @node_num, or NULL if the slot has never been
+ * allocated. Does not require the table's mutex.
  */
-static struct btnode *__bt_get_node(struct btree *t, unsigned long node_num)
+static struct bt_slot *bt_get_slot(struct btree *t, unsigned long node_num)
 {
-    struct btnode *temp;
-    unsigned long i;
-
-    temp = t->top;
+    struct bt_slot *chunk;
+    unsigned long i, n;
 
-    if (!node_num || node_num > t->size)
+    /* Pairs with the release store in bt_new_slot() */
+    if (node_num == 0 || node_num > __atomic_load_n(&t->size, __ATOMIC_ACQUIRE))
         return NULL;
 
-    if (node_num == 1) {
-        temp = t->top;
-        return (temp->flags & BT_FLAG_FREE) ? NULL : temp;
-    }
-
-    i = node_num;
-    while (i != 1) {
-        if (i & 1) {
-            /* If the bit is 1, traverse right */
-            temp = temp->right;
-        } else {
-            /* If the bit is 0, traverse left */
-            temp = temp->left;
-        }
-        i >>= 1;
-    }
-
-    return (temp->flags & BT_FLAG_FREE) ? NULL : temp;
-}
-
-/*
- * bt_get_node
- *
- * Return a node of the tree @t with position @node_num. If the node has been
- * freed or doesn't exist, return NULL
- */
-struct btnode *bt_get_node(struct btree *t, unsigned long node_num)
-{
-    struct btnode *temp;
-
-    if (pthread_mutex_lock(&t->mutex)) {
-        TRACE_ERROR("BTree Lock failed.\n");
+    /* Chunk n holds the slots BT_CHUNK_SLOTS * (2^n - 1) and following */
+    i = (node_num - 1) / BT_CHUNK_SLOTS + 1;
+    n = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(i);
+    if (n >= BT_NUM_CHUNKS)
         return NULL;
-    }
-
-    temp = __bt_get_node(t, node_num);
 
-    pthread_mutex_unlock(&t->mutex);
+    chunk = t->chunks[n];
+    if (chunk == NULL)
+        return NULL;
 
-    return temp;
+    return &chunk[node_num - 1 - BT_CHUNK_SLOTS * ((1UL << n) - 1)];
 }
 
 /*
@@ -91,7 +68,7 @@ struct btnode *bt_get_node(struct btree *t, unsigned long node_num)
  */
 void *bt_get_node_value(struct btree *t, unsigned long node_num)
 {
-    struct btnode *n;
+    struct bt_slot *slot;
     void *v;
     unsigned long ref;
 
@@ -99,20 +76,19 @@ void *bt_get_node_value(struct btree *t, unsigned long node_num)
     UNUSED(ref);
 #endif
 
-    if (pthread_mutex_lock(&t->mutex)) {
-        TRACE_ERROR("BTree Lock failed.\n");
+    slot = bt_get_slot(t, node_num);
+    if (slot == NULL)
         return NULL;
-    }
 
     /*
-     * Get the value within the locked block, to ensure that the node
-     * is not deleted after it was obtained via bt_get_node, but before the
-     * value is obtained from the node. For a deleted node, the node->value
-     * points to another node in the free list.
+     * Announce the reader before reading the value. bt_node_free() clears
+     * the value first and then waits for the readers, so either the value
+     * is seen as NULL here, or the reference is taken before bt_node_free()
+     * drops the table's reference.
      */
-    n = __bt_get_node(t, node_num);
-    v = ((n) ? n->value : NULL);
+    __sync_add_and_fetch(&slot->readers, 1);
 
+    v = slot->value;
     if (v != NULL) {
         ref = __sync_add_and_fetch(&((struct bt_ref_hdr *)v)->ref, 1);
 
@@ -120,7 +96,8 @@ void *bt_get_node_value(struct btree *t, unsigned long node_num)
                     (void *)t, v, ref);
     }
 
-    pthread_mutex_unlock(&t->mutex);
+    __sync_sub_and_fetch(&slot->readers, 1);
+
     return v;
 }
 
@@ -159,39 +136,33 @@ int bt_put_node_value(struct btree *t, void *value)
     return rc;
 }
 
-/* create a new node and set @parent_ptr to its location */
-static struct btnode *node_create(struct btnode **child_ptr,
-                                  struct btnode *parent_ptr, void *value)
+/*
+ * Allocates the slot following the last slot in use, and the chunk holding it
+ * if needed. Needs the table's mutex.
+ */
+static struct bt_slot *bt_new_slot(struct btree *t)
 {
-    struct btnode *node = malloc(sizeof(struct btnode));
+    unsigned long node_num = t->size + 1, i, n;
 
-    if (!node)
+    i = (node_num - 1) / BT_CHUNK_SLOTS + 1;
+    n = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(i);
+    if (n >= BT_NUM_CHUNKS) {
+        TRACE_ERROR("BTree is full.\n");
         return NULL;
+    }
 
-    node->left = node->right = NULL;
-    node->flags = 0;
-    node->value = value;
-    *child_ptr = node;
-    node->parent = parent_ptr;
+    if (t->chunks[n] == NULL) {
+        t->chunks[n] = calloc(BT_CHUNK_SLOTS << n, sizeof(struct bt_slot));
+        if (t->chunks[n] == NULL) {
+            TRACE_ERROR("BTree chunk allocation failed.\n");
+            return NULL;
+        }
+    }
 
-    return node;
-}
+    /* Make the chunk visible to readers before the new size */
+    __atomic_store_n(&t->size, node_num, __ATOMIC_RELEASE);
 
-/*
- * get_node_handle
- *
- * Recursively construct a node's handle by tracing its path back to the root
- * node
- */
-static unsigned long get_node_handle(struct btnode *node,
-                                     unsigned long handle_so_far)
-{
-    if (!node->parent)
-        return handle_so_far;
-    else if (node->parent->left == node)
-        return get_node_handle(node->parent, handle_so_far << 1);
-    else
-        return get_node_handle(node->parent, (handle_so_far << 1) + 1);
+    return bt_get_slot(t, node_num);
 }
 
 /*
@@ -201,7 +172,7 @@ static unsigned long get_node_handle(struct btnode *node,
  */
 unsigned long bt_node_add(struct btree *t, void *value)
 {
-    struct btnode *temp;
+    struct bt_slot *slot;
     unsigned long new_node_index;
 
     if (pthread_mutex_lock(&t->mutex)) {
@@ -214,87 +185,30 @@ unsigned long bt_node_add(struct btree *t, void *value)
     TRACE_DEBUG("bt_node_add: Btree: %p Value: %p Ref: %lu\n", (void *)t, value,
                 ((struct bt_ref_hdr *)value)->ref);
 
-    temp = t->top;
-
-    if (!temp) {                /* no root node yet exists, create it */
-        t->size = 1;
-        if (!node_create(&t->top, NULL, value)) {
+    if (t->free_list) {
+        /* there's a slot on the free list, use it instead of a new one */
+        new_node_index = t->free_list;
+        slot = bt_get_slot(t, new_node_index);
+        t->free_list = slot->next_free;
+        slot->next_free = 0;
+        t->free_nodes--;
+    } else {
+        slot = bt_new_slot(t);
+        if (slot == NULL) {
             pthread_mutex_unlock(&t->mutex);
             return 0;
         }
-
-        pthread_mutex_unlock(&t->mutex);
-        return 1;
-    } else if (t->free_list) {
-        /* there's a node on the free list,
-         * use it instead of mallocing new
-         */
-        temp = t->free_list;
-        t->free_list = temp->value;
-        temp->value = value;
-        temp->flags &= (~BT_FLAG_FREE);
-        t->free_nodes--;
-        new_node_index = GET_NODE_HANDLE(temp);
-        pthread_mutex_unlock(&t->mutex);
-        return new_node_index;
-    }
-
-    new_node_index = t->size + 1;
-
-    while (new_node_index != 1) {
-        if (new_node_index & 1) {
-            if (!temp->right) {
-                if (!(node_create(&temp->right, temp, value))) {
-                    pthread_mutex_unlock(&t->mutex);
-                    return 0;
-                }
-                break;
-            } else {
-                /* If the bit is 1, traverse right */
-                temp = temp->right;
-            }
-        } else {
-            if (!temp->left) {
-                if (!(node_create(&temp->left, temp, value))) {
-                    pthread_mutex_unlock(&t->mutex);
-                    return 0;
-                }
-                break;
-            } else {
-                /* If the bit is 0, traverse left */
-                temp = temp->left;
-            }
-        }
-
-        new_node_index >>= 1;
+        new_node_index = t->size;
     }
 
-    t->size++;
-    new_node_index = t->size;
+    /* Make the initialized value visible to readers before the value */
+    __sync_synchronize();
+    slot->value = value;
 
     pthread_mutex_unlock(&t->mutex);
     return new_node_index;
 }
 
-void tree_dump(struct btnode *n, int depth)
-{
-    int i;
-
-    if (!n)
-        return;
-
-    for (i = 0; i < depth; i++)
-        printf("  ");
-
-    if (n->flags & BT_FLAG_FREE)
-        printf("`- (deleted node)\n");
-    else
-        printf("`- %p\n", n->value);
-
-    tree_dump(n->left, depth + 1);
-    tree_dump(n->right, depth + 1);
-}
-
 /*
  * bt_node_free
  *
@@ -306,13 +220,13 @@ void tree_dump(struct btnode *n, int depth)
  * can use it as indication that it found the node_num in the tree and moved
  * it to the free list.
  *
- * Note that bt_get_node will return NULL if the node is already on the free
- * list, so no double freeing can occur
+ * Note that bt_get_node_value will return NULL if the node is already on the
+ * free list, so no double freeing can occur
  */
 void *bt_node_free(struct btree *t, unsigned long node_num,
                    int put_value)
 {
-    struct btnode *node;
+    struct bt_slot *slot;
     void *value = NULL;
 
     if (pthread_mutex_lock(&t->mutex)) {
@@ -320,24 +234,22 @@ void *bt_node_free(struct btree *t, unsigned long node_num,
         return NULL;
     }
 
-    node = __bt_get_node(t, node_num);
+    slot = bt_get_slot(t, node_num);
+    if (slot != NULL && slot->value != NULL) {
+        value = slot->value;
+        slot->value = NULL;
 
-    if (node) {
         /*
-         * Need to get the node value within the locked block,
-         * otherwise the node might be deleted concurrently before the
-         * value was obtained from the node.
+         * Wait for concurrent readers that might have seen the value, so
+         * that they have taken their reference before ours is dropped.
+         * Readers only hold the slot for a few instructions.
          */
-        value = node->value;
-
-        node->flags |= BT_FLAG_FREE;
+        __sync_synchronize();
+        while (slot->readers != 0)
+            sched_yield();
 
-        /* add node to the free list,
-         * which is chained by using
-         * the value pointer
-         */
-        node->value = t->free_list;
-        t->free_list = node;
+        slot->next_free = t->free_list;
+        t->free_list = node_num;
         t->free_nodes++;
 
         TRACE_DEBUG("bt_node_free: Btree: %p Value: %p Ref: %lu\n", (void *)t,
@@ -403,16 +315,14 @@ void bt_for_each_node(STDLL_TokData_t *tokdata, struct btree *t, void (*func)
                       (STDLL_TokData_t *tokdata, void *p1, unsigned long p2,
                       void *p3), void *p3)
 {
-    unsigned int i;
+    unsigned long i;
     void *value;
 
     for (i = 1; i < t->size + 1; i++) {
         /*
-         * Get the node value, not the node itself. This ensures that we either
-         * get the value from a valid node, or NULL in case of a deleted node.
-         * If we would get the node and then get the value from it without
-         * being in the locked block, the node could have been deleted after
-         * the node was obtained, but before the value was obtained.
+         * Get the node value with a reference, so that the value is not
+         * deleted while func is running, even if the node is freed
+         * concurrently.
          */
         value = bt_get_node_value(t, i);
 
@@ -427,55 +337,42 @@ void bt_for_each_node(STDLL_TokData_t *tokdata, struct btree *t, void (*func)
 
 /* bt_destroy
  *
- * Walk a binary tree backwards (largest index to smallest), deleting nodes
- * along the way.
- * Call the btree's delete callback on node->value before freeing the node.
+ * Delete all nodes of the table.
+ * Call the btree's delete callback on the value of each node in use before
+ * freeing the slots.
  */
 void bt_destroy(struct btree *t)
 {
     unsigned long i;
-    struct btnode *temp;
+    struct bt_slot *slot;
 
     if (pthread_mutex_lock(&t->mutex)) {
         TRACE_ERROR("BTree Lock failed.\n");
         return;
     }
 
-    while (t->size) {
-        temp = t->top;
-        i = t->size;
-        while (i != 1) {
-            if (i & 1) {
-                /* If the bit is 1, traverse right */
-                temp = temp->right;
-            } else {
-                /* If the bit is 0, traverse left */
-                temp = temp->left;
-            }
-            i >>= 1;
-        }
-
-        /*
-         * The value pointed by value in a node marked as freed points
-         * to the next node element in free_list and it shouldn't be
-         * freed here because the loop will iterate through each node,
-         * freed or not.
-         */
-        if (t->delete_func && !(temp->flags & BT_FLAG_FREE)) {
+    for (i = t->size; i > 0; i--) {
+        slot = bt_get_slot(t, i);
+        if (slot == NULL || slot->value == NULL)
+            continue;
 
+        if (t->delete_func) {
             TRACE_DEBUG("bt_destroy: Btree: %p Value: %p Ref: %lu\n", (void *)t,
-                        temp->value, ((struct bt_ref_hdr *)temp->value)->ref);
+                        slot->value,
+                        ((struct bt_ref_hdr *)slot->value)->ref);
 
-            t->delete_func(temp->value);
+            t->delete_func(slot->value);
         }
-
-        free(temp);
-        t->size--;
+        slot->value = NULL;
     }
 
     /* the tree is gone now, clear all the other variables */
-    t->top = NULL;
-    t->free_list = NULL;
+    t->size = 0;
+    for (i = 0; i < BT_NUM_CHUNKS; i++) {
+        free(t->chunks[i]);
+        t->chunks[i] = NULL;
+    }
+    t->free_list = 0;
     t->free_nodes = 0;
     t->delete_func = NULL;
 
@@ -491,10 +388,12 @@ void bt_destroy(struct btree *t)
 CK_RV bt_init(struct btree *t, void (*delete_func)(void *))
 {
     pthread_mutexattr_t attr;
+    unsigned long i;
 
-    t->free_list = NULL;
-    t->top = NULL;
+    for (i = 0; i < BT_NUM_CHUNKS; i++)
+        t->chunks[i] = NULL;
     t->size = 0;
+    t->free_list = 0;
     t->free_nodes = 0;
     t->delete_func = delete_func;
 
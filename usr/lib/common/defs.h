@@ -35,6 +35,17 @@
 #define MAX_PIN_LEN           8
 #define MIN_PIN_LEN           4
 
+/*
+ * Multi-part updates larger than this are processed in chunks of this size,
+ * so that C_SessionCancel can abort them between two chunks.
+ */
+#define SESSION_CANCEL_CHUNK_SIZE   (1024 * 1024)
+
+/* The operations whose contexts C_Get/SetOperationState work on */
+#define SESSION_STATE_OPS   (CKF_ENCRYPT | CKF_DECRYPT | CKF_DIGEST | \
+                             CKF_SIGN | CKF_SIGN_RECOVER | \
+                             CKF_VERIFY | CKF_VERIFY_RECOVER)
+
 #ifndef MIN
 #define MIN(a, b)  ((a) < (b) ? (a) : (b))
 #endif
@@ -162,7 +173,17 @@ struct oc_sha_ctx {
 
 #define DEFAULT_SO_PIN  "87654321"
 
-#define MAX_TOK_OBJS 2048
+/*
+ * Initial number of entries of each token object list in the SHM token object
+ * table. The table is replaced by one twice the size whenever it gets full.
+ */
+#define TOK_OBJ_TABLE_INIT_CAPACITY 2048
+
+/* Layout version of the token object lists in the SHM, see LW_SHM_TYPE */
+#define TOK_OBJ_SHM_LAYOUT  3
+
+/* Number of changes kept in the SHM token object change journal */
+#define TOK_OBJ_JOURNAL_SIZE    1024
 
 
 typedef enum {
@@ -194,6 +215,7 @@ typedef struct _DL_NODE {
 #define PK_LITE_NV   "NVTOK.DAT"
 #define PK_LITE_OBJ_DIR "TOK_OBJ"
 #define PK_LITE_OBJ_IDX "OBJ.IDX"
+#define PK_LITE_OBJ_LOG "OBJ.LOG"
 
 #define DEL_CMD "/bin/rm -f"
 
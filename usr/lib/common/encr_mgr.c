@@ -774,9 +774,62 @@ CK_RV encr_mgr_cleanup(STDLL_TokData_t *tokdata, SESSION *sess,
     ctx->context_len = 0;
     ctx->context_free_func = NULL;
 
+    if (ctx->cipher_ctx != NULL && ctx->cipher_ctx_free_func != NULL)
+        ctx->cipher_ctx_free_func(tokdata, sess, ctx->cipher_ctx);
+    ctx->cipher_ctx = NULL;
+    ctx->cipher_ctx_free_func = NULL;
+
     return CKR_OK;
 }
 
+// encr_mgr_cipher_update()
+//
+// Processes the block aligned part of a multi-part AES or DES3 encrypt or
+// decrypt update with the cipher state kept in the context, if the token
+// supports that. The key is only looked up to set up that state on the first
+// update. Returns CKR_FUNCTION_NOT_SUPPORTED if the caller has to fall back
+// to the single-part token functions.
+//
+CK_RV encr_mgr_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                             ENCR_DECR_CONTEXT *ctx,
+                             CK_BYTE *in_data, CK_ULONG in_data_len,
+                             CK_BYTE *out_data, CK_ULONG *out_data_len,
+                             CK_BYTE encrypt)
+{
+    OBJECT *key_obj = NULL;
+    CK_RV rc;
+
+    if (token_specific.t_cipher_update == NULL)
+        return CKR_FUNCTION_NOT_SUPPORTED;
+
+    if (*out_data_len < in_data_len) {
+        *out_data_len = in_data_len;
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    if (ctx->cipher_ctx == NULL) {
+        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key_obj,
+                                            READ_LOCK);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Failed to find specified object.\n");
+            return rc;
+        }
+    }
+
+    rc = token_specific.t_cipher_update(tokdata, sess, ctx, key_obj,
+                                        in_data, in_data_len, out_data,
+                                        encrypt);
+    if (rc == CKR_OK)
+        *out_data_len = in_data_len;
+    else if (rc != CKR_FUNCTION_NOT_SUPPORTED)
+        TRACE_DEVEL("Token specific cipher update failed.\n");
+
+    object_put(tokdata, key_obj, TRUE);
+
+    return rc;
+}
+
 //
 //
 CK_RV encr_mgr_encrypt(STDLL_TokData_t *tokdata,
@@ -1372,3 +1425,256 @@ done:
 
     return rc;
 }
+
+//
+// encr_mgr_msg_init()
+//
+// Initializes a message based encryption operation (C_MessageEncryptInit). Only
+// the key is set up here, the per message parameters like the IV and the tag
+// are passed with each message.
+//
+CK_RV encr_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        ENCR_DECR_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key_handle, CK_BBOOL checkpolicy)
+{
+    OBJECT *key_obj = NULL;
+    CK_KEY_TYPE keytype;
+    CK_BBOOL flag;
+    CK_ULONG strength = POLICY_STRENGTH_IDX_0;
+    CK_RV rc;
+
+    if (!sess || !ctx || !mech) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (ctx->active != FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        return CKR_OPERATION_ACTIVE;
+    }
+
+    rc = object_mgr_find_in_map1(tokdata, key_handle, &key_obj, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to acquire key from specified handle.\n");
+        if (rc == CKR_OBJECT_HANDLE_INVALID)
+            return CKR_KEY_HANDLE_INVALID;
+        else
+            return rc;
+    }
+
+    rc = template_attribute_get_bool(key_obj->template, CKA_ENCRYPT, &flag);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Could not find CKA_ENCRYPT for the key.\n");
+        rc = CKR_KEY_FUNCTION_NOT_PERMITTED;
+        goto done;
+    }
+
+    if (flag != TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_KEY_FUNCTION_NOT_PERMITTED));
+        rc = CKR_KEY_FUNCTION_NOT_PERMITTED;
+        goto done;
+    }
+
+    if (checkpolicy) {
+        rc = tokdata->policy->is_mech_allowed(tokdata->policy, mech,
+                                              &key_obj->strength,
+                                              POLICY_CHECK_ENCRYPT, sess);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("POLICY VIOLATION: message encrypt init\n");
+            goto done;
+        }
+    }
+    if (!key_object_is_mechanism_allowed(key_obj->template, mech->mechanism)) {
+        TRACE_ERROR("Mechanism not allowed per CKA_ALLOWED_MECHANISMS.\n");
+        rc = CKR_MECHANISM_INVALID;
+        goto done;
+    }
+
+    switch (mech->mechanism) {
+    case CKM_AES_GCM:
+        /* The GCM parameters are passed with each message */
+        if (mech->ulParameterLen != 0 || mech->pParameter != NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+            rc = CKR_MECHANISM_PARAM_INVALID;
+            goto done;
+        }
+
+        rc = template_attribute_get_ulong(key_obj->template, CKA_KEY_TYPE,
+                                          &keytype);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Could not find CKA_KEY_TYPE for the key.\n");
+            goto done;
+        }
+
+        if (keytype != CKK_AES) {
+            TRACE_ERROR("%s\n", ock_err(ERR_KEY_TYPE_INCONSISTENT));
+            rc = CKR_KEY_TYPE_INCONSISTENT;
+            goto done;
+        }
+
+        ctx->context_len = sizeof(AES_GCM_MSG_CONTEXT);
+        ctx->context = (CK_BYTE *) calloc(1, sizeof(AES_GCM_MSG_CONTEXT));
+        if (!ctx->context) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            rc = CKR_HOST_MEMORY;
+            goto done;
+        }
+
+        strength = key_obj->strength.strength;
+
+        /* Release obj lock, token specific aes-gcm may re-acquire the lock */
+        object_put(tokdata, key_obj, TRUE);
+        key_obj = NULL;
+
+        rc = aes_gcm_msg_init(tokdata, sess, ctx, key_handle, ENCRYPT);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Could not initialize message based AES_GCM.\n");
+            encr_mgr_cleanup(tokdata, sess, ctx);
+            goto done;
+        }
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        rc = CKR_MECHANISM_INVALID;
+        goto done;
+    }
+
+    ctx->key = key_handle;
+    ctx->mech.ulParameterLen = 0;
+    ctx->mech.mechanism = mech->mechanism;
+    ctx->mech.pParameter = NULL;
+    ctx->multi_init = FALSE;
+    ctx->multi = FALSE;
+    ctx->active = TRUE;
+    ctx->pkey_active = FALSE;
+
+done:
+    if (ctx->count_statistics == TRUE && rc == CKR_OK)
+        INC_COUNTER(tokdata, sess, mech, key_obj, strength);
+
+    object_put(tokdata, key_obj, TRUE);
+    key_obj = NULL;
+
+    return rc;
+}
+
+//
+// encr_mgr_encrypt_msg()
+//
+// Encrypts a single message of a message based encryption operation. The
+// operation stays active for further messages, also if this message fails.
+//
+CK_RV encr_mgr_encrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                           CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                           CK_VOID_PTR param, CK_ULONG param_len,
+                           CK_BYTE *aad, CK_ULONG aad_len,
+                           CK_BYTE *in_data, CK_ULONG in_data_len,
+                           CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    if (!sess || !ctx) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (ctx->active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        return CKR_OPERATION_NOT_INITIALIZED;
+    }
+    if (ctx->multi == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        return CKR_OPERATION_ACTIVE;
+    }
+
+    switch (ctx->mech.mechanism) {
+    case CKM_AES_GCM:
+        return aes_gcm_msg(tokdata, sess, length_only, ctx, param, param_len,
+                           aad, aad_len, in_data, in_data_len,
+                           out_data, out_data_len, ENCRYPT);
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+}
+
+//
+// encr_mgr_encrypt_msg_begin()
+//
+// Starts a multi-part message of a message based encryption operation. The
+// message is processed with encr_mgr_encrypt_msg_next().
+//
+CK_RV encr_mgr_encrypt_msg_begin(STDLL_TokData_t *tokdata, SESSION *sess,
+                                 ENCR_DECR_CONTEXT *ctx,
+                                 CK_VOID_PTR param, CK_ULONG param_len,
+                                 CK_BYTE *aad, CK_ULONG aad_len)
+{
+    CK_RV rc;
+
+    if (!sess || !ctx) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (ctx->active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        return CKR_OPERATION_NOT_INITIALIZED;
+    }
+    if (ctx->multi == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        return CKR_OPERATION_ACTIVE;
+    }
+
+    switch (ctx->mech.mechanism) {
+    case CKM_AES_GCM:
+        rc = aes_gcm_msg_begin(tokdata, sess, ctx, param, param_len,
+                               aad, aad_len, ENCRYPT);
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    if (rc == CKR_OK)
+        ctx->multi = TRUE;
+
+    return rc;
+}
+
+//
+// encr_mgr_encrypt_msg_next()
+//
+// Processes the next part of a multi-part message. The message is finished
+// with the part that has CKF_END_OF_MESSAGE set, or when a part fails.
+//
+CK_RV encr_mgr_encrypt_msg_next(STDLL_TokData_t *tokdata, SESSION *sess,
+                                CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                                CK_VOID_PTR param, CK_ULONG param_len,
+                                CK_BYTE *in_data, CK_ULONG in_data_len,
+                                CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                CK_FLAGS flags)
+{
+    CK_BBOOL last = (flags & CKF_END_OF_MESSAGE) ? TRUE : FALSE;
+    CK_RV rc;
+
+    if (!sess || !ctx) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (ctx->active == FALSE || ctx->multi == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        return CKR_OPERATION_NOT_INITIALIZED;
+    }
+
+    switch (ctx->mech.mechanism) {
+    case CKM_AES_GCM:
+        rc = aes_gcm_msg_next(tokdata, sess, length_only, ctx,
+                              param, param_len, in_data, in_data_len,
+                              out_data, out_data_len, last, ENCRYPT);
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    if (length_only == FALSE && rc != CKR_BUFFER_TOO_SMALL &&
+        (last == TRUE || rc != CKR_OK))
+        ctx->multi = FALSE;
+
+    return rc;
+}
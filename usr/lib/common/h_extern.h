@@ -420,6 +420,8 @@ CK_RV dp_x9dh_set_default_attributes(TEMPLATE *tmpl, CK_ULONG mode);
 CK_RV dp_x9dh_validate_attribute(TEMPLATE *tmpl,
                                  CK_ATTRIBUTE *attr, CK_ULONG mode);
 
+CK_RV new_token_object_name(STDLL_TokData_t *tokdata, CK_BYTE name[8]);
+void free_token_object_name(STDLL_TokData_t *tokdata, CK_BYTE name[8]);
 CK_RV save_token_object(STDLL_TokData_t *tokdata, OBJECT *obj);
 CK_RV save_private_token_object(STDLL_TokData_t *tokdata, OBJECT *obj);
 CK_RV save_public_token_object(STDLL_TokData_t *tokdata, OBJECT *obj);
@@ -1597,6 +1599,23 @@ CK_RV aes_gcm_free_param(CK_GCM_PARAMS *params);
 void aes_gcm_param_from_compat(const CK_GCM_PARAMS_COMPAT *from,
                                CK_GCM_PARAMS *to);
 
+CK_RV aes_gcm_msg_init(STDLL_TokData_t *tokdata, SESSION *,
+                       ENCR_DECR_CONTEXT *, CK_OBJECT_HANDLE, CK_BYTE);
+
+CK_RV aes_gcm_msg_begin(STDLL_TokData_t *tokdata, SESSION *,
+                        ENCR_DECR_CONTEXT *, CK_VOID_PTR, CK_ULONG,
+                        CK_BYTE *, CK_ULONG, CK_BYTE);
+
+CK_RV aes_gcm_msg_next(STDLL_TokData_t *tokdata, SESSION *, CK_BBOOL,
+                       ENCR_DECR_CONTEXT *, CK_VOID_PTR, CK_ULONG,
+                       CK_BYTE *, CK_ULONG, CK_BYTE *, CK_ULONG *,
+                       CK_BBOOL, CK_BYTE);
+
+CK_RV aes_gcm_msg(STDLL_TokData_t *tokdata, SESSION *, CK_BBOOL,
+                  ENCR_DECR_CONTEXT *, CK_VOID_PTR, CK_ULONG,
+                  CK_BYTE *, CK_ULONG, CK_BYTE *, CK_ULONG,
+                  CK_BYTE *, CK_ULONG *, CK_BYTE);
+
 CK_RV aes_ofb_encrypt(STDLL_TokData_t *tokdata, SESSION *sess,
                       CK_BBOOL length_only,
                       ENCR_DECR_CONTEXT *ctx, CK_BYTE *in_data,
@@ -1700,6 +1719,10 @@ CK_RV sw_sha1_hash(DIGEST_CONTEXT *ctx, CK_BYTE *in_data,
 CK_RV sha_init(STDLL_TokData_t *tokdata, SESSION *sess, DIGEST_CONTEXT *ctx,
                CK_MECHANISM *mech);
 
+CK_RV sha_hash_single(STDLL_TokData_t *tokdata, CK_MECHANISM *mech,
+                      CK_BYTE *in_data, CK_ULONG in_data_len,
+                      CK_BYTE *out_data, CK_ULONG *out_data_len);
+
 CK_RV sha_hash(STDLL_TokData_t *tokdata, SESSION *sess, CK_BBOOL length_only,
                DIGEST_CONTEXT *ctx, CK_BYTE *in_data, CK_ULONG in_data_len,
                CK_BYTE *out_data, CK_ULONG *out_data_len);
@@ -1943,6 +1966,11 @@ int ec_point_uncompressed_from_public_data(const CK_BYTE *data,
 
 CK_RV attach_shm(STDLL_TokData_t *tokdata, CK_SLOT_ID slot_id);
 CK_RV detach_shm(STDLL_TokData_t *tokdata, CK_BBOOL ignore_ref_count);
+CK_RV tok_obj_table_create(STDLL_TokData_t *tokdata, CK_ULONG_32 gen,
+                           CK_ULONG_32 capacity, struct tok_obj_table **table);
+CK_RV tok_obj_table_install(STDLL_TokData_t *tokdata,
+                            struct tok_obj_table *table);
+CK_RV tok_obj_table_sync(STDLL_TokData_t *tokdata);
 
 //get keytype
 CK_RV get_keytype(STDLL_TokData_t *tokdata, CK_OBJECT_HANDLE hkey,
@@ -1974,6 +2002,12 @@ CK_RV encr_mgr_init(STDLL_TokData_t *tokdata,
 CK_RV encr_mgr_cleanup(STDLL_TokData_t *tokdata, SESSION *sess,
                        ENCR_DECR_CONTEXT *ctx);
 
+CK_RV encr_mgr_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                             ENCR_DECR_CONTEXT *ctx,
+                             CK_BYTE *in_data, CK_ULONG in_data_len,
+                             CK_BYTE *out_data, CK_ULONG *out_data_len,
+                             CK_BYTE encrypt);
+
 CK_RV encr_mgr_encrypt(STDLL_TokData_t *tokdata,
                        SESSION *sess, CK_BBOOL length_only,
                        ENCR_DECR_CONTEXT *ctx,
@@ -1999,6 +2033,29 @@ CK_RV encr_mgr_reencrypt_single(STDLL_TokData_t *tokdata, SESSION *sess,
                                 CK_BYTE *in_data, CK_ULONG in_data_len,
                                 CK_BYTE *out_data, CK_ULONG *out_data_len);
 
+CK_RV encr_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        ENCR_DECR_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key_handle, CK_BBOOL checkpolicy);
+
+CK_RV encr_mgr_encrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                           CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                           CK_VOID_PTR param, CK_ULONG param_len,
+                           CK_BYTE *aad, CK_ULONG aad_len,
+                           CK_BYTE *in_data, CK_ULONG in_data_len,
+                           CK_BYTE *out_data, CK_ULONG *out_data_len);
+
+CK_RV encr_mgr_encrypt_msg_begin(STDLL_TokData_t *tokdata, SESSION *sess,
+                                 ENCR_DECR_CONTEXT *ctx,
+                                 CK_VOID_PTR param, CK_ULONG param_len,
+                                 CK_BYTE *aad, CK_ULONG aad_len);
+
+CK_RV encr_mgr_encrypt_msg_next(STDLL_TokData_t *tokdata, SESSION *sess,
+                                CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                                CK_VOID_PTR param, CK_ULONG param_len,
+                                CK_BYTE *in_data, CK_ULONG in_data_len,
+                                CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                CK_FLAGS flags);
+
 // decryption manager routines
 //
 CK_RV decr_mgr_init(STDLL_TokData_t *tokdata,
@@ -2048,6 +2105,29 @@ CK_RV decr_mgr_update_des3_cbc(STDLL_TokData_t *tokdata, SESSION *sess,
                                CK_BYTE *in_data, CK_ULONG in_data_len,
                                CK_BYTE *out_data, CK_ULONG *out_data_len);
 
+CK_RV decr_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        ENCR_DECR_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key_handle, CK_BBOOL checkpolicy);
+
+CK_RV decr_mgr_decrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                           CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                           CK_VOID_PTR param, CK_ULONG param_len,
+                           CK_BYTE *aad, CK_ULONG aad_len,
+                           CK_BYTE *in_data, CK_ULONG in_data_len,
+                           CK_BYTE *out_data, CK_ULONG *out_data_len);
+
+CK_RV decr_mgr_decrypt_msg_begin(STDLL_TokData_t *tokdata, SESSION *sess,
+                                 ENCR_DECR_CONTEXT *ctx,
+                                 CK_VOID_PTR param, CK_ULONG param_len,
+                                 CK_BYTE *aad, CK_ULONG aad_len);
+
+CK_RV decr_mgr_decrypt_msg_next(STDLL_TokData_t *tokdata, SESSION *sess,
+                                CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                                CK_VOID_PTR param, CK_ULONG param_len,
+                                CK_BYTE *in_data, CK_ULONG in_data_len,
+                                CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                CK_FLAGS flags);
+
 // digest manager routines
 //
 CK_RV digest_mgr_cleanup(STDLL_TokData_t *tokdata, SESSION *sess,
@@ -2251,6 +2331,10 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
                                CK_ULONG data_len);
 CK_RV session_mgr_cancel(STDLL_TokData_t *tokdata, SESSION *sess,
                          CK_FLAGS flags);
+CK_RV session_mgr_op_begin(SESSION *sess, CK_FLAGS op);
+CK_RV session_mgr_op_end(STDLL_TokData_t *tokdata, SESSION *sess,
+                         CK_FLAGS op, CK_RV rc);
+CK_BBOOL session_mgr_op_canceled(void);
 CK_BBOOL pin_expired(CK_SESSION_INFO *, CK_FLAGS);
 CK_BBOOL pin_locked(CK_SESSION_INFO *, CK_FLAGS);
 void set_login_flags(CK_USER_TYPE, CK_FLAGS_32 *);
@@ -2289,16 +2373,14 @@ CK_RV object_mgr_add_to_map(STDLL_TokData_t *tokdata,
                             unsigned long obj_handle,
                             CK_OBJECT_HANDLE *handle);
 
-void object_mgr_add_to_shm(OBJECT *obj, LW_SHM_TYPE *shm);
-CK_RV object_mgr_del_from_shm(OBJECT *obj, LW_SHM_TYPE *shm);
+CK_RV object_mgr_add_to_shm(STDLL_TokData_t *tokdata, OBJECT *obj);
+CK_RV object_mgr_del_from_shm(STDLL_TokData_t *tokdata, OBJECT *obj);
 CK_RV object_mgr_get_shm_entry_for_obj(STDLL_TokData_t *tokdata, OBJECT *obj,
                                        TOK_OBJ_ENTRY **entry);
 CK_RV object_mgr_check_shm(STDLL_TokData_t *tokdata, OBJECT *obj,
                            OBJ_LOCK_TYPE lock_type);
-CK_RV object_mgr_search_shm_for_obj(TOK_OBJ_ENTRY *list,
-                                    CK_ULONG lo,
-                                    CK_ULONG hi,
-                                    OBJECT *obj, CK_ULONG *index);
+CK_RV object_mgr_search_shm_for_obj(STDLL_TokData_t *tokdata, OBJECT *obj,
+                                    CK_ULONG *index);
 CK_RV object_mgr_update_from_shm(STDLL_TokData_t *tokdata);
 CK_RV object_mgr_update_publ_tok_obj_from_shm(STDLL_TokData_t *tokdata);
 CK_RV object_mgr_update_priv_tok_obj_from_shm(STDLL_TokData_t *tokdata);
@@ -2371,6 +2453,8 @@ CK_RV object_mgr_restore_obj_withSize(STDLL_TokData_t *tokdata,
                                       int data_size,
                                       const char *fname);
 
+CK_RV object_mgr_add_restored_obj(STDLL_TokData_t *tokdata, OBJECT *obj);
+
 CK_RV object_mgr_save_token_object(STDLL_TokData_t *tokdata, OBJECT *obj);
 
 CK_RV object_mgr_set_attribute_values(STDLL_TokData_t *tokdata,
@@ -2419,17 +2503,6 @@ CK_RV obj_mgr_iterate_key_objects(STDLL_TokData_t *tokdata,
 
 /* structures used to hold arguments to callback functions triggered by either
  * bt_for_each_node or bt_node_free */
-struct find_args {
-    int done;
-    OBJECT *obj;
-    CK_OBJECT_HANDLE map_handle;
-};
-
-struct find_by_name_args {
-    int done;
-    char *name;
-};
-
 struct find_build_list_args {
     CK_ATTRIBUTE *pTemplate;
     SESSION *sess;
@@ -2445,9 +2518,12 @@ struct purge_args {
 };
 
 struct update_tok_obj_args {
-    TOK_OBJ_ENTRY *entries;
-    CK_ULONG_32 *num_entries;
+    struct tok_obj_table *table;
+    CK_BBOOL priv;
+    CK_BBOOL *seen;     /* per SHM entry: object is in the btree */
     struct btree *t;
+    char (*deleted)[8]; /* journal: names deleted by other processes */
+    CK_ULONG_32 num_deleted;
 };
 
 
@@ -3100,6 +3176,11 @@ struct openssl_ex_data {
     EVP_PKEY *pkey;
 };
 
+void openssl_cache_init(void);
+void openssl_cache_final(void);
+const EVP_CIPHER *openssl_cached_cipher(const EVP_CIPHER *cipher);
+const EVP_MD *openssl_cached_md(const EVP_MD *md);
+
 void openssl_free_ex_data(OBJECT *obj, void *ex_data, size_t ex_data_len);
 CK_RV openssl_get_ex_data(OBJECT *obj, void **ex_data, size_t ex_data_len,
                           CK_BBOOL (*need_wr_lock)(OBJECT *obj,
@@ -3192,10 +3273,17 @@ CK_RV openssl_specific_sha_init(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
 CK_RV openssl_specific_sha(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                            CK_BYTE *in_data, CK_ULONG in_data_len,
                            CK_BYTE *out_data, CK_ULONG *out_data_len);
+CK_RV openssl_specific_sha_single(STDLL_TokData_t *tokdata, CK_MECHANISM *mech,
+                                  CK_BYTE *in_data, CK_ULONG in_data_len,
+                                  CK_BYTE *out_data, CK_ULONG *out_data_len);
 CK_RV openssl_specific_sha_update(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                   CK_BYTE *in_data, CK_ULONG in_data_len);
 CK_RV openssl_specific_sha_final(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                  CK_BYTE *out_data, CK_ULONG *out_data_len);
+CK_RV openssl_specific_check_op_state(STDLL_TokData_t *tokdata,
+                                      CK_ULONG operation,
+                                      CK_MECHANISM_TYPE mech, CK_BYTE *context,
+                                      CK_ULONG context_len);
 
 CK_RV openssl_specific_shake_key_derive(STDLL_TokData_t *tokdata, SESSION *sess,
                                         CK_MECHANISM *mech,
@@ -3311,17 +3399,43 @@ CK_RV openssl_specific_tdes_mac(STDLL_TokData_t *tokdata, CK_BYTE *message,
 CK_RV openssl_specific_tdes_cmac(STDLL_TokData_t *tokdata, CK_BYTE *message,
                                  CK_ULONG message_len, OBJECT *key, CK_BYTE *mac,
                                  CK_BBOOL first, CK_BBOOL last, CK_VOID_PTR *ctx);
+CK_RV openssl_specific_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                                     ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                                     CK_BYTE *in_data, CK_ULONG in_data_len,
+                                     CK_BYTE *out_data, CK_BYTE encrypt);
+CK_RV openssl_specific_aes_gcm_msg_init(STDLL_TokData_t *tokdata,
+                                        SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                        OBJECT *key, CK_BYTE encrypt);
+CK_RV openssl_specific_aes_gcm_msg_begin(STDLL_TokData_t *tokdata,
+                                         SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                         CK_BYTE *iv, CK_ULONG iv_len,
+                                         CK_BYTE *aad, CK_ULONG aad_len,
+                                         CK_BYTE encrypt);
+CK_RV openssl_specific_aes_gcm_msg_update(STDLL_TokData_t *tokdata,
+                                          SESSION *sess,
+                                          ENCR_DECR_CONTEXT *ctx,
+                                          CK_BYTE *in_data,
+                                          CK_ULONG in_data_len,
+                                          CK_BYTE *out_data,
+                                          CK_ULONG *out_data_len,
+                                          CK_BYTE encrypt);
+CK_RV openssl_specific_aes_gcm_msg_final(STDLL_TokData_t *tokdata,
+                                         SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                         CK_BYTE *tag, CK_ULONG tag_len,
+                                         CK_BYTE encrypt);
 
 CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
                                  SIGN_VERIFY_CONTEXT *ctx,
                                  CK_MECHANISM_PTR mech,
                                  CK_OBJECT_HANDLE Hkey);
-CK_RV openssl_specific_hmac(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
-                            CK_ULONG in_data_len, CK_BYTE *signature,
-                            CK_ULONG *sig_len, CK_BBOOL sign);
+CK_RV openssl_specific_hmac(STDLL_TokData_t *tokdata, SIGN_VERIFY_CONTEXT *ctx,
+                            CK_BYTE *in_data, CK_ULONG in_data_len,
+                            CK_BYTE *signature, CK_ULONG *sig_len,
+                            CK_BBOOL sign);
 CK_RV openssl_specific_hmac_update(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
                                    CK_ULONG in_data_len, CK_BBOOL sign);
-CK_RV openssl_specific_hmac_final(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
+CK_RV openssl_specific_hmac_final(STDLL_TokData_t *tokdata,
+                                  SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
                                   CK_ULONG *sig_len, CK_BBOOL sign);
 
 CK_RV openssl_specific_rsa_derive_kdk(STDLL_TokData_t *tokdata, OBJECT *key_obj,
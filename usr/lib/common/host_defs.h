@@ -32,6 +32,9 @@ struct _SESSION;
 
 typedef void (*context_free_func_t)(STDLL_TokData_t *tokdata, struct _SESSION *sess,
                                     CK_BYTE *context, CK_ULONG context_len);
+typedef void (*cipher_ctx_free_func_t)(STDLL_TokData_t *tokdata,
+                                       struct _SESSION *sess,
+                                       CK_VOID_PTR cipher_ctx);
 
 typedef struct _ENCR_DECR_CONTEXT {
     CK_OBJECT_HANDLE key;
@@ -39,6 +42,9 @@ typedef struct _ENCR_DECR_CONTEXT {
     CK_BYTE *context;
     CK_ULONG context_len;
     context_free_func_t context_free_func;
+    CK_VOID_PTR cipher_ctx;     // token specific cipher state kept across
+                                // updates, never part of a saved op state
+    cipher_ctx_free_func_t cipher_ctx_free_func;
     CK_BBOOL multi;
     CK_BBOOL active;
     CK_BBOOL init_pending;      // indicate init request pending
@@ -98,6 +104,11 @@ typedef struct _SESSION {
     DIGEST_CONTEXT digest_ctx;
     SIGN_VERIFY_CONTEXT sign_ctx;
     SIGN_VERIFY_CONTEXT verify_ctx;
+    ENCR_DECR_CONTEXT msg_encr_ctx;     // C_MessageEncryptInit operation
+    ENCR_DECR_CONTEXT msg_decr_ctx;     // C_MessageDecryptInit operation
+
+    uint64_t op_flags;          // running and canceled operations, see
+                                // session_mgr_op_begin()
 
     void *private_data;
 } SESSION;
@@ -151,6 +162,11 @@ typedef struct _AES_GCM_CONTEXT {
     CK_ULONG ulClen;
 } AES_GCM_CONTEXT;
 
+/* Message based AES-GCM, the keyed cipher is kept in the cipher_ctx */
+typedef struct _AES_GCM_MSG_CONTEXT {
+    CK_ULONG counter;           // next value for CKG_GENERATE(_COUNTER) IVs
+} AES_GCM_MSG_CONTEXT;
+
 typedef struct _SHA1_CONTEXT {
     unsigned int buf[16];
     unsigned int hash_value[5];
@@ -200,6 +216,10 @@ typedef pthread_mutex_t MUTEX;
 
 typedef struct _TEMPLATE {
     DL_NODE *attribute_list;
+    /* Hash index into attribute_list by attribute type, see template.c */
+    DL_NODE **attribute_index;
+    CK_ULONG index_size;
+    CK_ULONG index_count;
 } TEMPLATE;
 
 
@@ -312,6 +332,48 @@ typedef struct _TOKEN_DATA {
     TOKEN_DATA_VERSION dat;
 } TOKEN_DATA;
 
+/*
+ * Log-structured token object store (objstore = log), see loadsave.c.
+ * The file TOK_OBJ/OBJ.LOG starts with a struct objlog_header, followed by
+ * records consisting of a struct objlog_record and, for OBJLOG_RECORD_OBJ,
+ * the contents of the token object as written to the object's file by the
+ * file based object store. All integers are big endian.
+ */
+#define OBJLOG_MAGIC        "OCKOBLOG"
+#define OBJLOG_VERSION      1
+
+#define OBJLOG_RECORD_OBJ   1   /* object created or updated */
+#define OBJLOG_RECORD_DEL   2   /* object deleted, len is 0 */
+
+struct objlog_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t generation;        /* changes when the log is rewritten */
+};
+
+struct objlog_record {
+    CK_BYTE name[8];
+    uint32_t type;
+    uint32_t len;               /* of the data following the record */
+};
+
+/* Per process index of the latest record of each object in OBJ.LOG */
+struct objlog_entry {
+    CK_BYTE name[8];            /* all zero if the entry is unused */
+    off_t offset;               /* of the record data, 0 if deleted */
+    uint32_t len;
+};
+
+struct objlog {
+    uint32_t generation;
+    off_t end;                  /* end of the last record in the index */
+    off_t live_bytes;           /* bytes of the latest records of objects */
+    off_t dead_bytes;           /* bytes of outdated and deletion records */
+    struct objlog_entry *entries; /* hash table with open addressing */
+    unsigned long size;         /* number of entries, a power of 2 */
+    unsigned long used;         /* entries in use, including deleted ones */
+};
+
 typedef struct _TOKEN_DATA_OLD {
     CK_TOKEN_INFO_32 token_info;
 
@@ -381,16 +443,73 @@ typedef struct _TOK_OBJ_ENTRY {
     CK_ULONG_32 count_hi;
 } TOK_OBJ_ENTRY;
 
+#define TOK_OBJ_JOURNAL_ADD     1
+#define TOK_OBJ_JOURNAL_DEL     2
+
+/*
+ * Entry of the token object change journal in the SHM. Change number seq is
+ * stored at index seq % TOK_OBJ_JOURNAL_SIZE.
+ */
+typedef struct _TOK_OBJ_JOURNAL_ENTRY {
+    char name[8];
+    CK_ULONG_32 seq;
+    CK_ULONG_32 pid;            /* process that made the change */
+    CK_BYTE op;                 /* TOK_OBJ_JOURNAL_ADD or _DEL */
+    CK_BBOOL priv;
+    CK_BYTE reserved[2];
+} TOK_OBJ_JOURNAL_ENTRY;
+
 struct _LW_SHM_TYPE {
     TOKEN_DATA nv_token_data;
     CK_ULONG_32 num_priv_tok_obj;
     CK_ULONG_32 num_publ_tok_obj;
     CK_BBOOL priv_loaded;
     CK_BBOOL publ_loaded;
-    TOK_OBJ_ENTRY publ_tok_objs[MAX_TOK_OBJS];
-    TOK_OBJ_ENTRY priv_tok_objs[MAX_TOK_OBJS];
+    /*
+     * Sequence counter for the token object lists below. Writers (holding the
+     * XProcLock) make it odd while they modify the lists and even again when
+     * done, so that readers can check an entry without taking the XProcLock.
+     */
+    CK_ULONG_32 tok_obj_seq;
+    /*
+     * The token object lists live in a separate SHM segment (struct
+     * tok_obj_table) that is replaced by a larger one when it gets full.
+     * tok_obj_layout is 0 in a freshly created segment and TOK_OBJ_SHM_LAYOUT
+     * once the table has been set up, tok_obj_table_gen identifies the
+     * current table segment and tok_obj_capacity is its size.
+     */
+    CK_ULONG_32 tok_obj_layout;
+    CK_ULONG_32 tok_obj_table_gen;
+    CK_ULONG_32 tok_obj_capacity;
+    /*
+     * Ring of the latest additions to and deletions from the token object
+     * lists, tok_obj_journal_seq is the number of the latest change. Other
+     * processes apply these changes instead of comparing the lists with their
+     * local objects, unless they missed more changes than the ring holds.
+     */
+    CK_ULONG_32 tok_obj_journal_seq;
+    TOK_OBJ_JOURNAL_ENTRY tok_obj_journal[TOK_OBJ_JOURNAL_SIZE];
+};
+
+/*
+ * SHM token object table. The public and the private token object list
+ * (capacity entries each, the first num_publ_tok_obj/num_priv_tok_obj of them
+ * used) are followed by a hash index for each list, hash_size slots each,
+ * that map an object name to its list index + 1 (0 = free slot).
+ */
+struct tok_obj_table {
+    CK_ULONG_32 gen;
+    CK_ULONG_32 capacity;
+    CK_ULONG_32 hash_size;
+    CK_ULONG_32 reserved;
+    TOK_OBJ_ENTRY entries[];
 };
 
+#define TOK_OBJ_TABLE_SIZE(capacity)                                    \
+    (sizeof(struct tok_obj_table) +                                     \
+     2 * (size_t)(capacity) * sizeof(TOK_OBJ_ENTRY) +                   \
+     2 * 2 * (size_t)(capacity) * sizeof(CK_ULONG_32))
+
 struct tokspec_counter {
     uint32_t (*get_tokspec_count)(STDLL_TokData_t *tokdata);
     void (*incr_tokspec_count)(STDLL_TokData_t *tokdata);
@@ -417,9 +536,16 @@ struct _STDLL_TokData_t {
     CK_ULONG ro_session_count;
     CK_STATE global_login_state;
     LW_SHM_TYPE *global_shm;
+    struct tok_obj_table *tok_obj_table; /* current mapping, see attach_shm */
+    struct tok_obj_table **tok_obj_table_retired; /* outdated mappings */
+    unsigned int tok_obj_table_num_retired;
+    CK_ULONG_32 tok_obj_journal_pos[2]; /* last change applied, per list */
+    CK_BBOOL tok_obj_journal_valid[2]; /* FALSE: compare the whole list */
     TOKEN_DATA *nv_token_data;
     void *private_data;
     uint32_t version; /* major<<16|minor */
+    uint32_t objstore; /* OBJSTORE_xxx */
+    struct objlog objlog;
     unsigned char so_wrap_key[32];
     unsigned char user_wrap_key[32];
     pthread_mutex_t login_mutex;
@@ -28,6 +28,7 @@
 #include <syslog.h>
 #include <pwd.h>
 #include <grp.h>
+#include <openssl/crypto.h>
 #include <openssl/evp.h>
 
 #include "platform.h"
@@ -249,6 +250,702 @@ CK_RV set_perm(int file, const char *group)
     return CKR_OK;
 }
 
+/******************************************************************************
+ * log-structured token object store (objstore = log)
+ *
+ * Instead of one file per token object plus the object index OBJ.IDX, all
+ * token objects are kept in the single file TOK_OBJ/OBJ.LOG (see struct
+ * objlog_header in host_defs.h). Saving an object appends a record with the
+ * object's contents, deleting an object appends a deletion record. The record
+ * contents are the same as the object files of the file based store, so
+ * private objects are encrypted with a per object key and AES-GCM the same way.
+ *
+ * Each process keeps an index of the offset of the latest record of each
+ * object. Before each use, the records appended by other processes since are
+ * added to the index. When more than half of the log consists of outdated
+ * records, the log is compacted into a new file with a new generation number,
+ * which makes all processes rebuild their index.
+ *
+ * The token lock (XProcLock) must be held when using the log.
+ */
+#define OBJLOG_COMPACT_MIN      (1024 * 1024)
+#define OBJLOG_INITIAL_SIZE     1024
+
+static unsigned long objlog_hash(const CK_BYTE *name)
+{
+    unsigned long h = 5381;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        h = h * 33 + name[i];
+
+    return h;
+}
+
+static CK_BBOOL objlog_entry_used(const struct objlog_entry *e)
+{
+    return e->name[0] != 0;
+}
+
+/* Returns the entry of the given name, or the free entry to use for it. */
+static struct objlog_entry *objlog_slot(struct objlog *log,
+                                        const CK_BYTE *name)
+{
+    unsigned long i;
+
+    i = objlog_hash(name) & (log->size - 1);
+    while (objlog_entry_used(&log->entries[i]) &&
+           memcmp(log->entries[i].name, name, 8) != 0)
+        i = (i + 1) & (log->size - 1);
+
+    return &log->entries[i];
+}
+
+static struct objlog_entry *objlog_lookup(struct objlog *log,
+                                          const CK_BYTE *name)
+{
+    struct objlog_entry *e;
+
+    if (log->size == 0)
+        return NULL;
+
+    e = objlog_slot(log, name);
+    return objlog_entry_used(e) ? e : NULL;
+}
+
+static CK_RV objlog_grow(struct objlog *log)
+{
+    struct objlog_entry *old = log->entries;
+    unsigned long i, old_size = log->size;
+
+    log->size = old_size != 0 ? old_size * 2 : OBJLOG_INITIAL_SIZE;
+    log->entries = calloc(log->size, sizeof(struct objlog_entry));
+    if (log->entries == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        log->entries = old;
+        log->size = old_size;
+        return CKR_HOST_MEMORY;
+    }
+
+    for (i = 0; i < old_size; i++) {
+        if (objlog_entry_used(&old[i]))
+            *objlog_slot(log, old[i].name) = old[i];
+    }
+
+    free(old);
+    return CKR_OK;
+}
+
+static void objlog_reset(struct objlog *log)
+{
+    free(log->entries);
+    memset(log, 0, sizeof(*log));
+}
+
+/* Adds a record at offset 'off' of the log to the index */
+static CK_RV objlog_apply(struct objlog *log, const struct objlog_record *rec,
+                          off_t off)
+{
+    struct objlog_entry *e;
+    uint32_t type = be32toh(rec->type), len = be32toh(rec->len);
+    CK_RV rc;
+
+    e = objlog_lookup(log, rec->name);
+    if (e != NULL && e->offset != 0) {
+        log->live_bytes -= sizeof(*rec) + e->len;
+        log->dead_bytes += sizeof(*rec) + e->len;
+    }
+
+    switch (type) {
+    case OBJLOG_RECORD_OBJ:
+        if (e == NULL) {
+            if ((log->used + 1) * 4 > log->size * 3) {
+                rc = objlog_grow(log);
+                if (rc != CKR_OK)
+                    return rc;
+            }
+            e = objlog_slot(log, rec->name);
+            memcpy(e->name, rec->name, 8);
+            log->used++;
+        }
+        e->offset = off + sizeof(*rec);
+        e->len = len;
+        log->live_bytes += sizeof(*rec) + len;
+        break;
+    case OBJLOG_RECORD_DEL:
+        if (e != NULL) {
+            e->offset = 0;
+            e->len = 0;
+        }
+        log->dead_bytes += sizeof(*rec) + len;
+        break;
+    default:
+        TRACE_ERROR("Invalid record type %u in object log\n", type);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    log->end = off + sizeof(*rec) + len;
+    return CKR_OK;
+}
+
+/*
+ * Opens the object log for reading and adds the records that are not yet in
+ * the index. Returns CKR_OK and *fp = NULL if there is no object log.
+ */
+static CK_RV objlog_open(STDLL_TokData_t *tokdata, FILE **fp)
+{
+    struct objlog *log = &tokdata->objlog;
+    struct objlog_header hdr;
+    struct objlog_record rec;
+    char fname[PATH_MAX];
+    struct stat sb;
+    off_t off;
+    CK_RV rc;
+
+    *fp = open_token_object_path(fname, sizeof(fname), tokdata,
+                                 PK_LITE_OBJ_LOG, "r");
+    if (*fp == NULL) {
+        if (errno != ENOENT) {
+            TRACE_ERROR("fopen(%s): %s\n", fname, strerror(errno));
+            return CKR_FUNCTION_FAILED;
+        }
+        /* e.g. removed by C_InitToken */
+        objlog_reset(log);
+        return CKR_OK;
+    }
+
+    if (fstat(fileno(*fp), &sb) != 0 ||
+        fread(&hdr, sizeof(hdr), 1, *fp) != 1 ||
+        memcmp(hdr.magic, OBJLOG_MAGIC, sizeof(hdr.magic)) != 0 ||
+        be32toh(hdr.version) != OBJLOG_VERSION) {
+        TRACE_ERROR("%s is not a valid object log\n", fname);
+        OCK_SYSLOG(LOG_ERR, "%s is not a valid object log\n", fname);
+        rc = CKR_FUNCTION_FAILED;
+        goto err;
+    }
+
+    /* The log was rewritten or recreated since the index was built */
+    if (log->end == 0 || be32toh(hdr.generation) != log->generation ||
+        sb.st_size < log->end) {
+        objlog_reset(log);
+        log->generation = be32toh(hdr.generation);
+        log->end = sizeof(hdr);
+    }
+
+    off = log->end;
+    if (off < sb.st_size && fseeko(*fp, off, SEEK_SET) != 0) {
+        TRACE_ERROR("fseeko(%s): %s\n", fname, strerror(errno));
+        rc = CKR_FUNCTION_FAILED;
+        goto err;
+    }
+
+    /* An incomplete record at the end is from an interrupted append */
+    while (off + (off_t)sizeof(rec) <= sb.st_size &&
+           fread(&rec, sizeof(rec), 1, *fp) == 1 &&
+           off + (off_t)sizeof(rec) + be32toh(rec.len) <= sb.st_size) {
+        rc = objlog_apply(log, &rec, off);
+        if (rc != CKR_OK) {
+            OCK_SYSLOG(LOG_ERR, "Object log %s appears corrupted at offset "
+                       "%lld\n", fname, (long long)off);
+            goto err;
+        }
+
+        off = log->end;
+        if (fseeko(*fp, off, SEEK_SET) != 0) {
+            TRACE_ERROR("fseeko(%s): %s\n", fname, strerror(errno));
+            rc = CKR_FUNCTION_FAILED;
+            goto err;
+        }
+    }
+
+    return CKR_OK;
+
+err:
+    fclose(*fp);
+    *fp = NULL;
+    objlog_reset(log);
+    return rc;
+}
+
+static CK_RV objlog_create(STDLL_TokData_t *tokdata)
+{
+    struct objlog_header hdr;
+    char fname[PATH_MAX], basename[PATH_MAX];
+    uint32_t generation;
+    FILE *fp;
+    CK_RV rc;
+
+    rc = rng_generate(tokdata, (CK_BYTE *)&generation, sizeof(generation));
+    if (rc != CKR_OK)
+        return rc;
+
+    memcpy(hdr.magic, OBJLOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = htobe32(OBJLOG_VERSION);
+    hdr.generation = htobe32(generation);
+
+    fp = open_token_object_path_new(fname, sizeof(fname),
+                                    basename, sizeof(basename),
+                                    tokdata, PK_LITE_OBJ_LOG, "w");
+    if (fp == NULL) {
+        TRACE_ERROR("fopen(%s): %s\n", fname, strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = set_perm(fileno(fp), tokdata->tokgroup);
+    if (rc == CKR_OK && fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        TRACE_ERROR("fwrite(%s): %s\n", fname, strerror(errno));
+        rc = CKR_FUNCTION_FAILED;
+    }
+
+    return close_token_file_new(fp, rc, fname, basename);
+}
+
+static int objlog_entry_cmp(const void *a, const void *b)
+{
+    const struct objlog_entry *e1 = *(const struct objlog_entry **)a;
+    const struct objlog_entry *e2 = *(const struct objlog_entry **)b;
+
+    return e1->offset < e2->offset ? -1 : e1->offset > e2->offset;
+}
+
+/*
+ * Returns the index entries of all objects in the log, in the order of their
+ * latest record. The array must be freed by the caller.
+ */
+static CK_RV objlog_live_entries(struct objlog *log,
+                                 struct objlog_entry ***entries,
+                                 unsigned long *num)
+{
+    unsigned long i;
+
+    *num = 0;
+    *entries = malloc((log->used != 0 ? log->used : 1) *
+                      sizeof(struct objlog_entry *));
+    if (*entries == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    for (i = 0; i < log->size; i++) {
+        if (objlog_entry_used(&log->entries[i]) &&
+            log->entries[i].offset != 0)
+            (*entries)[(*num)++] = &log->entries[i];
+    }
+
+    qsort(*entries, *num, sizeof(struct objlog_entry *), objlog_entry_cmp);
+    return CKR_OK;
+}
+
+/*
+ * Rewrites the log with the latest records of all objects only. The new log
+ * gets a new generation, so that all processes rebuild their index.
+ */
+static CK_RV objlog_compact(STDLL_TokData_t *tokdata, FILE *in)
+{
+    struct objlog *log = &tokdata->objlog;
+    struct objlog_entry **entries = NULL;
+    struct objlog_header hdr;
+    struct objlog_record rec;
+    char fname[PATH_MAX], basename[PATH_MAX];
+    CK_BYTE *buf = NULL;
+    unsigned long i, num;
+    FILE *out = NULL;
+    CK_RV rc;
+
+    TRACE_DEVEL("Compacting object log: %lld live, %lld dead bytes\n",
+                (long long)log->live_bytes, (long long)log->dead_bytes);
+
+    rc = objlog_live_entries(log, &entries, &num);
+    if (rc != CKR_OK)
+        return rc;
+
+    out = open_token_object_path_new(fname, sizeof(fname),
+                                     basename, sizeof(basename),
+                                     tokdata, PK_LITE_OBJ_LOG, "w");
+    if (out == NULL) {
+        TRACE_ERROR("fopen(%s): %s\n", fname, strerror(errno));
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    rc = set_perm(fileno(out), tokdata->tokgroup);
+    if (rc != CKR_OK)
+        goto done;
+
+    memcpy(hdr.magic, OBJLOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = htobe32(OBJLOG_VERSION);
+    hdr.generation = htobe32(log->generation + 1);
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+        goto write_err;
+
+    for (i = 0; i < num; i++) {
+        buf = malloc(entries[i]->len != 0 ? entries[i]->len : 1);
+        if (buf == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            rc = CKR_HOST_MEMORY;
+            goto done;
+        }
+
+        if (fseeko(in, entries[i]->offset, SEEK_SET) != 0 ||
+            fread(buf, entries[i]->len, 1, in) != 1) {
+            TRACE_ERROR("Failed to read object %.8s from the object log\n",
+                        entries[i]->name);
+            rc = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+
+        memcpy(rec.name, entries[i]->name, 8);
+        rec.type = htobe32(OBJLOG_RECORD_OBJ);
+        rec.len = htobe32(entries[i]->len);
+        if (fwrite(&rec, sizeof(rec), 1, out) != 1 ||
+            fwrite(buf, entries[i]->len, 1, out) != 1)
+            goto write_err;
+
+        free(buf);
+        buf = NULL;
+    }
+
+    rc = CKR_OK;
+    goto done;
+
+write_err:
+    TRACE_ERROR("fwrite(%s): %s\n", fname, strerror(errno));
+    rc = CKR_FUNCTION_FAILED;
+done:
+    rc = close_token_file_new(out, rc, fname, basename);
+    /* The index is rebuilt from the new log at its next use */
+    if (rc == CKR_OK)
+        objlog_reset(log);
+    free(buf);
+    free(entries);
+    return rc;
+}
+
+/*
+ * Appends a record for the given object to the log, and compacts the log if
+ * it contains too many outdated records.
+ */
+static CK_RV objlog_append(STDLL_TokData_t *tokdata, const CK_BYTE *name,
+                           uint32_t type, const CK_BYTE *data, uint32_t len)
+{
+    struct objlog *log = &tokdata->objlog;
+    struct objlog_record rec;
+    char fname[PATH_MAX];
+    FILE *fp = NULL;
+    off_t off;
+    int fd = -1;
+    CK_RV rc;
+
+    rc = objlog_open(tokdata, &fp);
+    if (rc == CKR_OK && fp == NULL) {
+        rc = objlog_create(tokdata);
+        if (rc == CKR_OK)
+            rc = objlog_open(tokdata, &fp);
+    }
+    if (rc != CKR_OK)
+        return rc;
+
+    if (get_token_object_path(fname, sizeof(fname), tokdata,
+                              PK_LITE_OBJ_LOG, NULL) < 0) {
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    fd = open(fname, O_WRONLY);
+    if (fd < 0) {
+        TRACE_ERROR("open(%s): %s\n", fname, strerror(errno));
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    /* Drop an incomplete record of an interrupted append */
+    off = log->end;
+    if (ftruncate(fd, off) != 0) {
+        TRACE_ERROR("ftruncate(%s): %s\n", fname, strerror(errno));
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    memcpy(rec.name, name, 8);
+    rec.type = htobe32(type);
+    rec.len = htobe32(len);
+
+    if (pwrite(fd, &rec, sizeof(rec), off) != (ssize_t)sizeof(rec) ||
+        (len != 0 &&
+         pwrite(fd, data, len, off + sizeof(rec)) != (ssize_t)len)) {
+        TRACE_ERROR("pwrite(%s): %s\n", fname, strerror(errno));
+        if (ftruncate(fd, off) != 0)
+            TRACE_ERROR("ftruncate(%s): %s\n", fname, strerror(errno));
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    rc = objlog_apply(log, &rec, off);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (log->dead_bytes > OBJLOG_COMPACT_MIN &&
+        log->dead_bytes > log->live_bytes) {
+        /* The record is appended, so a failed compaction is not an error */
+        if (objlog_compact(tokdata, fp) != CKR_OK)
+            TRACE_WARNING("Compacting the object log failed\n");
+    }
+
+done:
+    if (fd >= 0)
+        close(fd);
+    if (fp != NULL)
+        fclose(fp);
+    return rc;
+}
+
+/*
+ * The name used for a token object in the log in messages and for restoring
+ * it. Its last path element is the object name, like with an object file.
+ */
+static int get_token_object_log_path(char *buf, size_t buflen,
+                                     STDLL_TokData_t *tokdata,
+                                     const char *name)
+{
+    if (ock_snprintf(buf, buflen, "%s/" PK_LITE_OBJ_DIR "/" PK_LITE_OBJ_LOG
+                     "/%.8s", tokdata->data_store, name) != 0) {
+        TRACE_ERROR("buffer overflow for object path %s", name);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Opens a token object for reading. With the log-structured store, the log is
+ * opened and positioned at the object's latest record.
+ */
+static FILE *open_token_object_read(char *buf, size_t buflen,
+                                    STDLL_TokData_t *tokdata, const char *name)
+{
+    struct objlog_entry *e;
+    FILE *fp;
+
+    if (tokdata->objstore != OBJSTORE_LOG)
+        return open_token_object_path(buf, buflen, tokdata, name, "r");
+
+    if (get_token_object_log_path(buf, buflen, tokdata, name) < 0)
+        return NULL;
+
+    if (objlog_open(tokdata, &fp) != CKR_OK || fp == NULL)
+        return NULL;
+
+    e = objlog_lookup(&tokdata->objlog, (const CK_BYTE *)name);
+    if (e == NULL || e->offset == 0) {
+        fclose(fp);
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if (fseeko(fp, e->offset, SEEK_SET) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    return fp;
+}
+
+/*
+ * Replaces the stored contents of a token object.
+ */
+static CK_RV write_token_object(STDLL_TokData_t *tokdata, OBJECT *obj,
+                                const CK_BYTE *data, CK_ULONG_32 len)
+{
+    char fname[PATH_MAX];
+    char basename[PATH_MAX];
+    FILE *fp;
+    CK_RV rc;
+
+    if (tokdata->objstore == OBJSTORE_LOG)
+        return objlog_append(tokdata, obj->name, OBJLOG_RECORD_OBJ, data, len);
+
+    fp = open_token_object_path_new(fname, sizeof(fname),
+                                    basename, sizeof(basename),
+                                    tokdata, (char *)obj->name, "w");
+    if (!fp) {
+        TRACE_ERROR("fopen(%s): %s\n", fname, strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = set_perm(fileno(fp), tokdata->tokgroup);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (fwrite(data, len, 1, fp) != 1) {
+        TRACE_ERROR("fwrite(%s): %s\n", fname, strerror(errno));
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    rc = CKR_OK;
+done:
+    return close_token_file_new(fp, rc, fname, basename);
+}
+
+/*
+ * Iterates over all token objects, either using the object index, or the
+ * index of the object log. With the object log, the log is opened only once.
+ */
+struct token_object_iter {
+    FILE *index;
+    FILE *log;
+    struct objlog_entry **entries;
+    unsigned long num;
+    unsigned long pos;
+};
+
+/* Returns FALSE if there are no token objects */
+static CK_BBOOL token_object_iter_init(STDLL_TokData_t *tokdata,
+                                       struct token_object_iter *it)
+{
+    char iname[PATH_MAX];
+
+    memset(it, 0, sizeof(*it));
+
+    if (tokdata->objstore != OBJSTORE_LOG) {
+        it->index = open_token_object_index(iname, sizeof(iname), tokdata,
+                                            "r");
+        return it->index != NULL;
+    }
+
+    if (objlog_open(tokdata, &it->log) != CKR_OK || it->log == NULL)
+        return FALSE;
+
+    if (objlog_live_entries(&tokdata->objlog, &it->entries,
+                            &it->num) != CKR_OK) {
+        fclose(it->log);
+        it->log = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Returns the next token object, opened and positioned at its contents, or
+ * NULL if there are no more objects. Objects that can not be opened are
+ * skipped. The returned file must be released with token_object_iter_put.
+ */
+static FILE *token_object_iter_next(STDLL_TokData_t *tokdata,
+                                    struct token_object_iter *it,
+                                    char *fname, size_t fnamelen)
+{
+    struct objlog_entry *e;
+    char tmp[PATH_MAX];
+    FILE *fp;
+
+    if (it->index != NULL) {
+        while (fgets(tmp, 50, it->index)) {
+            tmp[strlen(tmp) - 1] = 0;
+            fp = open_token_object_path(fname, fnamelen, tokdata, tmp, "r");
+            if (fp != NULL)
+                return fp;
+        }
+        return NULL;
+    }
+
+    while (it->pos < it->num) {
+        e = it->entries[it->pos++];
+        if (get_token_object_log_path(fname, fnamelen, tokdata,
+                                      (char *)e->name) < 0)
+            continue;
+        if (fseeko(it->log, e->offset, SEEK_SET) == 0)
+            return it->log;
+    }
+
+    return NULL;
+}
+
+static void token_object_iter_put(struct token_object_iter *it, FILE *fp)
+{
+    if (fp != it->log)
+        fclose(fp);
+}
+
+static void token_object_iter_done(struct token_object_iter *it)
+{
+    if (it->index != NULL)
+        fclose(it->index);
+    if (it->log != NULL)
+        fclose(it->log);
+    free(it->entries);
+}
+
+//
+// Note: The token lock (XProcLock) must be held when calling this function.
+//
+// Assigns a new unique name of the form OBxxxxxx to a token object. With the
+// file based store, an empty object file is created to reserve the name.
+//
+CK_RV new_token_object_name(STDLL_TokData_t *tokdata, CK_BYTE name[8])
+{
+    static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "abcdefghijklmnopqrstuvwxyz0123456789";
+    char fname[PATH_MAX];
+    CK_BYTE rnd[6];
+    FILE *fp;
+    int fd, i;
+    CK_RV rc;
+
+    if (tokdata->objstore != OBJSTORE_LOG) {
+        if (ock_snprintf(fname, sizeof(fname), "%s/" PK_LITE_OBJ_DIR "/%s",
+                         tokdata->data_store, "OBXXXXXX") != 0) {
+            TRACE_ERROR("buffer overflow for object path");
+            return CKR_FUNCTION_FAILED;
+        }
+
+        fd = mkstemp(fname);
+        if (fd < 0) {
+            TRACE_ERROR("mkstemp failed with: %s\n", strerror(errno));
+            return CKR_FUNCTION_FAILED;
+        }
+        close(fd); /* written and permissions set by save_token_object */
+
+        memcpy(name, &fname[strlen(fname) - 8], 8);
+        return CKR_OK;
+    }
+
+    rc = objlog_open(tokdata, &fp);
+    if (rc != CKR_OK)
+        return rc;
+    if (fp != NULL)
+        fclose(fp);
+
+    do {
+        rc = rng_generate(tokdata, rnd, sizeof(rnd));
+        if (rc != CKR_OK)
+            return rc;
+
+        name[0] = 'O';
+        name[1] = 'B';
+        for (i = 0; i < 6; i++)
+            name[2 + i] = chars[rnd[i] % (sizeof(chars) - 1)];
+    } while (objlog_lookup(&tokdata->objlog, name) != NULL);
+
+    return CKR_OK;
+}
+
+//
+// Releases a name obtained with new_token_object_name when creating the
+// object failed.
+//
+void free_token_object_name(STDLL_TokData_t *tokdata, CK_BYTE name[8])
+{
+    char fname[PATH_MAX];
+
+    /* Nothing is reserved in the object log */
+    if (tokdata->objstore == OBJSTORE_LOG)
+        return;
+
+    if (get_token_object_path(fname, sizeof(fname), tokdata,
+                              (char *)name, NULL) == 0)
+        remove(fname);
+}
+
 //
 // Note: The token lock (XProcLock) must be held when calling this function.
 // The object must hold the READ lock when this function is called.
@@ -268,6 +965,10 @@ CK_RV save_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
     if (rc != CKR_OK)
         return rc;
 
+    // the object log needs no index file
+    if (tokdata->objstore == OBJSTORE_LOG)
+        return CKR_OK;
+
     // update the index file if it exists
     fp = open_token_object_index(fname, sizeof(fname), tokdata, "r");
     if (fp) {
@@ -316,6 +1017,9 @@ CK_RV delete_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
     char objidx[PATH_MAX], idxtmp[PATH_MAX], fname[PATH_MAX], line[256];
     CK_RV rc;
 
+    if (tokdata->objstore == OBJSTORE_LOG)
+        return objlog_append(tokdata, obj->name, OBJLOG_RECORD_DEL, NULL, 0);
+
     // FIXME:  on UNIX, we need to make sure these guys aren't symlinks
     //         before we blindly write to these files...
     //
@@ -387,6 +1091,8 @@ CK_RV delete_token_data(STDLL_TokData_t *tokdata)
     if (system(cmd))
         TRACE_ERROR("system() failed.\n");
 
+    objlog_reset(&tokdata->objlog);
+
 done:
     free(cmd);
 
@@ -474,6 +1180,8 @@ void final_data_store(STDLL_TokData_t * tokdata)
         free(tokdata->pk_dir);
         tokdata->pk_dir = NULL;
     }
+
+    objlog_reset(&tokdata->objlog);
 }
 
 /******************************************************************************
@@ -2492,7 +3200,6 @@ CK_RV save_private_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
     FILE *fp = NULL;
     CK_BYTE *obj_data = NULL;
     char fname[PATH_MAX];
-    char basename[PATH_MAX];
     struct stat sb;
     CK_ULONG obj_data_len;
     CK_RV rc;
@@ -2521,8 +3228,8 @@ CK_RV save_private_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
         goto done;
     }
 
-    fp = open_token_object_path(fname, sizeof(fname), tokdata,
-                                (char *)obj->name, "r");
+    fp = open_token_object_read(fname, sizeof(fname), tokdata,
+                                (char *)obj->name);
     if (fp == NULL) {
         /* create new token object */
         new = 1;
@@ -2569,173 +3276,460 @@ CK_RV save_private_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
                 goto done;
         }
     }
-do_work:
-    if (new) {
-        /* get key */
-        rng_generate(tokdata, obj_key, 32);
+do_work:
+    if (new) {
+        /* get key */
+        rng_generate(tokdata, obj_key, 32);
+
+        /* iv = [obj.-name|counter] */
+        memcpy(obj_iv, obj->name, 8);
+        obj_iv[8] = 0;
+        obj_iv[9] = 0;
+        obj_iv[10] = 0;
+        obj_iv[11] = 1;
+
+        /* get wrapped key */
+        rc = aes_256_wrap(tokdata, obj_key_wrapped, obj_key,
+                          tokdata->master_key);
+        if (rc != CKR_OK)
+            goto done;
+    }
+
+    /* version */
+    tmp = htobe32(tokdata->version);
+    memcpy(data, &tmp, 4);
+    /* flags */
+    memcpy(data + 4, &flag, 1);
+    tmp = 0;
+    memcpy(data + 5, &tmp, 3);
+    /* wrapped key */
+    memcpy(data + 8, obj_key_wrapped, 40);
+    /* iv */
+    memcpy(data + 48, obj_iv, 12);
+    /* object len */
+    tmp = htobe32(obj_data_len_32);
+    memcpy(data + 60, &tmp, 4);
+
+    rc = aes_256_gcm_seal(tokdata,
+                          /* ciphertext */
+                          data + HEADER_LEN,
+                          /* tag */
+                          data + HEADER_LEN
+                               + obj_data_len_32,
+                          /* aad */
+                          data, HEADER_LEN,
+                          /* plaintext */
+                          obj_data, obj_data_len_32,
+                          /* key */
+                          obj_key,
+                          /* iv */
+                          obj_iv);
+    if (rc != CKR_OK)
+        goto done;
+
+    rc = write_token_object(tokdata, obj, data, total_len);
+
+done:
+    if (fp != NULL)
+        fclose(fp);
+    if (obj_data)
+        free(obj_data);
+    if (data)
+        free(data);
+    return rc;
+}
+
+/*
+ * Decrypts the body of a private token object. The plain text object is
+ * returned in a malloc'ed buffer of the size of the body.
+ */
+static CK_RV unseal_private_token_object(STDLL_TokData_t *tokdata,
+                                         CK_BYTE *header,
+                                         CK_BYTE *data, CK_ULONG len,
+                                         CK_BYTE *footer, CK_BYTE **plain)
+{
+    unsigned char obj_iv[12], obj_key[32], obj_key_wrapped[40];
+    CK_BYTE *buff = NULL;
+    CK_RV rc;
+
+    /* wrapped key */
+    memcpy(obj_key_wrapped, header + 8, 40);
+    /* iv */
+    memcpy(obj_iv, header + 48, 12);
+
+    rc = aes_256_unwrap(tokdata, obj_key, obj_key_wrapped, tokdata->master_key);
+    if (rc != CKR_OK)
+        return CKR_FUNCTION_FAILED;
+
+    buff = (CK_BYTE *)malloc(len);
+    if (buff == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    rc = aes_256_gcm_unseal(tokdata,
+                            buff, /* plain-text */
+                            header, HEADER_LEN, /* aad */
+                            data, len, /* cipher-text*/
+                            footer, /* tag */
+                            obj_key, obj_iv);
+    if (rc != CKR_OK) {
+        free(buff);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    *plain = buff;
+    return CKR_OK;
+}
+
+/*
+ * The private token objects are loaded at login in a pipeline: While the
+ * objects of one batch are unwrapped, decrypted and unflattened by a pool of
+ * threads, the main thread reads the object files of the next batch. The
+ * restored objects are then added to the object btree by the main thread in
+ * the order of the object index.
+ *
+ * The number of threads (including the main thread) defaults to the number
+ * of online CPUs, but at most LOAD_MAX_THREADS, and can be set with the
+ * environment variable OPENCRYPTOKI_LOAD_THREADS. Tokens with less than
+ * LOAD_BATCH_SIZE private objects are always loaded by the main thread only.
+ */
+#define LOAD_BATCH_SIZE         256
+#define LOAD_MAX_THREADS        16
+
+struct load_job {
+    char *fname;
+    unsigned char header[HEADER_LEN];
+    unsigned char footer[FOOTER_LEN];
+    CK_BYTE *data;
+    CK_ULONG_32 size;
+    OBJECT *obj;
+    CK_RV rc;
+};
+
+struct load_batch {
+    struct load_job jobs[LOAD_BATCH_SIZE];
+    unsigned int num;
+};
+
+struct load_pool {
+    STDLL_TokData_t *tokdata;
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX *libctx;
+#endif
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    struct load_batch *batch;
+    unsigned int next;
+    unsigned int pending;
+    int stop;
+    pthread_t threads[LOAD_MAX_THREADS];
+    unsigned int num_threads;
+};
+
+static unsigned int load_threads(void)
+{
+    const char *env;
+    char *end;
+    unsigned long num = 0;
+    long cpus;
+
+    env = getenv("OPENCRYPTOKI_LOAD_THREADS");
+    if (env != NULL) {
+        num = strtoul(env, &end, 10);
+        if (*env == '\0' || *end != '\0' || num == 0) {
+            TRACE_WARNING("Ignoring invalid OPENCRYPTOKI_LOAD_THREADS "
+                          "value '%s'\n", env);
+            num = 0;
+        }
+    }
+
+    if (num == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num = cpus > 0 ? (unsigned long)cpus : 1;
+    }
+
+    return num > LOAD_MAX_THREADS ? LOAD_MAX_THREADS : num;
+}
+
+static void load_job_run(STDLL_TokData_t *tokdata, struct load_job *job)
+{
+    CK_BYTE *buff = NULL;
+
+    job->rc = unseal_private_token_object(tokdata, job->header, job->data,
+                                          job->size, job->footer, &buff);
+    if (job->rc != CKR_OK)
+        return;
+
+    job->rc = object_restore_withSize(tokdata->policy, buff, &job->obj,
+                                      FALSE, -1, job->fname);
+    if (job->rc != CKR_OK)
+        TRACE_DEVEL("object_restore_withSize failed.\n");
+
+    free(buff);
+}
+
+/* Runs the jobs of the current batch. Must be called with the pool mutex. */
+static void load_pool_work(struct load_pool *pool)
+{
+    struct load_job *job;
+
+    while (pool->batch != NULL && pool->next < pool->batch->num) {
+        job = &pool->batch->jobs[pool->next++];
+
+        pthread_mutex_unlock(&pool->mutex);
+        load_job_run(pool->tokdata, job);
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+}
+
+static void *load_thread(void *arg)
+{
+    struct load_pool *pool = arg;
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    /* Use the same library context as the thread performing the login */
+    OSSL_LIB_CTX_set0_default(pool->libctx);
+#endif
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        load_pool_work(pool);
+        if (pool->stop)
+            break;
+        pthread_cond_wait(&pool->work_cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+static CK_RV load_pool_start(struct load_pool *pool, STDLL_TokData_t *tokdata,
+                             unsigned int num_threads)
+{
+    unsigned int i;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->tokdata = tokdata;
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    /* Returns the current default library context without changing it */
+    pool->libctx = OSSL_LIB_CTX_set0_default(NULL);
+#endif
+
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        TRACE_ERROR("Initializing the load pool mutex failed.\n");
+        return CKR_CANT_LOCK;
+    }
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    /* The main thread works on the batches, too */
+    for (i = 1; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[pool->num_threads], NULL,
+                           load_thread, pool) != 0) {
+            TRACE_WARNING("Failed to create a load thread, loading objects "
+                          "with %u threads\n", i);
+            break;
+        }
+        pool->num_threads++;
+    }
 
-        /* iv = [obj.-name|counter] */
-        memcpy(obj_iv, obj->name, 8);
-        obj_iv[8] = 0;
-        obj_iv[9] = 0;
-        obj_iv[10] = 0;
-        obj_iv[11] = 1;
+    TRACE_DEVEL("Loading private token objects with %u threads\n",
+                pool->num_threads + 1);
 
-        /* get wrapped key */
-        rc = aes_256_wrap(tokdata, obj_key_wrapped, obj_key,
-                          tokdata->master_key);
-        if (rc != CKR_OK)
-            goto done;
-    }
+    return CKR_OK;
+}
 
-    /* version */
-    tmp = htobe32(tokdata->version);
-    memcpy(data, &tmp, 4);
-    /* flags */
-    memcpy(data + 4, &flag, 1);
-    tmp = 0;
-    memcpy(data + 5, &tmp, 3);
-    /* wrapped key */
-    memcpy(data + 8, obj_key_wrapped, 40);
-    /* iv */
-    memcpy(data + 48, obj_iv, 12);
-    /* object len */
-    tmp = htobe32(obj_data_len_32);
-    memcpy(data + 60, &tmp, 4);
+static void load_pool_stop(struct load_pool *pool)
+{
+    unsigned int i;
 
-    rc = aes_256_gcm_seal(tokdata,
-                          /* ciphertext */
-                          data + HEADER_LEN,
-                          /* tag */
-                          data + HEADER_LEN
-                               + obj_data_len_32,
-                          /* aad */
-                          data, HEADER_LEN,
-                          /* plaintext */
-                          obj_data, obj_data_len_32,
-                          /* key */
-                          obj_key,
-                          /* iv */
-                          obj_iv);
-    if (rc != CKR_OK)
-        goto done;
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
 
-    fp = open_token_object_path_new(fname, sizeof(fname),
-                                    basename, sizeof(basename),
-                                    tokdata, (char *)obj->name, "w");
-    if (!fp) {
-        TRACE_ERROR("fopen(%s): %s\n", fname, strerror(errno));
-        rc = CKR_FUNCTION_FAILED;
-        goto done;
-    }
+    for (i = 0; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
 
-    rc = set_perm(fileno(fp), tokdata->tokgroup);
-    if (rc != CKR_OK)
-        goto done;
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mutex);
+}
 
-    if (fwrite(data, total_len, 1, fp) != 1) {
-        TRACE_ERROR("fwrite(%s): %s\n", fname, strerror(errno));
-        rc = CKR_FUNCTION_FAILED;
-        goto done;
-    }
+static void load_pool_submit(struct load_pool *pool, struct load_batch *batch)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->batch = batch;
+    pool->next = 0;
+    pool->pending = batch->num;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
 
-    rc = CKR_OK;
-done:
-    rc = close_token_file_new(fp, rc, fname, basename);
-    if (obj_data)
-        free(obj_data);
-    if (data)
-        free(data);
-    return rc;
+static void load_pool_wait(struct load_pool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    load_pool_work(pool);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pool->batch = NULL;
+    pthread_mutex_unlock(&pool->mutex);
 }
 
-//
-// Note: The token lock (XProcLock) must be held when calling this function.
-//
-CK_RV load_private_token_objects(STDLL_TokData_t *tokdata)
+/*
+ * Reads the object files of the next LOAD_BATCH_SIZE private objects in the
+ * object index. Objects that can not be read are ignored.
+ */
+static void load_batch_read(STDLL_TokData_t *tokdata,
+                            struct token_object_iter *it,
+                            struct load_batch *batch)
 {
-    FILE *fp1 = NULL, *fp2 = NULL;
-    CK_BYTE *buf = NULL;
-    char tmp[PATH_MAX];
-    char iname[PATH_MAX];
+    struct load_job *job;
+    FILE *fp;
     char fname[PATH_MAX];
     CK_BBOOL priv;
-    CK_ULONG_32 size;
-    CK_RV rc;
-    unsigned char header[HEADER_LEN], footer[FOOTER_LEN];
     uint32_t len;
 
-    if (tokdata->version < TOK_NEW_DATA_STORE)
-        return load_private_token_objects_old(tokdata);
-
-    fp1 = open_token_object_index(iname, sizeof(iname), tokdata, "r");
-    if (!fp1)
-        return CKR_OK;          // no token objects
-
-    while (fgets(tmp, 50, fp1)) {
-        tmp[strlen(tmp) - 1] = 0;
+    batch->num = 0;
 
-        fp2 = open_token_object_path(fname, sizeof(fname), tokdata, tmp, "r");
-        if (!fp2)
-            continue;
+    while (batch->num < LOAD_BATCH_SIZE &&
+           (fp = token_object_iter_next(tokdata, it, fname,
+                                        sizeof(fname))) != NULL) {
+        job = &batch->jobs[batch->num];
 
-        if (fread(header, HEADER_LEN, 1, fp2) != 1) {
-            fclose(fp2);
+        if (fread(job->header, HEADER_LEN, 1, fp) != 1) {
+            token_object_iter_put(it, fp);
             continue;
         }
 
-        memcpy(&priv, header + 4, 1);
+        memcpy(&priv, job->header + 4, 1);
         if (priv == FALSE) {
-            fclose(fp2);
+            token_object_iter_put(it, fp);
             continue;
         }
 
-        memcpy(&len, header + 60, 4);
-        size = be32toh(len);
+        memcpy(&len, job->header + 60, 4);
+        job->size = be32toh(len);
 
-        buf = (CK_BYTE *)malloc(size);
-        if (!buf) {
-            fclose(fp2);
+        job->data = (CK_BYTE *)malloc(job->size);
+        job->fname = strdup(fname);
+        if (!job->data || !job->fname) {
+            token_object_iter_put(it, fp);
             OCK_SYSLOG(LOG_ERR,
                        "Cannot malloc %u bytes to read in "
-                       "token object %s (ignoring it)", size, fname);
-            continue;
+                       "token object %s (ignoring it)", job->size, fname);
+            goto ignore;
         }
 
-        if (fread(buf, size, 1, fp2) != 1) {
-            free(buf);
-            fclose(fp2);
-            OCK_SYSLOG(LOG_ERR,
-                       "Cannot read token object %s " "(ignoring it)", fname);
-            continue;
-        }
-        if (fread(footer, FOOTER_LEN, 1, fp2) != 1) {
-            free(buf);
-            fclose(fp2);
+        if (fread(job->data, job->size, 1, fp) != 1 ||
+            fread(job->footer, FOOTER_LEN, 1, fp) != 1) {
+            token_object_iter_put(it, fp);
             OCK_SYSLOG(LOG_ERR,
                        "Cannot read token object %s " "(ignoring it)", fname);
-            continue;
+            goto ignore;
         }
 
-        rc = restore_private_token_object(tokdata, header,
-                                          buf, size,
-                                          footer, NULL, fname);
-        if (rc != CKR_OK)
-            goto error;
+        token_object_iter_put(it, fp);
+        job->obj = NULL;
+        job->rc = CKR_OK;
+        batch->num++;
+        continue;
 
-        free(buf);
-        fclose(fp2);
+ignore:
+        free(job->data);
+        free(job->fname);
+        job->data = NULL;
+        job->fname = NULL;
+    }
+}
+
+static void load_batch_free(struct load_batch *batch)
+{
+    struct load_job *job;
+    unsigned int i;
+
+    for (i = 0; i < batch->num; i++) {
+        job = &batch->jobs[i];
+        free(job->data);
+        free(job->fname);
+        if (job->obj != NULL)
+            object_free(job->obj);
     }
 
-    fclose(fp1);
-    return CKR_OK;
-error:
-    if (buf)
-        free(buf);
-    if (fp1)
-        fclose(fp1);
-    if (fp2)
-        fclose(fp2);
+    memset(batch, 0, sizeof(*batch));
+}
+
+//
+// Note: The token lock (XProcLock) must be held when calling this function.
+//
+CK_RV load_private_token_objects(STDLL_TokData_t *tokdata)
+{
+    struct token_object_iter it;
+    struct load_batch *batches, *cur, *next, *swap;
+    struct load_pool pool;
+    struct load_job *job;
+    unsigned int i;
+    CK_RV rc;
+
+    if (tokdata->version < TOK_NEW_DATA_STORE)
+        return load_private_token_objects_old(tokdata);
+
+    if (!token_object_iter_init(tokdata, &it))
+        return CKR_OK;          // no token objects
+
+    batches = calloc(2, sizeof(*batches));
+    if (batches == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        token_object_iter_done(&it);
+        return CKR_HOST_MEMORY;
+    }
+    cur = &batches[0];
+    next = &batches[1];
+
+    load_batch_read(tokdata, &it, cur);
+
+    rc = load_pool_start(&pool, tokdata,
+                         cur->num < LOAD_BATCH_SIZE ? 1 : load_threads());
+    if (rc != CKR_OK)
+        goto out;
+
+    while (cur->num > 0) {
+        load_pool_submit(&pool, cur);
+        load_batch_read(tokdata, &it, next);
+        load_pool_wait(&pool);
+
+        for (i = 0; i < cur->num; i++) {
+            job = &cur->jobs[i];
+            if (job->rc != CKR_OK) {
+                rc = job->rc;
+                goto done;
+            }
+
+            /* The object is freed by object_mgr_add_restored_obj on error */
+            rc = object_mgr_add_restored_obj(tokdata, job->obj);
+            job->obj = NULL;
+            if (rc != CKR_OK)
+                goto done;
+        }
+
+        load_batch_free(cur);
+        swap = cur;
+        cur = next;
+        next = swap;
+    }
+
+done:
+    load_pool_stop(&pool);
+out:
+    load_batch_free(&batches[0]);
+    load_batch_free(&batches[1]);
+    free(batches);
+    token_object_iter_done(&it);
     return rc;
 }
 
@@ -2748,7 +3742,6 @@ CK_RV restore_private_token_object(STDLL_TokData_t *tokdata,
                                    OBJECT *pObj,
                                    const char *fname)
 {
-    unsigned char obj_iv[12], obj_key[32], obj_key_wrapped[40];
     CK_BYTE *buff = NULL;
     CK_RV rc;
 
@@ -2756,44 +3749,14 @@ CK_RV restore_private_token_object(STDLL_TokData_t *tokdata,
         return restore_private_token_object_old(tokdata, data, len, pObj,
                                                 fname);
 
-    /* wrapped key */
-    memcpy(obj_key_wrapped, header + 8, 40);
-    /* iv */
-    memcpy(obj_iv, header + 48, 12);
-
-    rc = aes_256_unwrap(tokdata, obj_key, obj_key_wrapped, tokdata->master_key);
-    if (rc != CKR_OK) {
-        rc = CKR_FUNCTION_FAILED;
-        goto done;
-    }
-
-    buff = (CK_BYTE *)malloc(len);
-    if (buff == NULL) {
-        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-        rc = CKR_HOST_MEMORY;
-        goto done;
-    }
-
-    rc = aes_256_gcm_unseal(tokdata,
-                            buff, /* plain-text */
-                            header, HEADER_LEN, /* aad */
-                            data, len, /* cipher-text*/
-                            footer, /* tag */
-                            obj_key, obj_iv);
-    if (rc != CKR_OK) {
-        rc = CKR_FUNCTION_FAILED;
-        goto done;
-    }
+    rc = unseal_private_token_object(tokdata, header, data, len, footer,
+                                     &buff);
+    if (rc != CKR_OK)
+        return rc;
 
     rc = object_mgr_restore_obj(tokdata, buff, pObj, fname);
-    if (rc != CKR_OK) {
-        goto done;
-    }
 
-    rc = CKR_OK;
-done:
-    if (buff)
-        free(buff);
+    free(buff);
     return rc;
 }
 
@@ -2813,8 +3776,8 @@ CK_RV reload_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
     if (tokdata->version < TOK_NEW_DATA_STORE)
         return reload_token_object_old(tokdata, obj);
 
-    fp = open_token_object_path(fname, sizeof(fname), tokdata,
-                                (char *)obj->name, "r");
+    fp = open_token_object_read(fname, sizeof(fname), tokdata,
+                                (char *)obj->name);
     if (!fp) {
         TRACE_ERROR("fopen(%s): %s\n", fname, strerror(errno));
         rc = CKR_FUNCTION_FAILED;
@@ -2907,15 +3870,11 @@ done:
 //
 CK_RV save_public_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
 {
-    FILE *fp = NULL;
-    CK_BYTE *clear = NULL;
-    char fname[PATH_MAX];
-    char basename[PATH_MAX];
+    CK_BYTE *clear = NULL, *data = NULL;
     CK_ULONG clear_len;
     CK_BBOOL flag = FALSE;
     CK_RV rc;
-    CK_ULONG_32 len, be_len;
-    unsigned char reserved[7] = {0};
+    CK_ULONG_32 len;
     uint32_t tmp;
 
     if (tokdata->version < TOK_NEW_DATA_STORE)
@@ -2927,36 +3886,28 @@ CK_RV save_public_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
     }
     len = (CK_ULONG_32)clear_len;
 
-    fp = open_token_object_path_new(fname, sizeof(fname),
-                                    basename, sizeof(basename),
-                                    tokdata, (char *)obj->name, "w");
-    if (!fp) {
-        TRACE_ERROR("fopen(%s): %s\n", fname, strerror(errno));
-        rc = CKR_FUNCTION_FAILED;
+    data = calloc(1, PUB_HEADER_LEN + len);
+    if (data == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        rc = CKR_HOST_MEMORY;
         goto done;
     }
 
+    /* version, flags, 7 reserved bytes, object len, object */
     tmp = htobe32(tokdata->version);
-    be_len = htobe32(len);
-
-    rc = set_perm(fileno(fp), tokdata->tokgroup);
-    if (rc != CKR_OK)
-        goto done;
+    memcpy(data, &tmp, 4);
+    memcpy(data + 4, &flag, 1);
+    tmp = htobe32(len);
+    memcpy(data + 12, &tmp, 4);
+    memcpy(data + PUB_HEADER_LEN, clear, len);
 
-    if (fwrite(&tmp, 4, 1, fp) != 1
-        || fwrite(&flag, 1, 1, fp) != 1
-        || fwrite(reserved, 7, 1, fp) != 1
-        || fwrite(&be_len, 4, 1, fp) != 1
-        || fwrite(clear, len, 1, fp) != 1) {
-        rc = CKR_FUNCTION_FAILED;
-        goto done;
-    }
+    rc = write_token_object(tokdata, obj, data, PUB_HEADER_LEN + len);
 
-    rc = CKR_OK;
 done:
-    rc = close_token_file_new(fp, rc, fname, basename);
     if (clear)
         free(clear);
+    if (data)
+        free(data);
     return rc;
 }
 
@@ -2965,10 +3916,9 @@ done:
 //
 CK_RV load_public_token_objects(STDLL_TokData_t *tokdata)
 {
-    FILE *fp1 = NULL, *fp2 = NULL;
+    struct token_object_iter it;
+    FILE *fp2 = NULL;
     CK_BYTE *buf = NULL;
-    char tmp[PATH_MAX];
-    char iname[PATH_MAX];
     char fname[PATH_MAX];
     CK_BBOOL priv;
     CK_ULONG_32 size;
@@ -2978,19 +3928,13 @@ CK_RV load_public_token_objects(STDLL_TokData_t *tokdata)
     if (tokdata->version < TOK_NEW_DATA_STORE)
         return load_public_token_objects_old(tokdata);
 
-    fp1 = open_token_object_index(iname, sizeof(iname), tokdata, "r");
-    if (!fp1)
+    if (!token_object_iter_init(tokdata, &it))
         return CKR_OK;          // no token objects
 
-    while (fgets(tmp, 50, fp1)) {
-        tmp[strlen(tmp) - 1] = 0;
-
-        fp2 = open_token_object_path(fname, sizeof(fname), tokdata,  tmp, "r");
-        if (!fp2)
-            continue;
-
+    while ((fp2 = token_object_iter_next(tokdata, &it, fname,
+                                         sizeof(fname))) != NULL) {
         if (fread(header, PUB_HEADER_LEN, 1, fp2) != 1) {
-            fclose(fp2);
+            token_object_iter_put(&it, fp2);
             OCK_SYSLOG(LOG_ERR, "Cannot read header\n");
             continue;
         }
@@ -3007,13 +3951,13 @@ CK_RV load_public_token_objects(STDLL_TokData_t *tokdata)
             size = be32toh(size);
 
         if (priv == TRUE) {
-            fclose(fp2);
+            token_object_iter_put(&it, fp2);
             continue;
         }
 
         /* size can not be negative if treated as signed int */
         if (size >= 0x80000000) {
-            fclose(fp2);
+            token_object_iter_put(&it, fp2);
             OCK_SYSLOG(LOG_ERR, "Size is invalid in header of token object %s "
                                 "(ignoring it)\n", fname);
             continue;
@@ -3021,7 +3965,7 @@ CK_RV load_public_token_objects(STDLL_TokData_t *tokdata)
 
         buf = (CK_BYTE *) malloc(size);
         if (!buf) {
-            fclose(fp2);
+            token_object_iter_put(&it, fp2);
             OCK_SYSLOG(LOG_ERR,
                        "Cannot malloc %u bytes to read in "
                        "token object %s (ignoring it)", size, fname);
@@ -3029,7 +3973,7 @@ CK_RV load_public_token_objects(STDLL_TokData_t *tokdata)
         }
 
         if (fread(buf, size, 1, fp2) != 1) {
-            fclose(fp2);
+            token_object_iter_put(&it, fp2);
             free(buf);
             OCK_SYSLOG(LOG_ERR,
                        "Cannot read token object %s " "(ignoring it)", fname);
@@ -3043,9 +3987,9 @@ CK_RV load_public_token_objects(STDLL_TokData_t *tokdata)
                        "(ignoring it)", fname);
         }
         free(buf);
-        fclose(fp2);
+        token_object_iter_put(&it, fp2);
     }
 
-    fclose(fp1);
+    token_object_iter_done(&it);
     return CKR_OK;
 }
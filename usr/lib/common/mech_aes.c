@@ -567,6 +567,174 @@ CK_RV aes_xts_decrypt(STDLL_TokData_t *tokdata,
                          in_data, in_data_len, out_data, out_data_len);
 }
 
+// Encrypts or decrypts the block aligned data of an update call. The cipher
+// state is kept in the context if the token supports that, otherwise the key
+// is looked up and the single-part token function is called. For CBC the
+// init_v in the mechanism parameter is advanced to the last cipher block, so
+// that the data of one update may be passed in several calls.
+//
+static CK_RV aes_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                               ENCR_DECR_CONTEXT *ctx,
+                               CK_BYTE *in_data, CK_ULONG in_data_len,
+                               CK_BYTE *out_data, CK_ULONG *out_data_len,
+                               CK_BYTE encrypt)
+{
+    CK_AES_CTR_PARAMS *aesctr = NULL;
+    OBJECT *key = NULL;
+    CK_BYTE last_block[AES_BLOCK_SIZE];
+    CK_BBOOL cbc;
+    CK_RV rc;
+
+    cbc = (ctx->mech.mechanism == CKM_AES_CBC ||
+           ctx->mech.mechanism == CKM_AES_CBC_PAD);
+    // in place decryption overwrites the last cipher block
+    if (cbc && !encrypt)
+        memcpy(last_block, in_data + (in_data_len - AES_BLOCK_SIZE),
+               AES_BLOCK_SIZE);
+
+    rc = encr_mgr_cipher_update(tokdata, sess, ctx, in_data, in_data_len,
+                                out_data, out_data_len, encrypt);
+    if (rc != CKR_FUNCTION_NOT_SUPPORTED)
+        goto done;
+
+    rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to find specified object.\n");
+        return rc;
+    }
+
+    switch (ctx->mech.mechanism) {
+    case CKM_AES_ECB:
+        if (encrypt)
+            rc = ckm_aes_ecb_encrypt(tokdata, sess, in_data, in_data_len,
+                                     out_data, out_data_len, key);
+        else
+            rc = ckm_aes_ecb_decrypt(tokdata, sess, in_data, in_data_len,
+                                     out_data, out_data_len, key);
+        break;
+    case CKM_AES_CBC:
+    case CKM_AES_CBC_PAD:
+        if (encrypt)
+            rc = ckm_aes_cbc_encrypt(tokdata, sess, in_data, in_data_len,
+                                     out_data, out_data_len,
+                                     ctx->mech.pParameter, key);
+        else
+            rc = ckm_aes_cbc_decrypt(tokdata, sess, in_data, in_data_len,
+                                     out_data, out_data_len,
+                                     ctx->mech.pParameter, key);
+        break;
+    case CKM_AES_CTR:
+        aesctr = (CK_AES_CTR_PARAMS *) ctx->mech.pParameter;
+        if (encrypt)
+            rc = ckm_aes_ctr_encrypt(tokdata, in_data, in_data_len,
+                                     out_data, out_data_len,
+                                     (CK_BYTE *) aesctr->cb,
+                                     (CK_ULONG) aesctr->ulCounterBits, key);
+        else
+            rc = ckm_aes_ctr_decrypt(tokdata, in_data, in_data_len,
+                                     out_data, out_data_len,
+                                     (CK_BYTE *) aesctr->cb,
+                                     (CK_ULONG) aesctr->ulCounterBits, key);
+        break;
+    case CKM_AES_OFB:
+        rc = token_specific.t_aes_ofb(tokdata, in_data, in_data_len, out_data,
+                                      key, ctx->mech.pParameter, encrypt);
+        break;
+    case CKM_AES_CFB8:
+        rc = token_specific.t_aes_cfb(tokdata, in_data, in_data_len, out_data,
+                                      key, ctx->mech.pParameter, 0x01,
+                                      encrypt);
+        break;
+    case CKM_AES_CFB64:
+        rc = token_specific.t_aes_cfb(tokdata, in_data, in_data_len, out_data,
+                                      key, ctx->mech.pParameter, 0x08,
+                                      encrypt);
+        break;
+    case CKM_AES_CFB128:
+        rc = token_specific.t_aes_cfb(tokdata, in_data, in_data_len, out_data,
+                                      key, ctx->mech.pParameter, 0x10,
+                                      encrypt);
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        rc = CKR_MECHANISM_INVALID;
+        break;
+    }
+
+    object_put(tokdata, key, TRUE);
+    key = NULL;
+
+done:
+    if (rc == CKR_OK && cbc)
+        memcpy(ctx->mech.pParameter,
+               encrypt ? out_data + (in_data_len - AES_BLOCK_SIZE) : last_block,
+               AES_BLOCK_SIZE);
+
+    return rc;
+}
+
+// Encrypts or decrypts the out_len bytes made up of the data left over from
+// the previous update and the new input, and keeps the last remain bytes of
+// the input for the next call. The input is passed to the cipher as is, only
+// a partial block left over from the previous update is completed in a stack
+// buffer, or in the output buffer when called in place.
+//
+static CK_RV aes_cipher_update_blocks(STDLL_TokData_t *tokdata, SESSION *sess,
+                                      ENCR_DECR_CONTEXT *ctx,
+                                      CK_BYTE *in_data, CK_ULONG in_data_len,
+                                      CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                      CK_ULONG out_len, CK_ULONG remain,
+                                      CK_ULONG block_len, CK_BYTE encrypt)
+{
+    AES_CONTEXT *context = (AES_CONTEXT *) ctx->context;
+    CK_BYTE block[AES_BLOCK_SIZE], tail[AES_BLOCK_SIZE];
+    CK_ULONG fill, len;
+    CK_RV rc;
+
+    if (*out_data_len < out_len) {
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    // the output may overwrite the remaining input when done in place
+    if (remain != 0)
+        memcpy(tail, in_data + (in_data_len - remain), remain);
+
+    len = *out_data_len;
+    if (context->len == 0) {
+        rc = aes_cipher_update(tokdata, sess, ctx, in_data, out_len,
+                               out_data, &len, encrypt);
+    } else if (in_data == out_data) {
+        // move the input behind the data left over from the previous update
+        memmove(out_data + context->len, in_data, out_len - context->len);
+        memcpy(out_data, context->data, context->len);
+        rc = aes_cipher_update(tokdata, sess, ctx, out_data, out_len,
+                               out_data, &len, encrypt);
+    } else {
+        fill = block_len - context->len;
+        memcpy(block, context->data, context->len);
+        memcpy(block + context->len, in_data, fill);
+        rc = aes_cipher_update(tokdata, sess, ctx, block, block_len,
+                               out_data, &len, encrypt);
+        if (rc == CKR_OK && out_len > block_len) {
+            len = *out_data_len - block_len;
+            rc = aes_cipher_update(tokdata, sess, ctx, in_data + fill,
+                                   out_len - block_len,
+                                   out_data + block_len, &len, encrypt);
+        }
+    }
+    if (rc != CKR_OK)
+        return rc;
+
+    *out_data_len = out_len;
+
+    if (remain != 0)
+        memcpy(context->data, tail, remain);
+    context->len = remain;
+
+    return CKR_OK;
+}
+
 //
 //
 CK_RV aes_ecb_encrypt_update(STDLL_TokData_t *tokdata,
@@ -578,8 +746,6 @@ CK_RV aes_ecb_encrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -609,42 +775,9 @@ CK_RV aes_ecb_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous encryption operation first
-        //
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
-
-        rc = ckm_aes_ecb_encrypt(tokdata, sess, clear, out_len, out_data,
-                                 out_data_len, key);
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // update the context buffer.  we already used the buffer's current
-            // contents so we completely overwrite it
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-
-            context->len = remain;
-        }
-
-        free(clear);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 1);
 
         return rc;
     }
@@ -662,8 +795,6 @@ CK_RV aes_ecb_decrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -694,40 +825,9 @@ CK_RV aes_ecb_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous decryption operation first
-        //
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = ckm_aes_ecb_decrypt(tokdata, sess, cipher, out_len, out_data,
-                                 out_data_len, key);
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(cipher);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 0);
 
         return rc;
     }
@@ -745,8 +845,6 @@ CK_RV aes_cbc_encrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -778,47 +876,9 @@ CK_RV aes_cbc_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous encryption operation first
-        //
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
-
-        rc = ckm_aes_cbc_encrypt(tokdata, sess, clear, out_len, out_data,
-                                 out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // the new init_v is the last encrypted data block
-            //
-            memcpy(ctx->mech.pParameter,
-                   out_data + (*out_data_len - AES_BLOCK_SIZE), AES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the context buffer
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(clear);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 1);
 
         return rc;
     }
@@ -836,8 +896,6 @@ CK_RV aes_cbc_decrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -870,48 +928,9 @@ CK_RV aes_cbc_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous decryption operation first
-        //
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = ckm_aes_cbc_decrypt(tokdata, sess, cipher, out_len, out_data,
-                                 out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // the new init_v is the last input data block
-            //
-            memcpy(ctx->mech.pParameter, cipher + (out_len - AES_BLOCK_SIZE),
-                   AES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the context buffer
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-
-            context->len = remain;
-        }
-
-        free(cipher);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 0);
 
         return rc;
     }
@@ -929,8 +948,6 @@ CK_RV aes_cbc_pad_encrypt_update(STDLL_TokData_t *tokdata,
                                  CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -967,52 +984,10 @@ CK_RV aes_cbc_pad_encrypt_update(STDLL_TokData_t *tokdata,
             *out_data_len = out_len;
             return CKR_OK;
         }
-        // at this point, we should have:
-        //    1) remain != 0
-        //    2) out_len != 0
-        //
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous encryption operation first
-        //
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
 
-        //
-        // we don't do padding during the update
-        //
-        rc = ckm_aes_cbc_encrypt(tokdata, sess, clear, out_len, out_data,
-                                 out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            // the new init_v is the last encrypted data block
-            //
-            memcpy(ctx->mech.pParameter,
-                   out_data + (*out_data_len - AES_BLOCK_SIZE), AES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the temporary space
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(clear);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 1);
 
         return rc;
     }
@@ -1030,8 +1005,6 @@ CK_RV aes_cbc_pad_decrypt_update(STDLL_TokData_t *tokdata,
                                  CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -1070,49 +1043,10 @@ CK_RV aes_cbc_pad_decrypt_update(STDLL_TokData_t *tokdata,
             *out_data_len = out_len;
             return CKR_OK;
         }
-        // at this point, we should have:
-        //    1) remain != 0
-        //    2) out_len != 0
-        //
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous decryption operation first
-        //
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = ckm_aes_cbc_decrypt(tokdata, sess, cipher, out_len, out_data,
-                                 out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            // the new init_v is the last input data block
-            //
-            memcpy(ctx->mech.pParameter, cipher + (out_len - AES_BLOCK_SIZE),
-                   AES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the temporary space
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(cipher);
 
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 0);
 
         return rc;
     }
@@ -1129,11 +1063,8 @@ CK_RV aes_ctr_encrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    CK_AES_CTR_PARAMS *aesctr = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -1156,39 +1087,10 @@ CK_RV aes_ctr_encrypt_update(STDLL_TokData_t *tokdata,
             *out_data_len = out_len;
             return CKR_OK;
         }
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        //these buffers need to be longword aligned
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        //copy all the leftover data  from the previous encryption operation
-        //first
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
-        aesctr = (CK_AES_CTR_PARAMS *) ctx->mech.pParameter;
-        rc = ckm_aes_ctr_encrypt(tokdata, clear, out_len, out_data,
-                                 out_data_len, (CK_BYTE *) aesctr->cb,
-                                 (CK_ULONG) aesctr->ulCounterBits, key);
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(clear);
 
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 1);
 
         return rc;
     }
@@ -1205,11 +1107,8 @@ CK_RV aes_ctr_decrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    CK_AES_CTR_PARAMS *aesctr = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -1232,39 +1131,10 @@ CK_RV aes_ctr_decrypt_update(STDLL_TokData_t *tokdata,
             *out_data_len = out_len;
             return CKR_OK;
         }
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        //these buffers need to be longword aligned
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        //copy all the leftover data  from the previous encryption operation
-        //first
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
-        aesctr = (CK_AES_CTR_PARAMS *) ctx->mech.pParameter;
-        rc = ckm_aes_ctr_decrypt(tokdata, clear, out_len, out_data,
-                                 out_data_len, (CK_BYTE *) aesctr->cb,
-                                 (CK_ULONG) aesctr->ulCounterBits, key);
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
 
-        free(clear);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 0);
 
         return rc;
     }
@@ -1866,10 +1736,8 @@ CK_RV aes_ofb_encrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -1902,41 +1770,11 @@ CK_RV aes_ofb_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous encryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_aes_ofb(tokdata, cipher, out_len, out_data,
-                                      key_obj, ctx->mech.pParameter, 1);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 1);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific aes ofb encrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -2048,10 +1886,8 @@ CK_RV aes_ofb_decrypt_update(STDLL_TokData_t *tokdata,
                              CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     AES_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -2085,41 +1921,11 @@ CK_RV aes_ofb_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous decryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_aes_ofb(tokdata, cipher, out_len, out_data,
-                                      key_obj, ctx->mech.pParameter, 0);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      AES_BLOCK_SIZE, 0);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific aes ofb decrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -2233,10 +2039,8 @@ CK_RV aes_cfb_encrypt_update(STDLL_TokData_t *tokdata,
                              CK_ULONG *out_data_len, CK_ULONG cfb_len)
 {
     AES_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -2269,42 +2073,11 @@ CK_RV aes_cfb_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous encryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_aes_cfb(tokdata, cipher, out_len, out_data,
-                                      key_obj, ctx->mech.pParameter, cfb_len,
-                                      1);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      cfb_len, 1);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific aes cfb encrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -2419,10 +2192,8 @@ CK_RV aes_cfb_decrypt_update(STDLL_TokData_t *tokdata,
                              CK_ULONG *out_data_len, CK_ULONG cfb_len)
 {
     AES_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -2455,42 +2226,11 @@ CK_RV aes_cfb_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous decryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_aes_cfb(tokdata, cipher, out_len, out_data,
-                                      key_obj, ctx->mech.pParameter, cfb_len,
-                                      0);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = aes_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                      out_data, out_data_len, out_len, remain,
+                                      cfb_len, 0);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific aes cfb decrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -3744,6 +3484,274 @@ void aes_gcm_param_from_compat(const CK_GCM_PARAMS_COMPAT *from,
     to->ulTagBits = from->ulTagBits;
 }
 
+CK_RV aes_gcm_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                       ENCR_DECR_CONTEXT *ctx, CK_OBJECT_HANDLE key,
+                       CK_BYTE direction)
+{
+    OBJECT *key_obj = NULL;
+    CK_RV rc;
+
+    if (token_specific.t_aes_gcm_msg_init == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    rc = object_mgr_find_in_map_nocache(tokdata, key, &key_obj, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to find specified object.\n");
+        return rc;
+    }
+
+    rc = token_specific.t_aes_gcm_msg_init(tokdata, sess, ctx, key_obj,
+                                           direction);
+    if (rc != CKR_OK)
+        TRACE_ERROR("Token specific aes gcm msg init failed: %02lx\n", rc);
+
+    object_put(tokdata, key_obj, TRUE);
+    key_obj = NULL;
+
+    return rc;
+}
+
+static CK_RV aes_gcm_msg_check_param(CK_VOID_PTR param, CK_ULONG param_len,
+                                     CK_ULONG *tag_len)
+{
+    CK_GCM_MESSAGE_PARAMS *gcm = (CK_GCM_MESSAGE_PARAMS *)param;
+
+    if (gcm == NULL || param_len != sizeof(CK_GCM_MESSAGE_PARAMS) ||
+        gcm->pIv == NULL || gcm->ulIvLen == 0 || gcm->pTag == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+
+    *tag_len = (gcm->ulTagBits + 7) / 8; /* round to full byte */
+    if (*tag_len == 0 || *tag_len > AES_BLOCK_SIZE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+
+    return CKR_OK;
+}
+
+/*
+ * Generates the IV of a message into the caller's IV buffer, if requested
+ * by the ivGenerator. The leftmost ulIvFixedBits of the IV are supplied by
+ * the caller, the remaining bytes are a big endian message counter, or are
+ * random.
+ */
+static CK_RV aes_gcm_msg_generate_iv(STDLL_TokData_t *tokdata,
+                                     ENCR_DECR_CONTEXT *ctx,
+                                     CK_GCM_MESSAGE_PARAMS *gcm)
+{
+    AES_GCM_MSG_CONTEXT *context = (AES_GCM_MSG_CONTEXT *)ctx->context;
+    CK_ULONG fixed_len, i, counter;
+
+    if (gcm->ivGenerator == CKG_NO_GENERATE)
+        return CKR_OK;
+
+    if (gcm->ulIvFixedBits % 8 != 0 ||
+        gcm->ulIvFixedBits / 8 >= gcm->ulIvLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+    fixed_len = gcm->ulIvFixedBits / 8;
+
+    switch (gcm->ivGenerator) {
+    case CKG_GENERATE:
+    case CKG_GENERATE_COUNTER:
+        if (gcm->ulIvLen - fixed_len < sizeof(CK_ULONG) &&
+            context->counter >> ((gcm->ulIvLen - fixed_len) * 8) != 0) {
+            TRACE_ERROR("IV counter exhausted\n");
+            return CKR_FUNCTION_FAILED;
+        }
+        counter = context->counter++;
+        for (i = gcm->ulIvLen; i > fixed_len; i--) {
+            gcm->pIv[i - 1] = counter & 0xff;
+            counter >>= 8;
+        }
+        return CKR_OK;
+    case CKG_GENERATE_RANDOM:
+        return rng_generate(tokdata, gcm->pIv + fixed_len,
+                            gcm->ulIvLen - fixed_len);
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+}
+
+CK_RV aes_gcm_msg_begin(STDLL_TokData_t *tokdata, SESSION *sess,
+                        ENCR_DECR_CONTEXT *ctx,
+                        CK_VOID_PTR param, CK_ULONG param_len,
+                        CK_BYTE *aad, CK_ULONG aad_len, CK_BYTE direction)
+{
+    CK_GCM_MESSAGE_PARAMS *gcm = (CK_GCM_MESSAGE_PARAMS *)param;
+    CK_ULONG tag_len;
+    CK_RV rc;
+
+    if (!sess || !ctx || (aad == NULL && aad_len > 0)) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = aes_gcm_msg_check_param(param, param_len, &tag_len);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (token_specific.t_aes_gcm_msg_begin == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    if (direction == ENCRYPT) {
+        rc = aes_gcm_msg_generate_iv(tokdata, ctx, gcm);
+        if (rc != CKR_OK)
+            return rc;
+    }
+
+    rc = token_specific.t_aes_gcm_msg_begin(tokdata, sess, ctx,
+                                            gcm->pIv, gcm->ulIvLen,
+                                            aad, aad_len, direction);
+    if (rc != CKR_OK)
+        TRACE_ERROR("Token specific aes gcm msg begin failed: %02lx\n", rc);
+
+    return rc;
+}
+
+CK_RV aes_gcm_msg_next(STDLL_TokData_t *tokdata, SESSION *sess,
+                       CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                       CK_VOID_PTR param, CK_ULONG param_len,
+                       CK_BYTE *in_data, CK_ULONG in_data_len,
+                       CK_BYTE *out_data, CK_ULONG *out_data_len,
+                       CK_BBOOL last, CK_BYTE direction)
+{
+    CK_GCM_MESSAGE_PARAMS *gcm = (CK_GCM_MESSAGE_PARAMS *)param;
+    CK_ULONG tag_len;
+    CK_RV rc;
+
+    if (!sess || !ctx || !out_data_len ||
+        (in_data == NULL && in_data_len > 0)) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = aes_gcm_msg_check_param(param, param_len, &tag_len);
+    if (rc != CKR_OK)
+        return rc;
+
+    /* GCM is a stream mode, each part produces as much output as input */
+    if (length_only == TRUE) {
+        *out_data_len = in_data_len;
+        return CKR_OK;
+    }
+
+    if (*out_data_len < in_data_len) {
+        *out_data_len = in_data_len;
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    if (token_specific.t_aes_gcm_msg_update == NULL ||
+        token_specific.t_aes_gcm_msg_final == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    rc = token_specific.t_aes_gcm_msg_update(tokdata, sess, ctx,
+                                             in_data, in_data_len,
+                                             out_data, out_data_len,
+                                             direction);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Token specific aes gcm msg update failed: %02lx\n", rc);
+        return rc;
+    }
+
+    if (last) {
+        rc = token_specific.t_aes_gcm_msg_final(tokdata, sess, ctx,
+                                                gcm->pTag, tag_len,
+                                                direction);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Token specific aes gcm msg final failed: %02lx\n",
+                        rc);
+            /* Do not leave unauthenticated plain text in the output */
+            if (direction == DECRYPT)
+                OPENSSL_cleanse(out_data, *out_data_len);
+        }
+    }
+
+    return rc;
+}
+
+CK_RV aes_gcm_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                  CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                  CK_VOID_PTR param, CK_ULONG param_len,
+                  CK_BYTE *aad, CK_ULONG aad_len,
+                  CK_BYTE *in_data, CK_ULONG in_data_len,
+                  CK_BYTE *out_data, CK_ULONG *out_data_len,
+                  CK_BYTE direction)
+{
+    CK_BYTE *scratch;
+    CK_ULONG tag_len, scratch_len;
+    CK_RV rc;
+
+    if (!sess || !ctx || !out_data_len) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = aes_gcm_msg_check_param(param, param_len, &tag_len);
+    if (rc != CKR_OK)
+        return rc;
+
+    /*
+     * Check the output buffer before the IV is set up, so that a length
+     * query does not consume a generated IV.
+     */
+    if (length_only == TRUE) {
+        *out_data_len = in_data_len;
+        return CKR_OK;
+    }
+
+    if (*out_data_len < in_data_len) {
+        *out_data_len = in_data_len;
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    rc = aes_gcm_msg_begin(tokdata, sess, ctx, param, param_len,
+                           aad, aad_len, direction);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (direction == ENCRYPT)
+        return aes_gcm_msg_next(tokdata, sess, FALSE, ctx, param, param_len,
+                                in_data, in_data_len, out_data, out_data_len,
+                                TRUE, direction);
+
+    /*
+     * Decrypt into a scratch buffer, so that the caller's buffer only ever
+     * receives plain text whose tag has been verified.
+     */
+    scratch = malloc(in_data_len > 0 ? in_data_len : 1);
+    if (scratch == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    scratch_len = in_data_len;
+    rc = aes_gcm_msg_next(tokdata, sess, FALSE, ctx, param, param_len,
+                          in_data, in_data_len, scratch, &scratch_len,
+                          TRUE, direction);
+    if (rc == CKR_OK) {
+        memcpy(out_data, scratch, scratch_len);
+        *out_data_len = scratch_len;
+    }
+
+    OPENSSL_cleanse(scratch, in_data_len);
+    free(scratch);
+
+    return rc;
+}
+
 //
 // mechanisms
 //
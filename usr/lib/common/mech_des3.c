@@ -385,6 +385,158 @@ done:
 }
 
 
+// Encrypts or decrypts the block aligned data of an update call. The cipher
+// state is kept in the context if the token supports that, otherwise the key
+// is looked up and the single-part token function is called. For CBC the
+// init_v in the mechanism parameter is advanced to the last cipher block, so
+// that the data of one update may be passed in several calls.
+//
+static CK_RV des3_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                                ENCR_DECR_CONTEXT *ctx,
+                                CK_BYTE *in_data, CK_ULONG in_data_len,
+                                CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                CK_BYTE encrypt)
+{
+    OBJECT *key = NULL;
+    CK_BYTE last_block[DES_BLOCK_SIZE];
+    CK_BBOOL cbc;
+    CK_RV rc;
+
+    cbc = (ctx->mech.mechanism == CKM_DES3_CBC ||
+           ctx->mech.mechanism == CKM_DES3_CBC_PAD);
+    // in place decryption overwrites the last cipher block
+    if (cbc && !encrypt)
+        memcpy(last_block, in_data + (in_data_len - DES_BLOCK_SIZE),
+               DES_BLOCK_SIZE);
+
+    rc = encr_mgr_cipher_update(tokdata, sess, ctx, in_data, in_data_len,
+                                out_data, out_data_len, encrypt);
+    if (rc != CKR_FUNCTION_NOT_SUPPORTED)
+        goto done;
+
+    rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to find specified object.\n");
+        return rc;
+    }
+
+    switch (ctx->mech.mechanism) {
+    case CKM_DES3_ECB:
+        if (encrypt)
+            rc = ckm_des3_ecb_encrypt(tokdata, in_data, in_data_len,
+                                      out_data, out_data_len, key);
+        else
+            rc = ckm_des3_ecb_decrypt(tokdata, in_data, in_data_len,
+                                      out_data, out_data_len, key);
+        break;
+    case CKM_DES3_CBC:
+    case CKM_DES3_CBC_PAD:
+        if (encrypt)
+            rc = ckm_des3_cbc_encrypt(tokdata, in_data, in_data_len,
+                                      out_data, out_data_len,
+                                      ctx->mech.pParameter, key);
+        else
+            rc = ckm_des3_cbc_decrypt(tokdata, in_data, in_data_len,
+                                      out_data, out_data_len,
+                                      ctx->mech.pParameter, key);
+        break;
+    case CKM_DES_OFB64:
+        rc = token_specific.t_tdes_ofb(tokdata, in_data, out_data,
+                                       in_data_len, key,
+                                       ctx->mech.pParameter, encrypt);
+        break;
+    case CKM_DES_CFB8:
+        rc = token_specific.t_tdes_cfb(tokdata, in_data, out_data,
+                                       in_data_len, key,
+                                       ctx->mech.pParameter, 0x01, encrypt);
+        break;
+    case CKM_DES_CFB64:
+        rc = token_specific.t_tdes_cfb(tokdata, in_data, out_data,
+                                       in_data_len, key,
+                                       ctx->mech.pParameter, 0x08, encrypt);
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        rc = CKR_MECHANISM_INVALID;
+        break;
+    }
+
+    object_put(tokdata, key, TRUE);
+    key = NULL;
+
+done:
+    if (rc == CKR_OK && cbc)
+        memcpy(ctx->mech.pParameter,
+               encrypt ? out_data + (in_data_len - DES_BLOCK_SIZE) : last_block,
+               DES_BLOCK_SIZE);
+
+    return rc;
+}
+
+// Encrypts or decrypts the out_len bytes made up of the data left over from
+// the previous update and the new input, and keeps the last remain bytes of
+// the input for the next call. The input is passed to the cipher as is, only
+// a partial block left over from the previous update is completed in a stack
+// buffer, or in the output buffer when called in place.
+//
+static CK_RV des3_cipher_update_blocks(STDLL_TokData_t *tokdata, SESSION *sess,
+                                       ENCR_DECR_CONTEXT *ctx,
+                                       CK_BYTE *in_data, CK_ULONG in_data_len,
+                                       CK_BYTE *out_data,
+                                       CK_ULONG *out_data_len, CK_ULONG out_len,
+                                       CK_ULONG remain, CK_ULONG block_len,
+                                       CK_BYTE encrypt)
+{
+    DES_CONTEXT *context = (DES_CONTEXT *) ctx->context;
+    CK_BYTE block[DES_BLOCK_SIZE], tail[DES_BLOCK_SIZE];
+    CK_ULONG fill, len;
+    CK_RV rc;
+
+    if (*out_data_len < out_len) {
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    // the output may overwrite the remaining input when done in place
+    if (remain != 0)
+        memcpy(tail, in_data + (in_data_len - remain), remain);
+
+    len = *out_data_len;
+    if (context->len == 0) {
+        rc = des3_cipher_update(tokdata, sess, ctx, in_data, out_len,
+                                out_data, &len, encrypt);
+    } else if (in_data == out_data) {
+        // move the input behind the data left over from the previous update
+        memmove(out_data + context->len, in_data, out_len - context->len);
+        memcpy(out_data, context->data, context->len);
+        rc = des3_cipher_update(tokdata, sess, ctx, out_data, out_len,
+                                out_data, &len, encrypt);
+    } else {
+        fill = block_len - context->len;
+        memcpy(block, context->data, context->len);
+        memcpy(block + context->len, in_data, fill);
+        rc = des3_cipher_update(tokdata, sess, ctx, block, block_len,
+                                out_data, &len, encrypt);
+        if (rc == CKR_OK && out_len > block_len) {
+            len = *out_data_len - block_len;
+            rc = des3_cipher_update(tokdata, sess, ctx, in_data + fill,
+                                    out_len - block_len,
+                                    out_data + block_len, &len, encrypt);
+        }
+    }
+    if (rc != CKR_OK)
+        return rc;
+
+    *out_data_len = out_len;
+
+    if (remain != 0)
+        memcpy(context->data, tail, remain);
+    context->len = remain;
+
+    return CKR_OK;
+}
+
+
 //
 //
 CK_RV des3_ecb_encrypt_update(STDLL_TokData_t *tokdata,
@@ -396,8 +548,6 @@ CK_RV des3_ecb_encrypt_update(STDLL_TokData_t *tokdata,
                               CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -427,42 +577,9 @@ CK_RV des3_ecb_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous encryption operation first
-        //
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
-
-        rc = ckm_des3_ecb_encrypt(tokdata, clear, out_len,
-                                  out_data, out_data_len, key);
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // update the context buffer.  we already used the buffer's current
-            // contents so we completely overwrite it
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-
-            context->len = remain;
-        }
-
-        free(clear);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 1);
 
         return rc;
     }
@@ -480,8 +597,6 @@ CK_RV des3_ecb_decrypt_update(STDLL_TokData_t *tokdata,
                               CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -512,40 +627,9 @@ CK_RV des3_ecb_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous decryption operation first
-        //
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = ckm_des3_ecb_decrypt(tokdata, cipher, out_len, out_data,
-                                  out_data_len, key);
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 0);
 
         return rc;
     }
@@ -564,8 +648,6 @@ CK_RV des3_cbc_encrypt_update(STDLL_TokData_t *tokdata,
                               CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -597,47 +679,9 @@ CK_RV des3_cbc_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous encryption operation first
-        //
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
-
-        rc = ckm_des3_cbc_encrypt(tokdata, clear, out_len, out_data,
-                                  out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // the new init_v is the last encrypted data block
-            //
-            memcpy(ctx->mech.pParameter,
-                   out_data + (*out_data_len - DES_BLOCK_SIZE), DES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the context buffer
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(clear);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 1);
 
         return rc;
     }
@@ -655,8 +699,6 @@ CK_RV des3_cbc_decrypt_update(STDLL_TokData_t *tokdata,
                               CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -688,48 +730,9 @@ CK_RV des3_cbc_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_OK;
         }
 
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous decryption operation first
-        //
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = ckm_des3_cbc_decrypt(tokdata, cipher, out_len, out_data,
-                                  out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // the new init_v is the last input data block
-            //
-            memcpy(ctx->mech.pParameter, cipher + (out_len - DES_BLOCK_SIZE),
-                   DES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the context buffer
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-
-            context->len = remain;
-        }
-
-        free(cipher);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 0);
 
         return rc;
     }
@@ -748,8 +751,6 @@ CK_RV des3_cbc_pad_encrypt_update(STDLL_TokData_t *tokdata,
                                   CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *clear = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -785,52 +786,10 @@ CK_RV des3_cbc_pad_encrypt_update(STDLL_TokData_t *tokdata,
             *out_data_len = out_len;
             return CKR_OK;
         }
-        // at this point, we should have:
-        //    1) remain != 0
-        //    2) out_len != 0
-        //
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        clear = (CK_BYTE *) malloc(out_len);
-        if (!clear) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous encryption operation first
-        //
-        memcpy(clear, context->data, context->len);
-        memcpy(clear + context->len, in_data, out_len - context->len);
-
-        //
-        // we don't do padding during the update
-        //
-        rc = ckm_des3_cbc_encrypt(tokdata, clear, out_len, out_data,
-                                  out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            // the new init_v is the last encrypted data block
-            //
-            memcpy(ctx->mech.pParameter,
-                   out_data + (*out_data_len - DES_BLOCK_SIZE), DES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the temporary space
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
 
-        free(clear);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 1);
 
         return rc;
     }
@@ -848,8 +807,6 @@ CK_RV des3_cbc_pad_decrypt_update(STDLL_TokData_t *tokdata,
                                   CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_CONTEXT *context = NULL;
-    OBJECT *key = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
 
@@ -887,49 +844,10 @@ CK_RV des3_cbc_pad_decrypt_update(STDLL_TokData_t *tokdata,
             *out_data_len = out_len;
             return CKR_OK;
         }
-        // at this point, we should have:
-        //    1) remain != 0
-        //    2) out_len != 0
-        //
-        rc = object_mgr_find_in_map_nocache(tokdata, ctx->key, &key, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        // these buffers need to be longword aligned
-        //
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            object_put(tokdata, key, TRUE);
-            key = NULL;
-            return CKR_HOST_MEMORY;
-        }
-        // copy any data left over from the previous decryption operation first
-        //
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
 
-        rc = ckm_des3_cbc_decrypt(tokdata, cipher, out_len, out_data,
-                                  out_data_len, ctx->mech.pParameter, key);
-
-        if (rc == CKR_OK) {
-            // the new init_v is the last input data block
-            //
-            memcpy(ctx->mech.pParameter, cipher + (out_len - DES_BLOCK_SIZE),
-                   DES_BLOCK_SIZE);
-
-            // copy the remaining 'new' input data to the temporary space
-            //
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        }
-
-        free(cipher);
-
-        object_put(tokdata, key, TRUE);
-        key = NULL;
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 0);
 
         return rc;
     }
@@ -1253,10 +1171,8 @@ CK_RV des3_ofb_encrypt_update(STDLL_TokData_t *tokdata,
                               CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_DATA_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -1289,41 +1205,11 @@ CK_RV des3_ofb_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous encryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_tdes_ofb(tokdata, cipher, out_data, out_len,
-                                       key_obj, ctx->mech.pParameter, 1);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 1);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific des3 ofb encrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -1433,10 +1319,8 @@ CK_RV des3_ofb_decrypt_update(STDLL_TokData_t *tokdata,
                               CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
     DES_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -1469,41 +1353,11 @@ CK_RV des3_ofb_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous decryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_tdes_ofb(tokdata, cipher, out_data, out_len,
-                                       key_obj, ctx->mech.pParameter, 0);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       DES_BLOCK_SIZE, 0);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific des3 ofb decrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -1617,10 +1471,8 @@ CK_RV des3_cfb_encrypt_update(STDLL_TokData_t *tokdata,
                               CK_ULONG *out_data_len, CK_ULONG cfb_len)
 {
     DES_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -1653,41 +1505,11 @@ CK_RV des3_cfb_encrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous encryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_tdes_cfb(tokdata, cipher, out_data, out_len,
-                                       key_obj, ctx->mech.pParameter, cfb_len,
-                                       1);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       cfb_len, 1);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific des3 cfb encrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -1802,10 +1624,8 @@ CK_RV des3_cfb_decrypt_update(STDLL_TokData_t *tokdata,
                               CK_ULONG *out_data_len, CK_ULONG cfb_len)
 {
     DES_CONTEXT *context = NULL;
-    CK_BYTE *cipher = NULL;
     CK_ULONG total, remain, out_len;
     CK_RV rc;
-    OBJECT *key_obj = NULL;
 
     if (!sess || !ctx || !out_data_len) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -1839,41 +1659,11 @@ CK_RV des3_cfb_decrypt_update(STDLL_TokData_t *tokdata,
             return CKR_BUFFER_TOO_SMALL;
         }
 
-        rc = object_mgr_find_in_map1(tokdata, ctx->key, &key_obj, READ_LOCK);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("Failed to find specified object.\n");
-            return rc;
-        }
-        cipher = (CK_BYTE *) malloc(out_len);
-        if (!cipher) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            rc = CKR_HOST_MEMORY;
-            goto done;
-        }
-        // copy any data left over from the previous decryption operation first
-        memcpy(cipher, context->data, context->len);
-        memcpy(cipher + context->len, in_data, out_len - context->len);
-
-        rc = token_specific.t_tdes_cfb(tokdata, cipher, out_data, out_len,
-                                       key_obj, ctx->mech.pParameter, cfb_len,
-                                       0);
-
-        if (rc == CKR_OK) {
-            *out_data_len = out_len;
-
-            // copy the remaining 'new' input data to the context buffer
-            if (remain != 0)
-                memcpy(context->data, in_data + (in_data_len - remain), remain);
-            context->len = remain;
-        } else {
+        rc = des3_cipher_update_blocks(tokdata, sess, ctx, in_data, in_data_len,
+                                       out_data, out_data_len, out_len, remain,
+                                       cfb_len, 0);
+        if (rc != CKR_OK)
             TRACE_DEVEL("Token specific des3 cfb decrypt failed.\n");
-        }
-
-        free(cipher);
-
-done:
-        object_put(tokdata, key_obj, TRUE);
-        key_obj = NULL;
 
         return rc;
     }
@@ -359,7 +359,11 @@ CK_RV ec_hash_sign_update(STDLL_TokData_t *tokdata,
             return rc;
         }
         context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
+        /*
+         * The digest context holds its state in separately allocated
+         * memory, which is not part of a saved operation state.
+         */
+        ctx->state_unsaveable = CK_TRUE;
     }
 
     rc = digest_mgr_digest_update(tokdata, sess, &context->hash_context,
@@ -549,7 +553,7 @@ CK_RV ec_hash_verify_update(STDLL_TokData_t *tokdata,
             return rc;
         }
         context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
+        ctx->state_unsaveable = CK_TRUE;
     }
 
     rc = digest_mgr_digest_update(tokdata, sess, &context->hash_context,
@@ -47,7 +47,8 @@ CK_RV sw_md5_init(DIGEST_CONTEXT *ctx)
         return CKR_HOST_MEMORY;
     }
 
-    if (!EVP_DigestInit_ex((EVP_MD_CTX *)ctx->context, EVP_md5(), NULL)) {
+    if (!EVP_DigestInit_ex((EVP_MD_CTX *)ctx->context,
+                           openssl_cached_md(EVP_md5()), NULL)) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         EVP_MD_CTX_free((EVP_MD_CTX *)ctx->context);
         ctx->context = NULL;
@@ -270,7 +271,7 @@ CK_RV md5_hmac_sign(STDLL_TokData_t *tokdata,
     if (rc != CKR_OK)
         return rc;
 
-    rc = openssl_specific_hmac(ctx, in_data, in_data_len,
+    rc = openssl_specific_hmac(tokdata, ctx, in_data, in_data_len,
                                out_data, out_data_len, TRUE);
     if (rc != CKR_OK)
         return rc;
@@ -294,7 +295,7 @@ CK_RV md5_hmac_verify(STDLL_TokData_t *tokdata, SESSION *sess,
     if (rc != CKR_OK)
         return rc;
 
-    rc = openssl_specific_hmac(ctx, in_data, in_data_len,
+    rc = openssl_specific_hmac(tokdata, ctx, in_data, in_data_len,
                                signature, &sig_len, FALSE);
     if (rc != CKR_OK)
         return rc;
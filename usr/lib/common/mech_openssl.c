@@ -35,6 +35,327 @@
 #if OPENSSL_VERSION_PREREQ(3, 0)
 #include <openssl/core_names.h>
 #include <openssl/param_build.h>
+#include <openssl/provider.h>
+#endif
+
+/*
+ * openssl_specific_sha_single() digests with an EVP_MD_CTX of the calling
+ * thread that is kept for its later calls, instead of allocating and freeing
+ * a context for each digest. The thread-specific key is created with the
+ * first and deleted with the last initialized token, so that no destructor
+ * of an unloaded token library runs at thread exit. The contexts are kept in
+ * a list, so that those of threads still running at that time are freed, too.
+ */
+struct thread_md_ctx {
+    EVP_MD_CTX *md_ctx;
+    struct thread_md_ctx *prev;
+    struct thread_md_ctx *next;
+};
+
+static pthread_mutex_t thread_md_ctx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_md_ctx_key;
+static CK_BBOOL thread_md_ctx_key_valid = FALSE;
+static unsigned long thread_md_ctx_refcount;
+static struct thread_md_ctx *thread_md_ctx_list;
+
+static void thread_md_ctx_destroy(void *arg)
+{
+    struct thread_md_ctx *t = arg;
+
+    pthread_mutex_lock(&thread_md_ctx_mutex);
+    if (t->prev != NULL)
+        t->prev->next = t->next;
+    else
+        thread_md_ctx_list = t->next;
+    if (t->next != NULL)
+        t->next->prev = t->prev;
+    pthread_mutex_unlock(&thread_md_ctx_mutex);
+
+    EVP_MD_CTX_free(t->md_ctx);
+    free(t);
+}
+
+static void thread_md_ctx_init(void)
+{
+    pthread_mutex_lock(&thread_md_ctx_mutex);
+    if (thread_md_ctx_refcount++ == 0) {
+        thread_md_ctx_key_valid =
+                pthread_key_create(&thread_md_ctx_key,
+                                   thread_md_ctx_destroy) == 0;
+        if (!thread_md_ctx_key_valid)
+            TRACE_DEVEL("pthread_key_create failed, digests use a "
+                        "temporary context\n");
+    }
+    pthread_mutex_unlock(&thread_md_ctx_mutex);
+}
+
+static void thread_md_ctx_final(void)
+{
+    struct thread_md_ctx *t;
+
+    pthread_mutex_lock(&thread_md_ctx_mutex);
+    if (thread_md_ctx_refcount == 0 || --thread_md_ctx_refcount > 0)
+        goto out;
+
+    if (thread_md_ctx_key_valid) {
+        pthread_key_delete(thread_md_ctx_key);
+        thread_md_ctx_key_valid = FALSE;
+    }
+
+    while ((t = thread_md_ctx_list) != NULL) {
+        thread_md_ctx_list = t->next;
+        EVP_MD_CTX_free(t->md_ctx);
+        free(t);
+    }
+
+out:
+    pthread_mutex_unlock(&thread_md_ctx_mutex);
+}
+
+/* Returns the EVP_MD_CTX of the calling thread, or NULL if not available */
+static EVP_MD_CTX *thread_md_ctx_get(void)
+{
+    struct thread_md_ctx *t;
+
+    if (!thread_md_ctx_key_valid)
+        return NULL;
+
+    t = pthread_getspecific(thread_md_ctx_key);
+    if (t != NULL)
+        return t->md_ctx;
+
+    t = calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+
+    t->md_ctx = EVP_MD_CTX_new();
+    if (t->md_ctx == NULL) {
+        free(t);
+        return NULL;
+    }
+
+    if (pthread_setspecific(thread_md_ctx_key, t) != 0) {
+        EVP_MD_CTX_free(t->md_ctx);
+        free(t);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&thread_md_ctx_mutex);
+    t->next = thread_md_ctx_list;
+    if (t->next != NULL)
+        t->next->prev = t;
+    thread_md_ctx_list = t;
+    pthread_mutex_unlock(&thread_md_ctx_mutex);
+
+    return t->md_ctx;
+}
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+/*
+ * With OpenSSL 3, the legacy algorithm accessors like EVP_sha256() return
+ * objects that are not bound to a provider implementation, so every
+ * EVP_*Init call with such an object fetches the implementation again from
+ * the library context. This takes the lock of the library context's method
+ * store, and becomes a bottleneck with many threads doing small operations.
+ *
+ * The algorithms used by the token are therefore fetched once at token
+ * initialization from the library context in effect at that time, i.e. the
+ * one of the PKCS#11 API library, and openssl_cached_cipher() and
+ * openssl_cached_md() map the legacy objects to the fetched ones. If an
+ * algorithm could not be fetched (e.g. single DES without the legacy
+ * provider), or another library context is in effect, the legacy object is
+ * used as before.
+ */
+static const EVP_CIPHER *(*const openssl_cache_ciphers[])(void) = {
+    EVP_des_ecb, EVP_des_cbc, EVP_des_ofb, EVP_des_cfb8, EVP_des_cfb64,
+    EVP_des_ede_ecb, EVP_des_ede_cbc, EVP_des_ede_ofb, EVP_des_ede_cfb64,
+    EVP_des_ede3_ecb, EVP_des_ede3_cbc, EVP_des_ede3_ofb, EVP_des_ede3_cfb8,
+    EVP_des_ede3_cfb64,
+    EVP_aes_128_ecb, EVP_aes_192_ecb, EVP_aes_256_ecb,
+    EVP_aes_128_cbc, EVP_aes_192_cbc, EVP_aes_256_cbc,
+    EVP_aes_128_ctr, EVP_aes_192_ctr, EVP_aes_256_ctr,
+    EVP_aes_128_ofb, EVP_aes_192_ofb, EVP_aes_256_ofb,
+    EVP_aes_128_cfb8, EVP_aes_192_cfb8, EVP_aes_256_cfb8,
+    EVP_aes_128_cfb128, EVP_aes_192_cfb128, EVP_aes_256_cfb128,
+    EVP_aes_128_gcm, EVP_aes_192_gcm, EVP_aes_256_gcm,
+    EVP_aes_128_xts, EVP_aes_256_xts,
+    EVP_aes_128_wrap, EVP_aes_192_wrap, EVP_aes_256_wrap,
+    EVP_aes_128_wrap_pad, EVP_aes_192_wrap_pad, EVP_aes_256_wrap_pad,
+};
+
+static const EVP_MD *(*const openssl_cache_mds[])(void) = {
+    EVP_md5, EVP_sha1, EVP_sha224, EVP_sha256, EVP_sha384, EVP_sha512,
+    EVP_sha512_224, EVP_sha512_256,
+    EVP_sha3_224, EVP_sha3_256, EVP_sha3_384, EVP_sha3_512,
+    EVP_shake128, EVP_shake256,
+};
+
+static const char *const openssl_cache_macs[] = { "HMAC", "CMAC" };
+
+#define OPENSSL_CACHE_NUM_CIPHERS   (sizeof(openssl_cache_ciphers) / \
+                                     sizeof(openssl_cache_ciphers[0]))
+#define OPENSSL_CACHE_NUM_MDS       (sizeof(openssl_cache_mds) / \
+                                     sizeof(openssl_cache_mds[0]))
+#define OPENSSL_CACHE_NUM_MACS      (sizeof(openssl_cache_macs) / \
+                                     sizeof(openssl_cache_macs[0]))
+
+static struct {
+    OSSL_LIB_CTX *libctx;
+    unsigned long refcount;     /* number of initialized tokens */
+    const EVP_CIPHER *legacy_cipher[OPENSSL_CACHE_NUM_CIPHERS];
+    EVP_CIPHER *cipher[OPENSSL_CACHE_NUM_CIPHERS];
+    const EVP_MD *legacy_md[OPENSSL_CACHE_NUM_MDS];
+    EVP_MD *md[OPENSSL_CACHE_NUM_MDS];
+    EVP_MAC *mac[OPENSSL_CACHE_NUM_MACS];
+} openssl_cache;
+
+/*
+ * Called at token initialization, with the library context of the PKCS#11
+ * API library being the default library context.
+ */
+void openssl_cache_init(void)
+{
+    unsigned int i;
+
+    thread_md_ctx_init();
+
+    if (openssl_cache.refcount++ > 0)
+        return;
+
+    openssl_cache.libctx = OSSL_LIB_CTX_set0_default(NULL);
+
+    ERR_set_mark();
+
+    for (i = 0; i < OPENSSL_CACHE_NUM_CIPHERS; i++) {
+        openssl_cache.legacy_cipher[i] = openssl_cache_ciphers[i]();
+        openssl_cache.cipher[i] =
+            EVP_CIPHER_fetch(NULL,
+                             EVP_CIPHER_get0_name(
+                                        openssl_cache.legacy_cipher[i]),
+                             NULL);
+        if (openssl_cache.cipher[i] == NULL)
+            TRACE_DEVEL("Cipher %s not available\n",
+                        EVP_CIPHER_get0_name(openssl_cache.legacy_cipher[i]));
+    }
+
+    for (i = 0; i < OPENSSL_CACHE_NUM_MDS; i++) {
+        openssl_cache.legacy_md[i] = openssl_cache_mds[i]();
+        openssl_cache.md[i] =
+            EVP_MD_fetch(NULL, EVP_MD_get0_name(openssl_cache.legacy_md[i]),
+                         NULL);
+        if (openssl_cache.md[i] == NULL)
+            TRACE_DEVEL("Digest %s not available\n",
+                        EVP_MD_get0_name(openssl_cache.legacy_md[i]));
+    }
+
+    for (i = 0; i < OPENSSL_CACHE_NUM_MACS; i++) {
+        openssl_cache.mac[i] = EVP_MAC_fetch(NULL, openssl_cache_macs[i], NULL);
+        if (openssl_cache.mac[i] == NULL)
+            TRACE_DEVEL("MAC %s not available\n", openssl_cache_macs[i]);
+    }
+
+    /* Algorithms not available are reported when they are used */
+    ERR_pop_to_mark();
+}
+
+/* Called at token finalization */
+void openssl_cache_final(void)
+{
+    unsigned int i;
+
+    thread_md_ctx_final();
+
+    if (openssl_cache.refcount == 0 || --openssl_cache.refcount > 0)
+        return;
+
+    for (i = 0; i < OPENSSL_CACHE_NUM_CIPHERS; i++) {
+        EVP_CIPHER_free(openssl_cache.cipher[i]);
+        openssl_cache.cipher[i] = NULL;
+    }
+    for (i = 0; i < OPENSSL_CACHE_NUM_MDS; i++) {
+        EVP_MD_free(openssl_cache.md[i]);
+        openssl_cache.md[i] = NULL;
+    }
+    for (i = 0; i < OPENSSL_CACHE_NUM_MACS; i++) {
+        EVP_MAC_free(openssl_cache.mac[i]);
+        openssl_cache.mac[i] = NULL;
+    }
+    openssl_cache.libctx = NULL;
+}
+
+static CK_BBOOL openssl_cache_usable(void)
+{
+    return openssl_cache.refcount > 0 &&
+           OSSL_LIB_CTX_set0_default(NULL) == openssl_cache.libctx;
+}
+
+const EVP_CIPHER *openssl_cached_cipher(const EVP_CIPHER *cipher)
+{
+    unsigned int i;
+
+    if (cipher == NULL || !openssl_cache_usable())
+        return cipher;
+
+    for (i = 0; i < OPENSSL_CACHE_NUM_CIPHERS; i++) {
+        if (openssl_cache.legacy_cipher[i] == cipher)
+            return openssl_cache.cipher[i] != NULL ?
+                                openssl_cache.cipher[i] : cipher;
+    }
+
+    return cipher;
+}
+
+const EVP_MD *openssl_cached_md(const EVP_MD *md)
+{
+    unsigned int i;
+
+    if (md == NULL || !openssl_cache_usable())
+        return md;
+
+    for (i = 0; i < OPENSSL_CACHE_NUM_MDS; i++) {
+        if (openssl_cache.legacy_md[i] == md)
+            return openssl_cache.md[i] != NULL ? openssl_cache.md[i] : md;
+    }
+
+    return md;
+}
+
+/* Returns a reference to the MAC, to be freed with EVP_MAC_free() */
+static EVP_MAC *openssl_fetch_mac(const char *name)
+{
+    unsigned int i;
+
+    if (openssl_cache_usable()) {
+        for (i = 0; i < OPENSSL_CACHE_NUM_MACS; i++) {
+            if (openssl_cache.mac[i] != NULL &&
+                strcmp(openssl_cache_macs[i], name) == 0 &&
+                EVP_MAC_up_ref(openssl_cache.mac[i]) == 1)
+                return openssl_cache.mac[i];
+        }
+    }
+
+    return EVP_MAC_fetch(NULL, name, NULL);
+}
+#else
+void openssl_cache_init(void)
+{
+    thread_md_ctx_init();
+}
+
+void openssl_cache_final(void)
+{
+    thread_md_ctx_final();
+}
+
+const EVP_CIPHER *openssl_cached_cipher(const EVP_CIPHER *cipher)
+{
+    return cipher;
+}
+
+const EVP_MD *openssl_cached_md(const EVP_MD *md)
+{
+    return md;
+}
 #endif
 
 void openssl_free_ex_data(OBJECT *obj, void *ex_data, size_t ex_data_len)
@@ -132,6 +453,18 @@ static CK_BBOOL openssl_need_wr_lock(OBJECT *obj, void *ex_data,
     return data->pkey == NULL;
 }
 
+/*
+ * Key generation progress callback. It is called by OpenSSL (via BN_GENCB)
+ * while searching for primes, and aborts the key generation if the operation
+ * was canceled by C_SessionCancel.
+ */
+static int openssl_keygen_cb(EVP_PKEY_CTX *ctx)
+{
+    UNUSED(ctx);
+
+    return session_mgr_op_canceled() ? 0 : 1;
+}
+
 CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
 {
     CK_ATTRIBUTE *publ_exp = NULL;
@@ -195,6 +528,7 @@ CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
         rc = CKR_FUNCTION_FAILED;
         goto done;
     }
+    EVP_PKEY_CTX_set_cb(ctx, openssl_keygen_cb);
     if (mod_bits > INT_MAX
         || EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, mod_bits) != 1) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
@@ -224,6 +558,12 @@ CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
             break;
         }
 
+        if (session_mgr_op_canceled()) {
+            TRACE_DEVEL("RSA key generation canceled\n");
+            rc = CKR_FUNCTION_CANCELED;
+            break;
+        }
+
         TRACE_ERROR("%s (try %d)\n", ock_err(ERR_FUNCTION_FAILED), try);
         rc = CKR_FUNCTION_FAILED;
     }
@@ -231,6 +571,11 @@ CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
         goto done;
 #else
     if (EVP_PKEY_keygen(ctx, &pkey) != 1) {
+        if (session_mgr_op_canceled()) {
+            TRACE_DEVEL("RSA key generation canceled\n");
+            rc = CKR_FUNCTION_CANCELED;
+            goto done;
+        }
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         rc = CKR_FUNCTION_FAILED;
         goto done;
@@ -3023,7 +3368,258 @@ static const EVP_MD *md_from_mech(CK_MECHANISM *mech)
         break;
     }
 
-    return md;
+    return openssl_cached_md(md);
+}
+
+#if OPENSSL_VERSION_PREREQ(3, 0) && !defined(OPENSSL_NO_DEPRECATED_3_0)
+#define OPENSSL_SHA_STATE
+
+/*
+ * OpenSSL 3.0 can not export the state of an EVP_MD_CTX, so a digest or HMAC
+ * operation using one can not be saved by C_GetOperationState. For SHA-1 and
+ * SHA-2 the low level SHA functions are used instead, whose state is a plain
+ * structure without any pointers. It is kept in the operation's context as
+ * is, so C_GetOperationState and C_SetOperationState save and restore it
+ * without any further processing. The version must be changed whenever the
+ * layout of the structure changes.
+ *
+ * The low level functions bypass the providers. So they are only used when
+ * FIPS mode is not enabled and the digest would otherwise also be taken from
+ * the default provider of the library context in use, and never when another
+ * provider, e.g. the FIPS provider, implements it.
+ */
+#define OPENSSL_SHA_STATE_VERSION       1
+
+struct openssl_sha_state {
+    CK_ULONG version;
+    CK_MECHANISM_TYPE mech;
+    union {
+        SHA_CTX sha1;
+        SHA256_CTX sha256;
+        SHA512_CTX sha512;
+    } u;
+};
+
+/* The low level SHA functions are deprecated since OpenSSL 3.0 */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+static CK_BBOOL openssl_sha_state_usable(CK_MECHANISM_TYPE mech)
+{
+    CK_MECHANISM m = { mech, NULL, 0 };
+    const OSSL_PROVIDER *prov;
+    const EVP_MD *md;
+    EVP_MD *fetched = NULL;
+    CK_BBOOL usable;
+
+    switch (mech) {
+    case CKM_SHA_1:
+    case CKM_SHA224:
+    case CKM_SHA256:
+    case CKM_SHA384:
+    case CKM_SHA512:
+        break;
+    default:
+        return FALSE;
+    }
+
+    if (EVP_default_properties_is_fips_enabled(NULL) != 0)
+        return FALSE;
+
+    /* The cached digest is already fetched, a legacy one is not */
+    md = md_from_mech(&m);
+    if (md == NULL)
+        return FALSE;
+    prov = EVP_MD_get0_provider(md);
+    if (prov == NULL) {
+        fetched = EVP_MD_fetch(NULL, EVP_MD_get0_name(md), NULL);
+        if (fetched == NULL)
+            return FALSE;
+        prov = EVP_MD_get0_provider(fetched);
+    }
+
+    usable = prov != NULL &&
+             strcmp(OSSL_PROVIDER_get0_name(prov), "default") == 0;
+
+    EVP_MD_free(fetched);
+
+    return usable;
+}
+
+static int openssl_sha_state_init(struct openssl_sha_state *state,
+                                  CK_MECHANISM_TYPE mech)
+{
+    memset(state, 0, sizeof(*state));
+    state->version = OPENSSL_SHA_STATE_VERSION;
+    state->mech = mech;
+
+    switch (mech) {
+    case CKM_SHA_1:
+        return SHA1_Init(&state->u.sha1);
+    case CKM_SHA224:
+        return SHA224_Init(&state->u.sha256);
+    case CKM_SHA256:
+        return SHA256_Init(&state->u.sha256);
+    case CKM_SHA384:
+        return SHA384_Init(&state->u.sha512);
+    case CKM_SHA512:
+        return SHA512_Init(&state->u.sha512);
+    default:
+        return 0;
+    }
+}
+
+static int openssl_sha_state_update(struct openssl_sha_state *state,
+                                    const CK_BYTE *data, CK_ULONG len)
+{
+    switch (state->mech) {
+    case CKM_SHA_1:
+        return SHA1_Update(&state->u.sha1, data, len);
+    case CKM_SHA224:
+        return SHA224_Update(&state->u.sha256, data, len);
+    case CKM_SHA256:
+        return SHA256_Update(&state->u.sha256, data, len);
+    case CKM_SHA384:
+        return SHA384_Update(&state->u.sha512, data, len);
+    case CKM_SHA512:
+        return SHA512_Update(&state->u.sha512, data, len);
+    default:
+        return 0;
+    }
+}
+
+static int openssl_sha_state_final(struct openssl_sha_state *state,
+                                   CK_BYTE *out)
+{
+    switch (state->mech) {
+    case CKM_SHA_1:
+        return SHA1_Final(out, &state->u.sha1);
+    case CKM_SHA224:
+        return SHA224_Final(out, &state->u.sha256);
+    case CKM_SHA256:
+        return SHA256_Final(out, &state->u.sha256);
+    case CKM_SHA384:
+        return SHA384_Final(out, &state->u.sha512);
+    case CKM_SHA512:
+        return SHA512_Final(out, &state->u.sha512);
+    default:
+        return 0;
+    }
+}
+
+#pragma GCC diagnostic pop
+
+/*
+ * Returns the SHA state for digest mechanism mech kept in a context, or NULL
+ * if the context does not hold a valid one. A restored context comes from the
+ * application, so the buffer positions in it are checked before it is used.
+ */
+static struct openssl_sha_state *openssl_sha_state_get(CK_BYTE *context,
+                                                       CK_ULONG context_len,
+                                                       CK_MECHANISM_TYPE mech)
+{
+    struct openssl_sha_state *state = (struct openssl_sha_state *)context;
+    CK_BBOOL valid;
+
+    if (state == NULL || context_len != sizeof(*state) ||
+        state->version != OPENSSL_SHA_STATE_VERSION || state->mech != mech)
+        goto invalid;
+
+    switch (state->mech) {
+    case CKM_SHA_1:
+        valid = state->u.sha1.num < SHA_CBLOCK;
+        break;
+    case CKM_SHA224:
+    case CKM_SHA256:
+        valid = state->u.sha256.num < SHA256_CBLOCK &&
+                state->u.sha256.md_len == (state->mech == CKM_SHA224 ?
+                                           SHA224_DIGEST_LENGTH :
+                                           SHA256_DIGEST_LENGTH);
+        break;
+    case CKM_SHA384:
+    case CKM_SHA512:
+        valid = state->u.sha512.num < SHA512_CBLOCK &&
+                state->u.sha512.md_len == (state->mech == CKM_SHA384 ?
+                                           SHA384_DIGEST_LENGTH :
+                                           SHA512_DIGEST_LENGTH);
+        break;
+    default:
+        valid = FALSE;
+        break;
+    }
+
+    if (valid)
+        return state;
+
+invalid:
+    TRACE_ERROR("Invalid SHA state in context\n");
+    return NULL;
+}
+#endif
+
+/*
+ * Checks a digest, sign or verify context restored by C_SetOperationState
+ * before the session takes it over. With OpenSSL 3.0 only a SHA state can be
+ * saved for a SHA-1 or SHA-2 digest or HMAC, and it must be for the
+ * operation's digest. It is also rejected when the low level SHA functions
+ * must not be used here, e.g. because FIPS mode was enabled since it was
+ * saved.
+ */
+CK_RV openssl_specific_check_op_state(STDLL_TokData_t *tokdata,
+                                      CK_ULONG operation,
+                                      CK_MECHANISM_TYPE mech, CK_BYTE *context,
+                                      CK_ULONG context_len)
+{
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    CK_MECHANISM_TYPE digest_mech;
+    CK_BBOOL general;
+
+    UNUSED(tokdata);
+
+    switch (operation) {
+    case STATE_DIGEST:
+        digest_mech = mech;
+        break;
+    case STATE_SIGN:
+    case STATE_VERIFY:
+        if (get_hmac_digest(mech, &digest_mech, &general) != CKR_OK)
+            return CKR_OK;
+        break;
+    default:
+        return CKR_OK;
+    }
+
+    switch (digest_mech) {
+    case CKM_SHA_1:
+    case CKM_SHA224:
+    case CKM_SHA256:
+    case CKM_SHA384:
+    case CKM_SHA512:
+        break;
+    default:
+        return CKR_OK;
+    }
+
+#ifdef OPENSSL_SHA_STATE
+    if (openssl_sha_state_get(context, context_len, digest_mech) != NULL &&
+        openssl_sha_state_usable(digest_mech))
+        return CKR_OK;
+#else
+    UNUSED(context);
+    UNUSED(context_len);
+#endif
+
+    TRACE_ERROR("%s\n", ock_err(ERR_SAVED_STATE_INVALID));
+    return CKR_SAVED_STATE_INVALID;
+#else
+    UNUSED(tokdata);
+    UNUSED(operation);
+    UNUSED(mech);
+    UNUSED(context);
+    UNUSED(context_len);
+
+    return CKR_OK;
+#endif
 }
 
 #if !OPENSSL_VERSION_PREREQ(3, 0)
@@ -3082,10 +3678,47 @@ static void openssl_specific_sha_free(STDLL_TokData_t *tokdata, SESSION *sess,
 }
 #endif
 
-CK_RV openssl_specific_sha_init(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
-                                CK_MECHANISM *mech)
+#ifdef OPENSSL_SHA_STATE
+static CK_RV openssl_sha_state_digest(DIGEST_CONTEXT *ctx, CK_BYTE *in_data,
+                                      CK_ULONG in_data_len, CK_BYTE *out_data,
+                                      CK_ULONG *out_data_len)
 {
-#if !OPENSSL_VERSION_PREREQ(3, 0)
+    struct openssl_sha_state *state;
+    CK_ULONG hsize;
+    CK_RV rc = CKR_OK;
+
+    state = openssl_sha_state_get(ctx->context, ctx->context_len,
+                                  ctx->mech.mechanism);
+    if (state == NULL || get_sha_size(state->mech, &hsize) != CKR_OK) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (*out_data_len < hsize) {
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    if (!openssl_sha_state_update(state, in_data, in_data_len) ||
+        !openssl_sha_state_final(state, out_data)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        rc = CKR_FUNCTION_FAILED;
+    } else {
+        *out_data_len = hsize;
+    }
+
+    free(ctx->context);
+    ctx->context = NULL;
+    ctx->context_len = 0;
+
+    return rc;
+}
+#endif
+
+CK_RV openssl_specific_sha_init(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
+                                CK_MECHANISM *mech)
+{
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     EVP_MD_CTX *md_ctx;
 #else
     const EVP_MD *md;
@@ -3105,6 +3738,27 @@ CK_RV openssl_specific_sha_init(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
 
     EVP_MD_CTX_free(md_ctx);
 #else
+#ifdef OPENSSL_SHA_STATE
+    if (openssl_sha_state_usable(mech->mechanism)) {
+        ctx->context = malloc(sizeof(struct openssl_sha_state));
+        if (ctx->context == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            return CKR_HOST_MEMORY;
+        }
+
+        if (!openssl_sha_state_init((struct openssl_sha_state *)ctx->context,
+                                    mech->mechanism)) {
+            TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+            free(ctx->context);
+            ctx->context = NULL;
+            return CKR_FUNCTION_FAILED;
+        }
+
+        ctx->context_len = sizeof(struct openssl_sha_state);
+        return CKR_OK;
+    }
+#endif
+
     ctx->context_len = 1;
     ctx->context = (CK_BYTE *)EVP_MD_CTX_new();
     if (ctx->context == NULL) {
@@ -3165,6 +3819,12 @@ CK_RV openssl_specific_sha(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
 
     *out_data_len = len;
 #else
+#ifdef OPENSSL_SHA_STATE
+    if (ctx->context_free_func != openssl_specific_sha_free)
+        return openssl_sha_state_digest(ctx, in_data, in_data_len,
+                                        out_data, out_data_len);
+#endif
+
     if (*out_data_len < (CK_ULONG)EVP_MD_CTX_size((EVP_MD_CTX *)ctx->context)) {
         TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
         return CKR_BUFFER_TOO_SMALL;
@@ -3194,12 +3854,68 @@ out:
     return rc;
 }
 
+CK_RV openssl_specific_sha_single(STDLL_TokData_t *tokdata, CK_MECHANISM *mech,
+                                  CK_BYTE *in_data, CK_ULONG in_data_len,
+                                  CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    EVP_MD_CTX *md_ctx, *tmp_ctx = NULL;
+    const EVP_MD *md;
+    unsigned int len;
+    CK_RV rc = CKR_OK;
+
+    UNUSED(tokdata);
+
+    if ((!in_data && in_data_len > 0) || !out_data || !out_data_len)
+        return CKR_ARGUMENTS_BAD;
+
+    md = md_from_mech(mech);
+    if (md == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    if (*out_data_len < (CK_ULONG)EVP_MD_size(md)) {
+        *out_data_len = EVP_MD_size(md);
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    md_ctx = thread_md_ctx_get();
+    if (md_ctx == NULL) {
+        md_ctx = tmp_ctx = EVP_MD_CTX_new();
+        if (md_ctx == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            return CKR_HOST_MEMORY;
+        }
+    }
+
+    /* Re-initializing with the same digest reuses the context's state */
+    len = *out_data_len;
+    if (!EVP_DigestInit_ex(md_ctx, md, NULL) ||
+        !EVP_DigestUpdate(md_ctx, in_data, in_data_len) ||
+        !EVP_DigestFinal_ex(md_ctx, out_data, &len)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    *out_data_len = len;
+
+out:
+    EVP_MD_CTX_free(tmp_ctx);
+
+    return rc;
+}
+
 CK_RV openssl_specific_sha_update(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                   CK_BYTE *in_data, CK_ULONG in_data_len)
 {
 #if !OPENSSL_VERSION_PREREQ(3, 0)
     EVP_MD_CTX *md_ctx;
 #endif
+#ifdef OPENSSL_SHA_STATE
+    struct openssl_sha_state *state;
+#endif
 
     UNUSED(tokdata);
 
@@ -3232,6 +3948,19 @@ CK_RV openssl_specific_sha_update(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
 
     EVP_MD_CTX_free(md_ctx);
 #else
+#ifdef OPENSSL_SHA_STATE
+    if (ctx->context_free_func != openssl_specific_sha_free) {
+        state = openssl_sha_state_get(ctx->context, ctx->context_len,
+                                      ctx->mech.mechanism);
+        if (state == NULL ||
+            !openssl_sha_state_update(state, in_data, in_data_len)) {
+            TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+            return CKR_FUNCTION_FAILED;
+        }
+        return CKR_OK;
+    }
+#endif
+
     if (!EVP_DigestUpdate((EVP_MD_CTX *)ctx->context, in_data, in_data_len)) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         return CKR_FUNCTION_FAILED;
@@ -3282,6 +4011,11 @@ out:
     ctx->context_len = 0;
     ctx->context_free_func = NULL;
 #else
+#ifdef OPENSSL_SHA_STATE
+    if (ctx->context_free_func != openssl_specific_sha_free)
+        return openssl_sha_state_digest(ctx, NULL, 0, out_data, out_data_len);
+#endif
+
     if (*out_data_len < (CK_ULONG)EVP_MD_CTX_size((EVP_MD_CTX *)ctx->context)) {
         TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
         return CKR_BUFFER_TOO_SMALL;
@@ -3357,6 +4091,7 @@ CK_RV openssl_specific_shake_key_derive(STDLL_TokData_t *tokdata, SESSION *sess,
         goto out;
     }
 
+    md = openssl_cached_md(md);
     if (md == NULL ||
         !EVP_DigestInit_ex(ctx, md, NULL) ||
         !EVP_DigestUpdate(ctx, base_key_value->pValue,
@@ -3443,7 +4178,7 @@ out:
     return rc;
 }
 
-static const EVP_CIPHER *openssl_cipher_from_mech(CK_MECHANISM_TYPE mech,
+static const EVP_CIPHER *legacy_cipher_from_mech(CK_MECHANISM_TYPE mech,
                                                   CK_ULONG keylen,
                                                   CK_KEY_TYPE keytype)
 {
@@ -3638,17 +4373,19 @@ static const EVP_CIPHER *openssl_cipher_from_mech(CK_MECHANISM_TYPE mech,
     return NULL;
 }
 
-static CK_RV openssl_cipher_perform(OBJECT *key, CK_MECHANISM_TYPE mech,
-                                    CK_BYTE *in_data,  CK_ULONG in_data_len,
-                                    CK_BYTE *out_data, CK_ULONG *out_data_len,
-                                    CK_BYTE *init_v, CK_BYTE *out_v,
-                                    CK_BYTE encrypt)
+static const EVP_CIPHER *openssl_cipher_from_mech(CK_MECHANISM_TYPE mech,
+                                                  CK_ULONG keylen,
+                                                  CK_KEY_TYPE keytype)
+{
+    return openssl_cached_cipher(legacy_cipher_from_mech(mech, keylen,
+                                                         keytype));
+}
+
+static CK_RV openssl_cipher_from_key(OBJECT *key, CK_MECHANISM_TYPE mech,
+                                     const EVP_CIPHER **cipher,
+                                     CK_ATTRIBUTE **key_attr)
 {
-    const EVP_CIPHER *cipher = NULL;
-    CK_ATTRIBUTE *key_attr = NULL;
-    EVP_CIPHER_CTX *ctx = NULL;
     CK_KEY_TYPE keytype = 0;
-    int blocksize, outlen = 0, outlen2 = 0;
     CK_RV rc;
 
     rc = template_attribute_get_ulong(key->template, CKA_KEY_TYPE, &keytype);
@@ -3657,18 +4394,37 @@ static CK_RV openssl_cipher_perform(OBJECT *key, CK_MECHANISM_TYPE mech,
         return rc;
     }
 
-    rc = template_attribute_get_non_empty(key->template, CKA_VALUE, &key_attr);
+    rc = template_attribute_get_non_empty(key->template, CKA_VALUE, key_attr);
     if (rc != CKR_OK) {
         TRACE_ERROR("Could not find CKA_VALUE for the key.\n");
         return rc;
     }
 
-    cipher = openssl_cipher_from_mech(mech, key_attr->ulValueLen, keytype);
-    if (cipher == NULL) {
+    *cipher = openssl_cipher_from_mech(mech, (*key_attr)->ulValueLen, keytype);
+    if (*cipher == NULL) {
         TRACE_ERROR("Cipher not supported.\n");
         return CKR_MECHANISM_INVALID;
     }
 
+    return CKR_OK;
+}
+
+static CK_RV openssl_cipher_perform(OBJECT *key, CK_MECHANISM_TYPE mech,
+                                    CK_BYTE *in_data,  CK_ULONG in_data_len,
+                                    CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                    CK_BYTE *init_v, CK_BYTE *out_v,
+                                    CK_BYTE encrypt)
+{
+    const EVP_CIPHER *cipher = NULL;
+    CK_ATTRIBUTE *key_attr = NULL;
+    EVP_CIPHER_CTX *ctx = NULL;
+    int blocksize, outlen = 0, outlen2 = 0;
+    CK_RV rc;
+
+    rc = openssl_cipher_from_key(key, mech, &cipher, &key_attr);
+    if (rc != CKR_OK)
+        return rc;
+
 #if !OPENSSL_VERSION_PREREQ(3, 0)
     blocksize = EVP_CIPHER_block_size(cipher);
 #else
@@ -3731,6 +4487,235 @@ done:
     return rc;
 }
 
+static void openssl_cmac_subkey(CK_BYTE *block, CK_ULONG bsize)
+{
+    CK_BYTE carry = block[0] & 0x80;
+    CK_ULONG i;
+
+    for (i = 0; i < bsize - 1; i++)
+        block[i] = (block[i] << 1) | (block[i + 1] >> 7);
+    block[bsize - 1] <<= 1;
+
+    if (carry)
+        block[bsize - 1] ^= (bsize == AES_BLOCK_SIZE ? 0x87 : 0x1b);
+}
+
+/*
+ * The ex_data of a key used for multi-part CMAC holds a CBC encryption
+ * context keyed with the key value, and the two CMAC subkeys derived from it.
+ * Each part starts with a copy of that context, so the key schedule is set up
+ * only once per key, and not with every part of every operation.
+ */
+struct openssl_cmac_ex_data {
+    struct openssl_ex_data ex_data;
+    const EVP_CIPHER *cipher;
+    EVP_CIPHER_CTX *tmpl;
+    CK_BYTE subkey[2][AES_BLOCK_SIZE];
+};
+
+static void openssl_free_cmac_ex_data(OBJECT *obj, void *ex_data,
+                                      size_t ex_data_len)
+{
+    struct openssl_cmac_ex_data *data = ex_data;
+
+    if (ex_data == NULL || ex_data_len < sizeof(struct openssl_cmac_ex_data))
+        return;
+
+    if (data->tmpl != NULL) {
+        EVP_CIPHER_CTX_free(data->tmpl);
+        data->tmpl = NULL;
+    }
+    OPENSSL_cleanse(data->subkey, sizeof(data->subkey));
+
+    openssl_free_ex_data(obj, ex_data, ex_data_len);
+}
+
+static CK_BBOOL openssl_cmac_need_wr_lock(OBJECT *obj, void *ex_data,
+                                          size_t ex_data_len)
+{
+    struct openssl_cmac_ex_data *data = ex_data;
+
+    UNUSED(obj);
+
+    if (ex_data == NULL || ex_data_len < sizeof(struct openssl_cmac_ex_data))
+        return FALSE;
+
+    return data->tmpl == NULL;
+}
+
+/*
+ * Keys ctx for CBC encryption without padding, and derives the subkeys K1
+ * (index 0) and K2 (index 1).
+ */
+static CK_RV openssl_cmac_setup(const EVP_CIPHER *cipher, CK_ATTRIBUTE *value,
+                                EVP_CIPHER_CTX *ctx,
+                                CK_BYTE subkey[2][AES_BLOCK_SIZE])
+{
+    static const CK_BYTE zero[AES_BLOCK_SIZE] = { 0 };
+    CK_ULONG bsize = EVP_CIPHER_block_size(cipher);
+    int outlen;
+
+    if (EVP_EncryptInit_ex(ctx, cipher, NULL, value->pValue, zero) != 1 ||
+        EVP_CIPHER_CTX_set_padding(ctx, 0) != 1 ||
+        EVP_EncryptUpdate(ctx, subkey[0], &outlen, zero, bsize) != 1) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    openssl_cmac_subkey(subkey[0], bsize);
+    memcpy(subkey[1], subkey[0], bsize);
+    openssl_cmac_subkey(subkey[1], bsize);
+
+    return CKR_OK;
+}
+
+/*
+ * Sets up ctx and the subkeys for the key, from the key's ex_data if
+ * possible.
+ */
+static CK_RV openssl_cmac_get_ctx(OBJECT *key, const EVP_CIPHER *cipher,
+                                  CK_ATTRIBUTE *value, EVP_CIPHER_CTX *ctx,
+                                  CK_BYTE subkey[2][AES_BLOCK_SIZE])
+{
+    struct openssl_cmac_ex_data *ex_data = NULL;
+    CK_RV rc;
+
+    rc = openssl_get_ex_data(key, (void **)&ex_data,
+                             sizeof(struct openssl_cmac_ex_data),
+                             openssl_cmac_need_wr_lock,
+                             openssl_free_cmac_ex_data);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (ex_data->tmpl == NULL) {
+        ex_data->tmpl = EVP_CIPHER_CTX_new();
+        if (ex_data->tmpl != NULL &&
+            openssl_cmac_setup(cipher, value, ex_data->tmpl,
+                               ex_data->subkey) != CKR_OK) {
+            EVP_CIPHER_CTX_free(ex_data->tmpl);
+            ex_data->tmpl = NULL;
+        }
+        ex_data->cipher = cipher;
+    }
+
+    if (ex_data->tmpl != NULL && ex_data->cipher == cipher &&
+        EVP_CIPHER_CTX_copy(ctx, ex_data->tmpl) == 1) {
+        memcpy(subkey, ex_data->subkey, sizeof(ex_data->subkey));
+        rc = CKR_OK;
+    } else {
+        rc = openssl_cmac_setup(cipher, value, ctx, subkey);
+    }
+
+    object_ex_data_unlock(key);
+
+    return rc;
+}
+
+/*
+ * Multi-part CMAC keeps its state in the caller's MAC buffer: the chaining
+ * value of the CBC-MAC over the blocks processed so far. The caller holds
+ * back the last block of the message until the final part, where it is
+ * processed together with the subkey. Unlike an EVP_MAC context, this state
+ * contains no key dependent data, so it can be saved and restored by
+ * C_GetOperationState and C_SetOperationState. The keyed cipher context and
+ * the subkeys are taken from the key object, see openssl_cmac_get_ctx().
+ */
+static CK_RV openssl_cmac_chain(CK_MECHANISM_TYPE mech, CK_BYTE *message,
+                                CK_ULONG message_len, OBJECT *key,
+                                CK_BYTE *mac, CK_BBOOL first, CK_BBOOL last)
+{
+    CK_BYTE block[AES_BLOCK_SIZE], subkey[2][AES_BLOCK_SIZE];
+    CK_BYTE buf[16 * AES_BLOCK_SIZE];
+    const EVP_CIPHER *cipher = NULL;
+    CK_ATTRIBUTE *key_attr = NULL;
+    EVP_CIPHER_CTX *ctx = NULL;
+    CK_ULONG bsize, full, off, chunk, i;
+    int outlen;
+    CK_RV rc;
+
+    if (key == NULL)
+        return CKR_ARGUMENTS_BAD;
+
+    rc = openssl_cipher_from_key(key, mech == CKM_AES_CMAC ? CKM_AES_CBC :
+                                                             CKM_DES3_CBC,
+                                 &cipher, &key_attr);
+    if (rc != CKR_OK)
+        return rc;
+
+    bsize = EVP_CIPHER_block_size(cipher);
+    if (bsize > AES_BLOCK_SIZE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    /* All complete blocks, except the last block of the message */
+    if (last)
+        full = message_len > 0 ? (message_len - 1) / bsize * bsize : 0;
+    else
+        full = message_len;
+    if (full % bsize != 0 || message_len > INT_MAX) {
+        TRACE_ERROR("%s\n", ock_err(ERR_DATA_LEN_RANGE));
+        return CKR_DATA_LEN_RANGE;
+    }
+
+    if (first)
+        memset(mac, 0, bsize);
+
+    ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    rc = openssl_cmac_get_ctx(key, cipher, key_attr, ctx, subkey);
+    if (rc != CKR_OK)
+        goto done;
+
+    rc = CKR_FUNCTION_FAILED;
+
+    if (EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, mac) != 1)
+        goto out;
+
+    for (off = 0; off < full; off += chunk) {
+        chunk = full - off < sizeof(buf) ? full - off : sizeof(buf);
+        if (EVP_EncryptUpdate(ctx, buf, &outlen, message + off,
+                              chunk) != 1 || (CK_ULONG)outlen != chunk)
+            goto out;
+        memcpy(mac, buf + chunk - bsize, bsize);
+    }
+
+    if (last) {
+        if (message_len - full < bsize) {
+            memset(block, 0, bsize);
+            memcpy(block, message + full, message_len - full);
+            block[message_len - full] = 0x80;
+            for (i = 0; i < bsize; i++)
+                block[i] ^= subkey[1][i];
+        } else {
+            memcpy(block, message + full, bsize);
+            for (i = 0; i < bsize; i++)
+                block[i] ^= subkey[0][i];
+        }
+
+        if (EVP_EncryptUpdate(ctx, mac, &outlen, block, bsize) != 1)
+            goto out;
+    }
+
+    rc = CKR_OK;
+
+out:
+    if (rc != CKR_OK)
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+
+    OPENSSL_cleanse(block, sizeof(block));
+    OPENSSL_cleanse(buf, sizeof(buf));
+done:
+    OPENSSL_cleanse(subkey, sizeof(subkey));
+    EVP_CIPHER_CTX_free(ctx);
+
+    return rc;
+}
+
 CK_RV openssl_cmac_perform(CK_MECHANISM_TYPE mech, CK_BYTE *message,
                            CK_ULONG message_len, OBJECT *key, CK_BYTE *mac,
                            CK_BBOOL first, CK_BBOOL last, CK_VOID_PTR *ctx)
@@ -3757,6 +4742,11 @@ CK_RV openssl_cmac_perform(CK_MECHANISM_TYPE mech, CK_BYTE *message,
     OSSL_PARAM params[2];
 #endif
 
+    /* Only a single part CMAC uses a MAC context */
+    if (*ctx == NULL && !(first && last))
+        return openssl_cmac_chain(mech, message, message_len, key, mac,
+                                  first, last);
+
     if (first) {
         if (key == NULL)
             return CKR_ARGUMENTS_BAD;
@@ -3829,7 +4819,7 @@ CK_RV openssl_cmac_perform(CK_MECHANISM_TYPE mech, CK_BYTE *message,
             goto err;
         }
 #else
-        cmac->mac = EVP_MAC_fetch(NULL, "CMAC", NULL);
+        cmac->mac = openssl_fetch_mac("CMAC");
         if (cmac->mac == NULL) {
             TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
             rv = CKR_FUNCTION_FAILED;
@@ -4488,6 +5478,7 @@ static EVP_CIPHER_CTX *aes_xts_init_ecb_cipher_ctx(const CK_BYTE *key,
         TRACE_ERROR("Key size wrong: %lu.\n", keylen);
         return NULL;
     }
+    cipher = openssl_cached_cipher(cipher);
 
     ctx = EVP_CIPHER_CTX_new();
     if (ctx == NULL) {
@@ -4755,18 +5746,303 @@ CK_RV openssl_specific_tdes_cfb(STDLL_TokData_t *tokdata,
                                   encrypt);
 }
 
-CK_RV openssl_specific_tdes_mac(STDLL_TokData_t *tokdata, CK_BYTE *message,
-                                CK_ULONG message_len, OBJECT *key, CK_BYTE *mac)
+static void openssl_specific_cipher_ctx_free(STDLL_TokData_t *tokdata,
+                                             struct _SESSION *sess,
+                                             CK_VOID_PTR cipher_ctx)
 {
-    CK_BYTE *out_buf;
-    CK_ULONG out_len;
-    CK_RV rc;
+    UNUSED(tokdata);
+    UNUSED(sess);
 
-    out_buf = malloc(message_len);
-    if (out_buf == NULL) {
-        TRACE_ERROR("Malloc failed.\n");
-        return CKR_HOST_MEMORY;
-    }
+    EVP_CIPHER_CTX_free((EVP_CIPHER_CTX *)cipher_ctx);
+}
+
+/*
+ * Processes the block aligned part of a multi-part AES or DES3 operation.
+ * The EVP cipher context is set up from the key and the current IV on the
+ * first call and is then kept in ctx->cipher_ctx until the operation is
+ * cleaned up, so that further updates neither look up the key nor redo the
+ * key schedule. The IV or counter in the mechanism parameter is kept up to
+ * date, it is used by the final call and by C_GetOperationState.
+ *
+ * Returns CKR_FUNCTION_NOT_SUPPORTED if the caller should use the single-part
+ * cipher functions instead.
+ */
+CK_RV openssl_specific_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                                     ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                                     CK_BYTE *in_data, CK_ULONG in_data_len,
+                                     CK_BYTE *out_data, CK_BYTE encrypt)
+{
+    EVP_CIPHER_CTX *evp_ctx = (EVP_CIPHER_CTX *)ctx->cipher_ctx;
+    CK_MECHANISM_TYPE mech = ctx->mech.mechanism;
+    CK_AES_CTR_PARAMS *aesctr = NULL;
+    const EVP_CIPHER *cipher = NULL;
+    CK_ATTRIBUTE *key_attr = NULL;
+    CK_BYTE *init_v = NULL, *out_v = NULL;
+    int blocksize, outlen = 0;
+    CK_RV rc;
+
+    UNUSED(tokdata);
+    UNUSED(sess);
+
+    switch (mech) {
+    case CKM_AES_ECB:
+    case CKM_DES3_ECB:
+        break;
+    case CKM_AES_CBC_PAD:
+        mech = CKM_AES_CBC;
+        /* fall through */
+    case CKM_AES_CBC:
+        init_v = ctx->mech.pParameter;
+        break;
+    case CKM_DES3_CBC_PAD:
+        mech = CKM_DES3_CBC;
+        /* fall through */
+    case CKM_DES3_CBC:
+        init_v = ctx->mech.pParameter;
+        break;
+    case CKM_AES_OFB:
+    case CKM_AES_CFB8:
+    case CKM_AES_CFB128:
+    case CKM_DES_OFB64:
+    case CKM_DES_CFB8:
+    case CKM_DES_CFB64:
+        init_v = ctx->mech.pParameter;
+        out_v = ctx->mech.pParameter;
+        break;
+    case CKM_AES_CTR:
+        /* Only a full width counter can simply run on */
+        aesctr = (CK_AES_CTR_PARAMS *)ctx->mech.pParameter;
+        if (aesctr->ulCounterBits != AES_BLOCK_SIZE * 8)
+            return CKR_FUNCTION_NOT_SUPPORTED;
+        init_v = aesctr->cb;
+        out_v = aesctr->cb;
+        break;
+    default:
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+
+    if (evp_ctx == NULL) {
+        if (key == NULL) {
+            TRACE_ERROR("%s received bad argument(s)\n", __func__);
+            return CKR_FUNCTION_FAILED;
+        }
+
+        rc = openssl_cipher_from_key(key, mech, &cipher, &key_attr);
+        if (rc != CKR_OK)
+            return rc;
+
+        evp_ctx = EVP_CIPHER_CTX_new();
+        if (evp_ctx == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            return CKR_HOST_MEMORY;
+        }
+
+        if (EVP_CipherInit_ex(evp_ctx, cipher, NULL, key_attr->pValue,
+                              init_v, encrypt ? 1 : 0) != 1 ||
+            EVP_CIPHER_CTX_set_padding(evp_ctx, 0) != 1) {
+            TRACE_ERROR("%s\n", ock_err(ERR_GENERAL_ERROR));
+            EVP_CIPHER_CTX_free(evp_ctx);
+            return CKR_GENERAL_ERROR;
+        }
+
+        ctx->cipher_ctx = evp_ctx;
+        ctx->cipher_ctx_free_func = openssl_specific_cipher_ctx_free;
+    }
+
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    blocksize = EVP_CIPHER_CTX_block_size(evp_ctx);
+#else
+    blocksize = EVP_CIPHER_CTX_get_block_size(evp_ctx);
+#endif
+    if (in_data_len % blocksize || in_data_len > INT_MAX) {
+        TRACE_ERROR("%s\n", ock_err(ERR_DATA_LEN_RANGE));
+        return CKR_DATA_LEN_RANGE;
+    }
+
+    if (EVP_CipherUpdate(evp_ctx, out_data, &outlen,
+                         in_data, in_data_len) != 1 ||
+        (CK_ULONG)outlen != in_data_len) {
+        TRACE_ERROR("%s\n", ock_err(ERR_GENERAL_ERROR));
+        return CKR_GENERAL_ERROR;
+    }
+
+    if (out_v != NULL) {
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+        memcpy(out_v, EVP_CIPHER_CTX_iv(evp_ctx),
+               EVP_CIPHER_CTX_iv_length(evp_ctx));
+#else
+        if (EVP_CIPHER_CTX_get_updated_iv(evp_ctx, out_v,
+                                EVP_CIPHER_CTX_get_iv_length(evp_ctx)) != 1) {
+            TRACE_ERROR("%s\n", ock_err(ERR_GENERAL_ERROR));
+            return CKR_GENERAL_ERROR;
+        }
+#endif
+    }
+
+    return CKR_OK;
+}
+
+/*
+ * Message based AES-GCM: the EVP cipher context is keyed once by
+ * openssl_specific_aes_gcm_msg_init and kept in ctx->cipher_ctx until the
+ * operation is cleaned up. Each message only re-initializes the context with
+ * its IV, so that the AES key schedule is not redone per message.
+ */
+CK_RV openssl_specific_aes_gcm_msg_init(STDLL_TokData_t *tokdata,
+                                        SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                        OBJECT *key, CK_BYTE encrypt)
+{
+    const EVP_CIPHER *cipher = NULL;
+    CK_ATTRIBUTE *key_attr = NULL;
+    EVP_CIPHER_CTX *evp_ctx = NULL;
+    CK_RV rc;
+
+    UNUSED(tokdata);
+    UNUSED(sess);
+
+    rc = openssl_cipher_from_key(key, CKM_AES_GCM, &cipher, &key_attr);
+    if (rc != CKR_OK)
+        return rc;
+
+    evp_ctx = EVP_CIPHER_CTX_new();
+    if (evp_ctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    if (EVP_CipherInit_ex(evp_ctx, cipher, NULL, key_attr->pValue, NULL,
+                          encrypt ? 1 : 0) != 1) {
+        TRACE_ERROR("GCM context initialization failed\n");
+        EVP_CIPHER_CTX_free(evp_ctx);
+        return CKR_GENERAL_ERROR;
+    }
+
+    ctx->cipher_ctx = evp_ctx;
+    ctx->cipher_ctx_free_func = openssl_specific_cipher_ctx_free;
+    ctx->state_unsaveable = CK_TRUE;
+
+    return CKR_OK;
+}
+
+CK_RV openssl_specific_aes_gcm_msg_begin(STDLL_TokData_t *tokdata,
+                                         SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                         CK_BYTE *iv, CK_ULONG iv_len,
+                                         CK_BYTE *aad, CK_ULONG aad_len,
+                                         CK_BYTE encrypt)
+{
+    EVP_CIPHER_CTX *evp_ctx = (EVP_CIPHER_CTX *)ctx->cipher_ctx;
+    int outlen;
+
+    UNUSED(tokdata);
+    UNUSED(sess);
+
+    if (evp_ctx == NULL || iv_len > INT_MAX || aad_len > INT_MAX) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (EVP_CIPHER_CTX_ctrl(evp_ctx, EVP_CTRL_AEAD_SET_IVLEN,
+                            iv_len, NULL) != 1 ||
+        EVP_CipherInit_ex(evp_ctx, NULL, NULL, NULL, iv,
+                          encrypt ? 1 : 0) != 1) {
+        TRACE_ERROR("GCM set IV failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    if (aad_len > 0 &&
+        EVP_CipherUpdate(evp_ctx, NULL, &outlen, aad, aad_len) != 1) {
+        TRACE_ERROR("GCM add AAD data failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    return CKR_OK;
+}
+
+CK_RV openssl_specific_aes_gcm_msg_update(STDLL_TokData_t *tokdata,
+                                          SESSION *sess,
+                                          ENCR_DECR_CONTEXT *ctx,
+                                          CK_BYTE *in_data,
+                                          CK_ULONG in_data_len,
+                                          CK_BYTE *out_data,
+                                          CK_ULONG *out_data_len,
+                                          CK_BYTE encrypt)
+{
+    EVP_CIPHER_CTX *evp_ctx = (EVP_CIPHER_CTX *)ctx->cipher_ctx;
+    int outlen = 0;
+
+    UNUSED(tokdata);
+    UNUSED(sess);
+    UNUSED(encrypt);
+
+    if (evp_ctx == NULL || in_data_len > INT_MAX) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (in_data_len > 0 &&
+        EVP_CipherUpdate(evp_ctx, out_data, &outlen,
+                         in_data, in_data_len) != 1) {
+        TRACE_ERROR("GCM update failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    *out_data_len = outlen;
+
+    return CKR_OK;
+}
+
+CK_RV openssl_specific_aes_gcm_msg_final(STDLL_TokData_t *tokdata,
+                                         SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                         CK_BYTE *tag, CK_ULONG tag_len,
+                                         CK_BYTE encrypt)
+{
+    EVP_CIPHER_CTX *evp_ctx = (EVP_CIPHER_CTX *)ctx->cipher_ctx;
+    CK_BYTE buf[AES_BLOCK_SIZE];
+    int finlen;
+
+    UNUSED(tokdata);
+    UNUSED(sess);
+
+    if (evp_ctx == NULL || tag_len > AES_BLOCK_SIZE) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (encrypt) {
+        if (EVP_CipherFinal_ex(evp_ctx, buf, &finlen) != 1 ||
+            EVP_CIPHER_CTX_ctrl(evp_ctx, EVP_CTRL_AEAD_GET_TAG, tag_len,
+                                tag) != 1) {
+            TRACE_ERROR("GCM get tag failed\n");
+            return CKR_GENERAL_ERROR;
+        }
+    } else {
+        if (EVP_CIPHER_CTX_ctrl(evp_ctx, EVP_CTRL_AEAD_SET_TAG, tag_len,
+                                tag) != 1) {
+            TRACE_ERROR("GCM set tag failed\n");
+            return CKR_GENERAL_ERROR;
+        }
+
+        if (EVP_CipherFinal_ex(evp_ctx, buf, &finlen) != 1) {
+            TRACE_ERROR("GCM finalize decryption failed\n");
+            return CKR_AEAD_DECRYPT_FAILED;
+        }
+    }
+
+    return CKR_OK;
+}
+
+CK_RV openssl_specific_tdes_mac(STDLL_TokData_t *tokdata, CK_BYTE *message,
+                                CK_ULONG message_len, OBJECT *key, CK_BYTE *mac)
+{
+    CK_BYTE *out_buf;
+    CK_ULONG out_len;
+    CK_RV rc;
+
+    out_buf = malloc(message_len);
+    if (out_buf == NULL) {
+        TRACE_ERROR("Malloc failed.\n");
+        return CKR_HOST_MEMORY;
+    }
 
     rc = openssl_specific_tdes_cbc(tokdata, message, message_len, out_buf,
                                    &out_len, key, mac, 1);
@@ -4789,6 +6065,330 @@ CK_RV openssl_specific_tdes_cmac(STDLL_TokData_t *tokdata, CK_BYTE *message,
                                 first, last, ctx);
 }
 
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+typedef EVP_MD_CTX openssl_hmac_ctx;
+#else
+typedef EVP_MAC_CTX openssl_hmac_ctx;
+#endif
+
+/*
+ * The ex_data of a key used for HMAC holds a HMAC context keyed with the key
+ * value, for the digest the key was first used with. Each HMAC operation with
+ * that digest starts with a copy of it, and so does not need to set up the
+ * inner and outer padded key again, which costs more than the HMAC itself for
+ * short messages. A key used with multiple digests gets a new context for the
+ * other digests.
+ *
+ * When a saveable SHA state is used instead, the ex_data holds the SHA states
+ * after the inner and the outer padded key in the same way.
+ */
+struct openssl_hmac_ex_data {
+    struct openssl_ex_data ex_data;
+    const EVP_MD *md;
+    openssl_hmac_ctx *tmpl;
+#ifdef OPENSSL_SHA_STATE
+    CK_MECHANISM_TYPE pads_mech;
+    struct openssl_sha_state *pads;
+#endif
+};
+
+static void openssl_hmac_ctx_free(openssl_hmac_ctx *hctx)
+{
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    EVP_MD_CTX_destroy(hctx);
+#else
+    EVP_MAC_CTX_free(hctx);
+#endif
+}
+
+static openssl_hmac_ctx *openssl_hmac_ctx_new(const EVP_MD *md,
+                                              CK_ATTRIBUTE *value)
+{
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    EVP_MD_CTX *mdctx = NULL;
+    EVP_PKEY *pkey;
+
+    pkey = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, value->pValue,
+                                value->ulValueLen);
+    if (pkey == NULL) {
+        TRACE_ERROR("EVP_PKEY_new_mac_key() failed.\n");
+        return NULL;
+    }
+
+    mdctx = EVP_MD_CTX_create();
+    if (mdctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        goto out;
+    }
+
+    if (EVP_DigestSignInit(mdctx, NULL, md, NULL, pkey) != 1) {
+        TRACE_ERROR("EVP_DigestSignInit failed.\n");
+        EVP_MD_CTX_destroy(mdctx);
+        mdctx = NULL;
+    }
+
+out:
+    EVP_PKEY_free(pkey);
+    return mdctx;
+#else
+    EVP_MAC *mac;
+    EVP_MAC_CTX *mctx = NULL;
+    OSSL_PARAM params[2];
+
+    mac = openssl_fetch_mac("HMAC");
+    if (mac == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return NULL;
+    }
+
+    mctx = EVP_MAC_CTX_new(mac);
+    if (mctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        goto out;
+    }
+
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                 (char *)EVP_MD_get0_name(md),
+                                                 0);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if (EVP_MAC_init(mctx, value->pValue, value->ulValueLen, params) != 1) {
+        TRACE_ERROR("EVP_MAC_init failed.\n");
+        EVP_MAC_CTX_free(mctx);
+        mctx = NULL;
+    }
+
+out:
+    EVP_MAC_free(mac);
+    return mctx;
+#endif
+}
+
+static openssl_hmac_ctx *openssl_hmac_ctx_dup(openssl_hmac_ctx *tmpl)
+{
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    EVP_MD_CTX *mdctx;
+
+    mdctx = EVP_MD_CTX_create();
+    if (mdctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return NULL;
+    }
+
+    if (EVP_MD_CTX_copy_ex(mdctx, tmpl) != 1) {
+        TRACE_ERROR("EVP_MD_CTX_copy_ex failed.\n");
+        EVP_MD_CTX_destroy(mdctx);
+        return NULL;
+    }
+
+    return mdctx;
+#else
+    EVP_MAC_CTX *mctx;
+
+    mctx = EVP_MAC_CTX_dup(tmpl);
+    if (mctx == NULL)
+        TRACE_ERROR("EVP_MAC_CTX_dup failed.\n");
+
+    return mctx;
+#endif
+}
+
+static void openssl_free_hmac_ex_data(OBJECT *obj, void *ex_data,
+                                      size_t ex_data_len)
+{
+    struct openssl_hmac_ex_data *data = ex_data;
+
+    if (ex_data == NULL || ex_data_len < sizeof(struct openssl_hmac_ex_data))
+        return;
+
+    if (data->tmpl != NULL) {
+        openssl_hmac_ctx_free(data->tmpl);
+        data->tmpl = NULL;
+    }
+#ifdef OPENSSL_SHA_STATE
+    if (data->pads != NULL) {
+        OPENSSL_cleanse(data->pads, 2 * sizeof(struct openssl_sha_state));
+        free(data->pads);
+        data->pads = NULL;
+    }
+#endif
+
+    openssl_free_ex_data(obj, ex_data, ex_data_len);
+}
+
+static CK_BBOOL openssl_hmac_need_wr_lock(OBJECT *obj, void *ex_data,
+                                          size_t ex_data_len)
+{
+    struct openssl_hmac_ex_data *data = ex_data;
+
+    UNUSED(obj);
+
+    if (ex_data == NULL || ex_data_len < sizeof(struct openssl_hmac_ex_data))
+        return FALSE;
+
+    return data->tmpl == NULL;
+}
+
+#ifdef OPENSSL_SHA_STATE
+static CK_BBOOL openssl_hmac_pads_need_wr_lock(OBJECT *obj, void *ex_data,
+                                               size_t ex_data_len)
+{
+    struct openssl_hmac_ex_data *data = ex_data;
+
+    UNUSED(obj);
+
+    if (ex_data == NULL || ex_data_len < sizeof(struct openssl_hmac_ex_data))
+        return FALSE;
+
+    return data->pads == NULL;
+}
+
+/*
+ * Computes the SHA states after the inner (index 0) and the outer (index 1)
+ * padded key.
+ */
+static CK_RV openssl_hmac_pads(CK_MECHANISM_TYPE digest_mech,
+                               CK_ATTRIBUTE *value,
+                               struct openssl_sha_state *pads)
+{
+    CK_BYTE key[SHA512_BLOCK_SIZE] = { 0 }, pad[SHA512_BLOCK_SIZE];
+    CK_ULONG bsize, i;
+    CK_RV rc = CKR_FUNCTION_FAILED;
+
+    if (get_sha_block_size(digest_mech, &bsize) != CKR_OK ||
+        bsize > sizeof(key))
+        return CKR_MECHANISM_INVALID;
+
+    if (value->ulValueLen > bsize) {
+        if (!openssl_sha_state_init(&pads[0], digest_mech) ||
+            !openssl_sha_state_update(&pads[0], value->pValue,
+                                      value->ulValueLen) ||
+            !openssl_sha_state_final(&pads[0], key))
+            goto out;
+    } else {
+        memcpy(key, value->pValue, value->ulValueLen);
+    }
+
+    for (i = 0; i < bsize; i++)
+        pad[i] = key[i] ^ 0x36;
+    if (!openssl_sha_state_init(&pads[0], digest_mech) ||
+        !openssl_sha_state_update(&pads[0], pad, bsize))
+        goto out;
+
+    for (i = 0; i < bsize; i++)
+        pad[i] = key[i] ^ 0x5c;
+    if (!openssl_sha_state_init(&pads[1], digest_mech) ||
+        !openssl_sha_state_update(&pads[1], pad, bsize))
+        goto out;
+
+    rc = CKR_OK;
+
+out:
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(pad, sizeof(pad));
+    if (rc != CKR_OK)
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+
+    return rc;
+}
+
+/*
+ * Gets the SHA state after the inner (index 0) or the outer (index 1) padded
+ * key from the key's ex_data, computing it if needed.
+ */
+static CK_RV openssl_hmac_get_pad(OBJECT *key, CK_MECHANISM_TYPE digest_mech,
+                                  int index, struct openssl_sha_state *state)
+{
+    struct openssl_hmac_ex_data *ex_data = NULL;
+    struct openssl_sha_state pads[2];
+    CK_ATTRIBUTE *attr = NULL;
+    CK_RV rc;
+
+    rc = template_attribute_get_non_empty(key->template, CKA_VALUE, &attr);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Could not find CKA_VALUE for the key.\n");
+        return rc;
+    }
+
+    rc = openssl_get_ex_data(key, (void **)&ex_data,
+                             sizeof(struct openssl_hmac_ex_data),
+                             openssl_hmac_pads_need_wr_lock,
+                             openssl_free_hmac_ex_data);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (ex_data->pads == NULL) {
+        ex_data->pads = calloc(2, sizeof(struct openssl_sha_state));
+        if (ex_data->pads != NULL &&
+            openssl_hmac_pads(digest_mech, attr, ex_data->pads) != CKR_OK) {
+            free(ex_data->pads);
+            ex_data->pads = NULL;
+        }
+        ex_data->pads_mech = digest_mech;
+    }
+
+    if (ex_data->pads != NULL && ex_data->pads_mech == digest_mech) {
+        *state = ex_data->pads[index];
+    } else {
+        rc = openssl_hmac_pads(digest_mech, attr, pads);
+        if (rc == CKR_OK)
+            *state = pads[index];
+        OPENSSL_cleanse(pads, sizeof(pads));
+    }
+
+    object_ex_data_unlock(key);
+
+    return rc;
+}
+
+/*
+ * Finishes a HMAC kept in a saveable SHA state. Only the inner digest is part
+ * of the saved state, the outer padded key is taken from the key object, so
+ * that a saved state does not disclose key equivalent data.
+ */
+static CK_RV openssl_hmac_state_final(STDLL_TokData_t *tokdata,
+                                      SIGN_VERIFY_CONTEXT *ctx,
+                                      CK_MECHANISM_TYPE digest_mech,
+                                      CK_BYTE *mac)
+{
+    struct openssl_sha_state *state, outer;
+    CK_BYTE inner[MAX_SHA_HASH_SIZE];
+    OBJECT *key = NULL;
+    CK_ULONG hsize;
+    CK_RV rc;
+
+    state = openssl_sha_state_get(ctx->context, ctx->context_len, digest_mech);
+    if (state == NULL || get_sha_size(digest_mech, &hsize) != CKR_OK) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = object_mgr_find_in_map1(tokdata, ctx->key, &key, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to find specified object.\n");
+        return rc;
+    }
+
+    rc = openssl_hmac_get_pad(key, digest_mech, 1, &outer);
+    object_put(tokdata, key, TRUE);
+    key = NULL;
+    if (rc != CKR_OK)
+        return rc;
+
+    if (!openssl_sha_state_final(state, inner) ||
+        !openssl_sha_state_update(&outer, inner, hsize) ||
+        !openssl_sha_state_final(&outer, mac)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        rc = CKR_FUNCTION_FAILED;
+    }
+
+    OPENSSL_cleanse(&outer, sizeof(outer));
+    OPENSSL_cleanse(inner, sizeof(inner));
+
+    return rc;
+}
+#endif
+
 static void openssl_specific_hmac_free(STDLL_TokData_t *tokdata, SESSION *sess,
                                        CK_BYTE *context, CK_ULONG context_len)
 {
@@ -4796,7 +6396,7 @@ static void openssl_specific_hmac_free(STDLL_TokData_t *tokdata, SESSION *sess,
     UNUSED(sess);
     UNUSED(context_len);
 
-    EVP_MD_CTX_destroy((EVP_MD_CTX *)context);
+    openssl_hmac_ctx_free((openssl_hmac_ctx *)context);
 }
 
 CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
@@ -4807,8 +6407,13 @@ CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
     int rc;
     OBJECT *key = NULL;
     CK_ATTRIBUTE *attr = NULL;
-    EVP_MD_CTX *mdctx = NULL;
-    EVP_PKEY *pkey = NULL;
+    const EVP_MD *md;
+    struct openssl_hmac_ex_data *ex_data = NULL;
+    openssl_hmac_ctx *hctx = NULL;
+#ifdef OPENSSL_SHA_STATE
+    CK_MECHANISM_TYPE digest_mech;
+    CK_BBOOL general;
+#endif
 
     rc = object_mgr_find_in_map1(tokdata, Hkey, &key, READ_LOCK);
     if (rc != CKR_OK) {
@@ -4822,127 +6427,160 @@ CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
         goto done;
     }
 
-    pkey = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, attr->pValue,
-                                attr->ulValueLen);
-    if (pkey == NULL) {
-        TRACE_ERROR("EVP_PKEY_new_mac_key() failed.\n");
-        rc = CKR_FUNCTION_FAILED;
-        goto done;
-    }
-
-    mdctx = EVP_MD_CTX_create();
-    if (mdctx == NULL) {
-        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-        rc = CKR_HOST_MEMORY;
-        goto done;
-    }
-
     switch (mech->mechanism) {
     case CKM_MD5_HMAC_GENERAL:
     case CKM_MD5_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_md5(), NULL, pkey);
+        md = EVP_md5();
         break;
     case CKM_SHA_1_HMAC_GENERAL:
     case CKM_SHA_1_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha1(), NULL, pkey);
+        md = EVP_sha1();
         break;
     case CKM_SHA224_HMAC_GENERAL:
     case CKM_SHA224_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha224(), NULL, pkey);
+        md = EVP_sha224();
         break;
     case CKM_SHA256_HMAC_GENERAL:
     case CKM_SHA256_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha256(), NULL, pkey);
+        md = EVP_sha256();
         break;
     case CKM_SHA384_HMAC_GENERAL:
     case CKM_SHA384_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha384(), NULL, pkey);
+        md = EVP_sha384();
         break;
     case CKM_SHA512_HMAC_GENERAL:
     case CKM_SHA512_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha512(), NULL, pkey);
+        md = EVP_sha512();
         break;
 #ifdef NID_sha512_224WithRSAEncryption
     case CKM_SHA512_224_HMAC_GENERAL:
     case CKM_SHA512_224_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha512_224(), NULL, pkey);
+        md = EVP_sha512_224();
         break;
 #endif
 #ifdef NID_sha512_256WithRSAEncryption
     case CKM_SHA512_256_HMAC_GENERAL:
     case CKM_SHA512_256_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha512_256(), NULL, pkey);
+        md = EVP_sha512_256();
         break;
 #endif
 #ifdef NID_sha3_224
     case CKM_SHA3_224_HMAC:
     case CKM_SHA3_224_HMAC_GENERAL:
     case CKM_IBM_SHA3_224_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha3_224(), NULL, pkey);
+        md = EVP_sha3_224();
         break;
 #endif
 #ifdef NID_sha3_256
     case CKM_SHA3_256_HMAC:
     case CKM_SHA3_256_HMAC_GENERAL:
     case CKM_IBM_SHA3_256_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha3_256(), NULL, pkey);
+        md = EVP_sha3_256();
         break;
 #endif
 #ifdef NID_sha3_384
     case CKM_SHA3_384_HMAC:
     case CKM_SHA3_384_HMAC_GENERAL:
     case CKM_IBM_SHA3_384_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha3_384(), NULL, pkey);
+        md = EVP_sha3_384();
         break;
 #endif
 #ifdef NID_sha3_512
     case CKM_SHA3_512_HMAC:
     case CKM_SHA3_512_HMAC_GENERAL:
     case CKM_IBM_SHA3_512_HMAC:
-        rc = EVP_DigestSignInit(mdctx, NULL, EVP_sha3_512(), NULL, pkey);
+        md = EVP_sha3_512();
         break;
 #endif
     default:
-        EVP_MD_CTX_destroy(mdctx);
         TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
         rc = CKR_MECHANISM_INVALID;
         goto done;
     }
 
-    if (rc != 1) {
-        EVP_MD_CTX_destroy(mdctx);
+#ifdef OPENSSL_SHA_STATE
+    if (get_hmac_digest(mech->mechanism, &digest_mech, &general) == CKR_OK &&
+        openssl_sha_state_usable(digest_mech)) {
+        ctx->context = malloc(sizeof(struct openssl_sha_state));
+        if (ctx->context == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            rc = CKR_HOST_MEMORY;
+            goto done;
+        }
+
+        rc = openssl_hmac_get_pad(key, digest_mech, 0,
+                                  (struct openssl_sha_state *)ctx->context);
+        if (rc != CKR_OK) {
+            free(ctx->context);
+            ctx->context = NULL;
+            goto done;
+        }
+
+        ctx->context_len = sizeof(struct openssl_sha_state);
+        goto done;
+    }
+#endif
+
+    md = openssl_cached_md(md);
+
+    rc = openssl_get_ex_data(key, (void **)&ex_data,
+                             sizeof(struct openssl_hmac_ex_data),
+                             openssl_hmac_need_wr_lock,
+                             openssl_free_hmac_ex_data);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (ex_data->tmpl == NULL) {
+        ex_data->tmpl = openssl_hmac_ctx_new(md, attr);
+        ex_data->md = md;
+    }
+
+    if (ex_data->tmpl != NULL && ex_data->md == md)
+        hctx = openssl_hmac_ctx_dup(ex_data->tmpl);
+    else
+        hctx = openssl_hmac_ctx_new(md, attr);
+
+    object_ex_data_unlock(key);
+
+    if (hctx == NULL) {
         ctx->context = NULL;
-        TRACE_ERROR("EVP_DigestSignInit failed.\n");
         rc = CKR_FUNCTION_FAILED;
         goto done;
-    } else {
-        ctx->context = (CK_BYTE *) mdctx;
-        ctx->context_free_func = openssl_specific_hmac_free;
-        ctx->state_unsaveable = TRUE;
     }
 
+    ctx->context = (CK_BYTE *) hctx;
+    ctx->context_free_func = openssl_specific_hmac_free;
+    ctx->state_unsaveable = TRUE;
+
     rc = CKR_OK;
 done:
-    if (pkey != NULL)
-        EVP_PKEY_free(pkey);
-
     object_put(tokdata, key, TRUE);
     key = NULL;
     return rc;
 }
 
-CK_RV openssl_specific_hmac(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
-                            CK_ULONG in_data_len, CK_BYTE *signature,
-                            CK_ULONG *sig_len, CK_BBOOL sign)
+CK_RV openssl_specific_hmac(STDLL_TokData_t *tokdata, SIGN_VERIFY_CONTEXT *ctx,
+                            CK_BYTE *in_data, CK_ULONG in_data_len,
+                            CK_BYTE *signature, CK_ULONG *sig_len,
+                            CK_BBOOL sign)
 {
     int rc;
     size_t mac_len, len;
     unsigned char mac[MAX_SHA_HASH_SIZE];
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     EVP_MD_CTX *mdctx = NULL;
+#else
+    EVP_MAC_CTX *mctx = NULL;
+#endif
     CK_RV rv = CKR_OK;
     CK_BBOOL general = FALSE;
     CK_MECHANISM_TYPE digest_mech;
     CK_ULONG mac_len2;
+#ifdef OPENSSL_SHA_STATE
+    struct openssl_sha_state *state;
+#else
+    UNUSED(tokdata);
+#endif
 
     if (!ctx || !ctx->context) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -4967,6 +6605,7 @@ CK_RV openssl_specific_hmac(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
     }
     mac_len = mac_len2;
 
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     mdctx = (EVP_MD_CTX *) ctx->context;
 
     rc = EVP_DigestSignUpdate(mdctx, in_data, in_data_len);
@@ -4982,6 +6621,41 @@ CK_RV openssl_specific_hmac(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
         rv = CKR_FUNCTION_FAILED;
         goto done;
     }
+#else
+#ifdef OPENSSL_SHA_STATE
+    if (ctx->context_free_func != openssl_specific_hmac_free) {
+        state = openssl_sha_state_get(ctx->context, ctx->context_len,
+                                      digest_mech);
+        if (state == NULL ||
+            !openssl_sha_state_update(state, in_data, in_data_len)) {
+            TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+
+        rv = openssl_hmac_state_final(tokdata, ctx, digest_mech, mac);
+        if (rv != CKR_OK)
+            goto done;
+    } else
+#endif
+    {
+        mctx = (EVP_MAC_CTX *) ctx->context;
+
+        rc = EVP_MAC_update(mctx, in_data, in_data_len);
+        if (rc != 1) {
+            TRACE_ERROR("EVP_MAC_update failed.\n");
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+
+        rc = EVP_MAC_final(mctx, mac, &mac_len, sizeof(mac));
+        if (rc != 1) {
+            TRACE_ERROR("EVP_MAC_final failed.\n");
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+    }
+#endif
 
     if (sign) {
         if (general)
@@ -5003,7 +6677,14 @@ CK_RV openssl_specific_hmac(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
         }
     }
 done:
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     EVP_MD_CTX_destroy(mdctx);
+#else
+    if (mctx != NULL)
+        EVP_MAC_CTX_free(mctx);
+    else
+        free(ctx->context);
+#endif
     ctx->context = NULL;
 
     return rv;
@@ -5013,7 +6694,16 @@ CK_RV openssl_specific_hmac_update(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
                                    CK_ULONG in_data_len, CK_BBOOL sign)
 {
     int rc;
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     EVP_MD_CTX *mdctx = NULL;
+#else
+    EVP_MAC_CTX *mctx = NULL;
+#endif
+#ifdef OPENSSL_SHA_STATE
+    struct openssl_sha_state *state;
+    CK_MECHANISM_TYPE digest_mech;
+    CK_BBOOL general;
+#endif
     CK_RV rv = CKR_OK;
 
     UNUSED(sign);
@@ -5021,6 +6711,7 @@ CK_RV openssl_specific_hmac_update(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
     if (!ctx || !ctx->context)
         return CKR_OPERATION_NOT_INITIALIZED;
 
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     mdctx = (EVP_MD_CTX *) ctx->context;
 
     rc = EVP_DigestSignUpdate(mdctx, in_data, in_data_len);
@@ -5032,22 +6723,61 @@ CK_RV openssl_specific_hmac_update(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
     }
 
     EVP_MD_CTX_destroy(mdctx);
+#else
+#ifdef OPENSSL_SHA_STATE
+    if (ctx->context_free_func != openssl_specific_hmac_free) {
+        if (get_hmac_digest(ctx->mech.mechanism, &digest_mech,
+                            &general) == CKR_OK)
+            state = openssl_sha_state_get(ctx->context, ctx->context_len,
+                                          digest_mech);
+        else
+            state = NULL;
+        if (state == NULL ||
+            !openssl_sha_state_update(state, in_data, in_data_len)) {
+            TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+            return CKR_FUNCTION_FAILED;
+        }
+        return CKR_OK;
+    }
+#endif
+
+    mctx = (EVP_MAC_CTX *) ctx->context;
+
+    rc = EVP_MAC_update(mctx, in_data, in_data_len);
+    if (rc != 1) {
+        TRACE_ERROR("EVP_MAC_update failed.\n");
+        rv = CKR_FUNCTION_FAILED;
+    } else {
+        return CKR_OK;
+    }
+
+    EVP_MAC_CTX_free(mctx);
+#endif
     ctx->context = NULL;
     return rv;
 }
 
-CK_RV openssl_specific_hmac_final(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
+CK_RV openssl_specific_hmac_final(STDLL_TokData_t *tokdata,
+                                  SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
                                   CK_ULONG *sig_len, CK_BBOOL sign)
 {
     int rc;
     size_t mac_len, len;
     unsigned char mac[MAX_SHA_HASH_SIZE];
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     EVP_MD_CTX *mdctx = NULL;
+#else
+    EVP_MAC_CTX *mctx = NULL;
+#endif
     CK_RV rv = CKR_OK;
     CK_BBOOL general = FALSE;
     CK_MECHANISM_TYPE digest_mech;
     CK_ULONG mac_len2;
 
+#ifndef OPENSSL_SHA_STATE
+    UNUSED(tokdata);
+#endif
+
     if (!ctx || !ctx->context)
         return CKR_OPERATION_NOT_INITIALIZED;
 
@@ -5079,6 +6809,7 @@ CK_RV openssl_specific_hmac_final(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
         return CKR_OK;
     }
 
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     mdctx = (EVP_MD_CTX *) ctx->context;
 
     rc = EVP_DigestSignFinal(mdctx, mac, &mac_len);
@@ -5087,6 +6818,25 @@ CK_RV openssl_specific_hmac_final(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
         rv = CKR_FUNCTION_FAILED;
         goto done;
     }
+#else
+#ifdef OPENSSL_SHA_STATE
+    if (ctx->context_free_func != openssl_specific_hmac_free) {
+        rv = openssl_hmac_state_final(tokdata, ctx, digest_mech, mac);
+        if (rv != CKR_OK)
+            goto done;
+    } else
+#endif
+    {
+        mctx = (EVP_MAC_CTX *) ctx->context;
+
+        rc = EVP_MAC_final(mctx, mac, &mac_len, sizeof(mac));
+        if (rc != 1) {
+            TRACE_ERROR("EVP_MAC_final failed.\n");
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+    }
+#endif
 
     if (sign) {
         if (general)
@@ -5108,7 +6858,14 @@ CK_RV openssl_specific_hmac_final(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
         }
     }
 done:
+#if !OPENSSL_VERSION_PREREQ(3, 0)
     EVP_MD_CTX_destroy(mdctx);
+#else
+    if (mctx != NULL)
+        EVP_MAC_CTX_free(mctx);
+    else
+        free(ctx->context);
+#endif
     ctx->context = NULL;
     return rv;
 }
@@ -5632,7 +7389,7 @@ CK_RV openssl_specific_rsa_derive_kdk(STDLL_TokData_t *tokdata, OBJECT *key_obj,
      * messages for the same ciphertext, they'll know that the message is
      * synthetically generated, which means that the padding check failed
      */
-    md = EVP_sha256();
+    md = openssl_cached_md(EVP_sha256());
     if (md == NULL) {
         TRACE_ERROR("EVP_sha256 failed\n");
         rc = CKR_FUNCTION_FAILED;
@@ -5761,7 +7518,8 @@ CK_RV openssl_specific_rsa_prf(CK_BYTE *out, CK_ULONG outlen,
      * synthetically generated, which means that the padding check failed
      */
     for (pos = 0; pos < outlen; pos += SHA256_HASH_SIZE, iter++) {
-        if (EVP_DigestSignInit(mdctx, NULL, EVP_sha256(), NULL, pkey) != 1) {
+        if (EVP_DigestSignInit(mdctx, NULL, openssl_cached_md(EVP_sha256()),
+                               NULL, pkey) != 1) {
             TRACE_ERROR("EVP_DigestSignInit failed\n");
             rc = CKR_FUNCTION_FAILED;
             goto out;
@@ -17,10 +17,17 @@
 
 #include <string.h>             // for memcmp() et al
 #include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#if defined(HAVE_GETRANDOM) && defined(HAVE_SYS_RANDOM_H)
+#include <sys/random.h>
+#endif
+
+#include <openssl/crypto.h>
 
 #include "pkcs11types.h"
 #include "defs.h"
@@ -31,13 +38,50 @@
 #include "tok_specific.h"
 #include "trace.h"
 
-//
-//
-CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
+/*
+ * Small requests (IVs, nonces, blinding and padding bytes) are served from a
+ * per-thread buffer that is filled from the kernel's random number generator
+ * in one go, larger ones are read directly. The kernel generator reseeds
+ * itself, so the buffer is simply refilled when it runs empty. Bytes handed
+ * out are wiped from the buffer, so they are never returned twice.
+ *
+ * A forked child inherits the buffer of the forking thread, which would let
+ * parent and child produce the same random data. The atfork child handler
+ * bumps the generation, so that all buffers filled before the fork are
+ * dropped on their next use. The child is single threaded at that point, so
+ * the generation needs no locking.
+ */
+#define RNG_BUFFER_SIZE         512
+#define RNG_MAX_BUFFERED        128
+
+struct rng_buffer {
+    CK_BYTE data[RNG_BUFFER_SIZE];
+    CK_ULONG avail;
+    unsigned long generation;
+};
+
+static __thread struct rng_buffer rng_buffer;
+static unsigned long rng_generation = 1;
+static pthread_once_t rng_atfork_once = PTHREAD_ONCE_INIT;
+
+static void rng_atfork_child(void)
+{
+    rng_generation++;
+
+    /* Only the forking thread exists in the child, wipe its buffer now */
+    OPENSSL_cleanse(&rng_buffer, sizeof(rng_buffer));
+}
+
+static void rng_register_atfork(void)
+{
+    pthread_atfork(NULL, NULL, rng_atfork_child);
+}
+
+static CK_RV rng_read_device(CK_BYTE *output, CK_ULONG bytes)
 {
     int ranfd;
     int rlen;
-    unsigned int totallen = 0;
+    CK_ULONG totallen = 0;
 
     ranfd = open("/dev/prandom", O_RDONLY);
     if (ranfd < 0)
@@ -58,6 +102,69 @@ CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
     return CKR_FUNCTION_FAILED;
 }
 
+static CK_RV rng_read(CK_BYTE *output, CK_ULONG bytes)
+{
+#if defined(HAVE_GETRANDOM) && defined(HAVE_SYS_RANDOM_H)
+    CK_ULONG totallen = 0;
+    ssize_t rlen;
+
+    while (totallen < bytes) {
+        rlen = getrandom(output + totallen, bytes - totallen, 0);
+        if (rlen < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOSYS && totallen == 0)
+                return rng_read_device(output, bytes);
+            TRACE_ERROR("getrandom failed: %s\n", strerror(errno));
+            return CKR_FUNCTION_FAILED;
+        }
+        totallen += rlen;
+    }
+
+    return CKR_OK;
+#else
+    return rng_read_device(output, bytes);
+#endif
+}
+
+//
+//
+CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
+{
+    struct rng_buffer *buf = &rng_buffer;
+    CK_ULONG len;
+    CK_RV rc;
+
+    if (bytes > RNG_MAX_BUFFERED)
+        return rng_read(output, bytes);
+
+    pthread_once(&rng_atfork_once, rng_register_atfork);
+
+    if (buf->generation != rng_generation) {
+        OPENSSL_cleanse(buf->data, sizeof(buf->data));
+        buf->avail = 0;
+        buf->generation = rng_generation;
+    }
+
+    while (bytes > 0) {
+        if (buf->avail == 0) {
+            rc = rng_read(buf->data, sizeof(buf->data));
+            if (rc != CKR_OK)
+                return rc;
+            buf->avail = sizeof(buf->data);
+        }
+
+        len = MIN(bytes, buf->avail);
+        buf->avail -= len;
+        memcpy(output, buf->data + buf->avail, len);
+        OPENSSL_cleanse(buf->data + buf->avail, len);
+        output += len;
+        bytes -= len;
+    }
+
+    return CKR_OK;
+}
+
 //
 //
 CK_RV rng_generate(STDLL_TokData_t *tokdata, CK_BYTE *output, CK_ULONG bytes)
@@ -1665,7 +1665,11 @@ CK_RV rsa_hash_pss_update(STDLL_TokData_t *tokdata, SESSION *sess,
             TRACE_DEVEL("Digest Mgr Init failed.\n");
             return rc;
         }
-        ctx->state_unsaveable |= digest_ctx->state_unsaveable;
+        /*
+         * The digest context holds its state in separately allocated
+         * memory, which is not part of a saved operation state.
+         */
+        ctx->state_unsaveable = CK_TRUE;
     }
 
     rc = digest_mgr_digest_update(tokdata, sess, digest_ctx, in_data,
@@ -2071,7 +2075,7 @@ CK_RV rsa_hash_pkcs_sign_update(STDLL_TokData_t *tokdata,
             return rc;
         }
         context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
+        ctx->state_unsaveable = CK_TRUE;
     }
 
     rc = digest_mgr_digest_update(tokdata, sess, &context->hash_context,
@@ -2221,7 +2225,7 @@ CK_RV rsa_hash_pkcs_verify_update(STDLL_TokData_t *tokdata,
             return rc;
         }
         context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
+        ctx->state_unsaveable = CK_TRUE;
     }
 
     rc = digest_mgr_digest_update(tokdata, sess, &context->hash_context,
@@ -66,7 +66,8 @@ CK_RV sw_sha1_init(DIGEST_CONTEXT *ctx)
         return CKR_HOST_MEMORY;
     }
 
-    if (!EVP_DigestInit_ex((EVP_MD_CTX *)ctx->context, EVP_sha1(), NULL)) {
+    if (!EVP_DigestInit_ex((EVP_MD_CTX *)ctx->context,
+                           openssl_cached_md(EVP_sha1()), NULL)) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         EVP_MD_CTX_free((EVP_MD_CTX *)ctx->context);
         ctx->context = NULL;
@@ -181,6 +182,41 @@ CK_RV sha_init(STDLL_TokData_t *tokdata, SESSION *sess, DIGEST_CONTEXT *ctx,
     }
 }
 
+/*
+ * Single-shot digest without a session, used by C_IBM_DigestBatch. Tokens
+ * without t_sha_single use a temporary digest context.
+ */
+CK_RV sha_hash_single(STDLL_TokData_t *tokdata, CK_MECHANISM *mech,
+                      CK_BYTE *in_data, CK_ULONG in_data_len,
+                      CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    DIGEST_CONTEXT ctx;
+    CK_RV rc;
+
+    if (token_specific.t_sha_single != NULL)
+        return token_specific.t_sha_single(tokdata, mech, in_data, in_data_len,
+                                           out_data, out_data_len);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.mech.mechanism = mech->mechanism;
+
+    rc = sha_init(tokdata, NULL, &ctx, mech);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("sha_init failed\n");
+        goto out;
+    }
+
+    rc = sha_hash(tokdata, NULL, FALSE, &ctx, in_data, in_data_len,
+                  out_data, out_data_len);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("sha_hash failed\n");
+
+out:
+    digest_mgr_cleanup(tokdata, NULL, &ctx);
+
+    return rc;
+}
+
 CK_RV sha_hash(STDLL_TokData_t *tokdata, SESSION *sess, CK_BBOOL length_only,
                DIGEST_CONTEXT *ctx, CK_BYTE *in_data, CK_ULONG in_data_len,
                CK_BYTE *out_data, CK_ULONG *out_data_len)
@@ -376,8 +412,8 @@ CK_RV sha_hmac_sign(STDLL_TokData_t *tokdata,
         return token_specific.t_hmac_sign(tokdata, sess, in_data,
                                           in_data_len, out_data, out_data_len);
 
-    return openssl_specific_hmac(&sess->sign_ctx, in_data, in_data_len,
-                                 out_data, out_data_len, TRUE);
+    return openssl_specific_hmac(tokdata, &sess->sign_ctx, in_data,
+                                 in_data_len, out_data, out_data_len, TRUE);
 }
 
 // this routine gets called for these mechanisms actually:
@@ -422,8 +458,8 @@ CK_RV sha_hmac_verify(STDLL_TokData_t *tokdata, SESSION *sess,
         return token_specific.t_hmac_verify(tokdata, sess, in_data,
                                             in_data_len, signature, sig_len);
 
-    return openssl_specific_hmac(&sess->verify_ctx, in_data, in_data_len,
-                                 signature, &sig_len, FALSE);
+    return openssl_specific_hmac(tokdata, &sess->verify_ctx, in_data,
+                                 in_data_len, signature, &sig_len, FALSE);
 }
 
 CK_RV hmac_sign_init(STDLL_TokData_t *tokdata, SESSION *sess,
@@ -467,8 +503,8 @@ CK_RV hmac_sign_final(STDLL_TokData_t *tokdata, SESSION *sess,
         return token_specific.t_hmac_sign_final(tokdata, sess,
                                                 signature, sig_len);
 
-    return openssl_specific_hmac_final(&sess->sign_ctx, signature, sig_len,
-                                       TRUE);
+    return openssl_specific_hmac_final(tokdata, &sess->sign_ctx, signature,
+                                       sig_len, TRUE);
 }
 
 CK_RV hmac_verify_init(STDLL_TokData_t *tokdata, SESSION *sess,
@@ -512,8 +548,8 @@ CK_RV hmac_verify_final(STDLL_TokData_t *tokdata, SESSION *sess,
         return token_specific.t_hmac_verify_final(tokdata, sess,
                                                   signature, sig_len);
 
-    return openssl_specific_hmac_final(&sess->verify_ctx, signature, &sig_len,
-                                       FALSE);
+    return openssl_specific_hmac_final(tokdata, &sess->verify_ctx, signature,
+                                       &sig_len, FALSE);
 }
 
 CK_RV ckm_generic_secret_key_gen(STDLL_TokData_t *tokdata, TEMPLATE *tmpl)
@@ -289,7 +289,11 @@ CK_RV ssl3_mac_sign_update(STDLL_TokData_t *tokdata,
             goto done;
         }
         context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
+        /*
+         * The digest context holds its state in separately allocated
+         * memory, which is not part of a saved operation state.
+         */
+        ctx->state_unsaveable = CK_TRUE;
     }
 
 
@@ -576,7 +580,7 @@ CK_RV ssl3_mac_verify_update(STDLL_TokData_t *tokdata,
             goto done;
         }
         context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
+        ctx->state_unsaveable = CK_TRUE;
     }
 
     rc = digest_mgr_digest_update(tokdata, sess, &context->hash_context,
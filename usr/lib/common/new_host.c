@@ -135,6 +135,13 @@ CK_RV ST_Initialize(API_Slot_t *sltp, CK_SLOT_ID SlotNumber,
         goto done;
     }
 
+    sltp->TokData->objstore = sinfp->objstore;
+    if (sinfp->objstore == OBJSTORE_LOG && !newdatastore) {
+        TRACE_ERROR("objstore = log requires tokversion 3.12 or later.\n");
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
     /* Initialize Lock */
     if (XProcLock_Init(sltp->TokData) != CKR_OK) {
         TRACE_ERROR("Thread lock failed.\n");
@@ -172,6 +179,7 @@ CK_RV ST_Initialize(API_Slot_t *sltp, CK_SLOT_ID SlotNumber,
             TRACE_DEVEL("Token Specific Init failed.\n");
             goto done;
         }
+        openssl_cache_init();
         sltp->TokData->initialized = TRUE;
     }
 
@@ -255,6 +263,7 @@ CK_RV SC_Finalize(STDLL_TokData_t *tokdata, CK_SLOT_ID sid, SLOT_INFO *sinfp,
     detach_shm(tokdata, in_fork_initializer);
     /* close spin lock file */
     CloseXProcLock(tokdata);
+    openssl_cache_final();
     if (token_specific.t_final != NULL) {
         rc = token_specific.t_final(tokdata, in_fork_initializer);
         if (rc != CKR_OK) {
@@ -1130,6 +1139,7 @@ CK_RV SC_GetOperationState(STDLL_TokData_t *tokdata,
 {
     SESSION *sess = NULL;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -1154,12 +1164,20 @@ CK_RV SC_GetOperationState(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, SESSION_STATE_OPS);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     rc = session_mgr_get_op_state(tokdata, sess, length_only, pOperationState,
                                   pulOperationStateLen);
     if (rc != CKR_OK)
         TRACE_DEVEL("session_mgr_get_op_state() failed.\n");
 
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, SESSION_STATE_OPS, rc);
+
     TRACE_INFO("C_GetOperationState: rc = 0x%08lx, sess = %lu\n",
                rc, sSession->sessionh);
 
@@ -1178,6 +1196,7 @@ CK_RV SC_SetOperationState(STDLL_TokData_t *tokdata,
                            CK_OBJECT_HANDLE hAuthenticationKey)
 {
     SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -1199,6 +1218,11 @@ CK_RV SC_SetOperationState(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, SESSION_STATE_OPS);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     rc = session_mgr_set_op_state(tokdata, sess, hEncryptionKey,
                                   hAuthenticationKey, pOperationState,
                                   ulOperationStateLen);
@@ -1207,6 +1231,9 @@ CK_RV SC_SetOperationState(STDLL_TokData_t *tokdata,
         TRACE_DEVEL("session_mgr_set_op_state() failed.\n");
 
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, SESSION_STATE_OPS, rc);
+
     TRACE_INFO("C_SetOperationState: rc = 0x%08lx, sess = %lu\n",
                rc, sSession->sessionh);
 
@@ -2022,6 +2049,7 @@ CK_RV SC_FindObjectsInit(STDLL_TokData_t *tokdata,
                          CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount)
 {
     SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2037,6 +2065,11 @@ CK_RV SC_FindObjectsInit(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_FIND_OBJECTS);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (pin_expired(&sess->session_info,
                     tokdata->nv_token_data->token_info.flags) == TRUE) {
         TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
@@ -2053,6 +2086,9 @@ CK_RV SC_FindObjectsInit(STDLL_TokData_t *tokdata,
     rc = object_mgr_find_init(tokdata, sess, pTemplate, ulCount);
 
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_FIND_OBJECTS, rc);
+
     TRACE_INFO("C_FindObjectsInit: rc = 0x%08lx\n", rc);
 
     if (sess != NULL)
@@ -2088,6 +2124,7 @@ CK_RV SC_FindObjects(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
 {
     SESSION *sess = NULL;
     CK_ULONG count = 0;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2109,6 +2146,11 @@ CK_RV SC_FindObjects(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_FIND_OBJECTS);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (sess->find_active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
@@ -2130,6 +2172,9 @@ CK_RV SC_FindObjects(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     rc = CKR_OK;
 
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_FIND_OBJECTS, rc);
+
     TRACE_INFO("C_FindObjects: rc = 0x%08lx, returned %lu objects\n",
                rc, count);
 
@@ -2144,6 +2189,7 @@ CK_RV SC_FindObjectsFinal(STDLL_TokData_t *tokdata,
                           ST_SESSION_HANDLE *sSession)
 {
     SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2159,6 +2205,11 @@ CK_RV SC_FindObjectsFinal(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_FIND_OBJECTS);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (sess->find_active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
@@ -2176,6 +2227,9 @@ CK_RV SC_FindObjectsFinal(STDLL_TokData_t *tokdata,
     rc = CKR_OK;
 
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_FIND_OBJECTS, rc);
+
     TRACE_INFO("C_FindObjectsFinal: rc = 0x%08lx\n", rc);
 
     if (sess != NULL)
@@ -2189,6 +2243,8 @@ CK_RV SC_EncryptInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                      CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2217,6 +2273,11 @@ CK_RV SC_EncryptInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     rc = valid_mech(tokdata, pMechanism, CKF_ENCRYPT);
     if (rc != CKR_OK)
         goto done;
@@ -2228,10 +2289,18 @@ CK_RV SC_EncryptInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     }
 
     sess->encr_ctx.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
     rc = encr_mgr_init(tokdata, sess, &sess->encr_ctx, OP_ENCRYPT_INIT,
                        pMechanism, hKey, TRUE);
 
+    if (rc == CKR_OK)
+        STAT_RECORD(tokdata, sess, pMechanism->mechanism, STAT_OP_INIT, 0,
+                    &stat_start);
+
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_ENCRYPT, rc);
+
     TRACE_INFO("C_EncryptInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                (pMechanism ? pMechanism->mechanism : (CK_ULONG)(-1)));
@@ -2248,7 +2317,10 @@ CK_RV SC_Encrypt(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                  CK_BYTE_PTR pEncryptedData, CK_ULONG_PTR pulEncryptedDataLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2264,6 +2336,11 @@ CK_RV SC_Encrypt(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pData || !pulEncryptedDataLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -2279,17 +2356,26 @@ CK_RV SC_Encrypt(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (!pEncryptedData)
         length_only = TRUE;
 
+    stat_mech = sess->encr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = encr_mgr_encrypt(tokdata, sess, length_only, &sess->encr_ctx, pData,
                           ulDataLen, pEncryptedData, pulEncryptedDataLen);
     if (rc != CKR_OK)
         TRACE_DEVEL("encr_mgr_encrypt() failed.\n");
 
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_SINGLE, ulDataLen,
+                    &stat_start);
+
 done:
     if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
-        if (sess)
+        if (busy)
             encr_mgr_cleanup(tokdata, sess, &sess->encr_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_ENCRYPT, rc);
+
     TRACE_INFO("C_Encrypt: rc = 0x%08lx, sess = %ld, amount = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
 
@@ -2306,7 +2392,10 @@ CK_RV SC_EncryptUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                        CK_ULONG_PTR pulEncryptedPartLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2322,6 +2411,11 @@ CK_RV SC_EncryptUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if ((!pPart && ulPartLen != 0) || !pulEncryptedPartLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -2337,18 +2431,27 @@ CK_RV SC_EncryptUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (!pEncryptedPart)
         length_only = TRUE;
 
+    stat_mech = sess->encr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = encr_mgr_encrypt_update(tokdata, sess, length_only,
                                  &sess->encr_ctx, pPart, ulPartLen,
                                  pEncryptedPart, pulEncryptedPartLen);
     if (rc != CKR_OK)
         TRACE_DEVEL("encr_mgr_encrypt_update() failed.\n");
 
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_UPDATE, ulPartLen,
+                    &stat_start);
+
 done:
     if (rc != CKR_OK && rc != CKR_BUFFER_TOO_SMALL) {
-        if (sess)
+        if (busy)
             encr_mgr_cleanup(tokdata, sess, &sess->encr_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_ENCRYPT, rc);
+
     TRACE_INFO("C_EncryptUpdate: rc = 0x%08lx, sess = %ld, amount = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulPartLen);
 
@@ -2364,7 +2467,10 @@ CK_RV SC_EncryptFinal(STDLL_TokData_t * tokdata, ST_SESSION_HANDLE * sSession,
                       CK_ULONG_PTR pulLastEncryptedPartLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2380,6 +2486,11 @@ CK_RV SC_EncryptFinal(STDLL_TokData_t * tokdata, ST_SESSION_HANDLE * sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pulLastEncryptedPartLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -2395,17 +2506,26 @@ CK_RV SC_EncryptFinal(STDLL_TokData_t * tokdata, ST_SESSION_HANDLE * sSession,
     if (!pLastEncryptedPart)
         length_only = TRUE;
 
+    stat_mech = sess->encr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = encr_mgr_encrypt_final(tokdata, sess, length_only, &sess->encr_ctx,
                                 pLastEncryptedPart, pulLastEncryptedPartLen);
     if (rc != CKR_OK)
         TRACE_ERROR("encr_mgr_encrypt_final() failed.\n");
 
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_FINAL, 0,
+                    &stat_start);
+
 done:
     if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
-        if (sess)
+        if (busy)
             encr_mgr_cleanup(tokdata, sess, &sess->encr_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_ENCRYPT, rc);
+
     TRACE_INFO("C_EncryptFinal: rc = 0x%08lx, sess = %ld\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
 
@@ -2420,6 +2540,8 @@ CK_RV SC_DecryptInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                      CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2448,6 +2570,11 @@ CK_RV SC_DecryptInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     rc = valid_mech(tokdata, pMechanism, CKF_DECRYPT);
     if (rc != CKR_OK)
         goto done;
@@ -2459,12 +2586,20 @@ CK_RV SC_DecryptInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     }
 
     sess->decr_ctx.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
     rc = decr_mgr_init(tokdata, sess, &sess->decr_ctx, OP_DECRYPT_INIT,
                        pMechanism, hKey, TRUE, TRUE);
     if (rc != CKR_OK)
         TRACE_DEVEL("decr_mgr_init() failed.\n");
 
+    if (rc == CKR_OK)
+        STAT_RECORD(tokdata, sess, pMechanism->mechanism, STAT_OP_INIT, 0,
+                    &stat_start);
+
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DECRYPT, rc);
+
     TRACE_INFO("C_DecryptInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
@@ -2481,7 +2616,10 @@ CK_RV SC_Decrypt(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                  CK_BYTE_PTR pData, CK_ULONG_PTR pulDataLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
     unsigned int mask;
 
@@ -2498,6 +2636,11 @@ CK_RV SC_Decrypt(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pEncryptedData || !pulDataLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -2513,6 +2656,8 @@ CK_RV SC_Decrypt(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (!pData)
         length_only = TRUE;
 
+    stat_mech = sess->decr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = decr_mgr_decrypt(tokdata, sess, length_only, &sess->decr_ctx,
                           pEncryptedData, ulEncryptedDataLen, pData,
                           pulDataLen);
@@ -2523,16 +2668,23 @@ CK_RV SC_Decrypt(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (mask)
         TRACE_DEVEL("decr_mgr_decrypt() failed.\n");
 
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_SINGLE,
+                    ulEncryptedDataLen, &stat_start);
+
 done:
     /* (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) */
     mask = ~constant_time_eq(rc, CKR_OK);
     mask |= constant_time_is_zero(length_only);
     mask &= ~constant_time_eq(rc, CKR_BUFFER_TOO_SMALL);
     if (mask) {
-        if (sess)
+        if (busy)
             decr_mgr_cleanup(tokdata, sess, &sess->decr_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DECRYPT, rc);
+
     TRACE_INFO("C_Decrypt: rc = 0x%08lx, sess = %ld, amount = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                ulEncryptedDataLen);
@@ -2549,7 +2701,10 @@ CK_RV SC_DecryptUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                        CK_BYTE_PTR pPart, CK_ULONG_PTR pulPartLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
     unsigned int mask;
 
@@ -2566,6 +2721,11 @@ CK_RV SC_DecryptUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if ((!pEncryptedPart && ulEncryptedPartLen != 0) || !pulPartLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -2581,6 +2741,8 @@ CK_RV SC_DecryptUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (!pPart)
         length_only = TRUE;
 
+    stat_mech = sess->decr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = decr_mgr_decrypt_update(tokdata, sess, length_only,
                                  &sess->decr_ctx, pEncryptedPart,
                                  ulEncryptedPartLen, pPart, pulPartLen);
@@ -2591,15 +2753,22 @@ CK_RV SC_DecryptUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (mask)
         TRACE_DEVEL("decr_mgr_decrypt_update() failed.\n");
 
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_UPDATE,
+                    ulEncryptedPartLen, &stat_start);
+
 done:
     /* (rc != CKR_OK && rc != CKR_BUFFER_TOO_SMALL */
     mask = ~constant_time_eq(rc, CKR_OK);
     mask &= ~constant_time_eq(rc, CKR_BUFFER_TOO_SMALL);
     if (mask) {
-        if (sess)
+        if (busy)
             decr_mgr_cleanup(tokdata, sess, &sess->decr_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DECRYPT, rc);
+
     TRACE_INFO("C_DecryptUpdate: rc = 0x%08lx, sess = %ld, amount = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                ulEncryptedPartLen);
@@ -2615,7 +2784,10 @@ CK_RV SC_DecryptFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                       CK_BYTE_PTR pLastPart, CK_ULONG_PTR pulLastPartLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
     unsigned int mask;
 
@@ -2632,6 +2804,11 @@ CK_RV SC_DecryptFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pulLastPartLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -2647,6 +2824,8 @@ CK_RV SC_DecryptFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (!pLastPart)
         length_only = TRUE;
 
+    stat_mech = sess->decr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = decr_mgr_decrypt_final(tokdata, sess, length_only, &sess->decr_ctx,
                                 pLastPart, pulLastPartLen);
     /* (!is_rsa_mechanism(sess->decr_ctx.mech.mechanism) && rc != CKR_OK) */
@@ -2656,16 +2835,23 @@ CK_RV SC_DecryptFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     if (mask)
         TRACE_DEVEL("decr_mgr_decrypt_final() failed.\n");
 
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_FINAL, 0,
+                    &stat_start);
+
 done:
     /* (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) */
     mask = ~constant_time_eq(rc, CKR_OK);
     mask |= constant_time_is_zero(length_only);
     mask &= ~constant_time_eq(rc, CKR_BUFFER_TOO_SMALL);
     if (mask) {
-        if (sess)
+        if (busy)
             decr_mgr_cleanup(tokdata, sess, &sess->decr_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DECRYPT, rc);
+
     TRACE_INFO("C_DecryptFinal: rc = 0x%08lx, sess = %ld, amount = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                (pulLastPartLen ? *pulLastPartLen : 0));
@@ -2677,10 +2863,13 @@ done:
 }
 
 
-CK_RV SC_DigestInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                    CK_MECHANISM_PTR pMechanism)
+CK_RV SC_MessageEncryptInit(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2705,29 +2894,41 @@ CK_RV SC_DigestInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
 
     if (pMechanism == NULL) {
         /* As per PKCS#11 v3.0 Init with NULL pMechanism cancels operation */
-        rc = session_mgr_cancel(tokdata, sess, CKF_DIGEST);
+        rc = session_mgr_cancel(tokdata, sess, CKF_MESSAGE_ENCRYPT);
         goto done;
     }
 
-    rc = valid_mech(tokdata, pMechanism, CKF_DIGEST);
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_ENCRYPT);
     if (rc != CKR_OK)
         goto done;
+    busy = TRUE;
 
-    if (sess->digest_ctx.active == TRUE) {
+    rc = valid_mech(tokdata, pMechanism, CKF_MESSAGE_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (sess->msg_encr_ctx.active == TRUE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
         rc = CKR_OPERATION_ACTIVE;
         goto done;
     }
 
-    sess->digest_ctx.count_statistics = TRUE;
-    rc = digest_mgr_init(tokdata, sess, &sess->digest_ctx, pMechanism, TRUE);
-    if (rc != CKR_OK)
-        TRACE_DEVEL("digest_mgr_init() failed.\n");
+    sess->msg_encr_ctx.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
+    rc = encr_mgr_msg_init(tokdata, sess, &sess->msg_encr_ctx, pMechanism, hKey,
+                           TRUE);
+
+    if (rc == CKR_OK)
+        STAT_RECORD(tokdata, sess, pMechanism->mechanism, STAT_OP_INIT, 0,
+                    &stat_start);
 
 done:
-    TRACE_INFO("C_DigestInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_ENCRYPT, rc);
+
+    TRACE_INFO("C_MessageEncryptInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
-               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)(-1)));
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -2736,12 +2937,18 @@ done:
 }
 
 
-CK_RV SC_Digest(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pDigest,
-                CK_ULONG_PTR pulDigestLen)
+CK_RV SC_EncryptMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                        CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                        CK_BYTE_PTR pAssociatedData,
+                        CK_ULONG ulAssociatedDataLen,
+                        CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen,
+                        CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2757,23 +2964,47 @@ CK_RV SC_Digest(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (sess->digest_ctx.active == FALSE) {
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pParameter || (!pAssociatedData && ulAssociatedDataLen != 0) ||
+        (!pPlaintext && ulPlaintextLen != 0) || !pulCiphertextLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->msg_encr_ctx.active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
         goto done;
     }
 
-    if (!pDigest)
+    if (!pCiphertext)
         length_only = TRUE;
 
-    rc = digest_mgr_digest(tokdata, sess, length_only, &sess->digest_ctx,
-                           pData, ulDataLen, pDigest, pulDigestLen);
+    stat_mech = sess->msg_encr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = encr_mgr_encrypt_msg(tokdata, sess, length_only, &sess->msg_encr_ctx,
+                              pParameter, ulParameterLen,
+                              pAssociatedData, ulAssociatedDataLen,
+                              pPlaintext, ulPlaintextLen, pCiphertext, pulCiphertextLen);
     if (rc != CKR_OK)
-        TRACE_DEVEL("digest_mgr_digest() failed.\n");
+        TRACE_DEVEL("encr_mgr_encrypt_msg() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_SINGLE, ulPlaintextLen,
+                    &stat_start);
 
 done:
-    TRACE_INFO("C_Digest: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
-               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
+    /* The operation stays active for further messages */
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_ENCRYPT, rc);
+
+    TRACE_INFO("C_EncryptMessage: rc = 0x%08lx, sess = %ld, amount = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulPlaintextLen);
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -2782,10 +3013,14 @@ done:
 }
 
 
-CK_RV SC_DigestUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                      CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+CK_RV SC_EncryptMessageBegin(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession,
+                             CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                             CK_BYTE_PTR pAssociatedData,
+                             CK_ULONG ulAssociatedDataLen)
 {
     SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2801,23 +3036,35 @@ CK_RV SC_DigestUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (sess->digest_ctx.active == FALSE) {
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pParameter || (!pAssociatedData && ulAssociatedDataLen != 0)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->msg_encr_ctx.active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
         goto done;
     }
 
-    /* If there is data to hash, do so. */
-    if (ulPartLen) {
-        rc = digest_mgr_digest_update(tokdata, sess, &sess->digest_ctx,
-                                      pPart, ulPartLen);
-        if (rc != CKR_OK)
-            TRACE_DEVEL("digest_mgr_digest_update() failed.\n");
-    }
+    rc = encr_mgr_encrypt_msg_begin(tokdata, sess, &sess->msg_encr_ctx,
+                                    pParameter, ulParameterLen,
+                                    pAssociatedData, ulAssociatedDataLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("encr_mgr_encrypt_msg_begin() failed.\n");
 
 done:
-    TRACE_INFO("C_DigestUpdate: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
-               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulPartLen);
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_ENCRYPT, rc);
+
+    TRACE_INFO("C_EncryptMessageBegin: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -2826,10 +3073,18 @@ done:
 }
 
 
-CK_RV SC_DigestKey(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                   CK_OBJECT_HANDLE hKey)
+CK_RV SC_EncryptMessageNext(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                            CK_BYTE_PTR pPlaintextPart, CK_ULONG ulPlaintextPartLen,
+                            CK_BYTE_PTR pCiphertextPart,
+                            CK_ULONG_PTR pulCiphertextPartLen, CK_FLAGS flags)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2845,19 +3100,48 @@ CK_RV SC_DigestKey(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (sess->digest_ctx.active == FALSE) {
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pParameter || (!pPlaintextPart && ulPlaintextPartLen != 0) ||
+        !pulCiphertextPartLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->msg_encr_ctx.active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
         goto done;
     }
 
-    rc = digest_mgr_digest_key(tokdata, sess, &sess->digest_ctx, hKey);
+    if (!pCiphertextPart)
+        length_only = TRUE;
+
+    stat_mech = sess->msg_encr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = encr_mgr_encrypt_msg_next(tokdata, sess, length_only,
+                                   &sess->msg_encr_ctx,
+                                   pParameter, ulParameterLen,
+                                   pPlaintextPart, ulPlaintextPartLen,
+                                   pCiphertextPart, pulCiphertextPartLen, flags);
     if (rc != CKR_OK)
-        TRACE_DEVEL("digest_mgr_digest_key() failed.\n");
+        TRACE_DEVEL("encr_mgr_encrypt_msg_next() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_UPDATE, ulPlaintextPartLen,
+                    &stat_start);
 
 done:
-    TRACE_INFO("C_DigestKey: rc = 0x%08lx, sess = %ld, key = %lu\n",
-               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, hKey);
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_ENCRYPT, rc);
+
+    TRACE_INFO("C_EncryptMessageNext: rc = 0x%08lx, sess = %ld, amount = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               ulPlaintextPartLen);
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -2866,11 +3150,11 @@ done:
 }
 
 
-CK_RV SC_DigestFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                     CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen)
+CK_RV SC_MessageEncryptFinal(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession)
 {
     SESSION *sess = NULL;
-    CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2886,22 +3170,24 @@ CK_RV SC_DigestFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (sess->digest_ctx.active == FALSE) {
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (sess->msg_encr_ctx.active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
         goto done;
     }
 
-    if (!pDigest)
-        length_only = TRUE;
-
-    rc = digest_mgr_digest_final(tokdata, sess, length_only,
-                                 &sess->digest_ctx, pDigest, pulDigestLen);
-    if (rc != CKR_OK)
-        TRACE_ERROR("digest_mgr_digest_final() failed.\n");
+    rc = encr_mgr_cleanup(tokdata, sess, &sess->msg_encr_ctx);
 
 done:
-    TRACE_INFO("C_DigestFinal: rc = 0x%08lx, sess = %ld\n",
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_ENCRYPT, rc);
+
+    TRACE_INFO("C_MessageEncryptFinal: rc = 0x%08lx, sess = %ld\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
 
     if (sess != NULL)
@@ -2911,10 +3197,13 @@ done:
 }
 
 
-CK_RV SC_SignInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                  CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+CK_RV SC_MessageDecryptInit(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2939,30 +3228,41 @@ CK_RV SC_SignInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
 
     if (pMechanism == NULL) {
         /* As per PKCS#11 v3.0 Init with NULL pMechanism cancels operation */
-        rc = session_mgr_cancel(tokdata, sess, CKF_SIGN);
+        rc = session_mgr_cancel(tokdata, sess, CKF_MESSAGE_DECRYPT);
         goto done;
     }
 
-    rc = valid_mech(tokdata, pMechanism, CKF_SIGN);
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_DECRYPT);
     if (rc != CKR_OK)
         goto done;
+    busy = TRUE;
 
-    if (sess->sign_ctx.active == TRUE) {
-        rc = CKR_OPERATION_ACTIVE;
+    rc = valid_mech(tokdata, pMechanism, CKF_MESSAGE_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (sess->msg_decr_ctx.active == TRUE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        rc = CKR_OPERATION_ACTIVE;
         goto done;
     }
 
-    sess->sign_ctx.count_statistics = TRUE;
-    rc = sign_mgr_init(tokdata, sess, &sess->sign_ctx, pMechanism, FALSE, hKey,
-                       TRUE, TRUE);
-    if (rc != CKR_OK)
-        TRACE_DEVEL("sign_mgr_init() failed.\n");
+    sess->msg_decr_ctx.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
+    rc = decr_mgr_msg_init(tokdata, sess, &sess->msg_decr_ctx, pMechanism, hKey,
+                           TRUE);
+
+    if (rc == CKR_OK)
+        STAT_RECORD(tokdata, sess, pMechanism->mechanism, STAT_OP_INIT, 0,
+                    &stat_start);
 
 done:
-    TRACE_INFO("C_SignInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_DECRYPT, rc);
+
+    TRACE_INFO("C_MessageDecryptInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
-               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)(-1)));
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -2971,12 +3271,18 @@ done:
 }
 
 
-CK_RV SC_Sign(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-              CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature,
-              CK_ULONG_PTR pulSignatureLen)
+CK_RV SC_DecryptMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                        CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                        CK_BYTE_PTR pAssociatedData,
+                        CK_ULONG ulAssociatedDataLen,
+                        CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen,
+                        CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -2992,34 +3298,49 @@ CK_RV SC_Sign(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (!pData || !pulSignatureLen) {
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pParameter || (!pAssociatedData && ulAssociatedDataLen != 0) ||
+        (!pCiphertext && ulCiphertextLen != 0) || !pulPlaintextLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
         goto done;
     }
 
-    if (sess->sign_ctx.active == FALSE) {
+    if (sess->msg_decr_ctx.active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
         goto done;
     }
 
-    if (!pSignature)
+    if (!pPlaintext)
         length_only = TRUE;
 
-    rc = sign_mgr_sign(tokdata, sess, length_only, &sess->sign_ctx, pData,
-                       ulDataLen, pSignature, pulSignatureLen);
+    stat_mech = sess->msg_decr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = decr_mgr_decrypt_msg(tokdata, sess, length_only, &sess->msg_decr_ctx,
+                              pParameter, ulParameterLen,
+                              pAssociatedData, ulAssociatedDataLen,
+                              pCiphertext, ulCiphertextLen,
+                              pPlaintext, pulPlaintextLen);
     if (rc != CKR_OK)
-        TRACE_DEVEL("sign_mgr_sign() failed.\n");
+        TRACE_DEVEL("decr_mgr_decrypt_msg() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_SINGLE, ulCiphertextLen,
+                    &stat_start);
 
 done:
-    if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
-        if (sess != NULL)
-            sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
-    }
+    /* The operation stays active for further messages */
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_DECRYPT, rc);
 
-    TRACE_INFO("C_Sign: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
-               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
+    TRACE_INFO("C_DecryptMessage: rc = 0x%08lx, sess = %ld, amount = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               ulCiphertextLen);
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -3028,10 +3349,14 @@ done:
 }
 
 
-CK_RV SC_SignUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                    CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+CK_RV SC_DecryptMessageBegin(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession,
+                             CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                             CK_BYTE_PTR pAssociatedData,
+                             CK_ULONG ulAssociatedDataLen)
 {
     SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3047,28 +3372,35 @@ CK_RV SC_SignUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (!pPart && ulPartLen != 0) {
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pParameter || (!pAssociatedData && ulAssociatedDataLen != 0)) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
         goto done;
     }
 
-    if (sess->sign_ctx.active == FALSE) {
+    if (sess->msg_decr_ctx.active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
         goto done;
     }
 
-    rc = sign_mgr_sign_update(tokdata, sess, &sess->sign_ctx, pPart, ulPartLen);
+    rc = decr_mgr_decrypt_msg_begin(tokdata, sess, &sess->msg_decr_ctx,
+                                    pParameter, ulParameterLen,
+                                    pAssociatedData, ulAssociatedDataLen);
     if (rc != CKR_OK)
-        TRACE_DEVEL("sign_mgr_sign_update() failed.\n");
+        TRACE_DEVEL("decr_mgr_decrypt_msg_begin() failed.\n");
 
 done:
-    if (rc != CKR_OK && sess != NULL)
-        sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_DECRYPT, rc);
 
-    TRACE_INFO("C_SignUpdate: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
-               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulPartLen);
+    TRACE_INFO("C_DecryptMessageBegin: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -3077,11 +3409,19 @@ done:
 }
 
 
-CK_RV SC_SignFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
-                   CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+CK_RV SC_DecryptMessageNext(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                            CK_BYTE_PTR pCiphertextPart,
+                            CK_ULONG ulCiphertextPartLen,
+                            CK_BYTE_PTR pPlaintextPart,
+                            CK_ULONG_PTR pulPlaintextPartLen, CK_FLAGS flags)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3097,34 +3437,48 @@ CK_RV SC_SignFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (!pulSignatureLen) {
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pParameter || (!pCiphertextPart && ulCiphertextPartLen != 0) ||
+        !pulPlaintextPartLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
         goto done;
     }
 
-    if (sess->sign_ctx.active == FALSE) {
+    if (sess->msg_decr_ctx.active == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         rc = CKR_OPERATION_NOT_INITIALIZED;
         goto done;
     }
 
-    if (!pSignature)
+    if (!pPlaintextPart)
         length_only = TRUE;
 
-    rc = sign_mgr_sign_final(tokdata, sess, length_only, &sess->sign_ctx,
-                             pSignature, pulSignatureLen);
+    stat_mech = sess->msg_decr_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = decr_mgr_decrypt_msg_next(tokdata, sess, length_only,
+                                   &sess->msg_decr_ctx,
+                                   pParameter, ulParameterLen,
+                                   pCiphertextPart, ulCiphertextPartLen,
+                                   pPlaintextPart, pulPlaintextPartLen, flags);
     if (rc != CKR_OK)
-        TRACE_ERROR("sign_mgr_sign_final() failed.\n");
+        TRACE_DEVEL("decr_mgr_decrypt_msg_next() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_UPDATE,
+                    ulCiphertextPartLen, &stat_start);
 
 done:
-    if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
-        if (sess != NULL)
-            sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
-    }
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_DECRYPT, rc);
 
-    TRACE_INFO("C_SignFinal: rc = 0x%08lx, sess = %ld\n",
-               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+    TRACE_INFO("C_DecryptMessageNext: rc = 0x%08lx, sess = %ld, amount = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               ulCiphertextPartLen);
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -3133,11 +3487,11 @@ done:
 }
 
 
-CK_RV SC_SignRecoverInit(STDLL_TokData_t *tokdata,
-                         ST_SESSION_HANDLE *sSession,
-                         CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+CK_RV SC_MessageDecryptFinal(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession)
 {
     SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3153,26 +3507,717 @@ CK_RV SC_SignRecoverInit(STDLL_TokData_t *tokdata,
         goto done;
     }
 
-    if (pin_expired(&sess->session_info,
-                    tokdata->nv_token_data->token_info.flags) == TRUE) {
-        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
-        rc = CKR_PIN_EXPIRED;
-        goto done;
-    }
-
-    if (pMechanism == NULL) {
-        /* As per PKCS#11 v3.0 Init with NULL pMechanism cancels operation */
-        rc = session_mgr_cancel(tokdata, sess, CKF_SIGN_RECOVER);
-        goto done;
-    }
-
-    rc = valid_mech(tokdata, pMechanism, CKF_SIGN_RECOVER);
+    rc = session_mgr_op_begin(sess, CKF_MESSAGE_DECRYPT);
     if (rc != CKR_OK)
         goto done;
+    busy = TRUE;
 
-    if (sess->sign_ctx.active == TRUE) {
-        rc = CKR_OPERATION_ACTIVE;
-        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+    if (sess->msg_decr_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    rc = decr_mgr_cleanup(tokdata, sess, &sess->msg_decr_ctx);
+
+done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_MESSAGE_DECRYPT, rc);
+
+    TRACE_INFO("C_MessageDecryptFinal: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_DigestInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                    CK_MECHANISM_PTR pMechanism)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    if (pMechanism == NULL) {
+        /* As per PKCS#11 v3.0 Init with NULL pMechanism cancels operation */
+        rc = session_mgr_cancel(tokdata, sess, CKF_DIGEST);
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_DIGEST);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    rc = valid_mech(tokdata, pMechanism, CKF_DIGEST);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (sess->digest_ctx.active == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        rc = CKR_OPERATION_ACTIVE;
+        goto done;
+    }
+
+    sess->digest_ctx.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
+    rc = digest_mgr_init(tokdata, sess, &sess->digest_ctx, pMechanism, TRUE);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("digest_mgr_init() failed.\n");
+
+    if (rc == CKR_OK)
+        STAT_RECORD(tokdata, sess, pMechanism->mechanism, STAT_OP_INIT, 0,
+                    &stat_start);
+
+done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DIGEST, rc);
+
+    TRACE_INFO("C_DigestInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_Digest(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pDigest,
+                CK_ULONG_PTR pulDigestLen)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_DIGEST);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (sess->digest_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pDigest)
+        length_only = TRUE;
+
+    stat_mech = sess->digest_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = digest_mgr_digest(tokdata, sess, length_only, &sess->digest_ctx,
+                           pData, ulDataLen, pDigest, pulDigestLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("digest_mgr_digest() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_SINGLE, ulDataLen,
+                    &stat_start);
+
+done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DIGEST, rc);
+
+    TRACE_INFO("C_Digest: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+/*
+ * Performs a digest, sign or verify update. The caller has marked the
+ * operation busy. Parts larger than SESSION_CANCEL_CHUNK_SIZE are passed on
+ * in chunks, and the operation can be canceled by C_SessionCancel from
+ * another thread between two chunks. A canceled operation is cleaned up by
+ * session_mgr_op_end().
+ */
+static CK_RV update_cancelable(STDLL_TokData_t *tokdata, SESSION *sess,
+                               CK_FLAGS op, CK_BYTE *data, CK_ULONG data_len)
+{
+    CK_BBOOL chunked = data_len > SESSION_CANCEL_CHUNK_SIZE;
+    CK_ULONG len;
+    CK_RV rc;
+
+    do {
+        if (chunked && session_mgr_op_canceled()) {
+            TRACE_DEVEL("Operation canceled by C_SessionCancel.\n");
+            rc = CKR_FUNCTION_CANCELED;
+            break;
+        }
+
+        len = MIN(data_len, SESSION_CANCEL_CHUNK_SIZE);
+        switch (op) {
+        case CKF_DIGEST:
+            rc = digest_mgr_digest_update(tokdata, sess, &sess->digest_ctx,
+                                          data, len);
+            break;
+        case CKF_SIGN:
+            rc = sign_mgr_sign_update(tokdata, sess, &sess->sign_ctx,
+                                      data, len);
+            break;
+        default:
+            rc = verify_mgr_verify_update(tokdata, sess, &sess->verify_ctx,
+                                          data, len);
+            break;
+        }
+
+        data += len;
+        data_len -= len;
+    } while (rc == CKR_OK && data_len > 0);
+
+    return rc;
+}
+
+CK_RV SC_DigestUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                      CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_DIGEST);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (sess->digest_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    stat_mech = sess->digest_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    /* If there is data to hash, do so. */
+    if (ulPartLen) {
+        rc = update_cancelable(tokdata, sess, CKF_DIGEST, pPart, ulPartLen);
+        if (rc != CKR_OK)
+            TRACE_DEVEL("digest_mgr_digest_update() failed.\n");
+    }
+
+    STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_UPDATE, ulPartLen,
+                &stat_start);
+
+done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DIGEST, rc);
+
+    TRACE_INFO("C_DigestUpdate: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulPartLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_DigestKey(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                   CK_OBJECT_HANDLE hKey)
+{
+    SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_DIGEST);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (sess->digest_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    rc = digest_mgr_digest_key(tokdata, sess, &sess->digest_ctx, hKey);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("digest_mgr_digest_key() failed.\n");
+
+done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DIGEST, rc);
+
+    TRACE_INFO("C_DigestKey: rc = 0x%08lx, sess = %ld, key = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, hKey);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_DigestFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                     CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_DIGEST);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (sess->digest_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pDigest)
+        length_only = TRUE;
+
+    stat_mech = sess->digest_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = digest_mgr_digest_final(tokdata, sess, length_only,
+                                 &sess->digest_ctx, pDigest, pulDigestLen);
+    if (rc != CKR_OK)
+        TRACE_ERROR("digest_mgr_digest_final() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_FINAL, 0,
+                    &stat_start);
+
+done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_DIGEST, rc);
+
+    TRACE_INFO("C_DigestFinal: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_SignInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                  CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    if (pMechanism == NULL) {
+        /* As per PKCS#11 v3.0 Init with NULL pMechanism cancels operation */
+        rc = session_mgr_cancel(tokdata, sess, CKF_SIGN);
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_SIGN);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    rc = valid_mech(tokdata, pMechanism, CKF_SIGN);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (sess->sign_ctx.active == TRUE) {
+        rc = CKR_OPERATION_ACTIVE;
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        goto done;
+    }
+
+    sess->sign_ctx.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
+    rc = sign_mgr_init(tokdata, sess, &sess->sign_ctx, pMechanism, FALSE, hKey,
+                       TRUE, TRUE);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("sign_mgr_init() failed.\n");
+
+    if (rc == CKR_OK)
+        STAT_RECORD(tokdata, sess, pMechanism->mechanism, STAT_OP_INIT, 0,
+                    &stat_start);
+
+done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_SIGN, rc);
+
+    TRACE_INFO("C_SignInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_Sign(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+              CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature,
+              CK_ULONG_PTR pulSignatureLen)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_SIGN);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pData || !pulSignatureLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->sign_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pSignature)
+        length_only = TRUE;
+
+    stat_mech = sess->sign_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = sign_mgr_sign(tokdata, sess, length_only, &sess->sign_ctx, pData,
+                       ulDataLen, pSignature, pulSignatureLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("sign_mgr_sign() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_SINGLE, ulDataLen,
+                    &stat_start);
+
+done:
+    if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
+        if (busy)
+            sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
+    }
+
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_SIGN, rc);
+
+    TRACE_INFO("C_Sign: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_SignUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                    CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_SIGN);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pPart && ulPartLen != 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->sign_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    stat_mech = sess->sign_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = update_cancelable(tokdata, sess, CKF_SIGN, pPart, ulPartLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("sign_mgr_sign_update() failed.\n");
+
+    STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_UPDATE, ulPartLen,
+                &stat_start);
+
+done:
+    if (rc != CKR_OK && busy)
+        sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
+
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_SIGN, rc);
+
+    TRACE_INFO("C_SignUpdate: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulPartLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_SignFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                   CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+    SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_SIGN);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    if (!pulSignatureLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->sign_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pSignature)
+        length_only = TRUE;
+
+    stat_mech = sess->sign_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = sign_mgr_sign_final(tokdata, sess, length_only, &sess->sign_ctx,
+                             pSignature, pulSignatureLen);
+    if (rc != CKR_OK)
+        TRACE_ERROR("sign_mgr_sign_final() failed.\n");
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_FINAL, 0,
+                    &stat_start);
+
+done:
+    if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
+        if (busy)
+            sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
+    }
+
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_SIGN, rc);
+
+    TRACE_INFO("C_SignFinal: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+
+CK_RV SC_SignRecoverInit(STDLL_TokData_t *tokdata,
+                         ST_SESSION_HANDLE *sSession,
+                         CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    if (pMechanism == NULL) {
+        /* As per PKCS#11 v3.0 Init with NULL pMechanism cancels operation */
+        rc = session_mgr_cancel(tokdata, sess, CKF_SIGN_RECOVER);
+        goto done;
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_SIGN_RECOVER);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
+    rc = valid_mech(tokdata, pMechanism, CKF_SIGN_RECOVER);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (sess->sign_ctx.active == TRUE) {
+        rc = CKR_OPERATION_ACTIVE;
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
         goto done;
     }
 
@@ -3182,6 +4227,9 @@ CK_RV SC_SignRecoverInit(STDLL_TokData_t *tokdata,
         TRACE_DEVEL("sign_mgr_init() failed.\n");
 
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_SIGN_RECOVER, rc);
+
     TRACE_INFO("C_SignRecoverInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
@@ -3199,6 +4247,7 @@ CK_RV SC_SignRecover(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
 {
     SESSION *sess = NULL;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3214,6 +4263,11 @@ CK_RV SC_SignRecover(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_SIGN_RECOVER);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pData || !pulSignatureLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -3236,10 +4290,13 @@ CK_RV SC_SignRecover(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
 
 done:
     if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
-        if (sess != NULL)
+        if (busy)
             sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_SIGN_RECOVER, rc);
+
     TRACE_INFO("C_SignRecover: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
 
@@ -3254,6 +4311,8 @@ CK_RV SC_VerifyInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                     CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3282,6 +4341,11 @@ CK_RV SC_VerifyInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_VERIFY);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     rc = valid_mech(tokdata, pMechanism, CKF_VERIFY);
     if (rc != CKR_OK)
         goto done;
@@ -3293,12 +4357,20 @@ CK_RV SC_VerifyInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
     }
 
     sess->verify_ctx.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
     rc = verify_mgr_init(tokdata, sess, &sess->verify_ctx, pMechanism,
                          FALSE, hKey, TRUE);
     if (rc != CKR_OK)
         TRACE_DEVEL("verify_mgr_init() failed.\n");
 
+    if (rc == CKR_OK)
+        STAT_RECORD(tokdata, sess, pMechanism->mechanism, STAT_OP_INIT, 0,
+                    &stat_start);
+
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_VERIFY, rc);
+
     TRACE_INFO("C_VerifyInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
@@ -3315,6 +4387,9 @@ CK_RV SC_Verify(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                 CK_ULONG ulSignatureLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3330,6 +4405,11 @@ CK_RV SC_Verify(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_VERIFY);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pData || !pSignature) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -3342,15 +4422,23 @@ CK_RV SC_Verify(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    stat_mech = sess->verify_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = verify_mgr_verify(tokdata, sess, &sess->verify_ctx, pData,
                            ulDataLen, pSignature, ulSignatureLen);
     if (rc != CKR_OK)
         TRACE_DEVEL("verify_mgr_verify() failed.\n");
 
+    STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_SINGLE, ulDataLen,
+                &stat_start);
+
 done:
-    if (sess != NULL)
+    if (busy)
         verify_mgr_cleanup(tokdata, sess, &sess->verify_ctx);
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_VERIFY, rc);
+
     TRACE_INFO("C_Verify: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
 
@@ -3365,6 +4453,9 @@ CK_RV SC_VerifyUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                       CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3378,7 +4469,12 @@ CK_RV SC_VerifyUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
-    }
+    }
+
+    rc = session_mgr_op_begin(sess, CKF_VERIFY);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
 
     if (!pPart && ulPartLen != 0) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
@@ -3392,15 +4488,22 @@ CK_RV SC_VerifyUpdate(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    rc = verify_mgr_verify_update(tokdata, sess, &sess->verify_ctx, pPart,
-                                  ulPartLen);
+    stat_mech = sess->verify_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
+    rc = update_cancelable(tokdata, sess, CKF_VERIFY, pPart, ulPartLen);
     if (rc != CKR_OK)
         TRACE_DEVEL("verify_mgr_verify_update() failed.\n");
 
+    STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_UPDATE, ulPartLen,
+                &stat_start);
+
 done:
-    if (rc != CKR_OK && sess != NULL)
+    if (rc != CKR_OK && busy)
         verify_mgr_cleanup(tokdata, sess, &sess->verify_ctx);
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_VERIFY, rc);
+
     TRACE_INFO("C_VerifyUpdate: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulPartLen);
 
@@ -3415,6 +4518,9 @@ CK_RV SC_VerifyFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                      CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
 {
     SESSION *sess = NULL;
+    struct timespec stat_start = { 0, 0 };
+    CK_MECHANISM_TYPE stat_mech = 0;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3430,6 +4536,11 @@ CK_RV SC_VerifyFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_VERIFY);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pSignature) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -3442,15 +4553,23 @@ CK_RV SC_VerifyFinal(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    stat_mech = sess->verify_ctx.mech.mechanism;
+    STAT_START(tokdata, &stat_start);
     rc = verify_mgr_verify_final(tokdata, sess, &sess->verify_ctx,
                                  pSignature, ulSignatureLen);
     if (rc != CKR_OK)
         TRACE_DEVEL("verify_mgr_verify_final() failed.\n");
 
+    STAT_RECORD(tokdata, sess, stat_mech, STAT_OP_FINAL, 0,
+                &stat_start);
+
 done:
-    if (sess != NULL)
+    if (busy)
         verify_mgr_cleanup(tokdata, sess, &sess->verify_ctx);
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_VERIFY, rc);
+
     TRACE_INFO("C_VerifyFinal: rc = 0x%08lx, sess = %ld\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
 
@@ -3466,6 +4585,7 @@ CK_RV SC_VerifyRecoverInit(STDLL_TokData_t *tokdata,
                            CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     SESSION *sess = NULL;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3494,6 +4614,11 @@ CK_RV SC_VerifyRecoverInit(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_VERIFY_RECOVER);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     rc = valid_mech(tokdata, pMechanism, CKF_VERIFY_RECOVER);
     if (rc != CKR_OK)
         goto done;
@@ -3510,6 +4635,9 @@ CK_RV SC_VerifyRecoverInit(STDLL_TokData_t *tokdata,
         TRACE_DEVEL("verify_mgr_init() failed.\n");
 
 done:
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_VERIFY_RECOVER, rc);
+
     TRACE_INFO("C_VerifyRecoverInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
                (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1));
@@ -3527,6 +4655,7 @@ CK_RV SC_VerifyRecover(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
 {
     SESSION *sess = NULL;
     CK_BBOOL length_only = FALSE;
+    CK_BBOOL busy = FALSE;
     CK_RV rc = CKR_OK;
 
     if (tokdata->initialized == FALSE) {
@@ -3542,6 +4671,11 @@ CK_RV SC_VerifyRecover(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
+    rc = session_mgr_op_begin(sess, CKF_VERIFY_RECOVER);
+    if (rc != CKR_OK)
+        goto done;
+    busy = TRUE;
+
     if (!pSignature || !pulDataLen) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
@@ -3566,10 +4700,13 @@ CK_RV SC_VerifyRecover(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
 
 done:
     if (rc != CKR_BUFFER_TOO_SMALL && (rc != CKR_OK || length_only != TRUE)) {
-        if (sess != NULL)
+        if (busy)
             verify_mgr_cleanup(tokdata, sess, &sess->verify_ctx);
     }
 
+    if (busy)
+        rc = session_mgr_op_end(tokdata, sess, CKF_VERIFY_RECOVER, rc);
+
     TRACE_INFO("C_VerifyRecover: rc = 0x%08lx, sess = %ld, recover len = %lu, "
                "length_only = %d\n", rc,
                (sess == NULL) ? -1 : (CK_LONG) sess->handle,
@@ -3790,12 +4927,21 @@ CK_RV SC_GenerateKeyPair(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    /*
+     * The token's key generation checks session_mgr_op_canceled() where it
+     * can abort. A cancel request that arrives after the keys have been
+     * generated has no effect.
+     */
+    rc = session_mgr_op_begin(sess, CKF_GENERATE_KEY_PAIR);
+    if (rc != CKR_OK)
+        goto done;
     rc = key_mgr_generate_key_pair(tokdata, sess, pMechanism,
                                    pPublicKeyTemplate,
                                    ulPublicKeyAttributeCount,
                                    pPrivateKeyTemplate,
                                    ulPrivateKeyAttributeCount,
                                    phPublicKey, phPrivateKey, TRUE);
+    rc = session_mgr_op_end(tokdata, sess, CKF_GENERATE_KEY_PAIR, rc);
     if (rc != CKR_OK)
         TRACE_DEVEL("key_mgr_generate_key_pair() failed.\n");
 
@@ -4239,6 +5385,452 @@ done:
     return rc;
 }
 
+/*
+ * C_IBM_SignBatch and C_IBM_VerifyBatch sign or verify a number of items
+ * with the same key and mechanism. The mechanism, the key, the policy and the
+ * login state are checked once for the whole batch by initializing a template
+ * operation context. Mechanisms that keep no state in the operation context
+ * (e.g. CKM_RSA_PKCS, CKM_ECDSA or CKM_IBM_ED25519) use a copy of the template
+ * context for each item, all others initialize a new context per item, but
+ * without checking the policy again.
+ *
+ * Batches with at least BATCH_MIN_ITEMS items are processed by a number of
+ * threads (including the calling thread) that defaults to the number of
+ * online CPUs, but at most BATCH_MAX_THREADS, and can be set with the
+ * environment variable OPENCRYPTOKI_BATCH_THREADS.
+ */
+#define BATCH_MIN_ITEMS         64
+#define BATCH_MAX_THREADS       16
+
+struct batch_op {
+    STDLL_TokData_t *tokdata;
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX *libctx;
+#endif
+    SESSION *sess;
+    CK_MECHANISM *mech;
+    CK_OBJECT_HANDLE key;
+    CK_BBOOL verify;
+    CK_BBOOL stateless;
+    SIGN_VERIFY_CONTEXT tmpl;
+    CK_IBM_BATCH_ITEM *items;
+    CK_ULONG count;
+    CK_ULONG next;
+};
+
+static unsigned int batch_threads(CK_ULONG count)
+{
+    const char *env;
+    char *end;
+    unsigned long num = 0;
+    long cpus;
+
+    if (count < BATCH_MIN_ITEMS)
+        return 1;
+
+    env = getenv("OPENCRYPTOKI_BATCH_THREADS");
+    if (env != NULL) {
+        num = strtoul(env, &end, 10);
+        if (*env == '\0' || *end != '\0' || num == 0) {
+            TRACE_WARNING("Ignoring invalid OPENCRYPTOKI_BATCH_THREADS "
+                          "value '%s'\n", env);
+            num = 0;
+        }
+    }
+
+    if (num == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num = cpus > 0 ? (unsigned long)cpus : 1;
+    }
+
+    return num > BATCH_MAX_THREADS ? BATCH_MAX_THREADS : num;
+}
+
+static void batch_item_run(struct batch_op *op, CK_IBM_BATCH_ITEM *item)
+{
+    STDLL_TokData_t *tokdata = op->tokdata;
+    SIGN_VERIFY_CONTEXT ctx;
+    struct timespec stat_start = { 0, 0 };
+    CK_BBOOL length_only = FALSE;
+    CK_RV rc;
+
+    if (!item->pData || (op->verify && !item->pSignature)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        item->rv = CKR_ARGUMENTS_BAD;
+        return;
+    }
+
+    if (!op->verify && !item->pSignature)
+        length_only = TRUE;
+
+    if (op->stateless) {
+        ctx = op->tmpl;
+    } else {
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.count_statistics = TRUE;
+        if (op->verify)
+            rc = verify_mgr_init(tokdata, op->sess, &ctx, op->mech, FALSE,
+                                 op->key, FALSE);
+        else
+            rc = sign_mgr_init(tokdata, op->sess, &ctx, op->mech, FALSE,
+                               op->key, FALSE, FALSE);
+        if (rc != CKR_OK) {
+            TRACE_DEVEL("%s_mgr_init() failed.\n",
+                        op->verify ? "verify" : "sign");
+            item->rv = rc;
+            return;
+        }
+    }
+
+    STAT_START(tokdata, &stat_start);
+    if (op->verify) {
+        rc = verify_mgr_verify(tokdata, op->sess, &ctx, item->pData,
+                               item->ulDataLen, item->pSignature,
+                               item->ulSignatureLen);
+        if (rc != CKR_OK)
+            TRACE_DEVEL("verify_mgr_verify() failed.\n");
+    } else {
+        rc = sign_mgr_sign(tokdata, op->sess, length_only, &ctx, item->pData,
+                           item->ulDataLen, item->pSignature,
+                           &item->ulSignatureLen);
+        if (rc != CKR_OK)
+            TRACE_DEVEL("sign_mgr_sign() failed.\n");
+    }
+
+    if (length_only == FALSE)
+        STAT_RECORD(tokdata, op->sess, op->mech->mechanism, STAT_OP_SINGLE,
+                    item->ulDataLen, &stat_start);
+
+    if (!op->stateless) {
+        if (op->verify)
+            verify_mgr_cleanup(tokdata, op->sess, &ctx);
+        else
+            sign_mgr_cleanup(tokdata, op->sess, &ctx);
+    }
+
+    item->rv = rc;
+}
+
+static void batch_work(struct batch_op *op)
+{
+    CK_ULONG i;
+
+    while ((i = __sync_fetch_and_add(&op->next, 1)) < op->count)
+        batch_item_run(op, &op->items[i]);
+}
+
+static void *batch_thread(void *arg)
+{
+    struct batch_op *op = arg;
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    /* Use the same library context as the calling thread */
+    OSSL_LIB_CTX_set0_default(op->libctx);
+#endif
+
+    batch_work(op);
+
+    return NULL;
+}
+
+static CK_RV batch_run(STDLL_TokData_t *tokdata, SESSION *sess,
+                       CK_MECHANISM *mech, CK_OBJECT_HANDLE key,
+                       CK_BBOOL verify, CK_IBM_BATCH_ITEM *items,
+                       CK_ULONG count)
+{
+    struct batch_op op;
+    struct timespec stat_start = { 0, 0 };
+    pthread_t threads[BATCH_MAX_THREADS];
+    unsigned int i, num_threads, started = 0;
+    CK_RV rc;
+
+    memset(&op, 0, sizeof(op));
+    op.tokdata = tokdata;
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    /* Returns the current default library context without changing it */
+    op.libctx = OSSL_LIB_CTX_set0_default(NULL);
+#endif
+    op.sess = sess;
+    op.mech = mech;
+    op.key = key;
+    op.verify = verify;
+    op.items = items;
+    op.count = count;
+
+    op.tmpl.count_statistics = TRUE;
+    STAT_START(tokdata, &stat_start);
+    if (verify)
+        rc = verify_mgr_init(tokdata, sess, &op.tmpl, mech, FALSE, key, TRUE);
+    else
+        rc = sign_mgr_init(tokdata, sess, &op.tmpl, mech, FALSE, key, TRUE,
+                           TRUE);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("%s_mgr_init() failed.\n", verify ? "verify" : "sign");
+        return rc;
+    }
+
+    STAT_RECORD(tokdata, sess, mech->mechanism, STAT_OP_INIT, 0, &stat_start);
+
+    /* Keys with CKA_ALWAYS_AUTHENTICATE need a context specific login */
+    if (op.tmpl.auth_required == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_USER_NOT_LOGGED_IN));
+        rc = CKR_USER_NOT_LOGGED_IN;
+        goto done;
+    }
+
+    op.stateless = (op.tmpl.context == NULL);
+
+    /* The calling thread works on the items, too */
+    num_threads = batch_threads(count);
+    for (i = 1; i < num_threads; i++) {
+        if (pthread_create(&threads[started], NULL, batch_thread, &op) != 0) {
+            TRACE_WARNING("Failed to create a batch thread, processing the "
+                          "items with %u threads\n", i);
+            break;
+        }
+        started++;
+    }
+
+    TRACE_DEVEL("Processing %lu items with %u threads\n", count, started + 1);
+
+    batch_work(&op);
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+done:
+    if (verify)
+        verify_mgr_cleanup(tokdata, sess, &op.tmpl);
+    else
+        sign_mgr_cleanup(tokdata, sess, &op.tmpl);
+
+    return rc;
+}
+
+CK_RV SC_IBM_SignBatch(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
+                       CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey,
+                       CK_IBM_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism || (!pItems && ulCount > 0)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    rc = valid_mech(tokdata, pMechanism, CKF_SIGN);
+    if (rc != CKR_OK)
+        goto done;
+
+    rc = batch_run(tokdata, sess, pMechanism, hKey, FALSE, pItems, ulCount);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("batch_run() failed.\n");
+
+done:
+    TRACE_INFO("SC_IBM_SignBatch: rc = 0x%08lx, sess = %ld, mech = 0x%lx, "
+               "count = %lu\n", rc,
+               (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1), ulCount);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_IBM_VerifyBatch(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
+                         CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey,
+                         CK_IBM_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism || (!pItems && ulCount > 0)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    rc = valid_mech(tokdata, pMechanism, CKF_VERIFY);
+    if (rc != CKR_OK)
+        goto done;
+
+    rc = batch_run(tokdata, sess, pMechanism, hKey, TRUE, pItems, ulCount);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("batch_run() failed.\n");
+
+done:
+    TRACE_INFO("SC_IBM_VerifyBatch: rc = 0x%08lx, sess = %ld, mech = 0x%lx, "
+               "count = %lu\n", rc,
+               (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1), ulCount);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+/*
+ * C_IBM_DigestBatch digests a number of items with the same mechanism. It
+ * does not use a session and no digest context, the mechanism and the policy
+ * are checked once for the whole batch, and each item is digested with
+ * sha_hash_single().
+ */
+CK_RV SC_IBM_DigestBatch(STDLL_TokData_t *tokdata, CK_MECHANISM_PTR pMechanism,
+                         CK_IBM_DIGEST_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    struct timespec stat_start = { 0, 0 };
+    CK_ULONG i, hsize = 0;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism || (!pItems && ulCount > 0)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    rc = valid_mech(tokdata, pMechanism, CKF_DIGEST);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (get_sha_size(pMechanism->mechanism, &hsize) != CKR_OK) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        rc = CKR_MECHANISM_INVALID;
+        goto done;
+    }
+
+    if (pMechanism->ulParameterLen != 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        rc = CKR_MECHANISM_PARAM_INVALID;
+        goto done;
+    }
+
+    rc = tokdata->policy->is_mech_allowed(tokdata->policy, pMechanism, NULL,
+                                          POLICY_CHECK_DIGEST, NULL);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("POLICY VIOLATION: digest batch\n");
+        goto done;
+    }
+
+    for (i = 0; i < ulCount; i++) {
+        if (pItems[i].pDigest == NULL) {
+            pItems[i].ulDigestLen = hsize;
+            pItems[i].rv = CKR_OK;
+            continue;
+        }
+
+        if (!pItems[i].pData && pItems[i].ulDataLen > 0) {
+            pItems[i].rv = CKR_ARGUMENTS_BAD;
+            continue;
+        }
+
+        if (tokdata->statistics->increment_func != NULL)
+            tokdata->statistics->increment_func(tokdata->statistics,
+                                                tokdata->slot_id, pMechanism,
+                                                POLICY_STRENGTH_IDX_0);
+
+        STAT_START(tokdata, &stat_start);
+        pItems[i].rv = sha_hash_single(tokdata, pMechanism, pItems[i].pData,
+                                       pItems[i].ulDataLen, pItems[i].pDigest,
+                                       &pItems[i].ulDigestLen);
+        if (pItems[i].rv != CKR_OK)
+            TRACE_DEVEL("sha_hash_single() failed for item %lu.\n", i);
+        else if (tokdata->statistics->record_func != NULL)
+            tokdata->statistics->record_func(tokdata->statistics,
+                                             tokdata->slot_id,
+                                             pMechanism->mechanism,
+                                             STAT_OP_SINGLE,
+                                             pItems[i].ulDataLen, &stat_start);
+    }
+
+done:
+    TRACE_INFO("SC_IBM_DigestBatch: rc = 0x%08lx, mech = 0x%lx, count = %lu\n",
+               rc, (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1),
+               ulCount);
+
+    return rc;
+}
+
+CK_RV SC_IBM_GenerateRandom(STDLL_TokData_t *tokdata, CK_BYTE_PTR pRandomData,
+                            CK_ULONG ulRandomLen)
+{
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pRandomData && ulRandomLen != 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (ulRandomLen == 0)
+        goto done;
+
+    rc = rng_generate(tokdata, pRandomData, ulRandomLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("rng_generate() failed.\n");
+
+done:
+    TRACE_INFO("SC_IBM_GenerateRandom: rc = 0x%08lx, %lu bytes\n", rc,
+               ulRandomLen);
+
+    return rc;
+}
+
 CK_RV SC_HandleEvent(STDLL_TokData_t *tokdata, unsigned int event_type,
                      unsigned int event_flags, const char *payload,
                      unsigned int payload_len)
@@ -4290,6 +5882,16 @@ void SC_SetFunctionList(void)
     function_list.ST_Decrypt = SC_Decrypt;
     function_list.ST_DecryptUpdate = SC_DecryptUpdate;
     function_list.ST_DecryptFinal = SC_DecryptFinal;
+    function_list.ST_MessageEncryptInit = SC_MessageEncryptInit;
+    function_list.ST_EncryptMessage = SC_EncryptMessage;
+    function_list.ST_EncryptMessageBegin = SC_EncryptMessageBegin;
+    function_list.ST_EncryptMessageNext = SC_EncryptMessageNext;
+    function_list.ST_MessageEncryptFinal = SC_MessageEncryptFinal;
+    function_list.ST_MessageDecryptInit = SC_MessageDecryptInit;
+    function_list.ST_DecryptMessage = SC_DecryptMessage;
+    function_list.ST_DecryptMessageBegin = SC_DecryptMessageBegin;
+    function_list.ST_DecryptMessageNext = SC_DecryptMessageNext;
+    function_list.ST_MessageDecryptFinal = SC_MessageDecryptFinal;
     function_list.ST_DigestInit = SC_DigestInit;
     function_list.ST_Digest = SC_Digest;
     function_list.ST_DigestUpdate = SC_DigestUpdate;
@@ -4323,6 +5925,10 @@ void SC_SetFunctionList(void)
     function_list.ST_SessionCancel = SC_SessionCancel;
 
     function_list.ST_IBM_ReencryptSingle = SC_IBM_ReencryptSingle;
+    function_list.ST_IBM_SignBatch = SC_IBM_SignBatch;
+    function_list.ST_IBM_VerifyBatch = SC_IBM_VerifyBatch;
+    function_list.ST_IBM_DigestBatch = SC_IBM_DigestBatch;
+    function_list.ST_IBM_GenerateRandom = SC_IBM_GenerateRandom;
 
     function_list.ST_HandleEvent = SC_HandleEvent;
 }
@@ -18,6 +18,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
+#include <stdint.h>
+#include <limits.h>
 #include <errno.h>
 #include <unistd.h>
 
@@ -33,6 +35,127 @@
 #include "../api/apiproto.h"
 #include "../api/policy.h"
 
+/*
+ * The token object lists in the shared memory segment are protected by a
+ * sequence counter in addition to the XProcLock: a writer (which must hold the
+ * XProcLock) makes the counter odd before it modifies the lists, and even
+ * again afterwards. object_mgr_check_shm() uses this to compare an object's
+ * counters against its SHM entry without taking the XProcLock.
+ */
+static void object_mgr_shm_write_begin(LW_SHM_TYPE *global_shm)
+{
+    __atomic_add_fetch(&global_shm->tok_obj_seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void object_mgr_shm_write_end(LW_SHM_TYPE *global_shm)
+{
+    __atomic_add_fetch(&global_shm->tok_obj_seq, 1, __ATOMIC_RELEASE);
+}
+
+//
+// Token object table in shared memory
+//
+// The public and private token object lists are kept unordered: a new entry is
+// appended and a deleted one is replaced by the last entry of its list. Each
+// list has an open addressing hash index (linear probing) from the object name
+// to its list index, so that no list ever needs to be scanned. The caller must
+// hold the XProcLock for all of the functions below.
+//
+
+static TOK_OBJ_ENTRY *tok_obj_list(struct tok_obj_table *table, CK_BBOOL priv)
+{
+    return priv ? table->entries + table->capacity : table->entries;
+}
+
+static CK_ULONG_32 *tok_obj_hash(struct tok_obj_table *table, CK_BBOOL priv)
+{
+    CK_ULONG_32 *hash = (CK_ULONG_32 *)(table->entries + 2 * table->capacity);
+
+    return priv ? hash + table->hash_size : hash;
+}
+
+static CK_ULONG_32 *tok_obj_num(LW_SHM_TYPE *global_shm, CK_BBOOL priv)
+{
+    return priv ? &global_shm->num_priv_tok_obj : &global_shm->num_publ_tok_obj;
+}
+
+static CK_ULONG_32 tok_obj_hash_slot(const void *name, CK_ULONG_32 hash_size)
+{
+    uint64_t val;
+
+    memcpy(&val, name, sizeof(val));
+    return (CK_ULONG_32)((val * 0x9E3779B97F4A7C15ULL) >> 32) & (hash_size - 1);
+}
+
+/* Returns the hash slot holding name, or the free slot where it belongs */
+static CK_ULONG_32 tok_obj_hash_lookup(struct tok_obj_table *table,
+                                      CK_BBOOL priv, const void *name)
+{
+    TOK_OBJ_ENTRY *list = tok_obj_list(table, priv);
+    CK_ULONG_32 *hash = tok_obj_hash(table, priv);
+    CK_ULONG_32 mask = table->hash_size - 1;
+    CK_ULONG_32 i;
+
+    for (i = tok_obj_hash_slot(name, table->hash_size); hash[i] != 0;
+         i = (i + 1) & mask) {
+        if (memcmp(list[hash[i] - 1].name, name, 8) == 0)
+            break;
+    }
+
+    return i;
+}
+
+static void tok_obj_hash_remove(struct tok_obj_table *table, CK_BBOOL priv,
+                                CK_ULONG_32 i)
+{
+    TOK_OBJ_ENTRY *list = tok_obj_list(table, priv);
+    CK_ULONG_32 *hash = tok_obj_hash(table, priv);
+    CK_ULONG_32 mask = table->hash_size - 1;
+    CK_ULONG_32 j, k;
+
+    /* Move following entries of the probe sequence up into the gap */
+    for (j = (i + 1) & mask; hash[j] != 0; j = (j + 1) & mask) {
+        k = tok_obj_hash_slot(list[hash[j] - 1].name, table->hash_size);
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            hash[i] = hash[j];
+            i = j;
+        }
+    }
+    hash[i] = 0;
+}
+
+static void tok_obj_hash_rebuild(struct tok_obj_table *table, CK_BBOOL priv,
+                                 CK_ULONG_32 num)
+{
+    TOK_OBJ_ENTRY *list = tok_obj_list(table, priv);
+    CK_ULONG_32 *hash = tok_obj_hash(table, priv);
+    CK_ULONG_32 i;
+
+    memset(hash, 0, table->hash_size * sizeof(CK_ULONG_32));
+    for (i = 0; i < num; i++)
+        hash[tok_obj_hash_lookup(table, priv, list[i].name)] = i + 1;
+}
+
+/*
+ * Returns the current token object table of this process, after mapping a new
+ * one if another process has replaced it.
+ */
+static CK_RV object_mgr_get_tok_obj_table(STDLL_TokData_t *tokdata,
+                                          struct tok_obj_table **table)
+{
+    CK_RV rc;
+
+    rc = tok_obj_table_sync(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to map the token object table.\n");
+        return rc;
+    }
+
+    *table = tokdata->tok_obj_table;
+    return CKR_OK;
+}
+
 static CK_RV object_mgr_check_session(SESSION *sess, CK_BBOOL priv_obj,
                                       CK_BBOOL sess_obj)
 {
@@ -480,10 +603,9 @@ CK_RV object_mgr_create_final(STDLL_TokData_t *tokdata,
     CK_BBOOL sess_obj;
     CK_BBOOL priv_obj;
     CK_BBOOL locked = FALSE;
+    CK_BBOOL named = FALSE;
     CK_RV rc;
     unsigned long obj_handle;
-    char fname[PATH_MAX] = "";
-    int fd;
 
     if (!sess || !obj || !handle) {
         TRACE_ERROR("Invalid function arguments.\n");
@@ -523,40 +645,13 @@ CK_RV object_mgr_create_final(STDLL_TokData_t *tokdata,
         }
         locked = TRUE;
 
-        // Determine if we have already reached our Max Token Objects
-        //
-        if (priv_obj) {
-            if (tokdata->global_shm->num_priv_tok_obj >= MAX_TOK_OBJS) {
-                TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-                rc = CKR_HOST_MEMORY;
-                goto done;
-            }
-        } else {
-            if (tokdata->global_shm->num_publ_tok_obj >= MAX_TOK_OBJS) {
-                TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-                rc = CKR_HOST_MEMORY;
-                goto done;
-            }
-        }
-
-        /* create unique file name in token directory */
-        if (ock_snprintf(fname, sizeof(fname), "%s/" PK_LITE_OBJ_DIR "/%s",
-                         tokdata->data_store, "OBXXXXXX") != 0) {
-            TRACE_ERROR("buffer overflow for object path");
-            rc = CKR_FUNCTION_FAILED;
+        /* create unique object name */
+        rc = new_token_object_name(tokdata, obj->name);
+        if (rc != CKR_OK)
             goto done;
-        }
-
-        fd = mkstemp(fname);
-        if (fd < 0) {
-            TRACE_ERROR("mkstemp failed with: %s\n", strerror(errno));
-            rc = CKR_FUNCTION_FAILED;
-            goto done;
-        }
-        close(fd); /* written and permissions set by save_token_object */
+        named = TRUE;
 
         obj->session = NULL;
-        memcpy(&obj->name, &fname[strlen(fname) - 8], 8);
 
         rc = save_token_object(tokdata, obj);
         if (rc != CKR_OK)
@@ -564,7 +659,12 @@ CK_RV object_mgr_create_final(STDLL_TokData_t *tokdata,
 
         // add the object identifier to the shared memory segment
         //
-        object_mgr_add_to_shm(obj, tokdata->global_shm);
+        rc = object_mgr_add_to_shm(tokdata, obj);
+        if (rc != CKR_OK) {
+            TRACE_DEVEL("object_mgr_add_to_shm failed.\n");
+            delete_token_object(tokdata, obj);
+            goto done;
+        }
 
         // now, store the object in the token object btree
         //
@@ -609,7 +709,7 @@ CK_RV object_mgr_create_final(STDLL_TokData_t *tokdata,
                 bt_node_free(&tokdata->publ_token_obj_btree, obj_handle, FALSE);
             }
 
-            object_mgr_del_from_shm(obj, tokdata->global_shm);
+            object_mgr_del_from_shm(tokdata, obj);
         }
     }
 
@@ -628,8 +728,8 @@ done:
 
     if (rc == CKR_OK)
         TRACE_DEVEL("Object created: handle: %lu\n", *handle);
-    else if (fname[0] != '\0')
-        remove(fname);
+    else if (named)
+        free_token_object_name(tokdata, obj->name);
 
     return rc;
 }
@@ -700,7 +800,7 @@ CK_RV object_mgr_destroy_object(STDLL_TokData_t *tokdata,
         delete_token_object(tokdata, o);
 
         DUMP_SHM(tokdata->global_shm, "before");
-        object_mgr_del_from_shm(o, tokdata->global_shm);
+        object_mgr_del_from_shm(tokdata, o);
         DUMP_SHM(tokdata->global_shm, "after");
 
         if (map->is_private) {
@@ -767,7 +867,7 @@ void delete_token_obj_cb(STDLL_TokData_t *tokdata, void *node,
 
         delete_token_object(tokdata, o);
 
-        object_mgr_del_from_shm(o, tokdata->global_shm);
+        object_mgr_del_from_shm(tokdata, o);
 
         if (map->is_private) {
             bt_put_node_value(&tokdata->priv_token_obj_btree, o);
@@ -802,6 +902,7 @@ done:
 //
 CK_RV object_mgr_destroy_token_objects(STDLL_TokData_t *tokdata)
 {
+    struct tok_obj_table *table;
     CK_RV rc;
 
     rc = XProcLock(tokdata);
@@ -813,15 +914,29 @@ CK_RV object_mgr_destroy_token_objects(STDLL_TokData_t *tokdata)
     bt_for_each_node(tokdata, &tokdata->object_map_btree, delete_token_obj_cb,
                      NULL);
 
+    rc = object_mgr_get_tok_obj_table(tokdata, &table);
+    if (rc != CKR_OK) {
+        XProcUnLock(tokdata);
+        goto done;
+    }
+
     // now we want to purge the token object list in shared memory
     //
+    object_mgr_shm_write_begin(tokdata->global_shm);
+
     tokdata->global_shm->num_priv_tok_obj = 0;
     tokdata->global_shm->num_publ_tok_obj = 0;
 
-    memset(&tokdata->global_shm->publ_tok_objs, 0x0,
-           MAX_TOK_OBJS * sizeof(TOK_OBJ_ENTRY));
-    memset(&tokdata->global_shm->priv_tok_objs, 0x0,
-           MAX_TOK_OBJS * sizeof(TOK_OBJ_ENTRY));
+    memset(table->entries, 0x0, TOK_OBJ_TABLE_SIZE(table->capacity) -
+                                sizeof(struct tok_obj_table));
+
+    /*
+     * The deletions are not recorded in the change journal. Skip more
+     * changes than it holds, so that other processes compare all objects.
+     */
+    tokdata->global_shm->tok_obj_journal_seq += TOK_OBJ_JOURNAL_SIZE + 1;
+
+    object_mgr_shm_write_end(tokdata->global_shm);
 
     rc = XProcUnLock(tokdata);
     if (rc != CKR_OK) {
@@ -1016,52 +1131,22 @@ done:
     return rc;
 }
 
-void find_obj_cb(STDLL_TokData_t *tokdata, void *node,
-                 unsigned long map_handle, void *p3)
-{
-    OBJECT_MAP *map = (OBJECT_MAP *) node;
-    OBJECT *obj;
-    struct find_args *fa = (struct find_args *) p3;
-
-    UNUSED(tokdata);
-
-    if (fa->done)
-        return;
-
-    if (map->is_session_obj)
-        obj = bt_get_node_value(&tokdata->sess_obj_btree, map->obj_handle);
-    else if (map->is_private)
-        obj = bt_get_node_value(&tokdata->priv_token_obj_btree, map->obj_handle);
-    else
-        obj = bt_get_node_value(&tokdata->publ_token_obj_btree, map->obj_handle);
-
-    if (!obj)
-        return;
-
-    /* if this object is the one we're looking for (matches p3->obj), return
-     * its map_handle in p3->map_handle */
-    if (obj == fa->obj) {
-        fa->map_handle = map_handle;
-        fa->done = TRUE;
-    }
-
-    if (map->is_session_obj)
-        bt_put_node_value(&tokdata->sess_obj_btree, obj);
-    else if (map->is_private)
-        bt_put_node_value(&tokdata->priv_token_obj_btree, obj);
-    else
-        bt_put_node_value(&tokdata->publ_token_obj_btree, obj);
-    obj = NULL;
-}
-
 // object_mgr_find_in_map2()
 //
+// Looks up the map handle of an object. Every object that is added to the
+// object map remembers its map handle (see object_mgr_add_to_map()), so the
+// map node does not need to be searched for. Since map nodes are purged
+// independently of the objects (e.g. at logout), the map node is checked to
+// still refer to the passed object before its handle is returned.
+//
 // The caller must already have locked the passed object (READ_LOCK)!
 //
 CK_RV object_mgr_find_in_map2(STDLL_TokData_t *tokdata,
                               OBJECT *obj, CK_OBJECT_HANDLE *handle)
 {
-    struct find_args fa;
+    OBJECT_MAP *map;
+    OBJECT *map_obj;
+    struct btree *t;
     CK_RV rc;
 
     if (!obj || !handle) {
@@ -1069,19 +1154,29 @@ CK_RV object_mgr_find_in_map2(STDLL_TokData_t *tokdata,
         return CKR_FUNCTION_FAILED;
     }
 
-    fa.done = FALSE;
-    fa.obj = obj;
-    fa.map_handle = 0;
+    if (obj->map_handle == CK_INVALID_HANDLE)
+        return CKR_OBJECT_HANDLE_INVALID;
+
+    map = bt_get_node_value(&tokdata->object_map_btree, obj->map_handle);
+    if (map == NULL)
+        return CKR_OBJECT_HANDLE_INVALID;
+
+    if (map->is_session_obj)
+        t = &tokdata->sess_obj_btree;
+    else if (map->is_private)
+        t = &tokdata->priv_token_obj_btree;
+    else
+        t = &tokdata->publ_token_obj_btree;
 
-    // pass the fa structure with the values to operate on in the find_obj_cb
-    // function
-    bt_for_each_node(tokdata, &tokdata->object_map_btree, find_obj_cb, &fa);
+    map_obj = bt_get_node_value(t, map->obj_handle);
+    bt_put_node_value(t, map_obj);
+    bt_put_node_value(&tokdata->object_map_btree, map);
 
-    if (fa.done == FALSE || fa.map_handle == 0) {
+    /* The map node has been reused for another object */
+    if (map_obj != obj)
         return CKR_OBJECT_HANDLE_INVALID;
-    }
 
-    *handle = fa.map_handle;
+    *handle = obj->map_handle;
 
     if (!object_is_session_object(obj)) {
         rc = object_mgr_check_shm(tokdata, obj, READ_LOCK);
@@ -1467,6 +1562,8 @@ CK_BBOOL object_mgr_purge_token_objects(STDLL_TokData_t *tokdata)
                      &tokdata->priv_token_obj_btree);
     bt_for_each_node(tokdata, &tokdata->publ_token_obj_btree, purge_token_obj_cb,
                      &tokdata->publ_token_obj_btree);
+    tokdata->tok_obj_journal_valid[FALSE] = FALSE;
+    tokdata->tok_obj_journal_valid[TRUE] = FALSE;
 
     return TRUE;
 }
@@ -1476,6 +1573,7 @@ CK_BBOOL object_mgr_purge_private_token_objects(STDLL_TokData_t *tokdata)
 {
     bt_for_each_node(tokdata, &tokdata->priv_token_obj_btree, purge_token_obj_cb,
                      &tokdata->priv_token_obj_btree);
+    tokdata->tok_obj_journal_valid[TRUE] = FALSE;
 
     return TRUE;
 }
@@ -1496,7 +1594,6 @@ CK_RV object_mgr_restore_obj_withSize(STDLL_TokData_t *tokdata, CK_BYTE *data,
                                       const char *fname)
 {
     OBJECT *obj = NULL;
-    CK_BBOOL priv;
     CK_RV rc, tmp;
     TOK_OBJ_ENTRY *entry = NULL;
 
@@ -1515,72 +1612,91 @@ CK_RV object_mgr_restore_obj_withSize(STDLL_TokData_t *tokdata, CK_BYTE *data,
         return rc;
     }
 
+    if (oldObj == NULL)
+        return object_mgr_add_restored_obj(tokdata, obj);
+
     rc = XProcLock(tokdata);
     if (rc != CKR_OK) {
         TRACE_ERROR("Failed to get Process Lock.\n");
-        if (oldObj == NULL)
-            object_free(obj);
         return rc;
     }
 
-    if (oldObj != NULL) {
-        /* Update of existing object */
-        rc = object_mgr_get_shm_entry_for_obj(tokdata, obj, &entry);
-        if (rc == CKR_OK) {
-            obj->count_lo = entry->count_lo;
-            obj->count_hi = entry->count_hi;
+    /* Update of existing object */
+    rc = object_mgr_get_shm_entry_for_obj(tokdata, obj, &entry);
+    if (rc == CKR_OK) {
+        obj->count_lo = entry->count_lo;
+        obj->count_hi = entry->count_hi;
+    }
+
+    tmp = XProcUnLock(tokdata);
+    if (tmp != CKR_OK)
+        TRACE_ERROR("Failed to release Process Lock.\n");
+    if (rc == CKR_OK)
+        rc = tmp;
+
+    return rc;
+}
+
+//
+// Adds a token object that was restored by object_restore_withSize() to the
+// token object btree and to the shared memory segment. This is separate from
+// object_mgr_restore_obj_withSize(), so that objects can be restored in
+// parallel, but are added in the order of the object index. On failure, the
+// object is freed.
+//
+CK_RV object_mgr_add_restored_obj(STDLL_TokData_t *tokdata, OBJECT *obj)
+{
+    CK_BBOOL priv;
+    CK_RV rc, tmp;
+    TOK_OBJ_ENTRY *entry = NULL;
+
+    rc = XProcLock(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to get Process Lock.\n");
+        object_free(obj);
+        return rc;
+    }
+
+    priv = object_is_private(obj);
+
+    if (priv) {
+        if (!bt_node_add(&tokdata->priv_token_obj_btree, obj)) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            rc = CKR_HOST_MEMORY;
+            object_free(obj);
+            goto unlock;
         }
     } else {
-        /* New object */
-        priv = object_is_private(obj);
+        if (!bt_node_add(&tokdata->publ_token_obj_btree, obj)) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            rc = CKR_HOST_MEMORY;
+            object_free(obj);
+            goto unlock;
+        }
+    }
 
-        if (priv) {
-            if (!bt_node_add(&tokdata->priv_token_obj_btree, obj)) {
-                TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-                rc = CKR_HOST_MEMORY;
-                object_free(obj);
+    if (priv) {
+        if (tokdata->global_shm->priv_loaded == FALSE) {
+            rc = object_mgr_add_to_shm(tokdata, obj);
+            if (rc != CKR_OK)
                 goto unlock;
-            }
         } else {
-            if (!bt_node_add(&tokdata->publ_token_obj_btree, obj)) {
-                TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-                rc = CKR_HOST_MEMORY;
-                object_free(obj);
-                goto unlock;
+            rc = object_mgr_get_shm_entry_for_obj(tokdata, obj, &entry);
+            if (rc == CKR_OK) {
+                obj->count_lo = entry->count_lo;
+                obj->count_hi = entry->count_hi;
             }
         }
-
-        if (priv) {
-            if (tokdata->global_shm->priv_loaded == FALSE) {
-                if (tokdata->global_shm->num_priv_tok_obj < MAX_TOK_OBJS) {
-                    object_mgr_add_to_shm(obj, tokdata->global_shm);
-                } else {
-                    TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-                    rc = CKR_HOST_MEMORY;
-                    goto unlock;
-                }
-            } else {
-                rc = object_mgr_get_shm_entry_for_obj(tokdata, obj, &entry);
-                if (rc == CKR_OK) {
-                    obj->count_lo = entry->count_lo;
-                    obj->count_hi = entry->count_hi;
-                }
-            }
+    } else {
+        if (tokdata->global_shm->publ_loaded == FALSE) {
+            rc = object_mgr_add_to_shm(tokdata, obj);
+            if (rc != CKR_OK)
+                goto unlock;
         } else {
-            if (tokdata->global_shm->publ_loaded == FALSE) {
-                if (tokdata->global_shm->num_publ_tok_obj < MAX_TOK_OBJS) {
-                    object_mgr_add_to_shm(obj, tokdata->global_shm);
-                } else {
-                    TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-                    rc = CKR_HOST_MEMORY;
-                    goto unlock;
-                }
-            } else {
-                rc = object_mgr_get_shm_entry_for_obj(tokdata, obj, &entry);
-                if (rc == CKR_OK) {
-                    obj->count_lo = entry->count_lo;
-                    obj->count_hi = entry->count_hi;
-                }
+            rc = object_mgr_get_shm_entry_for_obj(tokdata, obj, &entry);
+            if (rc == CKR_OK) {
+                obj->count_lo = entry->count_lo;
+                obj->count_hi = entry->count_hi;
             }
         }
     }
@@ -1601,7 +1717,6 @@ unlock:
 CK_RV object_mgr_save_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
 {
     TOK_OBJ_ENTRY *entry = NULL;
-    CK_ULONG index;
     CK_RV rc;
 
     obj->count_lo++;
@@ -1614,45 +1729,11 @@ CK_RV object_mgr_save_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
         goto done;
     }
 
-    if (object_is_private(obj)) {
-        if (tokdata->global_shm->num_priv_tok_obj == 0) {
-            TRACE_DEVEL("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
-            rc = CKR_OBJECT_HANDLE_INVALID;
-            XProcUnLock(tokdata);
-            goto done;
-        }
-        rc = object_mgr_search_shm_for_obj(tokdata->global_shm->
-                                           priv_tok_objs, 0,
-                                           tokdata->global_shm->
-                                           num_priv_tok_obj - 1, obj,
-                                           &index);
-
-        if (rc != CKR_OK) {
-            TRACE_DEVEL("object_mgr_search_shm_for_obj failed.\n");
-            XProcUnLock(tokdata);
-            goto done;
-        }
-
-        entry = &tokdata->global_shm->priv_tok_objs[index];
-    } else {
-        if (tokdata->global_shm->num_publ_tok_obj == 0) {
-            TRACE_DEVEL("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
-            rc = CKR_OBJECT_HANDLE_INVALID;
-            XProcUnLock(tokdata);
-            goto done;
-        }
-        rc = object_mgr_search_shm_for_obj(tokdata->global_shm->
-                                           publ_tok_objs, 0,
-                                           tokdata->global_shm->
-                                           num_publ_tok_obj - 1, obj,
-                                           &index);
-        if (rc != CKR_OK) {
-            TRACE_DEVEL("object_mgr_search_shm_for_obj failed.\n");
-            XProcUnLock(tokdata);
-            goto done;
-        }
-
-        entry = &tokdata->global_shm->publ_tok_objs[index];
+    rc = object_mgr_get_shm_entry_for_obj(tokdata, obj, &entry);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("object_mgr_get_shm_entry_for_obj failed.\n");
+        XProcUnLock(tokdata);
+        goto done;
     }
 
     rc = save_token_object(tokdata, obj);
@@ -1662,8 +1743,10 @@ CK_RV object_mgr_save_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
         goto done;
     }
 
+    object_mgr_shm_write_begin(tokdata->global_shm);
     entry->count_lo = obj->count_lo;
     entry->count_hi = obj->count_hi;
+    object_mgr_shm_write_end(tokdata->global_shm);
 
     rc = XProcUnLock(tokdata);
     if (rc != CKR_OK) {
@@ -1778,132 +1861,170 @@ done:
 }
 
 
+/*
+ * Replaces the full token object table by one with twice the capacity. Other
+ * processes pick up the new table the next time they access it.
+ */
+static CK_RV object_mgr_grow_tok_obj_table(STDLL_TokData_t *tokdata)
+{
+    LW_SHM_TYPE *global_shm = tokdata->global_shm;
+    struct tok_obj_table *old = tokdata->tok_obj_table, *table;
+    CK_ULONG_32 capacity = old->capacity * 2;
+    CK_RV rc;
+
+    if (capacity < old->capacity || TOK_OBJ_TABLE_SIZE(capacity) > INT_MAX) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    rc = tok_obj_table_create(tokdata, old->gen + 1, capacity, &table);
+    if (rc != CKR_OK)
+        return rc;
+
+    memcpy(tok_obj_list(table, FALSE), tok_obj_list(old, FALSE),
+           global_shm->num_publ_tok_obj * sizeof(TOK_OBJ_ENTRY));
+    memcpy(tok_obj_list(table, TRUE), tok_obj_list(old, TRUE),
+           global_shm->num_priv_tok_obj * sizeof(TOK_OBJ_ENTRY));
+    tok_obj_hash_rebuild(table, FALSE, global_shm->num_publ_tok_obj);
+    tok_obj_hash_rebuild(table, TRUE, global_shm->num_priv_tok_obj);
+
+    rc = tok_obj_table_install(tokdata, table);
+    if (rc != CKR_OK)
+        return rc;
+
+    object_mgr_shm_write_begin(global_shm);
+    global_shm->tok_obj_table_gen = table->gen;
+    global_shm->tok_obj_capacity = table->capacity;
+    object_mgr_shm_write_end(global_shm);
+
+    TRACE_DEVEL("Token object table grown to %u entries.\n", capacity);
+
+    return CKR_OK;
+}
+
+/*
+ * Records an addition to or deletion from a token object list in the SHM
+ * change journal. The caller must hold the XProcLock.
+ */
+static void object_mgr_journal_change(STDLL_TokData_t *tokdata,
+                                      const char *name, CK_BBOOL priv,
+                                      CK_BYTE op)
+{
+    LW_SHM_TYPE *global_shm = tokdata->global_shm;
+    CK_ULONG_32 seq = global_shm->tok_obj_journal_seq + 1;
+    TOK_OBJ_JOURNAL_ENTRY *je;
+
+    je = &global_shm->tok_obj_journal[seq % TOK_OBJ_JOURNAL_SIZE];
+    memcpy(je->name, name, 8);
+    je->seq = seq;
+    je->pid = tokdata->real_pid;
+    je->op = op;
+    je->priv = priv;
+
+    global_shm->tok_obj_journal_seq = seq;
+}
+
 //
 //
-void object_mgr_add_to_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
+CK_RV object_mgr_add_to_shm(STDLL_TokData_t *tokdata, OBJECT *obj)
 {
-    // TODO: Can't this function fail?
+    LW_SHM_TYPE *global_shm = tokdata->global_shm;
+    struct tok_obj_table *table;
     TOK_OBJ_ENTRY *entry = NULL;
+    CK_ULONG_32 *num, slot;
     CK_BBOOL priv;
+    CK_RV rc;
 
     // the calling routine is responsible for locking the global_shm mutex
     //
     priv = object_is_private(obj);
+    num = tok_obj_num(global_shm, priv);
 
-    if (priv)
-        entry = &global_shm->priv_tok_objs[global_shm->num_priv_tok_obj];
-    else
-        entry = &global_shm->publ_tok_objs[global_shm->num_publ_tok_obj];
+    rc = object_mgr_get_tok_obj_table(tokdata, &table);
+    if (rc != CKR_OK)
+        return rc;
 
+    if (*num >= table->capacity) {
+        rc = object_mgr_grow_tok_obj_table(tokdata);
+        if (rc != CKR_OK)
+            return rc;
+        table = tokdata->tok_obj_table;
+    }
+
+    slot = tok_obj_hash_lookup(table, priv, obj->name);
+    if (tok_obj_hash(table, priv)[slot] != 0) {
+        TRACE_DEVEL("Object %.8s already in the SHM.\n", obj->name);
+        obj->index = tok_obj_hash(table, priv)[slot] - 1;
+        return CKR_OK;
+    }
+
+    object_mgr_shm_write_begin(global_shm);
+
+    entry = &tok_obj_list(table, priv)[*num];
     entry->deleted = FALSE;
     entry->count_lo = 0;
     entry->count_hi = 0;
     memcpy(entry->name, obj->name, 8);
 
-    if (priv)
-        global_shm->num_priv_tok_obj++;
-    else
-        global_shm->num_publ_tok_obj++;
+    tok_obj_hash(table, priv)[slot] = *num + 1;
+    obj->index = *num;
+    (*num)++;
+
+    object_mgr_shm_write_end(global_shm);
+
+    object_mgr_journal_change(tokdata, (char *)obj->name, priv,
+                              TOK_OBJ_JOURNAL_ADD);
 
-    return;
+    return CKR_OK;
 }
 
 
 //
 //
-CK_RV object_mgr_del_from_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
+CK_RV object_mgr_del_from_shm(STDLL_TokData_t *tokdata, OBJECT *obj)
 {
-    CK_ULONG index, count;
+    LW_SHM_TYPE *global_shm = tokdata->global_shm;
+    struct tok_obj_table *table;
+    TOK_OBJ_ENTRY *list;
+    CK_ULONG_32 *num, last;
+    CK_ULONG index;
     CK_BBOOL priv;
     CK_RV rc;
 
-
     // the calling routine is responsible for locking the global_shm mutex
     //
-
     priv = object_is_private(obj);
+    num = tok_obj_num(global_shm, priv);
 
-    if (priv) {
-        if (global_shm->num_priv_tok_obj == 0) {
-            TRACE_DEVEL("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
-            return CKR_OBJECT_HANDLE_INVALID;
-        }
-        rc = object_mgr_search_shm_for_obj(global_shm->priv_tok_objs,
-                                           0, global_shm->num_priv_tok_obj - 1,
-                                           obj, &index);
-        if (rc != CKR_OK) {
-            TRACE_DEVEL("object_mgr_search_shm_for_obj failed.\n");
-            return rc;
-        }
-        // Since the number of objects starts at 1 and index starts at zero, we
-        // decrement before we get count.  This eliminates the need to perform
-        // this operation later as well as decrementing the number of objects.
-        // (i.e. If we have 10 objects, num will be 10 but the last index is 9.
-        // If we want to delete the last object we need to subtract 9 from 9 not
-        // 10 from 9.)
-        //
-        global_shm->num_priv_tok_obj--;
-        if (index > global_shm->num_priv_tok_obj) {
-            count = index - global_shm->num_priv_tok_obj;
-        } else {
-            count = global_shm->num_priv_tok_obj - index;
-        }
-
-        if (count > 0) {
-            // If we aren't deleting the last element in the list
-            // Move up count number of elements effectively deleting the index
-            // NB: memmove is required since the copied regions may overlap
-            memmove((char *) &global_shm->priv_tok_objs[index],
-                    (char *) &global_shm->priv_tok_objs[index + 1],
-                    sizeof(TOK_OBJ_ENTRY) * count);
-            // We need to zero out the last entry... Since the memcopy
-            // does not zero it out...
-            memset((char *) &global_shm->
-                   priv_tok_objs[global_shm->num_priv_tok_obj + 1], 0,
-                   sizeof(TOK_OBJ_ENTRY));
-        } else {
-            // We are deleting the last element which is in num_priv_tok_obj
-            memset((char *) &global_shm->
-                   priv_tok_objs[global_shm->num_priv_tok_obj], 0,
-                   sizeof(TOK_OBJ_ENTRY));
-        }
-    } else {
-        if (global_shm->num_publ_tok_obj == 0) {
-            TRACE_DEVEL("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
-            return CKR_OBJECT_HANDLE_INVALID;
-        }
-        rc = object_mgr_search_shm_for_obj(global_shm->publ_tok_objs,
-                                           0, global_shm->num_publ_tok_obj - 1,
-                                           obj, &index);
-        if (rc != CKR_OK) {
-            TRACE_DEVEL("object_mgr_search_shm_for_obj failed.\n");
-            return rc;
-        }
-        global_shm->num_publ_tok_obj--;
+    rc = object_mgr_search_shm_for_obj(tokdata, obj, &index);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("object_mgr_search_shm_for_obj failed.\n");
+        return rc;
+    }
 
+    table = tokdata->tok_obj_table;
+    list = tok_obj_list(table, priv);
+    last = *num - 1;
 
-        if (index > global_shm->num_publ_tok_obj) {
-            count = index - global_shm->num_publ_tok_obj;
-        } else {
-            count = global_shm->num_publ_tok_obj - index;
-        }
-
-        if (count > 0) {
-            // NB: memmove is required since the copied regions may overlap
-            memmove((char *) &global_shm->publ_tok_objs[index],
-                    (char *) &global_shm->publ_tok_objs[index + 1],
-                    sizeof(TOK_OBJ_ENTRY) * count);
-            // We need to zero out the last entry... Since the memcopy
-            // does not zero it out...
-            memset((char *) &global_shm->
-                   publ_tok_objs[global_shm->num_publ_tok_obj + 1], 0,
-                   sizeof(TOK_OBJ_ENTRY));
-        } else {
-            memset((char *) &global_shm->
-                   publ_tok_objs[global_shm->num_publ_tok_obj], 0,
-                   sizeof(TOK_OBJ_ENTRY));
-        }
+    object_mgr_shm_write_begin(global_shm);
+
+    tok_obj_hash_remove(table, priv,
+                        tok_obj_hash_lookup(table, priv, list[index].name));
+
+    // Fill the gap with the last entry of the list
+    if (index != last) {
+        list[index] = list[last];
+        tok_obj_hash(table, priv)[tok_obj_hash_lookup(table, priv,
+                                                      list[index].name)] =
+            index + 1;
     }
+    memset(&list[last], 0, sizeof(TOK_OBJ_ENTRY));
+    (*num)--;
+
+    object_mgr_shm_write_end(global_shm);
+
+    object_mgr_journal_change(tokdata, (char *)obj->name, priv,
+                              TOK_OBJ_JOURNAL_DEL);
 
     return CKR_OK;
 }
@@ -1916,43 +2037,63 @@ CK_RV object_mgr_get_shm_entry_for_obj(STDLL_TokData_t *tokdata, OBJECT *obj,
 
     *entry = NULL;
 
-    if (object_is_private(obj)) {
-        /* first check the object count. If it is 0, then just return. */
-        if (tokdata->global_shm->num_priv_tok_obj == 0) {
-            TRACE_ERROR("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
-            return CKR_OBJECT_HANDLE_INVALID;
-        }
-        rc = object_mgr_search_shm_for_obj(tokdata->global_shm->priv_tok_objs,
-                                           0,
-                                           tokdata->global_shm->
-                                           num_priv_tok_obj - 1, obj, &index);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("object_mgr_search_shm_for_obj failed.\n");
-            return rc;
-        }
-        *entry = &tokdata->global_shm->priv_tok_objs[index];
-    } else {
-        /* first check the object count. If it is 0, then just return. */
-        if (tokdata->global_shm->num_publ_tok_obj == 0) {
-            TRACE_ERROR("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
-            return CKR_OBJECT_HANDLE_INVALID;
-        }
-        rc = object_mgr_search_shm_for_obj(tokdata->global_shm->publ_tok_objs,
-                                           0,
-                                           tokdata->global_shm->num_publ_tok_obj
-                                           - 1,
-                                           obj, &index);
-        if (rc != CKR_OK) {
-            TRACE_ERROR("object_mgr_search_shm_for_obj failed.\n");
-            return rc;
-        }
-        *entry = &tokdata->global_shm->publ_tok_objs[index];
+    rc = object_mgr_search_shm_for_obj(tokdata, obj, &index);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("object_mgr_search_shm_for_obj failed.\n");
+        return rc;
     }
 
+    *entry = &tok_obj_list(tokdata->tok_obj_table,
+                           object_is_private(obj))[index];
+
     return CKR_OK;
 }
 
 
+/*
+ * Lock-free check whether the object's SHM entry is still at its cached index
+ * and carries the same counters as the object. Returns TRUE only if the entry
+ * was read while no writer was active and matches; in all other cases the
+ * caller must fall back to the check under the XProcLock.
+ */
+static CK_BBOOL object_mgr_check_shm_unlocked(STDLL_TokData_t *tokdata,
+                                              OBJECT *obj)
+{
+    LW_SHM_TYPE *global_shm = tokdata->global_shm;
+    struct tok_obj_table *table;
+    TOK_OBJ_ENTRY entry;
+    CK_ULONG_32 seq, num;
+    CK_ULONG index;
+    CK_BBOOL priv;
+
+    seq = __atomic_load_n(&global_shm->tok_obj_seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+        return FALSE;
+
+    /* Outdated mappings stay valid until detach, but must not be used */
+    table = __atomic_load_n(&tokdata->tok_obj_table, __ATOMIC_ACQUIRE);
+    if (table == NULL || table->gen !=
+        __atomic_load_n(&global_shm->tok_obj_table_gen, __ATOMIC_RELAXED))
+        return FALSE;
+
+    priv = object_is_private(obj);
+    num = __atomic_load_n(tok_obj_num(global_shm, priv), __ATOMIC_RELAXED);
+
+    index = __atomic_load_n(&obj->index, __ATOMIC_RELAXED);
+    if (index >= num || index >= table->capacity)
+        return FALSE;
+
+    memcpy(&entry, &tok_obj_list(table, priv)[index], sizeof(entry));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&global_shm->tok_obj_seq, __ATOMIC_RELAXED) != seq)
+        return FALSE;
+
+    return memcmp(entry.name, obj->name, 8) == 0 &&
+           entry.count_hi == obj->count_hi &&
+           entry.count_lo == obj->count_lo;
+}
+
 // The object must hold the READ or WRITE lock when this function is called!
 //
 CK_RV object_mgr_check_shm(STDLL_TokData_t *tokdata, OBJECT *obj,
@@ -1974,6 +2115,10 @@ CK_RV object_mgr_check_shm(STDLL_TokData_t *tokdata, OBJECT *obj,
         return CKR_FUNCTION_FAILED;
     }
 
+    /* Fast path: the object is unchanged, no need for the XProcLock */
+    if (object_mgr_check_shm_unlocked(tokdata, obj))
+        return CKR_OK;
+
 retry:
     rc = XProcLock(tokdata);
     if (rc != CKR_OK) {
@@ -2089,42 +2234,37 @@ done_no_xproc_unlock:
 }
 
 
-// I'd use the standard bsearch() routine but I want an index, not a pointer.
-// Converting the pointer to an index might cause problems when switching
-// to a 64-bit environment...
+// Looks up the SHM entry of a token object, trying the index cached in the
+// object first and the hash index of its list otherwise.
 //
-CK_RV object_mgr_search_shm_for_obj(TOK_OBJ_ENTRY *obj_list,
-                                    CK_ULONG lo,
-                                    CK_ULONG hi, OBJECT *obj, CK_ULONG *index)
+CK_RV object_mgr_search_shm_for_obj(STDLL_TokData_t *tokdata, OBJECT *obj,
+                                    CK_ULONG *index)
 {
-// SAB  XXX reduce the search time since this is what seems to be burning cycles
-    CK_ULONG idx;
+    struct tok_obj_table *table;
+    TOK_OBJ_ENTRY *list;
+    CK_ULONG_32 num, idx;
+    CK_BBOOL priv;
+    CK_RV rc;
 
-    UNUSED(lo);
+    rc = object_mgr_get_tok_obj_table(tokdata, &table);
+    if (rc != CKR_OK)
+        return rc;
 
-    if (obj->index == 0) {
-        for (idx = 0; idx <= hi; idx++) {
-            if (memcmp(obj->name, obj_list[idx].name, 8) == 0) {
-                *index = idx;
-                obj->index = idx;
-                return CKR_OK;
-            }
-        }
-    } else {
-        // SAB better double check
-        if (memcmp(obj->name, obj_list[obj->index].name, 8) == 0) {
-            *index = obj->index;
-            return CKR_OK;
-        } else {
-            // something is hosed.. go back to the brute force method
-            for (idx = 0; idx <= hi; idx++) {
-                if (memcmp(obj->name, obj_list[idx].name, 8) == 0) {
-                    *index = idx;
-                    obj->index = idx;
-                    return CKR_OK;
-                }
-            }
-        }
+    priv = object_is_private(obj);
+    list = tok_obj_list(table, priv);
+    num = *tok_obj_num(tokdata->global_shm, priv);
+
+    if (obj->index < num && memcmp(obj->name, list[obj->index].name, 8) == 0) {
+        *index = obj->index;
+        return CKR_OK;
+    }
+
+    idx = tok_obj_hash(table, priv)[tok_obj_hash_lookup(table, priv,
+                                                         obj->name)];
+    if (idx != 0) {
+        *index = idx - 1;
+        obj->index = idx - 1;
+        return CKR_OK;
     }
 
     TRACE_ERROR("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
@@ -2149,18 +2289,24 @@ void delete_objs_from_btree_cb(STDLL_TokData_t *tokdata, void *node,
                                unsigned long obj_handle, void *p3)
 {
     struct update_tok_obj_args *ua = (struct update_tok_obj_args *) p3;
-    TOK_OBJ_ENTRY *shm_te = NULL;
     OBJECT *obj = (OBJECT *) node;
-    CK_ULONG index;
-
-    UNUSED(tokdata);
-
-    /* for each TOK_OBJ_ENTRY in the SHM list */
-    for (index = 0; index < *(ua->num_entries); index++) {
-        shm_te = &(ua->entries[index]);
+    CK_ULONG_32 idx, i;
 
-        /* found it, return */
-        if (!memcmp(obj->name, shm_te->name, 8)) {
+    if (ua->deleted != NULL) {
+        /* journal: delete only the objects deleted by other processes */
+        for (i = 0; i < ua->num_deleted; i++) {
+            if (memcmp(ua->deleted[i], obj->name, 8) == 0)
+                break;
+        }
+        if (i == ua->num_deleted)
+            return;
+    } else {
+        idx = tok_obj_hash(ua->table, ua->priv)[tok_obj_hash_lookup(ua->table,
+                                                                    ua->priv,
+                                                                    obj->name)];
+        /* found it, remember that it needs not be added */
+        if (idx != 0) {
+            ua->seen[idx - 1] = TRUE;
             return;
         }
     }
@@ -2170,145 +2316,190 @@ void delete_objs_from_btree_cb(STDLL_TokData_t *tokdata, void *node,
     bt_node_free(ua->t, obj_handle, TRUE);
 }
 
-void find_by_name_cb(STDLL_TokData_t *tokdata, void *node,
-                     unsigned long obj_handle, void *p3)
+/* Loads a token object added by another process and adds it to the btree */
+static CK_RV object_mgr_add_tok_obj_from_shm(STDLL_TokData_t *tokdata,
+                                             struct btree *t,
+                                             const char *name)
 {
-    OBJECT *obj = (OBJECT *) node;
-    struct find_by_name_args *fa = (struct find_by_name_args *) p3;
+    OBJECT *new_obj;
+    CK_RV rc;
 
-    UNUSED(tokdata);
-    UNUSED(obj_handle);
+    new_obj = (OBJECT *) malloc(sizeof(OBJECT));
+    if (new_obj == NULL)
+        return CKR_HOST_MEMORY;
+    memset(new_obj, 0x0, sizeof(OBJECT));
 
-    if (fa->done)
-        return;
+    rc = object_init_lock(new_obj);
+    if (rc != CKR_OK) {
+        free(new_obj);
+        return rc;
+    }
 
-    if (!memcmp(obj->name, fa->name, 8)) {
-        fa->done = TRUE;
+    rc = object_init_ex_data_lock(new_obj);
+    if (rc != CKR_OK) {
+        object_destroy_lock(new_obj);
+        free(new_obj);
+        return rc;
     }
+
+    memcpy(new_obj->name, name, 8);
+    rc = reload_token_object(tokdata, new_obj);
+    if (rc == CKR_OK)
+        bt_node_add(t, new_obj);
+    else
+        object_free(new_obj);
+
+    return rc;
 }
 
-CK_RV object_mgr_update_publ_tok_obj_from_shm(STDLL_TokData_t *tokdata)
+/*
+ * Applies the changes of the SHM change journal that other processes made to
+ * a token object list since the last update. Returns FALSE if that is not
+ * possible, because the local objects were never compared with the list or
+ * the journal no longer holds all changes since then.
+ */
+static CK_BBOOL object_mgr_update_tok_obj_from_journal(STDLL_TokData_t *tokdata,
+                                                       struct update_tok_obj_args *ua)
 {
-    struct update_tok_obj_args ua;
-    struct find_by_name_args fa;
-    TOK_OBJ_ENTRY *shm_te = NULL;
-    CK_ULONG index;
-    OBJECT *new_obj;
-    CK_RV rc;
+    LW_SHM_TYPE *global_shm = tokdata->global_shm;
+    TOK_OBJ_JOURNAL_ENTRY *je;
+    CK_ULONG_32 seq, pos, s, t, idx;
+    char (*added)[8] = NULL;
+    CK_ULONG_32 num_added = 0, i;
 
-    ua.entries = tokdata->global_shm->publ_tok_objs;
-    ua.num_entries = &(tokdata->global_shm->num_publ_tok_obj);
-    ua.t = &tokdata->publ_token_obj_btree;
+    if (!tokdata->tok_obj_journal_valid[ua->priv])
+        return FALSE;
 
-    /* delete any objects not in SHM from the btree */
-    bt_for_each_node(tokdata, &tokdata->publ_token_obj_btree,
-                     delete_objs_from_btree_cb, &ua);
+    seq = global_shm->tok_obj_journal_seq;
+    pos = tokdata->tok_obj_journal_pos[ua->priv];
+    if (seq == pos)
+        return TRUE;
+    if (seq - pos > TOK_OBJ_JOURNAL_SIZE) {
+        TRACE_DEVEL("Missed %u token object changes, comparing all objects.\n",
+                    seq - pos);
+        return FALSE;
+    }
 
-    /* for each item in SHM, add it to the btree if its not there */
-    for (index = 0; index < tokdata->global_shm->num_publ_tok_obj; index++) {
-        shm_te = &tokdata->global_shm->publ_tok_objs[index];
+    ua->deleted = calloc(2 * (seq - pos), 8);
+    if (ua->deleted == NULL)
+        return FALSE;
+    added = ua->deleted + (seq - pos);
+    ua->num_deleted = 0;
 
-        fa.done = FALSE;
-        fa.name = shm_te->name;
+    for (s = pos + 1; s != seq + 1; s++) {
+        je = &global_shm->tok_obj_journal[s % TOK_OBJ_JOURNAL_SIZE];
+        if (je->seq != s) {
+            free(ua->deleted);
+            ua->deleted = NULL;
+            return FALSE;
+        }
 
-        /* find an object from SHM in the btree */
-        bt_for_each_node(tokdata, &tokdata->publ_token_obj_btree,
-                         find_by_name_cb, &fa);
+        /* Own changes are already applied to the local objects */
+        if (je->priv != ua->priv || je->pid == (CK_ULONG_32)tokdata->real_pid)
+            continue;
 
-        /* we didn't find it in the btree, so add it */
-        if (fa.done == FALSE) {
-            new_obj = (OBJECT *) malloc(sizeof(OBJECT));
-            if (new_obj == NULL)
-                return CKR_HOST_MEMORY;
-            memset(new_obj, 0x0, sizeof(OBJECT));
+        if (je->op == TOK_OBJ_JOURNAL_DEL) {
+            memcpy(ua->deleted[ua->num_deleted++], je->name, 8);
+            continue;
+        }
 
-            rc = object_init_lock(new_obj);
-            if (rc != CKR_OK) {
-                free(new_obj);
-                continue;
-            }
+        /* An object deleted again later on is not added */
+        for (t = s + 1; t != seq + 1; t++) {
+            if (global_shm->tok_obj_journal[t % TOK_OBJ_JOURNAL_SIZE].op ==
+                TOK_OBJ_JOURNAL_DEL &&
+                memcmp(global_shm->tok_obj_journal[t % TOK_OBJ_JOURNAL_SIZE].name,
+                       je->name, 8) == 0)
+                break;
+        }
+        if (t == seq + 1)
+            memcpy(added[num_added++], je->name, 8);
+    }
 
-            rc = object_init_ex_data_lock(new_obj);
-            if (rc != CKR_OK) {
-                object_destroy_lock(new_obj);
-                free(new_obj);
-                continue;
-            }
+    if (ua->num_deleted > 0)
+        bt_for_each_node(tokdata, ua->t, delete_objs_from_btree_cb, ua);
 
-            memcpy(new_obj->name, shm_te->name, 8);
-            rc = reload_token_object(tokdata, new_obj);
-            if (rc == CKR_OK)
-                bt_node_add(&tokdata->publ_token_obj_btree, new_obj);
-            else
-                object_free(new_obj);
-        }
+    for (i = 0; i < num_added; i++) {
+        idx = tok_obj_hash(ua->table, ua->priv)[tok_obj_hash_lookup(ua->table,
+                                                                    ua->priv,
+                                                                    added[i])];
+        if (idx != 0)
+            object_mgr_add_tok_obj_from_shm(tokdata, ua->t, added[i]);
     }
 
-    return CKR_OK;
+    free(ua->deleted);
+    ua->deleted = NULL;
+    tokdata->tok_obj_journal_pos[ua->priv] = seq;
+
+    return TRUE;
 }
 
-CK_RV object_mgr_update_priv_tok_obj_from_shm(STDLL_TokData_t *tokdata)
+static CK_RV object_mgr_update_tok_obj_from_shm(STDLL_TokData_t *tokdata,
+                                                CK_BBOOL priv)
 {
     struct update_tok_obj_args ua;
-    struct find_by_name_args fa;
     TOK_OBJ_ENTRY *shm_te = NULL;
+    CK_ULONG_32 num;
     CK_ULONG index;
-    OBJECT *new_obj;
     CK_RV rc;
 
-    // SAB XXX don't bother doing this call if we are not in the correct
-    // login state
-    if (!session_mgr_user_session_exists(tokdata))
+    memset(&ua, 0, sizeof(ua));
+    rc = object_mgr_get_tok_obj_table(tokdata, &ua.table);
+    if (rc != CKR_OK)
+        return rc;
+
+    ua.priv = priv;
+    ua.t = priv ? &tokdata->priv_token_obj_btree :
+                  &tokdata->publ_token_obj_btree;
+
+    if (object_mgr_update_tok_obj_from_journal(tokdata, &ua))
         return CKR_OK;
 
-    ua.entries = tokdata->global_shm->priv_tok_objs;
-    ua.num_entries = &(tokdata->global_shm->num_priv_tok_obj);
-    ua.t = &tokdata->priv_token_obj_btree;
+    num = *tok_obj_num(tokdata->global_shm, priv);
+    ua.seen = calloc(num + 1, sizeof(CK_BBOOL));
+    if (ua.seen == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
 
     /* delete any objects not in SHM from the btree */
-    bt_for_each_node(tokdata, &tokdata->priv_token_obj_btree, delete_objs_from_btree_cb,
-                     &ua);
+    bt_for_each_node(tokdata, ua.t, delete_objs_from_btree_cb, &ua);
 
     /* for each item in SHM, add it to the btree if its not there */
-    for (index = 0; index < tokdata->global_shm->num_priv_tok_obj; index++) {
-        shm_te = &tokdata->global_shm->priv_tok_objs[index];
+    for (index = 0; index < num; index++) {
+        if (ua.seen[index])
+            continue;
 
-        fa.done = FALSE;
-        fa.name = shm_te->name;
+        shm_te = &tok_obj_list(ua.table, priv)[index];
 
-        /* find an object from SHM in the btree */
-        bt_for_each_node(tokdata, &tokdata->priv_token_obj_btree, find_by_name_cb, &fa);
+        rc = object_mgr_add_tok_obj_from_shm(tokdata, ua.t, shm_te->name);
+        if (rc == CKR_HOST_MEMORY) {
+            free(ua.seen);
+            return rc;
+        }
+    }
 
-        /* we didn't find it in the btree, so add it */
-        if (fa.done == FALSE) {
-            new_obj = (OBJECT *) malloc(sizeof(OBJECT));
-            if (new_obj == NULL)
-                return CKR_HOST_MEMORY;
-            memset(new_obj, 0x0, sizeof(OBJECT));
+    free(ua.seen);
 
-            rc = object_init_lock(new_obj);
-            if (rc != CKR_OK) {
-                free(new_obj);
-                continue;
-            }
+    /* The local objects now match the list as of the latest change */
+    tokdata->tok_obj_journal_pos[priv] = tokdata->global_shm->tok_obj_journal_seq;
+    tokdata->tok_obj_journal_valid[priv] = TRUE;
 
-            rc = object_init_ex_data_lock(new_obj);
-            if (rc != CKR_OK) {
-                object_destroy_lock(new_obj);
-                free(new_obj);
-                continue;
-            }
+    return CKR_OK;
+}
 
-            memcpy(new_obj->name, shm_te->name, 8);
-            rc = reload_token_object(tokdata, new_obj);
-            if (rc == CKR_OK)
-                bt_node_add(&tokdata->priv_token_obj_btree, new_obj);
-            else
-                object_free(new_obj);
-        }
-    }
+CK_RV object_mgr_update_publ_tok_obj_from_shm(STDLL_TokData_t *tokdata)
+{
+    return object_mgr_update_tok_obj_from_shm(tokdata, FALSE);
+}
 
-    return CKR_OK;
+CK_RV object_mgr_update_priv_tok_obj_from_shm(STDLL_TokData_t *tokdata)
+{
+    // SAB XXX don't bother doing this call if we are not in the correct
+    // login state
+    if (!session_mgr_user_session_exists(tokdata))
+        return CKR_OK;
+
+    return object_mgr_update_tok_obj_from_shm(tokdata, TRUE);
 }
 
 // SAB FIXME FIXME
@@ -2372,17 +2563,21 @@ CK_RV object_put(STDLL_TokData_t *tokdata, OBJECT *obj, CK_BBOOL unlock)
 }
 
 #ifdef DEBUG
-void dump_shm(LW_SHM_TYPE *global_shm, const char *s)
+void dump_shm(STDLL_TokData_t *tokdata, const char *s)
 {
+    struct tok_obj_table *table = tokdata->tok_obj_table;
     CK_ULONG i;
-    TRACE_DEBUG("%s: dump_shm priv:\n", s);
 
-    for (i = 0; i < global_shm->num_priv_tok_obj; i++) {
-        TRACE_DEBUG("[%lu]: %.8s\n", i, global_shm->priv_tok_objs[i].name);
+    if (table == NULL)
+        return;
+
+    TRACE_DEBUG("%s: dump_shm priv:\n", s);
+    for (i = 0; i < tokdata->global_shm->num_priv_tok_obj; i++) {
+        TRACE_DEBUG("[%lu]: %.8s\n", i, tok_obj_list(table, TRUE)[i].name);
     }
     TRACE_DEBUG("%s: dump_shm publ:\n", s);
-    for (i = 0; i < global_shm->num_publ_tok_obj; i++) {
-        TRACE_DEBUG("[%lu]: %.8s\n", i, global_shm->publ_tok_objs[i].name);
+    for (i = 0; i < tokdata->global_shm->num_publ_tok_obj; i++) {
+        TRACE_DEBUG("[%lu]: %.8s\n", i, tok_obj_list(table, FALSE)[i].name);
     }
 }
 #endif
@@ -697,6 +697,25 @@ CK_RV object_set_attribute_values(STDLL_TokData_t * tokdata, SESSION *sess,
         return rc;
     }
 
+    // anything cached in the ex_data was built from the old attributes
+    //
+    rc = object_ex_data_lock(obj, WRITE_LOCK);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (obj->ex_data != NULL && obj->ex_data_reload != NULL) {
+        rc = obj->ex_data_reload(obj, obj->ex_data, obj->ex_data_len);
+        if (rc != CKR_OK) {
+            TRACE_DEVEL("ex_data_reload failed.\n");
+            object_ex_data_unlock(obj);
+            return rc;
+        }
+    }
+
+    rc = object_ex_data_unlock(obj);
+    if (rc != CKR_OK)
+        return rc;
+
     return CKR_OK;
 
 error:
@@ -23,6 +23,9 @@
 #include <dirent.h>
 #include <grp.h>
 #include <ctype.h>
+#if defined(HAVE_GETRANDOM) && defined(HAVE_SYS_RANDOM_H)
+#include <sys/random.h>
+#endif
 #include <openssl/evp.h>
 #include <pkcs11types.h>
 
@@ -173,7 +176,7 @@ done:
 
 #ifndef OCK_NO_LOCAL_RNG
 
-CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
+static CK_RV local_rng_device(CK_BYTE *output, CK_ULONG bytes)
 {
     int ranfd;
     int rlen;
@@ -198,6 +201,34 @@ CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
     return CKR_FUNCTION_FAILED;
 }
 
+/*
+ * The utilities only need a few random bytes now and then, so unlike the
+ * tokens' local_rng() in mech_rng.c this does not buffer.
+ */
+CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
+{
+#if defined(HAVE_GETRANDOM) && defined(HAVE_SYS_RANDOM_H)
+    CK_ULONG done = 0;
+    ssize_t len;
+
+    while (done < bytes) {
+        len = getrandom(output + done, bytes - done, 0);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOSYS && done == 0)
+                break;
+            return CKR_FUNCTION_FAILED;
+        }
+        done += len;
+    }
+    if (done == bytes)
+        return CKR_OK;
+#endif
+
+    return local_rng_device(output, bytes);
+}
+
 #endif
 
 CK_RV aes_256_wrap(unsigned char out[40], const unsigned char in[32],
@@ -309,6 +309,11 @@ CK_RV session_mgr_close_session(STDLL_TokData_t *tokdata,
     if (sess->encr_ctx.mech.pParameter)
         free(sess->encr_ctx.mech.pParameter);
 
+    if (sess->encr_ctx.cipher_ctx != NULL &&
+        sess->encr_ctx.cipher_ctx_free_func != NULL)
+        sess->encr_ctx.cipher_ctx_free_func(tokdata, sess,
+                                            sess->encr_ctx.cipher_ctx);
+
     if (sess->decr_ctx.context) {
         if (sess->decr_ctx.context_free_func != NULL)
             sess->decr_ctx.context_free_func(tokdata, sess,
@@ -321,6 +326,11 @@ CK_RV session_mgr_close_session(STDLL_TokData_t *tokdata,
     if (sess->decr_ctx.mech.pParameter)
         free(sess->decr_ctx.mech.pParameter);
 
+    if (sess->decr_ctx.cipher_ctx != NULL &&
+        sess->decr_ctx.cipher_ctx_free_func != NULL)
+        sess->decr_ctx.cipher_ctx_free_func(tokdata, sess,
+                                            sess->decr_ctx.cipher_ctx);
+
     if (sess->digest_ctx.context) {
         if (sess->digest_ctx.context_free_func != NULL)
             sess->digest_ctx.context_free_func(tokdata, sess,
@@ -357,6 +367,11 @@ CK_RV session_mgr_close_session(STDLL_TokData_t *tokdata,
     if (sess->verify_ctx.mech.pParameter)
         free(sess->verify_ctx.mech.pParameter);
 
+    if (sess->msg_encr_ctx.active)
+        encr_mgr_cleanup(tokdata, sess, &sess->msg_encr_ctx);
+    if (sess->msg_decr_ctx.active)
+        decr_mgr_cleanup(tokdata, sess, &sess->msg_decr_ctx);
+
     bt_put_node_value(&tokdata->sess_btree, sess);
     sess = NULL;
     bt_node_free(&tokdata->sess_btree, handle, TRUE);
@@ -417,6 +432,11 @@ void session_free(STDLL_TokData_t *tokdata, void *node_value,
     if (sess->encr_ctx.mech.pParameter)
         free(sess->encr_ctx.mech.pParameter);
 
+    if (sess->encr_ctx.cipher_ctx != NULL &&
+        sess->encr_ctx.cipher_ctx_free_func != NULL)
+        sess->encr_ctx.cipher_ctx_free_func(tokdata, sess,
+                                            sess->encr_ctx.cipher_ctx);
+
     if (sess->decr_ctx.context) {
         if (sess->decr_ctx.context_free_func != NULL)
             sess->decr_ctx.context_free_func(tokdata, sess,
@@ -429,6 +449,11 @@ void session_free(STDLL_TokData_t *tokdata, void *node_value,
     if (sess->decr_ctx.mech.pParameter)
         free(sess->decr_ctx.mech.pParameter);
 
+    if (sess->decr_ctx.cipher_ctx != NULL &&
+        sess->decr_ctx.cipher_ctx_free_func != NULL)
+        sess->decr_ctx.cipher_ctx_free_func(tokdata, sess,
+                                            sess->decr_ctx.cipher_ctx);
+
     if (sess->digest_ctx.context) {
         if (sess->digest_ctx.context_free_func != NULL)
             sess->digest_ctx.context_free_func(tokdata, sess,
@@ -465,6 +490,11 @@ void session_free(STDLL_TokData_t *tokdata, void *node_value,
     if (sess->verify_ctx.mech.pParameter)
         free(sess->verify_ctx.mech.pParameter);
 
+    if (sess->msg_encr_ctx.active)
+        encr_mgr_cleanup(tokdata, sess, &sess->msg_encr_ctx);
+    if (sess->msg_decr_ctx.active)
+        decr_mgr_cleanup(tokdata, sess, &sess->msg_decr_ctx);
+
     /* NB: any access to sess or @node_value after this returns will segfault */
     bt_node_free(&tokdata->sess_btree, node_idx, TRUE);
 }
@@ -591,6 +621,7 @@ CK_RV session_mgr_get_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
                                CK_BYTE *data, CK_ULONG *data_len)
 {
     OP_STATE_DATA *op_data = NULL;
+    ENCR_DECR_CONTEXT saved_ctx;
     CK_ULONG max_data_len = *data_len;
     CK_ULONG op_data_len;
     CK_ULONG all_data_len = 0;
@@ -645,8 +676,12 @@ CK_RV session_mgr_get_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
 
             offset = sizeof(OP_STATE_DATA);
 
+            /* a cached cipher state is not saved, it is set up again */
+            saved_ctx = sess->encr_ctx;
+            saved_ctx.cipher_ctx = NULL;
+            saved_ctx.cipher_ctx_free_func = NULL;
             memcpy((CK_BYTE *) op_data + offset,
-                   &sess->encr_ctx, sizeof(ENCR_DECR_CONTEXT));
+                   &saved_ctx, sizeof(ENCR_DECR_CONTEXT));
 
             offset += sizeof(ENCR_DECR_CONTEXT);
 
@@ -703,8 +738,12 @@ CK_RV session_mgr_get_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
 
             offset = sizeof(OP_STATE_DATA);
 
+            /* a cached cipher state is not saved, it is set up again */
+            saved_ctx = sess->decr_ctx;
+            saved_ctx.cipher_ctx = NULL;
+            saved_ctx.cipher_ctx_free_func = NULL;
             memcpy((CK_BYTE *) op_data + offset,
-                   &sess->decr_ctx, sizeof(ENCR_DECR_CONTEXT));
+                   &saved_ctx, sizeof(ENCR_DECR_CONTEXT));
 
             offset += sizeof(ENCR_DECR_CONTEXT);
 
@@ -910,6 +949,22 @@ CK_RV session_mgr_get_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
 }
 
 
+/*
+ * Lets the token check the context of a saved operation. It comes from the
+ * application's buffer and may have been modified there.
+ */
+static CK_RV session_mgr_check_op_state(STDLL_TokData_t *tokdata,
+                                        CK_ULONG operation,
+                                        CK_MECHANISM_TYPE mech,
+                                        CK_BYTE *context, CK_ULONG context_len)
+{
+    if (token_specific.t_check_op_state == NULL)
+        return CKR_OK;
+
+    return token_specific.t_check_op_state(tokdata, operation, mech,
+                                           context, context_len);
+}
+
 //
 //
 CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
@@ -928,6 +983,7 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
     CK_ULONG len;
     CK_ULONG encr_key_needed = 0;
     CK_ULONG auth_key_needed = 0;
+    CK_RV rc;
 
     if (!sess || !data) {
         TRACE_ERROR("%s received bad argument(s)\n", __func__);
@@ -985,6 +1041,13 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
                     TRACE_ERROR("%s\n", ock_err(ERR_SAVED_STATE_INVALID));
                     return CKR_SAVED_STATE_INVALID;
                 }
+                rc = session_mgr_check_op_state(tokdata,
+                                                op_data->active_operation,
+                                                ctx->mech.mechanism,
+                                                (CK_BYTE *)(ctx + 1),
+                                                ctx->context_len);
+                if (rc != CKR_OK)
+                    return rc;
 
                 encr_key_needed++;
             }
@@ -1002,6 +1065,13 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
                     TRACE_ERROR("%s\n", ock_err(ERR_SAVED_STATE_INVALID));
                     return CKR_SAVED_STATE_INVALID;
                 }
+                rc = session_mgr_check_op_state(tokdata,
+                                                op_data->active_operation,
+                                                ctx->mech.mechanism,
+                                                (CK_BYTE *)(ctx + 1),
+                                                ctx->context_len);
+                if (rc != CKR_OK)
+                    return rc;
 
                 auth_key_needed++;
             }
@@ -1018,6 +1088,13 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
                     TRACE_ERROR("%s\n", ock_err(ERR_SAVED_STATE_INVALID));
                     return CKR_SAVED_STATE_INVALID;
                 }
+                rc = session_mgr_check_op_state(tokdata,
+                                                op_data->active_operation,
+                                                ctx->mech.mechanism,
+                                                (CK_BYTE *)(ctx + 1),
+                                                ctx->context_len);
+                if (rc != CKR_OK)
+                    return rc;
             }
             break;
         default:
@@ -1201,14 +1278,21 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
             return CKR_SAVED_STATE_INVALID;
         }
 
-        /* copy the new state information */
+        /*
+         * copy the new state information. A saveable context is plain
+         * memory that needs no free function, and function pointers from
+         * the saved state must not be used anyway.
+         */
         switch (op_data->active_operation) {
         case STATE_ENCR:
             memcpy(&sess->encr_ctx, ptr1, sizeof(ENCR_DECR_CONTEXT));
 
             sess->encr_ctx.key = encr_key;
             sess->encr_ctx.context = context;
+            sess->encr_ctx.context_free_func = NULL;
             sess->encr_ctx.mech.pParameter = mech_param;
+            sess->encr_ctx.cipher_ctx = NULL;
+            sess->encr_ctx.cipher_ctx_free_func = NULL;
             break;
 
         case STATE_DECR:
@@ -1216,7 +1300,10 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
 
             sess->decr_ctx.key = encr_key;
             sess->decr_ctx.context = context;
+            sess->decr_ctx.context_free_func = NULL;
             sess->decr_ctx.mech.pParameter = mech_param;
+            sess->decr_ctx.cipher_ctx = NULL;
+            sess->decr_ctx.cipher_ctx_free_func = NULL;
             break;
 
         case STATE_SIGN:
@@ -1224,6 +1311,7 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
 
             sess->sign_ctx.key = auth_key;
             sess->sign_ctx.context = context;
+            sess->sign_ctx.context_free_func = NULL;
             sess->sign_ctx.mech.pParameter = mech_param;
             break;
 
@@ -1232,6 +1320,7 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
 
             sess->verify_ctx.key = auth_key;
             sess->verify_ctx.context = context;
+            sess->verify_ctx.context_free_func = NULL;
             sess->verify_ctx.mech.pParameter = mech_param;
             break;
 
@@ -1239,6 +1328,7 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
             memcpy(&sess->digest_ctx, ptr1, sizeof(DIGEST_CONTEXT));
 
             sess->digest_ctx.context = context;
+            sess->digest_ctx.context_free_func = NULL;
             sess->digest_ctx.mech.pParameter = mech_param;
             break;
         }
@@ -1254,33 +1344,79 @@ CK_RV session_mgr_set_op_state(STDLL_TokData_t *tokdata, SESSION *sess,
     return CKR_OK;
 }
 
-CK_RV session_mgr_cancel(STDLL_TokData_t *tokdata, SESSION *sess,
-                         CK_FLAGS flags)
+/*
+ * The op_flags field of a session holds the operations that are currently
+ * running (busy) in the low 32 bits, and the running operations that are to
+ * be canceled in the high 32 bits, so that both are updated together with
+ * a single compare-and-swap. All operation flags are below 1 << 32. A cancel
+ * bit is only set while its operation is busy, and whoever ends the busy state
+ * clears both bits together.
+ */
+#define OPS_BUSY(f)             ((CK_FLAGS)((f) & 0xffffffffULL))
+#define OPS_CANCEL(f)           ((CK_FLAGS)((f) >> 32))
+#define OPS(busy, cancel)       ((uint64_t)(busy) | ((uint64_t)(cancel) << 32))
+
+/* The cancelable operation the current thread is running, if any */
+static __thread SESSION *cancel_sess;
+static __thread CK_FLAGS cancel_op;
+
+/*
+ * Cleans up the contexts of the given operations of the session.
+ * Returns TRUE if any of them was active.
+ */
+static CK_BBOOL session_mgr_cleanup_ops(STDLL_TokData_t *tokdata,
+                                        SESSION *sess, CK_FLAGS flags)
 {
-    if ((flags & CKF_ENCRYPT) && sess->encr_ctx.active)
+    CK_BBOOL active = FALSE;
+
+    if ((flags & CKF_ENCRYPT) && sess->encr_ctx.active) {
         encr_mgr_cleanup(tokdata, sess, &sess->encr_ctx);
+        active = TRUE;
+    }
 
-    if ((flags & CKF_DECRYPT) && sess->decr_ctx.active)
+    if ((flags & CKF_DECRYPT) && sess->decr_ctx.active) {
         decr_mgr_cleanup(tokdata, sess, &sess->decr_ctx);
+        active = TRUE;
+    }
 
-    if ((flags & CKF_DIGEST) && sess->digest_ctx.active)
+    if ((flags & CKF_DIGEST) && sess->digest_ctx.active) {
         digest_mgr_cleanup(tokdata, sess, &sess->digest_ctx);
+        active = TRUE;
+    }
 
     if ((flags & CKF_SIGN) && sess->sign_ctx.active &&
-        !sess->sign_ctx.recover)
+        !sess->sign_ctx.recover) {
         sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
+        active = TRUE;
+    }
 
     if ((flags & CKF_SIGN_RECOVER) && sess->sign_ctx.active &&
-        sess->sign_ctx.recover)
+        sess->sign_ctx.recover) {
         sign_mgr_cleanup(tokdata, sess, &sess->sign_ctx);
+        active = TRUE;
+    }
 
     if ((flags & CKF_VERIFY) && sess->verify_ctx.active &&
-        !sess->verify_ctx.recover)
+        !sess->verify_ctx.recover) {
         verify_mgr_cleanup(tokdata, sess, &sess->verify_ctx);
+        active = TRUE;
+    }
 
     if ((flags & CKF_VERIFY_RECOVER) && sess->verify_ctx.active &&
-        sess->verify_ctx.recover)
+        sess->verify_ctx.recover) {
         verify_mgr_cleanup(tokdata, sess, &sess->verify_ctx);
+        active = TRUE;
+    }
+
+    if ((flags & CKF_MESSAGE_ENCRYPT) && sess->msg_encr_ctx.active) {
+        encr_mgr_cleanup(tokdata, sess, &sess->msg_encr_ctx);
+        active = TRUE;
+    }
+
+    if ((flags & CKF_MESSAGE_DECRYPT) && sess->msg_decr_ctx.active) {
+        decr_mgr_cleanup(tokdata, sess, &sess->msg_decr_ctx);
+        active = TRUE;
+    }
 
     if ((flags & CKF_FIND_OBJECTS) && sess->find_active) {
         if (sess->find_list)
@@ -1289,8 +1425,126 @@ CK_RV session_mgr_cancel(STDLL_TokData_t *tokdata, SESSION *sess,
         sess->find_len = 0;
         sess->find_idx = 0;
         sess->find_active = FALSE;
+        active = TRUE;
     }
 
+    return active;
+}
+
+// session_mgr_op_begin()
+//
+// marks an operation of the session as being in progress in the calling
+// thread. Every call that uses or sets up an operation's context must do so.
+// While the operation is in progress, C_SessionCancel from another thread
+// does not touch its context, but requests the running thread to abort it.
+// Long running calls check that via session_mgr_op_canceled() at suitable
+// points. session_mgr_op_end() must be called when done.
+//
+// Returns:  CKR_OPERATION_ACTIVE if another thread is running the operation
+//           CKR_FUNCTION_CANCELED if C_SessionCancel is cleaning it up
+//
+CK_RV session_mgr_op_begin(SESSION *sess, CK_FLAGS op)
+{
+    uint64_t old, new;
+
+    old = __atomic_load_n(&sess->op_flags, __ATOMIC_RELAXED);
+    do {
+        if (OPS_BUSY(old) & op) {
+            TRACE_ERROR("Operation 0x%lx of session %lu is busy.\n", op,
+                        sess->handle);
+            return (OPS_CANCEL(old) & op) ? CKR_FUNCTION_CANCELED :
+                                            CKR_OPERATION_ACTIVE;
+        }
+        new = old | OPS(op, 0);
+    } while (!__atomic_compare_exchange_n(&sess->op_flags, &old, new, 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    cancel_sess = sess;
+    cancel_op = op;
+
+    return CKR_OK;
+}
+
+// session_mgr_op_end()
+//
+// ends an operation call started by session_mgr_op_begin(). If the operation
+// was canceled while the call was running, and it is still active, its
+// context is cleaned up here.
+//
+// Returns:  CKR_FUNCTION_CANCELED if the operation was canceled while the
+//           call was running and would have continued, otherwise rc
+//
+CK_RV session_mgr_op_end(STDLL_TokData_t *tokdata, SESSION *sess,
+                         CK_FLAGS op, CK_RV rc)
+{
+    uint64_t old;
+
+    cancel_sess = NULL;
+    cancel_op = 0;
+
+    old = __atomic_load_n(&sess->op_flags, __ATOMIC_RELAXED);
+    do {
+        if (OPS_CANCEL(old) & op)
+            break;
+    } while (!__atomic_compare_exchange_n(&sess->op_flags, &old,
+                                          old & ~OPS(op, 0), 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (!(OPS_CANCEL(old) & op))
+        return rc;
+
+    /* The operation stays busy until its context is cleaned up */
+    if (session_mgr_cleanup_ops(tokdata, sess, op)) {
+        TRACE_DEVEL("Operation canceled by C_SessionCancel.\n");
+        if (rc == CKR_OK || rc == CKR_BUFFER_TOO_SMALL)
+            rc = CKR_FUNCTION_CANCELED;
+    }
+
+    __atomic_and_fetch(&sess->op_flags, ~OPS(op, op), __ATOMIC_RELEASE);
+
+    return rc;
+}
+
+// session_mgr_op_canceled()
+//
+// checks if the operation the calling thread is running has been canceled.
+// This is called from long running loops and from OpenSSL callbacks, where
+// the session is not at hand. A cancel request that is missed here is still
+// handled by session_mgr_op_end().
+//
+CK_BBOOL session_mgr_op_canceled(void)
+{
+    if (cancel_sess == NULL)
+        return FALSE;
+
+    return (OPS_CANCEL(__atomic_load_n(&cancel_sess->op_flags,
+                                       __ATOMIC_RELAXED)) & cancel_op) != 0;
+}
+
+CK_RV session_mgr_cancel(STDLL_TokData_t *tokdata, SESSION *sess,
+                         CK_FLAGS flags)
+{
+    /*
+     * Operations running in another thread are only flagged here. That
+     * thread aborts them with CKR_FUNCTION_CANCELED and cleans up their
+     * context itself. The other operations are marked busy and canceled
+     * while their context is cleaned up here, so that no other thread can
+     * start using it meanwhile.
+     */
+    uint64_t old;
+    CK_FLAGS claim;
+
+    old = __atomic_load_n(&sess->op_flags, __ATOMIC_RELAXED);
+    do {
+        claim = flags & ~OPS_BUSY(old);
+    } while (!__atomic_compare_exchange_n(&sess->op_flags, &old,
+                                          old | OPS(claim, flags), 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    session_mgr_cleanup_ops(tokdata, sess, claim);
+
+    __atomic_and_fetch(&sess->op_flags, ~OPS(claim, claim), __ATOMIC_RELEASE);
+
     return CKR_OK;
 }
 
@@ -284,11 +284,12 @@ int sm_open(const char *sm_name, int mode, void **p_addr, size_t len, int force,
         }
 
         /*
-         * Too big real_len indicates the new token data format is used.
-         * If no application is attached to the shm (ref==1) it can be
-         * safely expanded/recreated. Otherwise, fail.
+         * A different real_len indicates a different layout, e.g. the new
+         * token data format, or the token object lists that are no longer
+         * part of the token's shm. If no application is attached to the shm
+         * (ref==1) it can be safely resized/recreated. Otherwise, fail.
          */
-        if (ref <= 1 && real_len > (size_t)stat_buf.st_size) {
+        if (ref <= 1) {
             created = 1;
             TRACE_DEVEL("Truncating \"%s\".\n", name);
             if (ftruncate(fd, real_len) < 0) {
@@ -28,6 +28,7 @@
  */
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -62,6 +63,137 @@ static CK_RV get_unique_id_str(char unique_id_str[2 * UNIQUE_ID_LEN + 1])
     return CKR_OK;
 }
 
+/*
+ * Attribute index
+ *
+ * Each template keeps an open addressed hash table (linear probing) that maps
+ * an attribute type to its node in the attribute list, so that finding an
+ * attribute does not need to walk the list. The table is kept at most half
+ * full. The index is an accelerator only: if it can not be allocated, lookups
+ * fall back to walking the list, and the index is rebuilt the next time an
+ * attribute is added.
+ */
+#define TEMPLATE_INDEX_MIN_SIZE     16  /* must be a power of 2 */
+
+static CK_ULONG template_index_slot(CK_ATTRIBUTE_TYPE type, CK_ULONG size)
+{
+    /* Fibonacci hashing spreads the small, dense attribute type values */
+    return (CK_ULONG)(((uint64_t)type * 0x9E3779B97F4A7C15ULL) >> 32) &
+                                                                (size - 1);
+}
+
+static void template_index_free(TEMPLATE *tmpl)
+{
+    free(tmpl->attribute_index);
+    tmpl->attribute_index = NULL;
+    tmpl->index_size = 0;
+    tmpl->index_count = 0;
+}
+
+static void template_index_put(DL_NODE **index, CK_ULONG size, DL_NODE *node)
+{
+    CK_ULONG i;
+
+    i = template_index_slot(((CK_ATTRIBUTE *)node->data)->type, size);
+    while (index[i] != NULL)
+        i = (i + 1) & (size - 1);
+    index[i] = node;
+}
+
+static void template_index_rebuild(TEMPLATE *tmpl)
+{
+    DL_NODE **index, *node;
+    CK_ULONG size = TEMPLATE_INDEX_MIN_SIZE, count;
+
+    count = dlist_length(tmpl->attribute_list);
+    while (size < 2 * count)
+        size <<= 1;
+
+    index = calloc(size, sizeof(DL_NODE *));
+    if (index == NULL) {
+        /* Lookups fall back to walking the list */
+        template_index_free(tmpl);
+        return;
+    }
+
+    for (node = tmpl->attribute_list; node != NULL; node = node->next)
+        template_index_put(index, size, node);
+
+    free(tmpl->attribute_index);
+    tmpl->attribute_index = index;
+    tmpl->index_size = size;
+    tmpl->index_count = count;
+}
+
+/* Add a node that has just been added to the attribute list to the index */
+static void template_index_add(TEMPLATE *tmpl, DL_NODE *node)
+{
+    if (tmpl->attribute_index == NULL ||
+        2 * (tmpl->index_count + 1) > tmpl->index_size) {
+        template_index_rebuild(tmpl);
+        return;
+    }
+
+    template_index_put(tmpl->attribute_index, tmpl->index_size, node);
+    tmpl->index_count++;
+}
+
+/* Remove the node of an attribute type from the index (backward shift) */
+static void template_index_remove(TEMPLATE *tmpl, CK_ATTRIBUTE_TYPE type)
+{
+    DL_NODE **index = tmpl->attribute_index;
+    CK_ULONG mask = tmpl->index_size - 1;
+    CK_ULONG i, j, k;
+
+    if (index == NULL)
+        return;
+
+    i = template_index_slot(type, tmpl->index_size);
+    while (index[i] != NULL && ((CK_ATTRIBUTE *)index[i]->data)->type != type)
+        i = (i + 1) & mask;
+    if (index[i] == NULL)
+        return;
+
+    index[i] = NULL;
+    tmpl->index_count--;
+
+    /* Move up entries of the probe sequence that would otherwise be lost */
+    for (j = (i + 1) & mask; index[j] != NULL; j = (j + 1) & mask) {
+        k = template_index_slot(((CK_ATTRIBUTE *)index[j]->data)->type,
+                                tmpl->index_size);
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            index[i] = index[j];
+            index[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+/* Find the list node of an attribute type */
+static DL_NODE *template_find_node(TEMPLATE *tmpl, CK_ATTRIBUTE_TYPE type)
+{
+    DL_NODE **index = tmpl->attribute_index;
+    DL_NODE *node;
+    CK_ULONG i;
+
+    if (index != NULL) {
+        i = template_index_slot(type, tmpl->index_size);
+        while ((node = index[i]) != NULL) {
+            if (((CK_ATTRIBUTE *)node->data)->type == type)
+                return node;
+            i = (i + 1) & (tmpl->index_size - 1);
+        }
+        return NULL;
+    }
+
+    for (node = tmpl->attribute_list; node != NULL; node = node->next) {
+        if (((CK_ATTRIBUTE *)node->data)->type == type)
+            return node;
+    }
+
+    return NULL;
+}
+
 /* template_add_attributes()
  *
  * blindly add the given attributes to the template. do no sanity checking
@@ -267,22 +399,14 @@ CK_BBOOL template_attribute_find(TEMPLATE *tmpl, CK_ATTRIBUTE_TYPE type,
                                  CK_ATTRIBUTE **attr)
 {
     DL_NODE *node = NULL;
-    CK_ATTRIBUTE *a = NULL;
 
     if (!tmpl || !attr)
         return FALSE;
 
-    node = tmpl->attribute_list;
-
-    while (node != NULL) {
-        a = (CK_ATTRIBUTE *) node->data;
-
-        if (type == a->type) {
-            *attr = a;
-            return TRUE;
-        }
-
-        node = node->next;
+    node = template_find_node(tmpl, type);
+    if (node != NULL) {
+        *attr = (CK_ATTRIBUTE *) node->data;
+        return TRUE;
     }
 
     *attr = NULL;
@@ -655,6 +779,7 @@ CK_RV template_copy(TEMPLATE *dest, TEMPLATE *src)
             return CKR_HOST_MEMORY;
         }
         dest->attribute_list = list;
+        template_index_add(dest, list);
         node = node->next;
     }
 
@@ -1213,6 +1338,7 @@ CK_RV template_free(TEMPLATE *tmpl)
                                                  tmpl->attribute_list);
     }
 
+    template_index_free(tmpl);
     free(tmpl);
 
     return CKR_OK;
@@ -1270,6 +1396,9 @@ CK_ULONG template_get_count(TEMPLATE *tmpl)
     if (tmpl == NULL)
         return 0;
 
+    if (tmpl->attribute_index != NULL)
+        return tmpl->index_count;
+
     return dlist_length(tmpl->attribute_list);
 }
 
@@ -1622,37 +1751,31 @@ CK_RV template_remove_attribute(TEMPLATE *tmpl, CK_ATTRIBUTE_TYPE type)
 {
     DL_NODE *node = NULL;
     CK_ATTRIBUTE *attr = NULL;
-    CK_BBOOL found = FALSE;
 
     if (!tmpl) {
         TRACE_ERROR("Invalid function arguments.\n");
         return CKR_ARGUMENTS_BAD;
     }
-    node = tmpl->attribute_list;
 
-    while (node != NULL) {
-        attr = (CK_ATTRIBUTE *) node->data;
+    node = template_find_node(tmpl, type);
+    if (node == NULL)
+        return CKR_ATTRIBUTE_TYPE_INVALID;
 
-        if (type == attr->type) {
-            found = TRUE;
-            if (is_attribute_attr_array(attr->type)) {
-                 cleanse_and_free_attribute_array2(
-                                     (CK_ATTRIBUTE_PTR)attr->pValue,
-                                     attr->ulValueLen / sizeof(CK_ATTRIBUTE),
-                                     FALSE);
-            }
-            if (attr->pValue != NULL)
-                OPENSSL_cleanse(attr->pValue, attr->ulValueLen);
-            free(attr);
-            tmpl->attribute_list =
-                dlist_remove_node(tmpl->attribute_list, node);
-            break;
-        }
+    template_index_remove(tmpl, type);
 
-        node = node->next;
+    attr = (CK_ATTRIBUTE *) node->data;
+    if (is_attribute_attr_array(attr->type)) {
+         cleanse_and_free_attribute_array2(
+                             (CK_ATTRIBUTE_PTR)attr->pValue,
+                             attr->ulValueLen / sizeof(CK_ATTRIBUTE),
+                             FALSE);
     }
+    if (attr->pValue != NULL)
+        OPENSSL_cleanse(attr->pValue, attr->ulValueLen);
+    free(attr);
+    tmpl->attribute_list = dlist_remove_node(tmpl->attribute_list, node);
 
-    return found ? CKR_OK : CKR_ATTRIBUTE_TYPE_INVALID;
+    return CKR_OK;
 }
 
 /* template_update_attribute()
@@ -1687,6 +1810,8 @@ CK_RV template_update_attribute(TEMPLATE *tmpl, CK_ATTRIBUTE *new_attr)
     }
 
     tmpl->attribute_list = list;
+    template_index_add(tmpl, list);
+
     return CKR_OK;
 }
 
@@ -326,6 +326,47 @@ struct token_specific_struct {
 
     CK_RV (*t_check_obj_access) (STDLL_TokData_t *tokdata, OBJECT *obj,
                                  CK_BBOOL create);
+
+    // Multi-part AES/DES3 cipher using a cipher state that is kept in
+    // ENCR_DECR_CONTEXT.cipher_ctx for the lifetime of the operation.
+    // The key object is only passed while no cipher state exists yet.
+    CK_RV (*t_cipher_update) (STDLL_TokData_t *tokdata, SESSION *sess,
+                              ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                              CK_BYTE *in_data, CK_ULONG in_data_len,
+                              CK_BYTE *out_data, CK_BYTE encrypt);
+
+    // Message based AES-GCM (C_MessageEncryptInit and friends). The keyed
+    // cipher is set up once by t_aes_gcm_msg_init and kept in
+    // ENCR_DECR_CONTEXT.cipher_ctx, each message only sets IV, AAD and tag.
+    CK_RV (*t_aes_gcm_msg_init) (STDLL_TokData_t *tokdata, SESSION *sess,
+                                 ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                                 CK_BYTE encrypt);
+    CK_RV (*t_aes_gcm_msg_begin) (STDLL_TokData_t *tokdata, SESSION *sess,
+                                  ENCR_DECR_CONTEXT *ctx,
+                                  CK_BYTE *iv, CK_ULONG iv_len,
+                                  CK_BYTE *aad, CK_ULONG aad_len,
+                                  CK_BYTE encrypt);
+    CK_RV (*t_aes_gcm_msg_update) (STDLL_TokData_t *tokdata, SESSION *sess,
+                                   ENCR_DECR_CONTEXT *ctx,
+                                   CK_BYTE *in_data, CK_ULONG in_data_len,
+                                   CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                   CK_BYTE encrypt);
+    CK_RV (*t_aes_gcm_msg_final) (STDLL_TokData_t *tokdata, SESSION *sess,
+                                  ENCR_DECR_CONTEXT *ctx,
+                                  CK_BYTE *tag, CK_ULONG tag_len,
+                                  CK_BYTE encrypt);
+
+    // Single-shot SHA digest without a DIGEST_CONTEXT, used by
+    // C_IBM_DigestBatch. The token may keep per-thread digest state.
+    CK_RV (*t_sha_single) (STDLL_TokData_t *tokdata, CK_MECHANISM *mech,
+                           CK_BYTE *in_data, CK_ULONG in_data_len,
+                           CK_BYTE *out_data, CK_ULONG *out_data_len);
+
+    // Checks the context of an operation (STATE_DIGEST, STATE_SIGN, ...)
+    // restored by C_SetOperationState, before the session takes it over.
+    CK_RV (*t_check_op_state) (STDLL_TokData_t *tokdata, CK_ULONG operation,
+                               CK_MECHANISM_TYPE mech, CK_BYTE *context,
+                               CK_ULONG context_len);
 };
 
 typedef struct token_specific_struct token_spec_t;
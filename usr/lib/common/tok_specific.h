@@ -376,4 +376,40 @@ CK_RV token_specific_handle_event(STDLL_TokData_t *tokdata,
 CK_RV token_specific_check_obj_access(STDLL_TokData_t *tokdata,
                                       OBJECT *obj, CK_BBOOL create);
 
+CK_RV token_specific_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                                   ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                                   CK_BYTE *in_data, CK_ULONG in_data_len,
+                                   CK_BYTE *out_data, CK_BYTE encrypt);
+
+CK_RV token_specific_aes_gcm_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                                      ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                                      CK_BYTE encrypt);
+
+CK_RV token_specific_aes_gcm_msg_begin(STDLL_TokData_t *tokdata, SESSION *sess,
+                                       ENCR_DECR_CONTEXT *ctx,
+                                       CK_BYTE *iv, CK_ULONG iv_len,
+                                       CK_BYTE *aad, CK_ULONG aad_len,
+                                       CK_BYTE encrypt);
+
+CK_RV token_specific_aes_gcm_msg_update(STDLL_TokData_t *tokdata,
+                                        SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                        CK_BYTE *in_data, CK_ULONG in_data_len,
+                                        CK_BYTE *out_data,
+                                        CK_ULONG *out_data_len,
+                                        CK_BYTE encrypt);
+
+CK_RV token_specific_aes_gcm_msg_final(STDLL_TokData_t *tokdata, SESSION *sess,
+                                       ENCR_DECR_CONTEXT *ctx,
+                                       CK_BYTE *tag, CK_ULONG tag_len,
+                                       CK_BYTE encrypt);
+
+CK_RV token_specific_sha_single(STDLL_TokData_t *tokdata, CK_MECHANISM *mech,
+                                CK_BYTE *in_data, CK_ULONG in_data_len,
+                                CK_BYTE *out_data, CK_ULONG *out_data_len);
+
+CK_RV token_specific_check_op_state(STDLL_TokData_t *tokdata,
+                                    CK_ULONG operation,
+                                    CK_MECHANISM_TYPE mech, CK_BYTE *context,
+                                    CK_ULONG context_len);
+
 #endif
@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <grp.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +22,7 @@
 #include <unistd.h>
 #include <sys/file.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #if !defined(_AIX)
     #include <sys/syscall.h>
@@ -46,6 +48,75 @@
 pthread_mutex_t tlmtx = PTHREAD_MUTEX_INITIALIZER;
 struct trace_handle_t trace;
 
+/*
+ * Unless OPENCRYPTOKI_TRACE_SYNC is set, trace messages are not written by the
+ * tracing thread. Each thread formats its messages into its own ring buffer,
+ * and a background writer thread collects the messages of all ring buffers and
+ * writes them with writev(). The API library starts the writer, and passes it
+ * to the tokens with the trace handle, so there is one writer per process.
+ * If a ring buffer is full, messages are dropped and counted, and the number
+ * of dropped messages is written to the trace file. A thread that traces an
+ * error waits until its messages have been written, so that they are not lost
+ * if the process dies right after.
+ */
+#define TRACE_MSG_MAX           1024
+#define TRACE_RING_SIZE         (64 * 1024)
+#define TRACE_MAX_RINGS         256
+#define TRACE_IOV_MAX           64
+#define TRACE_FLUSH_MSEC        100
+#define TRACE_REAP_SEC          1
+
+struct trace_ring {
+    volatile unsigned long head;        /* updated by the owning thread */
+    volatile unsigned long tail;        /* updated by the writer thread */
+    volatile unsigned long dropped;
+    volatile pid_t owner;               /* thread id, 0 if free */
+    char data[TRACE_RING_SIZE];
+};
+
+struct trace_batch {
+    struct iovec iov[TRACE_IOV_MAX];
+    int iovcnt;
+    struct trace_ring *ring[TRACE_IOV_MAX];
+    unsigned long head[TRACE_IOV_MAX];
+    int num_rings;
+    char drop_msg[TRACE_IOV_MAX][64];
+};
+
+struct trace_writer {
+    unsigned long generation;
+    pid_t pid;
+    int fd;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t flushed;             /* signaled after each flush */
+    unsigned long flush_seq;            /* number of flushes done */
+    int flush_req;                      /* flush now, see trace_writer_sync */
+    int stop;
+    time_t last_reap;                   /* used by the writer thread only */
+    volatile unsigned long num_rings;
+    struct trace_ring *rings[TRACE_MAX_RINGS];
+    struct trace_batch batch;           /* used by the writer thread only */
+};
+
+static unsigned long trace_generation;
+static int trace_atexit_registered;
+
+/*
+ * Cache of the ring buffer of the thread in the writer with the generation
+ * stored along with it. The API library and each token have their own copy of
+ * these variables, but the writer has only one ring buffer per thread. A
+ * thread gets a new ring buffer when tracing was re-initialized, e.g. in a
+ * forked child.
+ */
+static __thread struct trace_ring *trace_tls_ring;
+static __thread unsigned long trace_tls_generation;
+static __thread pid_t trace_tls_tid;
+static __thread time_t trace_tls_time = (time_t)-1;
+static __thread char trace_tls_timestamp[32];
+static __thread size_t trace_tls_timestamp_len;
+
 static const char *ock_err_msg[] = {
     "Malloc Failed",            /*ERR_HOST_MEMORY */
     "Slot Invalid",             /*ERR_SLOT_ID_INVALID */
@@ -133,10 +204,326 @@ void set_trace(struct trace_handle_t t_handle)
 {
     trace.fd = t_handle.fd;
     trace.level = t_handle.level;
+    trace.writer = t_handle.writer;
+}
+
+static void trace_batch_write(struct trace_writer *w, struct trace_batch *b)
+{
+    int i;
+
+    if (b->iovcnt > 0 && writev(w->fd, b->iov, b->iovcnt) == -1)
+        fprintf(stderr, "cannot write to trace file\n");
+
+    /* The messages must have been written before the space is reused */
+    __sync_synchronize();
+    for (i = 0; i < b->num_rings; i++)
+        b->ring[i]->tail = b->head[i];
+
+    b->iovcnt = 0;
+    b->num_rings = 0;
+}
+
+static void trace_writer_flush(struct trace_writer *w)
+{
+    struct trace_batch *b = &w->batch;
+    struct trace_ring *r;
+    unsigned long i, num_rings, head, tail, dropped, ofs, len;
+    char *msg;
+
+    num_rings = w->num_rings;
+    __sync_synchronize();
+
+    for (i = 0; i < num_rings; i++) {
+        r = w->rings[i];
+
+        head = r->head;
+        __sync_synchronize();
+        tail = r->tail;
+        dropped = r->dropped;
+        if (head == tail && dropped == 0)
+            continue;
+
+        if (b->iovcnt + 3 > TRACE_IOV_MAX)
+            trace_batch_write(w, b);
+
+        if (head != tail) {
+            ofs = tail % TRACE_RING_SIZE;
+            len = head - tail;
+            if (ofs + len > TRACE_RING_SIZE) {
+                b->iov[b->iovcnt].iov_base = &r->data[ofs];
+                b->iov[b->iovcnt++].iov_len = TRACE_RING_SIZE - ofs;
+                len -= TRACE_RING_SIZE - ofs;
+                ofs = 0;
+            }
+            b->iov[b->iovcnt].iov_base = &r->data[ofs];
+            b->iov[b->iovcnt++].iov_len = len;
+        }
+
+        if (dropped != 0) {
+            __sync_sub_and_fetch(&r->dropped, dropped);
+            msg = b->drop_msg[b->num_rings];
+            b->iov[b->iovcnt].iov_base = msg;
+            b->iov[b->iovcnt++].iov_len =
+                snprintf(msg, sizeof(b->drop_msg[0]),
+                         "**** %lu trace messages dropped ****\n", dropped);
+        }
+
+        b->ring[b->num_rings] = r;
+        b->head[b->num_rings++] = head;
+    }
+
+    trace_batch_write(w, b);
+}
+
+/*
+ * Frees the ring buffers of threads that have exited, so that they can be
+ * reused by new threads. A ring is only freed when all its messages have
+ * been written.
+ */
+static void trace_writer_reap(struct trace_writer *w)
+{
+#if defined(SYS_tgkill)
+    struct trace_ring *r;
+    unsigned long i;
+    time_t now;
+
+    now = time(NULL);
+    if (now - w->last_reap < TRACE_REAP_SEC)
+        return;
+    w->last_reap = now;
+
+    pthread_mutex_lock(&w->mutex);
+    for (i = 0; i < w->num_rings; i++) {
+        r = w->rings[i];
+        if (r->owner == 0 || r->head != r->tail || r->dropped != 0)
+            continue;
+        if (syscall(SYS_tgkill, w->pid, r->owner, 0) == -1 && errno == ESRCH)
+            r->owner = 0;
+    }
+    pthread_mutex_unlock(&w->mutex);
+#else
+    UNUSED(w);
+#endif
+}
+
+static void *trace_writer_thread(void *arg)
+{
+    struct trace_writer *w = arg;
+    struct timespec ts;
+    int stop;
+
+    do {
+        pthread_mutex_lock(&w->mutex);
+        if (!w->stop && !w->flush_req) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += TRACE_FLUSH_MSEC * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&w->cond, &w->mutex, &ts);
+        }
+        w->flush_req = 0;
+        stop = w->stop;
+        pthread_mutex_unlock(&w->mutex);
+
+        trace_writer_flush(w);
+
+        pthread_mutex_lock(&w->mutex);
+        w->flush_seq++;
+        pthread_cond_broadcast(&w->flushed);
+        pthread_mutex_unlock(&w->mutex);
+
+        trace_writer_reap(w);
+    } while (!stop);
+
+    return NULL;
+}
+
+static struct trace_writer *trace_writer_start(int fd)
+{
+    struct trace_writer *w;
+    sigset_t all, old;
+    int rc;
+
+    w = calloc(1, sizeof(*w));
+    if (w == NULL)
+        return NULL;
+
+    w->generation = ++trace_generation;
+    w->pid = getpid();
+    w->fd = fd;
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    pthread_cond_init(&w->flushed, NULL);
+
+    /* The writer thread must not handle any of the application's signals */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    rc = pthread_create(&w->thread, NULL, trace_writer_thread, w);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc != 0) {
+        pthread_cond_destroy(&w->flushed);
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->mutex);
+        free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+static void trace_writer_stop(struct trace_writer *w)
+{
+    unsigned long i;
+
+    /*
+     * In a forked child, the writer thread does not exist, and the messages
+     * still buffered belong to the parent, which writes them itself. The
+     * mutex might have been held by another thread at fork time, so it is
+     * not used. The tokens still have the old writer in their trace handle
+     * until C_Finalize passes them the new one, and may trace until then
+     * (see ock_traceit). So the writer is left as it is, not freed.
+     */
+    if (w->pid != getpid())
+        return;
+
+    pthread_mutex_lock(&w->mutex);
+    w->stop = 1;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+
+    /* The writer thread writes all buffered messages before it ends */
+    pthread_join(w->thread, NULL);
+
+    pthread_cond_destroy(&w->flushed);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->mutex);
+
+    for (i = 0; i < w->num_rings; i++)
+        free(w->rings[i]);
+    free(w);
+}
+
+/*
+ * Waits until the writer thread has written all messages that were buffered
+ * when this was called. The flush that is running when this is called might
+ * have missed them, the one after it has not.
+ */
+static void trace_writer_sync(struct trace_writer *w)
+{
+    unsigned long target;
+
+    pthread_mutex_lock(&w->mutex);
+    target = w->flush_seq + 2;
+    w->flush_req = 1;
+    pthread_cond_signal(&w->cond);
+    while (!w->stop && w->flush_seq < target)
+        pthread_cond_wait(&w->flushed, &w->mutex);
+    pthread_mutex_unlock(&w->mutex);
+}
+
+/*
+ * Writes the buffered messages when the process exits without C_Finalize,
+ * e.g. when C_Initialize failed. Messages of threads that are still running
+ * afterwards are not waited for.
+ */
+static void trace_atexit(void)
+{
+    struct trace_writer *w = trace.writer;
+
+    if (w != NULL && w->pid == getpid())
+        trace_writer_sync(w);
+}
+
+/*
+ * Returns the ring buffer of the calling thread, or NULL if the thread has
+ * none and no more can be allocated. The thread's messages are then written
+ * synchronously.
+ */
+static struct trace_ring *trace_get_ring(struct trace_writer *w)
+{
+    struct trace_ring *r = NULL;
+    unsigned long i;
+    pid_t tid;
+
+    if (trace_tls_generation == w->generation)
+        return trace_tls_ring;
+
+    tid = (pid_t)__gettid();
+
+    pthread_mutex_lock(&w->mutex);
+    /*
+     * Use the ring the thread already got in another library, so that all its
+     * messages are written in the order they were traced.
+     */
+    for (i = 0; i < w->num_rings; i++) {
+        if (w->rings[i]->owner == tid) {
+            r = w->rings[i];
+            break;
+        }
+    }
+    /* Reuse the ring of a thread that has exited */
+    for (i = 0; r == NULL && i < w->num_rings; i++) {
+        if (w->rings[i]->owner == 0) {
+            r = w->rings[i];
+            r->owner = tid;
+        }
+    }
+    if (r == NULL && w->num_rings < TRACE_MAX_RINGS) {
+        r = calloc(1, sizeof(*r));
+        if (r != NULL) {
+            r->owner = tid;
+            w->rings[w->num_rings] = r;
+            __sync_synchronize();
+            w->num_rings++;
+        }
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    trace_tls_ring = r;
+    trace_tls_generation = w->generation;
+    trace_tls_tid = tid;
+
+    return r;
+}
+
+static void trace_enqueue(struct trace_writer *w, struct trace_ring *r,
+                          const char *msg, unsigned long len)
+{
+    unsigned long head, used, ofs, n;
+
+    head = r->head;
+    used = head - r->tail;
+    if (TRACE_RING_SIZE - used < len) {
+        __sync_add_and_fetch(&r->dropped, 1);
+        pthread_cond_signal(&w->cond);
+        return;
+    }
+
+    ofs = head % TRACE_RING_SIZE;
+    n = TRACE_RING_SIZE - ofs < len ? TRACE_RING_SIZE - ofs : len;
+    memcpy(&r->data[ofs], msg, n);
+    if (n < len)
+        memcpy(r->data, msg + n, len - n);
+
+    /* The message must be complete before the writer can see it */
+    __sync_synchronize();
+    r->head = head + len;
+
+    if (used + len > TRACE_RING_SIZE / 2)
+        pthread_cond_signal(&w->cond);
 }
 
 void trace_finalize(void)
 {
+    struct trace_writer *w = trace.writer;
+
+    trace.writer = NULL;
+    if (w != NULL)
+        trace_writer_stop(w);
+
     if (trace.fd >= 0)
         close(trace.fd);
     trace.fd = -1;
@@ -154,6 +541,7 @@ CK_RV trace_initialize(void)
     /* initialize the trace values */
     trace.level = TRACE_LEVEL_NONE;
     trace.fd = -1;
+    trace.writer = NULL;
 
     opt = getenv("OPENCRYPTOKI_TRACE_LEVEL");
     if (!opt)
@@ -213,6 +601,15 @@ CK_RV trace_initialize(void)
         goto error;
     }
 
+    if (getenv("OPENCRYPTOKI_TRACE_SYNC") == NULL) {
+        trace.writer = trace_writer_start(trace.fd);
+        if (trace.writer == NULL)
+            OCK_SYSLOG(LOG_WARNING, "Failed to start the trace writer thread, "
+                       "tracing synchronously.\n");
+        else if (!trace_atexit_registered && atexit(trace_atexit) == 0)
+            trace_atexit_registered = 1;
+    }
+
 #ifdef PACKAGE_VERSION
     TRACE_ERROR("**** OCK Trace level %d activated for OCK version %s ****\n",
                 trace.level, PACKAGE_VERSION);
@@ -232,9 +629,11 @@ void ock_traceit(trace_level_t level, const char *file, int line,
 {
     va_list ap;
     time_t t;
-    struct tm *tm;
+    struct tm tm;
     const char *fmt_pre;
-    char buf[1024];
+    struct trace_writer *w = trace.writer;
+    struct trace_ring *r = NULL;
+    char buf[TRACE_MSG_MAX];
     char *pbuf;
     int buflen, len;
 #ifdef __gettid
@@ -247,19 +646,33 @@ void ock_traceit(trace_level_t level, const char *file, int line,
     if (level > trace.level)
         return;
 
+    /*
+     * The writer of the parent process is still known to the tokens in a
+     * forked child until C_Finalize. It has no writer thread here, so
+     * write synchronously.
+     */
+    if (w != NULL && w->pid == getpid())
+        r = trace_get_ring(w);
+
     pbuf = buf;
     buflen = sizeof(buf);
 
-    /* add the current time */
+    /* add the current time, formatted only once per second and thread */
     t = time(0);
-    tm = localtime(&t);
-    len = strftime(pbuf, buflen, "%m/%d/%Y %H:%M:%S ", tm);
-    pbuf += len;
-    buflen -= len;
+    if (t != trace_tls_time) {
+        localtime_r(&t, &tm);
+        trace_tls_timestamp_len = strftime(trace_tls_timestamp,
+                                           sizeof(trace_tls_timestamp),
+                                           "%m/%d/%Y %H:%M:%S ", &tm);
+        trace_tls_time = t;
+    }
+    memcpy(pbuf, trace_tls_timestamp, trace_tls_timestamp_len);
+    pbuf += trace_tls_timestamp_len;
+    buflen -= trace_tls_timestamp_len;
 
 #ifdef __gettid
     /* add thread id */
-    tid = __gettid();
+    tid = r != NULL ? trace_tls_tid : (pid_t)__gettid();
     len = snprintf(pbuf, buflen, "%u ", (unsigned int) tid);
     pbuf += len;
     buflen -= len;
@@ -286,19 +699,32 @@ void ock_traceit(trace_level_t level, const char *file, int line,
         fmt_pre = "[%s:%d %s] ERROR: ";
         break;
     }
-    snprintf(pbuf, buflen, fmt_pre, file, line, stdll_name);
+    len = snprintf(pbuf, buflen, fmt_pre, file, line, stdll_name);
+    if (len >= buflen)
+        len = buflen - 1;
+    pbuf += len;
+    buflen -= len;
 
     /* add the format */
-    len = strlen(buf);
-    pbuf = buf + len;
-    buflen = sizeof(buf) - len;
     va_start(ap, fmt);
-    vsnprintf(pbuf, buflen, fmt, ap);
+    len = vsnprintf(pbuf, buflen, fmt, ap);
     va_end(ap);
+    if (len < 0)
+        len = 0;
+    if (len >= buflen)
+        len = buflen - 1;
+    len = (pbuf - buf) + len;
+
+    if (r != NULL) {
+        trace_enqueue(w, r, buf, len);
+        if (level == TRACE_LEVEL_ERROR)
+            trace_writer_sync(w);
+        return;
+    }
 
     /* serialize appends to the file */
     pthread_mutex_lock(&tlmtx);
-    if (write(trace.fd, buf, strlen(buf)) == -1)
+    if (write(trace.fd, buf, len) == -1)
         fprintf(stderr, "cannot write to trace file\n");
     pthread_mutex_unlock(&tlmtx);
 }
@@ -116,10 +116,22 @@ typedef enum {
 } trace_level_t;
 
 
+/*
+ * Trace messages with a level above this are not compiled in at all, e.g.
+ * build with CFLAGS=-DOCK_TRACE_MAX_LEVEL=TRACE_LEVEL_ERROR to keep only the
+ * error messages.
+ */
+#ifndef OCK_TRACE_MAX_LEVEL
+#define OCK_TRACE_MAX_LEVEL TRACE_LEVEL_DEBUG
+#endif
+
+struct trace_writer;
+
 /* Encapsulate all trace variables */
 struct trace_handle_t {
     int fd;                     /* file descriptor for filename */
     trace_level_t level;        /* trace level */
+    struct trace_writer *writer; /* background writer, NULL if synchronous */
 };
 
 extern struct trace_handle_t trace;
@@ -133,24 +145,29 @@ void ock_traceit(trace_level_t level, const char *file, int line,
 const char *ock_err(int num);
 
 
-#define TRACE_ERROR(...)						\
-    ock_traceit(TRACE_LEVEL_ERROR, __FILE__, __LINE__, STDLL_NAME, __VA_ARGS__)
+/*
+ * The level is checked before calling ock_traceit(), so that the arguments
+ * are not evaluated and the message is not formatted for disabled levels.
+ */
+#define OCK_TRACE(lvl, ...)						\
+    do {								\
+        if ((lvl) <= OCK_TRACE_MAX_LEVEL && (lvl) <= trace.level)	\
+            ock_traceit((lvl), __FILE__, __LINE__, STDLL_NAME,		\
+                        __VA_ARGS__);					\
+    } while (0)
+
+#define TRACE_ERROR(...)	OCK_TRACE(TRACE_LEVEL_ERROR, __VA_ARGS__)
 
-#define TRACE_WARNING(...)						\
-    ock_traceit(TRACE_LEVEL_WARNING, __FILE__, __LINE__, STDLL_NAME,	\
-                __VA_ARGS__)
+#define TRACE_WARNING(...)	OCK_TRACE(TRACE_LEVEL_WARNING, __VA_ARGS__)
 
-#define TRACE_INFO(...)							\
-    ock_traceit(TRACE_LEVEL_INFO, __FILE__, __LINE__, STDLL_NAME, __VA_ARGS__)
+#define TRACE_INFO(...)		OCK_TRACE(TRACE_LEVEL_INFO, __VA_ARGS__)
 
-#define TRACE_DEVEL(...)						\
-    ock_traceit(TRACE_LEVEL_DEVEL, __FILE__, __LINE__, STDLL_NAME, __VA_ARGS__)
+#define TRACE_DEVEL(...)	OCK_TRACE(TRACE_LEVEL_DEVEL, __VA_ARGS__)
 
 #ifdef DEBUG
-#define TRACE_DEBUG(...)						\
-    ock_traceit(TRACE_LEVEL_DEBUG, __FILE__, __LINE__, STDLL_NAME, __VA_ARGS__)
+#define TRACE_DEBUG(...)	OCK_TRACE(TRACE_LEVEL_DEBUG, __VA_ARGS__)
 
-void dump_shm(LW_SHM_TYPE *, const char *);
+void dump_shm(STDLL_TokData_t *, const char *);
 #define DUMP_SHM(x,y) dump_shm(x,y)
 #else
 #define TRACE_DEBUG(...)
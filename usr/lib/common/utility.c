@@ -593,6 +593,177 @@ CK_RV parity_is_odd(CK_BYTE b)
         return FALSE;
 }
 
+static CK_RV tok_obj_table_name(STDLL_TokData_t *tokdata, CK_ULONG_32 gen,
+                                char *buf, size_t len)
+{
+    char pk_dir[PATH_MAX];
+
+    if (get_pk_dir(tokdata, pk_dir, PATH_MAX) == NULL ||
+        ock_snprintf(buf, len, "%s/tok_obj_table.%u", pk_dir, gen) != 0) {
+        TRACE_ERROR("token object table name too long\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return CKR_OK;
+}
+
+/*
+ * Creates (or re-initializes a left over) SHM segment for generation gen of
+ * the token object table. The caller must hold the XProcLock.
+ */
+CK_RV tok_obj_table_create(STDLL_TokData_t *tokdata, CK_ULONG_32 gen,
+                           CK_ULONG_32 capacity, struct tok_obj_table **table)
+{
+    char buf[PATH_MAX];
+    CK_RV rc;
+    int ret;
+
+    rc = tok_obj_table_name(tokdata, gen, buf, sizeof(buf));
+    if (rc != CKR_OK)
+        return rc;
+
+    ret = sm_open(buf, 0660, (void **) table, TOK_OBJ_TABLE_SIZE(capacity), 1,
+                  tokdata->tokgroup);
+    if (ret < 0) {
+        TRACE_ERROR("sm_open failed for the token object table.\n");
+        return CKR_HOST_MEMORY;
+    }
+    if (ret > 0)
+        memset(*table, 0, TOK_OBJ_TABLE_SIZE(capacity));
+
+    (*table)->gen = gen;
+    (*table)->capacity = capacity;
+    (*table)->hash_size = 2 * capacity;
+
+    return CKR_OK;
+}
+
+/*
+ * Makes table the current token object table of this process. The previous
+ * one stays mapped until detach_shm(), since other threads may still read it
+ * without holding the XProcLock (see object_mgr_check_shm).
+ */
+CK_RV tok_obj_table_install(STDLL_TokData_t *tokdata,
+                            struct tok_obj_table *table)
+{
+    struct tok_obj_table **retired;
+
+    if (tokdata->tok_obj_table != NULL) {
+        retired = realloc(tokdata->tok_obj_table_retired,
+                          (tokdata->tok_obj_table_num_retired + 1) *
+                          sizeof(*retired));
+        if (retired == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            sm_close(table, 0, 0);
+            return CKR_HOST_MEMORY;
+        }
+        retired[tokdata->tok_obj_table_num_retired++] = tokdata->tok_obj_table;
+        tokdata->tok_obj_table_retired = retired;
+    }
+
+    __atomic_store_n(&tokdata->tok_obj_table, table, __ATOMIC_RELEASE);
+
+    return CKR_OK;
+}
+
+/*
+ * Maps the current token object table if another process has replaced it.
+ * The caller must hold the XProcLock.
+ */
+CK_RV tok_obj_table_sync(STDLL_TokData_t *tokdata)
+{
+    LW_SHM_TYPE *shm = tokdata->global_shm;
+    struct tok_obj_table *table = tokdata->tok_obj_table;
+    char buf[PATH_MAX];
+    CK_RV rc;
+    int ret;
+
+    if (table != NULL && table->gen == shm->tok_obj_table_gen)
+        return CKR_OK;
+
+    rc = tok_obj_table_name(tokdata, shm->tok_obj_table_gen, buf, sizeof(buf));
+    if (rc != CKR_OK)
+        return rc;
+
+    ret = sm_open(buf, 0660, (void **) &table,
+                  TOK_OBJ_TABLE_SIZE(shm->tok_obj_capacity), 0,
+                  tokdata->tokgroup);
+    if (ret < 0) {
+        TRACE_ERROR("sm_open failed for the token object table.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (ret == 0 || table->gen != shm->tok_obj_table_gen) {
+        TRACE_ERROR("Token object table %u does not exist.\n",
+                    shm->tok_obj_table_gen);
+        sm_close(table, 1, 0);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return tok_obj_table_install(tokdata, table);
+}
+
+static CK_RV attach_tok_obj_table(STDLL_TokData_t *tokdata)
+{
+    LW_SHM_TYPE *shm = tokdata->global_shm;
+    struct tok_obj_table *table;
+    CK_RV rc;
+
+    rc = XProcLock(tokdata);
+    if (rc != CKR_OK)
+        return rc;
+
+    switch (shm->tok_obj_layout) {
+    case 0:
+        /* Newly created shared memory, set up an empty object table */
+        rc = tok_obj_table_create(tokdata, shm->tok_obj_table_gen + 1,
+                                  TOK_OBJ_TABLE_INIT_CAPACITY, &table);
+        if (rc != CKR_OK)
+            break;
+        rc = tok_obj_table_install(tokdata, table);
+        if (rc != CKR_OK)
+            break;
+        shm->tok_obj_table_gen = table->gen;
+        shm->tok_obj_capacity = table->capacity;
+        shm->tok_obj_layout = TOK_OBJ_SHM_LAYOUT;
+        break;
+    case TOK_OBJ_SHM_LAYOUT:
+        rc = tok_obj_table_sync(tokdata);
+        break;
+    default:
+        TRACE_ERROR("Unsupported token object layout %u in shared memory.\n",
+                    shm->tok_obj_layout);
+        OCK_SYSLOG(LOG_ERR, "Slot %lu: Unsupported token object layout %u in "
+                   "shared memory, it is used by a different version of "
+                   "opencryptoki\n", tokdata->slot_id, shm->tok_obj_layout);
+        rc = CKR_FUNCTION_FAILED;
+        break;
+    }
+
+    if (rc == CKR_OK)
+        rc = XProcUnLock(tokdata);
+    else
+        XProcUnLock(tokdata);
+
+    return rc;
+}
+
+static void detach_tok_obj_table(STDLL_TokData_t *tokdata,
+                                 CK_BBOOL ignore_ref_count)
+{
+    unsigned int i;
+
+    /* The last user of an outdated table removes it */
+    for (i = 0; i < tokdata->tok_obj_table_num_retired; i++)
+        sm_close(tokdata->tok_obj_table_retired[i], 1, ignore_ref_count);
+    free(tokdata->tok_obj_table_retired);
+    tokdata->tok_obj_table_retired = NULL;
+    tokdata->tok_obj_table_num_retired = 0;
+
+    if (tokdata->tok_obj_table != NULL)
+        sm_close(tokdata->tok_obj_table, 0, ignore_ref_count);
+    tokdata->tok_obj_table = NULL;
+}
+
 CK_RV attach_shm(STDLL_TokData_t *tokdata, CK_SLOT_ID slot_id)
 {
     CK_RV rc;
@@ -600,8 +771,12 @@ CK_RV attach_shm(STDLL_TokData_t *tokdata, CK_SLOT_ID slot_id)
     char buf[PATH_MAX];
     LW_SHM_TYPE **shm = &tokdata->global_shm;
 
-    if (token_specific.t_attach_shm != NULL)
-        return token_specific.t_attach_shm(tokdata, slot_id);
+    if (token_specific.t_attach_shm != NULL) {
+        rc = token_specific.t_attach_shm(tokdata, slot_id);
+        if (rc != CKR_OK)
+            return rc;
+        goto tok_obj_table;
+    }
 
     rc = XProcLock(tokdata);
     if (rc != CKR_OK)
@@ -625,7 +800,19 @@ CK_RV attach_shm(STDLL_TokData_t *tokdata, CK_SLOT_ID slot_id)
         goto err;
     }
 
-    return XProcUnLock(tokdata);
+    rc = XProcUnLock(tokdata);
+    if (rc != CKR_OK)
+        return rc;
+
+tok_obj_table:
+    rc = attach_tok_obj_table(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("attach_tok_obj_table failed.\n");
+        detach_tok_obj_table(tokdata, FALSE);
+        sm_close((void *) tokdata->global_shm, 0, 0);
+    }
+
+    return rc;
 
 err:
     XProcUnLock(tokdata);
@@ -640,6 +827,8 @@ CK_RV detach_shm(STDLL_TokData_t *tokdata, CK_BBOOL ignore_ref_count)
     if (rc != CKR_OK)
         return rc;
 
+    detach_tok_obj_table(tokdata, ignore_ref_count);
+
     if (sm_close((void *) tokdata->global_shm, 0, ignore_ref_count)) {
         TRACE_DEVEL("sm_close failed.\n");
         rc = CKR_FUNCTION_FAILED;
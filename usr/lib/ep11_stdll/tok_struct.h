@@ -160,6 +160,13 @@ token_spec_t token_specific = {
     &token_specific_set_attrs_for_new_object,
     &token_specific_handle_event,
     &token_specific_check_obj_access,
+    NULL,                       // cipher_update
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg_begin
+    NULL,                       // aes_gcm_msg_update
+    NULL,                       // aes_gcm_msg_final
+    NULL,                       // sha_single
+    NULL,                       // check_op_state
 };
 
 #endif
@@ -125,6 +125,13 @@ CK_RV ST_Initialize(API_Slot_t *sltp, CK_SLOT_ID SlotNumber,
         goto done;
     }
 
+    sltp->TokData->objstore = sinfp->objstore;
+    if (sinfp->objstore == OBJSTORE_LOG && !newdatastore) {
+        TRACE_ERROR("objstore = log requires tokversion 3.12 or later.\n");
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
     /* Initialize Lock */
     if (XProcLock_Init(sltp->TokData) != CKR_OK) {
         TRACE_ERROR("Thread lock failed.\n");
@@ -161,6 +168,7 @@ CK_RV ST_Initialize(API_Slot_t *sltp, CK_SLOT_ID SlotNumber,
             TRACE_DEVEL("Token Specific Init failed.\n");
             goto done;
         }
+        openssl_cache_init();
         sltp->TokData->initialized = TRUE;
     }
 
@@ -244,6 +252,7 @@ CK_RV SC_Finalize(STDLL_TokData_t *tokdata, CK_SLOT_ID sid, SLOT_INFO *sinfp,
     detach_shm(tokdata, in_fork_initializer);
     /* close spin lock file */
     CloseXProcLock(tokdata);
+    openssl_cache_final();
 
     rc = icsftok_final(tokdata, TRUE, in_fork_initializer);
     if (rc != CKR_OK) {
@@ -3386,6 +3395,359 @@ done:
     return rc;
 }
 
+CK_RV SC_MessageEncryptInit(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    UNUSED(sSession);
+    UNUSED(pMechanism);
+    UNUSED(hKey);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV SC_EncryptMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                        CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                        CK_BYTE_PTR pAssociatedData,
+                        CK_ULONG ulAssociatedDataLen,
+                        CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen,
+                        CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen)
+{
+    UNUSED(sSession);
+    UNUSED(pParameter);
+    UNUSED(ulParameterLen);
+    UNUSED(pAssociatedData);
+    UNUSED(ulAssociatedDataLen);
+    UNUSED(pPlaintext);
+    UNUSED(ulPlaintextLen);
+    UNUSED(pCiphertext);
+    UNUSED(pulCiphertextLen);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_EncryptMessageBegin(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession,
+                             CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                             CK_BYTE_PTR pAssociatedData,
+                             CK_ULONG ulAssociatedDataLen)
+{
+    UNUSED(sSession);
+    UNUSED(pParameter);
+    UNUSED(ulParameterLen);
+    UNUSED(pAssociatedData);
+    UNUSED(ulAssociatedDataLen);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_EncryptMessageNext(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                            CK_BYTE_PTR pPlaintextPart,
+                            CK_ULONG ulPlaintextPartLen,
+                            CK_BYTE_PTR pCiphertextPart,
+                            CK_ULONG_PTR pulCiphertextPartLen, CK_FLAGS flags)
+{
+    UNUSED(sSession);
+    UNUSED(pParameter);
+    UNUSED(ulParameterLen);
+    UNUSED(pPlaintextPart);
+    UNUSED(ulPlaintextPartLen);
+    UNUSED(pCiphertextPart);
+    UNUSED(pulCiphertextPartLen);
+    UNUSED(flags);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_MessageEncryptFinal(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession)
+{
+    UNUSED(sSession);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_MessageDecryptInit(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    UNUSED(sSession);
+    UNUSED(pMechanism);
+    UNUSED(hKey);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV SC_DecryptMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                        CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                        CK_BYTE_PTR pAssociatedData,
+                        CK_ULONG ulAssociatedDataLen,
+                        CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen,
+                        CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen)
+{
+    UNUSED(sSession);
+    UNUSED(pParameter);
+    UNUSED(ulParameterLen);
+    UNUSED(pAssociatedData);
+    UNUSED(ulAssociatedDataLen);
+    UNUSED(pCiphertext);
+    UNUSED(ulCiphertextLen);
+    UNUSED(pPlaintext);
+    UNUSED(pulPlaintextLen);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_DecryptMessageBegin(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession,
+                             CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                             CK_BYTE_PTR pAssociatedData,
+                             CK_ULONG ulAssociatedDataLen)
+{
+    UNUSED(sSession);
+    UNUSED(pParameter);
+    UNUSED(ulParameterLen);
+    UNUSED(pAssociatedData);
+    UNUSED(ulAssociatedDataLen);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_DecryptMessageNext(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                            CK_BYTE_PTR pCiphertextPart,
+                            CK_ULONG ulCiphertextPartLen,
+                            CK_BYTE_PTR pPlaintextPart,
+                            CK_ULONG_PTR pulPlaintextPartLen, CK_FLAGS flags)
+{
+    UNUSED(sSession);
+    UNUSED(pParameter);
+    UNUSED(ulParameterLen);
+    UNUSED(pCiphertextPart);
+    UNUSED(ulCiphertextPartLen);
+    UNUSED(pPlaintextPart);
+    UNUSED(pulPlaintextPartLen);
+    UNUSED(flags);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_MessageDecryptFinal(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession)
+{
+    UNUSED(sSession);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+    return CKR_OPERATION_NOT_INITIALIZED;
+}
+
+CK_RV SC_IBM_SignBatch(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
+                       CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey,
+                       CK_IBM_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    UNUSED(hKey);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism || (!pItems && ulCount > 0)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+    rc = CKR_FUNCTION_NOT_SUPPORTED;
+
+done:
+    TRACE_INFO("SC_IBM_SignBatch: rc = 0x%08lx, sess = %ld, mech = 0x%lx, "
+               "count = %lu\n", rc,
+               (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1), ulCount);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_IBM_VerifyBatch(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
+                         CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey,
+                         CK_IBM_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    UNUSED(hKey);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism || (!pItems && ulCount > 0)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+    rc = CKR_FUNCTION_NOT_SUPPORTED;
+
+done:
+    TRACE_INFO("SC_IBM_VerifyBatch: rc = 0x%08lx, sess = %ld, mech = 0x%lx, "
+               "count = %lu\n", rc,
+               (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1), ulCount);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_IBM_DigestBatch(STDLL_TokData_t *tokdata, CK_MECHANISM_PTR pMechanism,
+                         CK_IBM_DIGEST_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism || (!pItems && ulCount > 0)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+    rc = CKR_FUNCTION_NOT_SUPPORTED;
+
+done:
+    TRACE_INFO("SC_IBM_DigestBatch: rc = 0x%08lx, mech = 0x%lx, count = %lu\n",
+               rc, (pMechanism ? pMechanism->mechanism : (CK_ULONG)-1),
+               ulCount);
+
+    return rc;
+}
+
+CK_RV SC_IBM_GenerateRandom(STDLL_TokData_t *tokdata, CK_BYTE_PTR pRandomData,
+                            CK_ULONG ulRandomLen)
+{
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pRandomData && ulRandomLen != 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (ulRandomLen == 0)
+        goto done;
+
+    rc = rng_generate(tokdata, pRandomData, ulRandomLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("rng_generate() failed.\n");
+
+done:
+    TRACE_INFO("SC_IBM_GenerateRandom: rc = 0x%08lx, %lu bytes\n", rc,
+               ulRandomLen);
+
+    return rc;
+}
+
 CK_RV SC_HandleEvent(STDLL_TokData_t *tokdata, unsigned int event_type,
                      unsigned int event_flags, const char *payload,
                      unsigned int payload_len)
@@ -3437,6 +3799,16 @@ void SC_SetFunctionList(void)
     function_list.ST_Decrypt = SC_Decrypt;
     function_list.ST_DecryptUpdate = SC_DecryptUpdate;
     function_list.ST_DecryptFinal = SC_DecryptFinal;
+    function_list.ST_MessageEncryptInit = SC_MessageEncryptInit;
+    function_list.ST_EncryptMessage = SC_EncryptMessage;
+    function_list.ST_EncryptMessageBegin = SC_EncryptMessageBegin;
+    function_list.ST_EncryptMessageNext = SC_EncryptMessageNext;
+    function_list.ST_MessageEncryptFinal = SC_MessageEncryptFinal;
+    function_list.ST_MessageDecryptInit = SC_MessageDecryptInit;
+    function_list.ST_DecryptMessage = SC_DecryptMessage;
+    function_list.ST_DecryptMessageBegin = SC_DecryptMessageBegin;
+    function_list.ST_DecryptMessageNext = SC_DecryptMessageNext;
+    function_list.ST_MessageDecryptFinal = SC_MessageDecryptFinal;
     function_list.ST_DigestInit = SC_DigestInit;
     function_list.ST_Digest = SC_Digest;
     function_list.ST_DigestUpdate = SC_DigestUpdate;
@@ -3470,6 +3842,10 @@ void SC_SetFunctionList(void)
     function_list.ST_SessionCancel = SC_SessionCancel;
 
     function_list.ST_IBM_ReencryptSingle = SC_IBM_ReencryptSingle;
+    function_list.ST_IBM_SignBatch = SC_IBM_SignBatch;
+    function_list.ST_IBM_VerifyBatch = SC_IBM_VerifyBatch;
+    function_list.ST_IBM_DigestBatch = SC_IBM_DigestBatch;
+    function_list.ST_IBM_GenerateRandom = SC_IBM_GenerateRandom;
 
     function_list.ST_HandleEvent = SC_HandleEvent;
 }
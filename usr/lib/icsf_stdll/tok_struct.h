@@ -142,6 +142,13 @@ token_spec_t token_specific = {
     NULL,                       // set_attrs_for_new_object
     NULL,                       // handle_event
     NULL,                       // check_obj_access
+    NULL,                       // cipher_update
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg_begin
+    NULL,                       // aes_gcm_msg_update
+    NULL,                       // aes_gcm_msg_final
+    NULL,                       // sha_single
+    NULL,                       // check_op_state
 };
 
 #endif
@@ -253,7 +253,9 @@ static const MECH_LIST_ELEMENT soft_mech_list[] = {
     {CKM_AES_CFB8, {16, 32, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP}},
     {CKM_AES_CFB128, {16, 32, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP}},
 #endif
-    {CKM_AES_GCM, {16, 32, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP}},
+    {CKM_AES_GCM, {16, 32, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP |
+                           CKF_MESSAGE_ENCRYPT | CKF_MESSAGE_DECRYPT |
+                           CKF_MULTI_MESSAGE}},
     {CKM_AES_MAC, {16, 32, CKF_HW | CKF_SIGN | CKF_VERIFY}},
     {CKM_AES_MAC_GENERAL, {16, 32, CKF_HW | CKF_SIGN | CKF_VERIFY}},
     {CKM_AES_CMAC, {16, 32, CKF_SIGN | CKF_VERIFY}},
@@ -890,6 +892,53 @@ CK_RV token_specific_aes_key_wrap(STDLL_TokData_t *tokdata, SESSION *sess,
                                          iv, iv_len, encrypt, pad);
 }
 
+CK_RV token_specific_cipher_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                                   ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                                   CK_BYTE *in_data, CK_ULONG in_data_len,
+                                   CK_BYTE *out_data, CK_BYTE encrypt)
+{
+    return openssl_specific_cipher_update(tokdata, sess, ctx, key, in_data,
+                                          in_data_len, out_data, encrypt);
+}
+
+CK_RV token_specific_aes_gcm_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                                      ENCR_DECR_CONTEXT *ctx, OBJECT *key,
+                                      CK_BYTE encrypt)
+{
+    return openssl_specific_aes_gcm_msg_init(tokdata, sess, ctx, key, encrypt);
+}
+
+CK_RV token_specific_aes_gcm_msg_begin(STDLL_TokData_t *tokdata, SESSION *sess,
+                                       ENCR_DECR_CONTEXT *ctx,
+                                       CK_BYTE *iv, CK_ULONG iv_len,
+                                       CK_BYTE *aad, CK_ULONG aad_len,
+                                       CK_BYTE encrypt)
+{
+    return openssl_specific_aes_gcm_msg_begin(tokdata, sess, ctx, iv, iv_len,
+                                              aad, aad_len, encrypt);
+}
+
+CK_RV token_specific_aes_gcm_msg_update(STDLL_TokData_t *tokdata,
+                                        SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                        CK_BYTE *in_data, CK_ULONG in_data_len,
+                                        CK_BYTE *out_data,
+                                        CK_ULONG *out_data_len,
+                                        CK_BYTE encrypt)
+{
+    return openssl_specific_aes_gcm_msg_update(tokdata, sess, ctx, in_data,
+                                               in_data_len, out_data,
+                                               out_data_len, encrypt);
+}
+
+CK_RV token_specific_aes_gcm_msg_final(STDLL_TokData_t *tokdata, SESSION *sess,
+                                       ENCR_DECR_CONTEXT *ctx,
+                                       CK_BYTE *tag, CK_ULONG tag_len,
+                                       CK_BYTE encrypt)
+{
+    return openssl_specific_aes_gcm_msg_final(tokdata, sess, ctx, tag, tag_len,
+                                              encrypt);
+}
+
 /* Begin code contributed by Corrent corp. */
 #ifndef NODH
 // This computes DH shared secret, where:
@@ -1315,12 +1364,29 @@ CK_RV token_specific_sha(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                 out_data, out_data_len);
 }
 
+CK_RV token_specific_sha_single(STDLL_TokData_t *tokdata, CK_MECHANISM *mech,
+                                CK_BYTE *in_data, CK_ULONG in_data_len,
+                                CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    return openssl_specific_sha_single(tokdata, mech, in_data, in_data_len,
+                                       out_data, out_data_len);
+}
+
 CK_RV token_specific_sha_update(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                 CK_BYTE *in_data, CK_ULONG in_data_len)
 {
     return openssl_specific_sha_update(tokdata, ctx, in_data, in_data_len);
 }
 
+CK_RV token_specific_check_op_state(STDLL_TokData_t *tokdata,
+                                    CK_ULONG operation,
+                                    CK_MECHANISM_TYPE mech, CK_BYTE *context,
+                                    CK_ULONG context_len)
+{
+    return openssl_specific_check_op_state(tokdata, operation, mech,
+                                           context, context_len);
+}
+
 CK_RV token_specific_sha_final(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                CK_BYTE *out_data, CK_ULONG *out_data_len)
 {
@@ -1358,20 +1424,16 @@ CK_RV token_specific_hmac_sign(STDLL_TokData_t *tokdata, SESSION *sess,
                                CK_BYTE *in_data, CK_ULONG in_data_len,
                                CK_BYTE *signature, CK_ULONG *sig_len)
 {
-    UNUSED(tokdata);
-
-    return openssl_specific_hmac(&sess->sign_ctx, in_data, in_data_len,
-                                 signature, sig_len, TRUE);
+    return openssl_specific_hmac(tokdata, &sess->sign_ctx, in_data,
+                                 in_data_len, signature, sig_len, TRUE);
 }
 
 CK_RV token_specific_hmac_verify(STDLL_TokData_t *tokdata, SESSION *sess,
                                  CK_BYTE *in_data, CK_ULONG in_data_len,
                                  CK_BYTE *signature, CK_ULONG sig_len)
 {
-    UNUSED(tokdata);
-
-    return openssl_specific_hmac(&sess->verify_ctx, in_data, in_data_len,
-                                 signature, &sig_len, FALSE);
+    return openssl_specific_hmac(tokdata, &sess->verify_ctx, in_data,
+                                 in_data_len, signature, &sig_len, FALSE);
 }
 
 CK_RV token_specific_hmac_sign_update(STDLL_TokData_t *tokdata, SESSION *sess,
@@ -1396,20 +1458,16 @@ CK_RV token_specific_hmac_verify_update(STDLL_TokData_t *tokdata,
 CK_RV token_specific_hmac_sign_final(STDLL_TokData_t *tokdata, SESSION *sess,
                                      CK_BYTE *signature, CK_ULONG *sig_len)
 {
-    UNUSED(tokdata);
-
-    return openssl_specific_hmac_final(&sess->sign_ctx, signature, sig_len,
-                                       TRUE);
+    return openssl_specific_hmac_final(tokdata, &sess->sign_ctx, signature,
+                                       sig_len, TRUE);
 }
 
 CK_RV token_specific_hmac_verify_final(STDLL_TokData_t *tokdata,
                                        SESSION *sess, CK_BYTE *signature,
                                        CK_ULONG sig_len)
 {
-    UNUSED(tokdata);
-
-    return openssl_specific_hmac_final(&sess->verify_ctx, signature, &sig_len,
-                                       FALSE);
+    return openssl_specific_hmac_final(tokdata, &sess->verify_ctx, signature,
+                                       &sig_len, FALSE);
 }
 
 CK_RV token_specific_generic_secret_key_gen(STDLL_TokData_t *tokdata,
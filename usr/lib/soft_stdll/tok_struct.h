@@ -181,6 +181,13 @@ token_spec_t token_specific = {
     &token_specific_set_attrs_for_new_object,
     NULL,                       // handle_event
     NULL,                       // check_obj_access
+    &token_specific_cipher_update,
+    &token_specific_aes_gcm_msg_init,
+    &token_specific_aes_gcm_msg_begin,
+    &token_specific_aes_gcm_msg_update,
+    &token_specific_aes_gcm_msg_final,
+    &token_specific_sha_single,
+    &token_specific_check_op_state,
 };
 
 #endif
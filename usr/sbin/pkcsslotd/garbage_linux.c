@@ -16,6 +16,11 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <time.h>
+
+#if !defined(_AIX)
+    #include <sys/syscall.h>
+#endif
 
 #include "log.h"
 #include "slotmgr.h"
@@ -28,6 +33,15 @@
 
 #define PROC_BASE "/proc"
 
+/*
+ * Seconds between two sweeps over the process table.  If the kernel reports
+ * process exits via pidfds, dead processes are cleaned up as soon as they
+ * exit (see CleanupExitedProcess), and the sweep is only a fallback for the
+ * rare cases not covered by that.
+ */
+#define GC_INTERVAL             10
+#define GC_FALLBACK_INTERVAL    60
+
 #if !defined(NOGARBAGE)
 
 #include "garbage_linux.h"
@@ -38,6 +52,9 @@ int Stat2Proc(int pid, proc_t *p);
 
 pthread_t GCThread;             /* Garbage Collection thread's handle */
 static BOOL ThreadRunning = FALSE;      /* If we're already running or not */
+static int ProcExitFdSupport = -1;      /* -1: not yet probed */
+static BOOL ProcExitFdMissed = FALSE;   /* a live process is not watched */
+static struct timespec LastGarbageCheck;
 
 #if THREADED
 static void *GCMain(void *Ptr);
@@ -218,7 +235,7 @@ void *GCMain(void *Ptr)
         DbgLog(DL5, "Garbage collection finished.");
 
         /* now we pause */
-        sleep(10);
+        sleep(GarbageCheckInterval());
     }                           /* end while 1 */
 
 
@@ -255,6 +272,97 @@ void GCCancel(void *Ptr)
 
 
 
+/*****************************************************************************
+ * ReleaseProcEntry -
+ *
+ *       Gives back the sessions of a dead process and frees its process
+ *       table entry. The caller must hold the global shared memory lock.
+ *
+ ******************************************************************************/
+
+static void ReleaseProcEntry(Slot_Mgr_Shr_t *MemPtr, int ProcIndex)
+{
+    Slot_Mgr_Proc_t_64 *pProc = &(MemPtr->proc_table[ProcIndex]);
+    int SlotIndex;
+
+#ifdef DEV
+    DbgLog(DL1, "Garbage collection routine found bad entry for pid "
+           "%d (Index: %d); removing from table",
+           pProc->proc_id, ProcIndex);
+#endif                          /* DEV */
+
+    /*                         */
+    /* Clean up session counts */
+    /*                         */
+    for (SlotIndex = 0; SlotIndex < NUMBER_SLOTS_MANAGED; SlotIndex++) {
+
+        unsigned int *pGlobalSessions =
+            &(MemPtr->slot_global_sessions[SlotIndex]);
+        unsigned int *pGlobalRWSessions =
+            &(MemPtr->slot_global_rw_sessions[SlotIndex]);
+        unsigned int *pGlobalTokspecCount =
+            &(MemPtr->slot_global_tokspec_count[SlotIndex]);
+        unsigned int *pProcSessions =
+            &(pProc->slot_session_count[SlotIndex]);
+        unsigned int *pProcRWSessions =
+            &(pProc->slot_rw_session_count[SlotIndex]);
+        unsigned int *pProcTokspecCount =
+            &(pProc->slot_tokspec_count[SlotIndex]);
+
+        if (*pProcSessions > 0) {
+
+#ifdef DEV
+            DbgLog(DL2, "GC: Invalid pid (%d) is holding %u sessions "
+                   "open on slot %d.  Global session count for this "
+                   "slot is %u",
+                   pProc->proc_id, *pProcSessions, SlotIndex,
+                   *pGlobalSessions);
+
+            if (*pProcSessions > *pGlobalSessions) {
+                WarnLog("Garbage Collection: Illegal values in table "
+                        "for defunct process");
+                DbgLog(DL0, "Garbage collection: A process "
+                       "( Index: %d, pid: %d ) showed %u sessions "
+                       "open on slot %d, but the global count for this "
+                       "slot is only %u",
+                       ProcIndex, pProc->proc_id, *pProcSessions,
+                       SlotIndex, *pGlobalSessions);
+            }
+#endif                          /* DEV */
+
+            /* Clients update the global counts without the lock */
+            slot_mgr_counter_sub(pGlobalSessions, *pProcSessions);
+            slot_mgr_counter_sub(pGlobalRWSessions, *pProcRWSessions);
+
+            *pProcSessions = 0;
+            *pProcRWSessions = 0;
+
+        }
+        /* end if *pProcSessions */
+
+        if (*pProcTokspecCount > 0) {
+            slot_mgr_counter_sub(pGlobalTokspecCount, *pProcTokspecCount);
+            *pProcTokspecCount = 0;
+        }
+    }                   /* end for SlotIndex */
+
+
+    /*                                      */
+    /* NULL out everything except the mutex */
+    /*                                      */
+
+    pProc->inuse = CK_FALSE;
+    pProc->proc_id = 0;
+    pProc->slotmap = 0;
+    pProc->blocking = 0;
+    pProc->error = 0;
+    memset(&(pProc->slot_session_count), '\0',
+           sizeof(pProc->slot_session_count));
+    memset(&(pProc->reg_time), '\0', sizeof(pProc->reg_time));
+}
+
+
+
 /*****************************************************************************
  * CheckForGarbage -
  *
@@ -264,7 +372,6 @@ void GCCancel(void *Ptr)
 
 BOOL CheckForGarbage(Slot_Mgr_Shr_t *MemPtr)
 {
-    int SlotIndex;
     int ProcIndex;
     int Err;
     BOOL ValidPid;
@@ -293,6 +400,7 @@ BOOL CheckForGarbage(Slot_Mgr_Shr_t *MemPtr)
     DbgLog(DL5, "Garbage collection: Got global shared memory lock");
 #endif                          /* DEV */
 
+    clock_gettime(CLOCK_MONOTONIC, &LastGarbageCheck);
 
     for (ProcIndex = 0; ProcIndex < NUMBER_PROCESSES_ALLOWED; ProcIndex++) {
 
@@ -308,101 +416,139 @@ BOOL CheckForGarbage(Slot_Mgr_Shr_t *MemPtr)
                     && (pProc->proc_id != 0));
 
 
-        if ((pProc->inuse) && (!ValidPid)) {
+        if ((pProc->inuse) && (!ValidPid))
+            ReleaseProcEntry(MemPtr, ProcIndex);
+    }                           /* end for ProcIndex */
 
-#ifdef DEV
-            DbgLog(DL1, "Garbage collection routine found bad entry for pid "
-                   "%d (Index: %d); removing from table",
-                   pProc->proc_id, ProcIndex);
-#endif                          /* DEV */
+    XProcUnLock();
+    DbgLog(DL5, "Garbage collection: Released global shared memory lock");
 
-            /*                         */
-            /* Clean up session counts */
-            /*                         */
-            for (SlotIndex = 0; SlotIndex < NUMBER_SLOTS_MANAGED; SlotIndex++) {
-
-                unsigned int *pGlobalSessions =
-                    &(MemPtr->slot_global_sessions[SlotIndex]);
-                unsigned int *pGlobalRWSessions =
-                    &(MemPtr->slot_global_rw_sessions[SlotIndex]);
-                unsigned int *pGlobalTokspecCount =
-                    &(MemPtr->slot_global_tokspec_count[SlotIndex]);
-                unsigned int *pProcSessions =
-                    &(pProc->slot_session_count[SlotIndex]);
-                unsigned int *pProcRWSessions =
-                    &(pProc->slot_rw_session_count[SlotIndex]);
-                unsigned int *pProcTokspecCount =
-                    &(pProc->slot_tokspec_count[SlotIndex]);
-
-                if (*pProcSessions > 0) {
+    return TRUE;
+}
 
-#ifdef DEV
-                    DbgLog(DL2, "GC: Invalid pid (%d) is holding %u sessions "
-                           "open on slot %d.  Global session count for this "
-                           "slot is %u",
-                           pProc->proc_id, *pProcSessions, SlotIndex,
-                           *pGlobalSessions);
-#endif                          /* DEV */
 
-                    if (*pProcSessions > *pGlobalSessions) {
-#ifdef DEV
-                        WarnLog("Garbage Collection: Illegal values in table "
-                                "for defunct process");
-                        DbgLog(DL0, "Garbage collection: A process "
-                               "( Index: %d, pid: %d ) showed %u sessions "
-                               "open on slot %d, but the global count for this "
-                               "slot is only %u",
-                               ProcIndex, pProc->proc_id, *pProcSessions,
-                               SlotIndex, *pGlobalSessions);
-#endif                          /* DEV */
-                        *pGlobalSessions = 0;
-                        *pGlobalRWSessions = 0;
-                    } else {
-                        *pGlobalSessions -= *pProcSessions;
-                        *pGlobalRWSessions -= *pProcRWSessions;
-                    }
-
-                    *pProcSessions = 0;
-                    *pProcRWSessions = 0;
-
-                }
-                /* end if *pProcSessions */
-
-                if (*pGlobalTokspecCount > 0) {
-                    if (*pProcTokspecCount > *pGlobalTokspecCount)
-                        *pGlobalTokspecCount = 0;
-                    else
-                        *pGlobalTokspecCount -= *pProcTokspecCount;
-                    *pProcTokspecCount = 0;
-                }
-            }                   /* end for SlotIndex */
-
-
-            /*                                      */
-            /* NULL out everything except the mutex */
-            /*                                      */
-
-            pProc->inuse = CK_FALSE;
-            pProc->proc_id = 0;
-            pProc->slotmap = 0;
-            pProc->blocking = 0;
-            pProc->error = 0;
-            memset(&(pProc->slot_session_count), '\0',
-                   sizeof(pProc->slot_session_count));
-            memset(&(pProc->reg_time), '\0', sizeof(pProc->reg_time));
 
+/*****************************************************************************
+ * CleanupExitedProcess -
+ *
+ *       Frees the process table entries of a process that is known to have
+ *       exited, without sweeping over all other entries. A process that has
+ *       exited but was not yet reaped by its parent still shows up in /proc
+ *       as a zombie, so zombies are treated as dead here.
+ *
+ ******************************************************************************/
+
+BOOL CleanupExitedProcess(Slot_Mgr_Shr_t *MemPtr, pid_t_64 pid)
+{
+    Slot_Mgr_Proc_t_64 *pProc;
+    proc_t procstore;
+    int ProcIndex;
+    BOOL Dead;
+
+    ASSERT(MemPtr != NULL_PTR);
+
+    if (pid == 0)
+        return FALSE;
+
+    XProcLock();
+    for (ProcIndex = 0; ProcIndex < NUMBER_PROCESSES_ALLOWED; ProcIndex++) {
+        pProc = &(MemPtr->proc_table[ProcIndex]);
+        if (!pProc->inuse || pProc->proc_id != pid)
+            continue;
+
+        Dead = !IsValidProcessEntry(pProc->proc_id, pProc->reg_time);
+        if (!Dead) {
+            memset(&procstore, 0, sizeof(procstore));
+            Dead = Stat2Proc((int) pid, &procstore) &&
+                   (procstore.state == 'Z' || procstore.state == 'X');
         }
-        /* end if inuse && ValidPid */
-    }                           /* end for ProcIndex */
 
+        DbgLog(DL3, "CleanupExitedProcess: PID %lld is %s", pid,
+               Dead ? "dead" : "still alive");
+        if (Dead)
+            ReleaseProcEntry(MemPtr, ProcIndex);
+    }
     XProcUnLock();
-    DbgLog(DL5, "Garbage collection: Released global shared memory lock");
 
     return TRUE;
 }
 
 
 
+/*****************************************************************************
+ * OpenProcExitFd -
+ *
+ *       Returns a file descriptor that becomes readable when the given
+ *       process exits (a pidfd), or -1 with errno set
+ *
+ ******************************************************************************/
+
+int OpenProcExitFd(pid_t_64 pid)
+{
+#if defined(SYS_pidfd_open)
+    int fd;
+
+    fd = syscall(SYS_pidfd_open, (pid_t) pid, 0);
+    if (fd < 0 && errno == ENOSYS)
+        ProcExitFdSupport = 0;
+    else if (fd < 0 && errno != ESRCH)
+        ProcExitFdMissed = TRUE;
+    return fd;
+#else
+    UNUSED(pid);
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+
+/*****************************************************************************
+ * GarbageCheckInterval -
+ *
+ *       Returns the number of seconds between two sweeps over the process
+ *       table. The long interval is only used as long as every process got
+ *       a pidfd, e.g. not after the daemon ran out of file descriptors.
+ *
+ ******************************************************************************/
+
+unsigned int GarbageCheckInterval(void)
+{
+    int fd;
+
+    if (ProcExitFdSupport == -1) {
+        fd = OpenProcExitFd(getpid());
+        ProcExitFdSupport = (fd >= 0);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    return (ProcExitFdSupport == 1 && !ProcExitFdMissed) ?
+                                        GC_FALLBACK_INTERVAL : GC_INTERVAL;
+}
+
+
+
+/*****************************************************************************
+ * GarbageCheckDue -
+ *
+ *       Tells if the next sweep over the process table is due
+ *
+ ******************************************************************************/
+
+BOOL GarbageCheckDue(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (LastGarbageCheck.tv_sec == 0 && LastGarbageCheck.tv_nsec == 0) ||
+           now.tv_sec - LastGarbageCheck.tv_sec >=
+                                        (time_t)GarbageCheckInterval();
+}
+
+
+
 /******************************************************************************
  * Stat2Proc -
  *
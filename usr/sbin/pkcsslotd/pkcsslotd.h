@@ -66,6 +66,10 @@ BOOL IsDaemon(void);
 BOOL StopGCThread(void *Ptr);
 BOOL StartGCThread(Slot_Mgr_Shr_t *MemPtr);
 BOOL CheckForGarbage(Slot_Mgr_Shr_t *MemPtr);
+BOOL CleanupExitedProcess(Slot_Mgr_Shr_t *MemPtr, pid_t_64 pid);
+int OpenProcExitFd(pid_t_64 pid);
+unsigned int GarbageCheckInterval(void);
+BOOL GarbageCheckDue(void);
 int InitializeMutexes(void);
 int DestroyMutexes(void);
 int CreateSharedMemory(void);
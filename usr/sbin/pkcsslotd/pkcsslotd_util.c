@@ -109,6 +109,8 @@ void PopulateSlotInfo(Slot_Info_t_64 *slot_info, unsigned int *processed)
             memcpy(slot_info[id].usergroup, sinfo[id].usergroup,
                    strlen(sinfo[id].usergroup));
 
+            slot_info[id].objstore = sinfo[id].objstore;
+
             slot_count++;
         }
     }
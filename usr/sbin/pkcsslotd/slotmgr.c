@@ -832,6 +832,22 @@ static int config_parse_slot(const char *config_file,
             continue;
         }
 
+        if (strcmp(c->key, "objstore") == 0 &&
+            (str = confignode_getstr(c)) != NULL) {
+            if (strcmp(str, "files") == 0) {
+                sinfo[slot_no].objstore = OBJSTORE_FILES;
+            } else if (strcmp(str, "log") == 0) {
+                sinfo[slot_no].objstore = OBJSTORE_LOG;
+            } else {
+                ErrLog("Error parsing config file '%s': invalid objstore "
+                       "'%s' at line %d, must be 'files' or 'log'\n",
+                       config_file, str, c->line);
+                return 1;
+            }
+
+            continue;
+        }
+
         ErrLog("Error parsing config file '%s': unexpected token '%s' "
                "at line %d: \n", config_file, c->key, c->line);
         return 1;
@@ -947,6 +963,11 @@ static int config_parse(const char *config_file)
                 event_support_disabled = 1;
                 continue;
             }
+            if (strcmp(confignode_to_bareconst(c)->base.key,
+                       "lazy-slot-init") == 0) {
+                socketData.flags |= FLAG_LAZY_SLOT_INIT;
+                continue;
+            }
 
             ErrLog("Error parsing config file '%s': unexpected token '%s' "
                    "at line %d: \n", config_file, c->key, c->line);
@@ -1235,7 +1256,8 @@ int main(int argc, char *argv[], char *envp[])
 
     while (1) {
 #if !(THREADED) && !(NOGARBAGE)
-        CheckForGarbage(shmp);
+        if (GarbageCheckDue())
+            CheckForGarbage(shmp);
 #endif
         socket_connection_handler(10);
     }
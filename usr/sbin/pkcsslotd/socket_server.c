@@ -138,6 +138,20 @@ struct admin_conn_info {
     struct event_info *event;
 };
 
+#if !defined(NOGARBAGE) && !defined(_AIX)
+/*
+ * Watches a process from its first connection on. Every process connects
+ * in C_Initialize before it registers in the process table, and keeps the
+ * watch when it hangs up. The pidfd becomes readable when the process
+ * exits, so that its process table entry can be freed right away.
+ */
+struct proc_exit_watch {
+    int pidfd;
+    pid_t_64 pid;
+    struct epoll_info ep_info;
+};
+#endif
+
 #ifdef WITH_LIBUDEV
 struct udev_mon {
     struct udev *udev;
@@ -170,6 +184,14 @@ static struct udev_mon udev_mon = { .socket = -1 };
 #endif
 static DL_NODE *pending_events = NULL;
 static unsigned long pending_events_count = 0;
+#if !defined(NOGARBAGE) && !defined(_AIX)
+/*
+ * Process exit watches hashed by pid, so that finding the watch of a
+ * connecting process does not scan the watches of all processes.
+ */
+#define PROC_EXIT_WATCH_BUCKETS 256
+static DL_NODE *proc_exit_watches[PROC_EXIT_WATCH_BUCKETS];
+#endif
 
 #define MAX_PENDING_EVENTS      1024
 
@@ -223,6 +245,9 @@ static inline void proc_get(struct proc_conn_info *conn);
 static inline void proc_put(struct proc_conn_info *conn);
 static void proc_hangup(void *client);
 static void proc_free(void *client);
+#if !defined(NOGARBAGE) && !defined(_AIX)
+static void proc_exit_watch_start(pid_t_64 pid);
+#endif
 static int admin_xfer_complete(void *client);
 static void admin_event_limit_underrun(struct admin_conn_info *conn);
 static int admin_event_delivered(struct admin_conn_info *conn,
@@ -748,6 +773,9 @@ static int proc_new_conn(int socket, struct listener_info *listener)
 #else
     conn->client_cred.real_uid = ucred.uid;
     conn->client_cred.real_gid = ucred.gid;
+#endif
+#if !defined(NOGARBAGE) && !defined(_AIX)
+    proc_exit_watch_start(ucred.pid);
 #endif
     /* Add currently pending events to this connection */
     node = dlist_get_first(pending_events);
@@ -1023,6 +1051,125 @@ static void proc_free(void *client)
     free(conn);
 }
 
+#if !defined(NOGARBAGE) && !defined(_AIX)
+static DL_NODE **proc_exit_watch_bucket(pid_t_64 pid)
+{
+    return &proc_exit_watches[(unsigned long long)pid %
+                              PROC_EXIT_WATCH_BUCKETS];
+}
+
+static struct proc_exit_watch *proc_exit_watch_find(pid_t_64 pid)
+{
+    struct proc_exit_watch *watch;
+    DL_NODE *node;
+
+    node = dlist_get_first(*proc_exit_watch_bucket(pid));
+    while (node != NULL) {
+        watch = node->data;
+        if (watch->pid == pid)
+            return watch;
+        node = dlist_next(node);
+    }
+
+    return NULL;
+}
+
+static void proc_exit_watch_term(struct proc_exit_watch *watch)
+{
+    DL_NODE **bucket = proc_exit_watch_bucket(watch->pid);
+    DL_NODE *node;
+
+    node = dlist_find(*bucket, watch);
+    if (node == NULL)
+        return;
+    *bucket = dlist_remove_node(*bucket, node);
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watch->pidfd, NULL);
+    close(watch->pidfd);
+    watch->pidfd = -1;
+    epoll_info_put(&watch->ep_info);
+}
+
+static int proc_exit_watch_notify(int events, void *private)
+{
+    struct proc_exit_watch *watch = private;
+
+    DbgLog(DL3, "%s: process %lld exited: events: 0x%x", __func__,
+           watch->pid, events);
+
+    CleanupExitedProcess(shmp, watch->pid);
+    proc_exit_watch_term(watch);
+
+    return 0;
+}
+
+static void proc_exit_watch_free(void *private)
+{
+    DbgLog(DL3, "%s: watch: %p", __func__, private);
+    free(private);
+}
+
+static void proc_exit_watch_start(pid_t_64 pid)
+{
+    DL_NODE **bucket = proc_exit_watch_bucket(pid);
+    struct proc_exit_watch *watch;
+    struct epoll_event evt;
+    DL_NODE *list;
+    int pidfd, err;
+
+    if (proc_exit_watch_find(pid) != NULL)
+        return;
+
+    pidfd = OpenProcExitFd(pid);
+    if (pidfd < 0) {
+        err = errno;
+        if (err == ESRCH) {
+            /* Already gone */
+            CleanupExitedProcess(shmp, pid);
+        } else {
+            /* Left to the periodic garbage collection */
+            DbgLog(DL3, "%s: No pidfd for process %lld, errno %d (%s).",
+                   __func__, pid, err, strerror(err));
+        }
+        return;
+    }
+
+    watch = calloc(1, sizeof(struct proc_exit_watch));
+    if (watch == NULL) {
+        ErrLog("%s: Failed to allocate memory for the process exit watch",
+               __func__);
+        close(pidfd);
+        return;
+    }
+    watch->pidfd = pidfd;
+    watch->pid = pid;
+    epoll_info_init(&watch->ep_info, proc_exit_watch_notify,
+                    proc_exit_watch_free, watch);
+
+    list = dlist_add_as_first(*bucket, watch);
+    if (list == NULL) {
+        ErrLog("%s: failed add watch to list of process exit watches",
+               __func__);
+        close(pidfd);
+        free(watch);
+        return;
+    }
+    *bucket = list;
+
+    evt.events = EPOLLIN;
+    evt.data.ptr = &watch->ep_info;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &evt) != 0) {
+        err = errno;
+        InfoLog("%s: Failed to add pidfd %d to epoll, errno %d (%s).",
+                __func__, pidfd, err, strerror(err));
+        proc_exit_watch_term(watch);
+        return;
+    }
+
+    DbgLog(DL3, "%s: watching process %lld: pidfd: %d", __func__, pid, pidfd);
+}
+#endif
+
 static int admin_new_conn(int socket, struct listener_info *listener)
 {
     struct admin_conn_info *conn;
@@ -1922,6 +2069,9 @@ int init_socket_server(int event_support_disabled)
 int term_socket_server(void)
 {
     DL_NODE *node, *next;
+#if !defined(NOGARBAGE) && !defined(_AIX)
+    unsigned int i;
+#endif
 
 #ifdef WITH_LIBUDEV
     udev_mon_term(&udev_mon);
@@ -1953,6 +2103,13 @@ int term_socket_server(void)
         node = next;
     }
     dlist_purge(pending_events);
+
+#if !defined(NOGARBAGE) && !defined(_AIX)
+    for (i = 0; i < PROC_EXIT_WATCH_BUCKETS; i++) {
+        while ((node = dlist_get_first(proc_exit_watches[i])) != NULL)
+            proc_exit_watch_term(node->data);
+    }
+#endif
 #if defined(_AIX)
     if (pollset_fd >= 0)
         close(pollset_fd);
@@ -83,12 +83,17 @@ static void make_shm_name(char *shm_name, size_t max_shm_len, int user_id)
     }
 }
 
+/*
+ * Maps the statistics of a user. *shm_data points to the header of the
+ * segment, which is followed by *num_shards shards of num_slots slots each.
+ */
 static int open_shm(uid_t user_id, const char *user_name,
                     CK_ULONG num_slots, CK_BYTE **shm_data,
-                    CK_ULONG *shm_size)
+                    CK_ULONG *shm_size, CK_ULONG *num_shards)
 {
     char shm_name[PATH_MAX];
     struct stat stat_buf;
+    struct stat_shm_header hdr;
     int shm_fd;
 
     make_shm_name(shm_name, sizeof(shm_name), user_id);
@@ -122,9 +127,28 @@ static int open_shm(uid_t user_id, const char *user_name,
         return 1;
     }
 
-    *shm_size = num_slots * STAT_SLOT_SIZE;
+    if ((CK_ULONG)stat_buf.st_size < STAT_SHM_HDR_SIZE ||
+        pread(shm_fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        hdr.magic != STAT_SHM_MAGIC) {
+        warnx("Failed to open statistics for user '%s': SHM '%s' has no valid header",
+              user_name, shm_name);
+        close(shm_fd);
+        return 1;
+    }
+
+    if (hdr.version != STAT_SHM_VERSION) {
+        warnx("Failed to open statistics for user '%s': SHM '%s' has layout version %lu, expected %u",
+              user_name, shm_name, hdr.version, STAT_SHM_VERSION);
+        close(shm_fd);
+        return 1;
+    }
+
+    *num_shards = hdr.num_shards;
+    *shm_size = STAT_SHM_HDR_SIZE + hdr.num_shards * num_slots * STAT_SLOT_SIZE;
 
-    if ((CK_ULONG)stat_buf.st_size != *shm_size) {
+    if (hdr.num_shards == 0 || hdr.num_shards > STAT_MAX_SHARDS ||
+        hdr.shard_size != num_slots * STAT_SLOT_SIZE ||
+        (CK_ULONG)stat_buf.st_size != *shm_size) {
         warnx("Failed to open statistics for user '%s': SHM '%s' has wrong size",
               user_name, shm_name);
         close(shm_fd);
@@ -152,6 +176,33 @@ static void close_shm(CK_BYTE *shm_data, CK_ULONG shm_size)
      munmap(shm_data, shm_size);
 }
 
+/*
+ * Returns the sum of the counters of all shards in a newly allocated buffer,
+ * which has the layout of a single shard.
+ */
+static CK_BYTE *sum_shards(const CK_BYTE *shm_data, CK_ULONG num_shards,
+                           CK_ULONG shard_size)
+{
+    const counter_t *shard_counter;
+    counter_t *sum_counter;
+    CK_ULONG i, k;
+
+    sum_counter = calloc(shard_size, 1);
+    if (sum_counter == NULL) {
+        warnx("Failed to allocate the statistics buffer");
+        return NULL;
+    }
+
+    for (i = 0; i < num_shards; i++) {
+        shard_counter = (const counter_t *)(shm_data + STAT_SHM_HDR_SIZE +
+                                            i * shard_size);
+        for (k = 0; k < shard_size / sizeof(counter_t); k++)
+            sum_counter[k] += shard_counter[k];
+    }
+
+    return (CK_BYTE *)sum_counter;
+}
+
 typedef int (*user_f)(int user_id, const char *user_name, void *private);
 
 static int for_all_users(user_f user_cb, void *cb_private)
@@ -234,10 +285,9 @@ static int for_all_slots(slot_f slot_cb, void *cb_private,
 static bool all_conters_zero(CK_BYTE *mech_data, CK_ULONG mech_size)
 {
     counter_t *counter = (counter_t *)mech_data;
-    int i;
+    CK_ULONG i;
 
-    for (i = 0; i < NUM_SUPPORTED_STRENGTHS + 1 &&
-                i * sizeof(counter_t) < mech_size; i++) {
+    for (i = 0; i < mech_size / sizeof(counter_t); i++) {
         if (counter[i] != 0)
             return false;
     }
@@ -317,14 +367,19 @@ static int reset_shm(uid_t user_id, const char *user_name,
 {
     int rc = 0;
     CK_BYTE *shm_data = NULL;
-    CK_ULONG shm_size = 0;
+    CK_ULONG shm_size = 0, num_shards = 0, shard_size, i;
 
-    rc = open_shm(user_id, user_name, num_slots, &shm_data, &shm_size);
+    rc = open_shm(user_id, user_name, num_slots, &shm_data, &shm_size,
+                  &num_shards);
     if (rc != 0)
         return rc;
 
-    rc = for_all_slots(reset_slot_cb, NULL, shm_data, shm_size,
-                       num_slots, slots, slot_id_specified, slot_id);
+    shard_size = num_slots * STAT_SLOT_SIZE;
+    for (i = 0; i < num_shards && rc == 0; i++)
+        rc = for_all_slots(reset_slot_cb, NULL,
+                           shm_data + STAT_SHM_HDR_SIZE + i * shard_size,
+                           shard_size, num_slots, slots, slot_id_specified,
+                           slot_id);
 
     if (rc == 0) {
         if (slot_id_specified)
@@ -422,6 +477,44 @@ struct display_mech {
     bool first_mech;
 };
 
+static const char *stat_op_names[STAT_NUM_OPS] = {
+    [STAT_OP_INIT] = "init",
+    [STAT_OP_UPDATE] = "update",
+    [STAT_OP_FINAL] = "final",
+    [STAT_OP_SINGLE] = "single",
+};
+
+static void display_mech_ops_json(const struct stat_mech_counters *counters)
+{
+    const struct stat_op_counters *op;
+    int i, k;
+
+    printf("\t\t\t\t\t\t\t\"operations\": {");
+    for (i = 0; i < STAT_NUM_OPS; i++) {
+        op = &counters->ops[i];
+
+        printf("%s\n\t\t\t\t\t\t\t\t\"%s\": {\n", i == 0 ? "" : ",",
+               stat_op_names[i]);
+        printf("\t\t\t\t\t\t\t\t\t\"calls\": %lu,\n", op->calls);
+        printf("\t\t\t\t\t\t\t\t\t\"bytes\": %lu,\n", op->bytes);
+
+        /*
+         * Bucket k counts the calls that took between 2^(k-1) (0 for k = 0)
+         * and 2^k microseconds, the last bucket has no upper limit.
+         */
+        printf("\t\t\t\t\t\t\t\t\t\"latency-us\": {");
+        for (k = 0; k < STAT_NUM_LATENCY_BUCKETS; k++) {
+            if (k == STAT_NUM_LATENCY_BUCKETS - 1)
+                printf(" \"%lu-\": %lu", 1UL << (k - 1), op->latency[k]);
+            else
+                printf(" \"%lu-%lu\": %lu,", k == 0 ? 0 : 1UL << (k - 1),
+                       1UL << k, op->latency[k]);
+        }
+        printf(" }\n\t\t\t\t\t\t\t\t}");
+    }
+    printf("\n\t\t\t\t\t\t\t}\n");
+}
+
 static int display_mech_cb(CK_MECHANISM_TYPE mech, const char *mech_name,
                            CK_BYTE *mech_data, CK_ULONG mech_size,
                            CK_ULONG ofs, void *private)
@@ -444,15 +537,17 @@ static int display_mech_cb(CK_MECHANISM_TYPE mech, const char *mech_name,
     for (i = 0; i < NUM_SUPPORTED_STRENGTHS + 1 &&
                  i * sizeof(counter_t) < mech_size; i++) {
         if (dm->json)
-            printf("\t\t\t\t\t\t\t\"strength-%lu\": %lu%s\n",
+            printf("\t\t\t\t\t\t\t\"strength-%lu\": %lu,\n",
                    i == 0 ? 0 : supportedstrengths[NUM_SUPPORTED_STRENGTHS - i],
-                   counter[i], i == NUM_SUPPORTED_STRENGTHS ? "" : ",");
+                   counter[i]);
         else
             printf(" %15lu", counter[i]);
     }
 
-    if (dm->json)
+    if (dm->json) {
+        display_mech_ops_json((const struct stat_mech_counters *)mech_data);
         printf("\t\t\t\t\t\t}");
+    }
     else
         printf("\n");
     dm->first_mech = false;
@@ -575,13 +670,20 @@ static int display_stats(int user_id, const char *user_name,
                          struct display_data* dd)
 {
     int rc = 0;
-    CK_BYTE *shm_data = NULL;
-    CK_ULONG shm_size = 0;
+    CK_BYTE *shm_data = NULL, *sum_data;
+    CK_ULONG shm_size = 0, num_shards = 0;
 
-    rc = open_shm(user_id, user_name, dd->num_slots, &shm_data, &shm_size);
+    rc = open_shm(user_id, user_name, dd->num_slots, &shm_data, &shm_size,
+                  &num_shards);
     if (rc != 0)
         return rc;
 
+    sum_data = sum_shards(shm_data, num_shards,
+                          dd->num_slots * STAT_SLOT_SIZE);
+    close_shm(shm_data, shm_size);
+    if (sum_data == NULL)
+        return 1;
+
     if (dd->json) {
         if (!dd->first_user)
             printf(",\n");
@@ -591,15 +693,15 @@ static int display_stats(int user_id, const char *user_name,
     }
 
     dd->first_slot = true;
-    rc = for_all_slots(display_slot_cb, dd, shm_data, shm_size,
-                       dd->num_slots, dd->slots,
+    rc = for_all_slots(display_slot_cb, dd, sum_data,
+                       dd->num_slots * STAT_SLOT_SIZE, dd->num_slots, dd->slots,
                        dd->slot_id_specified, dd->slot_id);
 
     if (dd->json)
         printf("\n\t\t\t]\n\t\t}");
     dd->first_user = false;
 
-    close_shm(shm_data, shm_size);
+    free(sum_data);
     return rc;
 }
 
@@ -623,22 +725,20 @@ static int summary_mech_cb(CK_MECHANISM_TYPE mech, const char *mech_name,
     struct summary_data *sd = private;
     counter_t *slot_counter = (counter_t *)mech_data;
     counter_t *sum_counter;
-    int i;
+    CK_ULONG i;
 
     UNUSED(mech);
     UNUSED(mech_name);
 
     ofs += sd->slot_id * STAT_SLOT_SIZE;
-    if (ofs + (NUM_SUPPORTED_STRENGTHS + 1) * sizeof(counter_t) >
-                                                        sd->summary_size) {
+    if (ofs + mech_size > sd->summary_size) {
         warnx("Internal error: mechanism offset larger than summary size");
         return 1;
     }
 
     sum_counter = (counter_t *)(&sd->summary_data[ofs]);
 
-    for (i = 0; i < NUM_SUPPORTED_STRENGTHS + 1 &&
-                i * sizeof(counter_t) < mech_size; i++)
+    for (i = 0; i < mech_size / sizeof(counter_t); i++)
         sum_counter[i] += slot_counter[i];
 
     return 0;
@@ -661,17 +761,25 @@ static int display_summary_cb(int user_id, const char *user_name, void *private)
 {
     struct summary_data *sd = private;
     int rc = 0;
-    CK_BYTE *shm_data = NULL;
-    CK_ULONG shm_size = 0;
+    CK_BYTE *shm_data = NULL, *sum_data;
+    CK_ULONG shm_size = 0, num_shards = 0;
 
-    rc = open_shm(user_id, user_name, sd->num_slots, &shm_data, &shm_size);
+    rc = open_shm(user_id, user_name, sd->num_slots, &shm_data, &shm_size,
+                  &num_shards);
     if (rc != 0)
         return rc;
 
-    rc = for_all_slots(summary_slot_cb, sd, shm_data, shm_size,
-                       sd->num_slots, sd->slots, false, 0);
-
+    sum_data = sum_shards(shm_data, num_shards,
+                          sd->num_slots * STAT_SLOT_SIZE);
     close_shm(shm_data, shm_size);
+    if (sum_data == NULL)
+        return 1;
+
+    rc = for_all_slots(summary_slot_cb, sd, sum_data,
+                       sd->num_slots * STAT_SLOT_SIZE, sd->num_slots, sd->slots,
+                       false, 0);
+
+    free(sum_data);
     return rc;
 
 }
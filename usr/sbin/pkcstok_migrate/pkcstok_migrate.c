@@ -29,6 +29,7 @@
 #endif
 
 #include <openssl/evp.h>
+#include <openssl/rand.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -1208,14 +1209,15 @@ static struct ConfigBaseNode *config_parse(const char *config_file,
  */
 static CK_RV identify_token(CK_SLOT_ID slot_id, char *conf_dir,
                             char *dll_name, size_t dll_name_len,
-                            char *token_group, size_t token_group_len)
+                            char *token_group, size_t token_group_len,
+                            int *objstore)
 {
     char conf_file[PATH_MAX];
     CK_RV ret;
     struct ConfigBaseNode *config = NULL, *c;
     struct ConfigIdxStructNode *slot;
     size_t max_dllname_size, max_tokengroup_size;
-    char *stdll, *usergroup = "";
+    char *stdll, *usergroup = "", *store = "files";
 
     max_dllname_size = dll_name_len > sizeof(((Slot_Info_t_64 *)NULL)->dll_location)
         ? sizeof(((Slot_Info_t_64 *)NULL)->dll_location) : dll_name_len;
@@ -1267,6 +1269,15 @@ static CK_RV identify_token(CK_SLOT_ID slot_id, char *conf_dir,
         goto done;
     }
 
+    c = confignode_find(slot->value, "objstore");
+    if (c != NULL && (store = confignode_getstr(c)) == NULL) {
+        TRACE_ERROR("Failed to find objstore for slot %lu in config file %s\n",
+                    slot_id, conf_file);
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+    *objstore = strcmp(store, "log") == 0 ? OBJSTORE_LOG : OBJSTORE_FILES;
+
     strncpy(dll_name, stdll, max_dllname_size);
     dll_name[max_dllname_size - 1] = 0;
 
@@ -2039,6 +2050,353 @@ done:
     return ret;
 }
 
+/**
+ * Builds the path of the given file in the TOK_OBJ folder of the data store.
+ */
+static CK_RV get_tokobj_path(char *buf, size_t buflen, const char *data_store,
+                             const char *name)
+{
+    if (ock_snprintf(buf, buflen, "%s/TOK_OBJ/%s", data_store, name) != 0) {
+        TRACE_ERROR("Path overflow for token object file %s\n", name);
+        return CKR_FUNCTION_FAILED;
+    }
+    return CKR_OK;
+}
+
+/**
+ * Reads the whole content of the given file. The returned buffer must be
+ * freed by the caller.
+ */
+static CK_RV read_whole_file(const char *fname, unsigned char **data,
+                             uint32_t *len)
+{
+    struct stat statbuf;
+    FILE *fp;
+    CK_RV ret;
+
+    *data = NULL;
+
+    fp = fopen(fname, "r");
+    if (!fp) {
+        TRACE_ERROR("fopen(%s) failed, errno=%s\n", fname, strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (fstat(fileno(fp), &statbuf) != 0) {
+        TRACE_ERROR("fstat(%s) failed, errno=%s\n", fname, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+    *len = statbuf.st_size;
+
+    *data = malloc(*len != 0 ? *len : 1);
+    if (*data == NULL) {
+        TRACE_ERROR("malloc failed\n");
+        ret = CKR_HOST_MEMORY;
+        goto done;
+    }
+
+    if (*len != 0 && fread(*data, *len, 1, fp) != 1) {
+        TRACE_ERROR("fread(%s) failed, errno=%s\n", fname, strerror(errno));
+        free(*data);
+        *data = NULL;
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    ret = CKR_OK;
+
+done:
+    fclose(fp);
+
+    return ret;
+}
+
+/**
+ * Converts the token objects of the given 3.12 format data store from one
+ * file per object plus OBJ.IDX to the single object log OBJ.LOG. Each object
+ * file becomes one record of the log, its content is not changed.
+ */
+static CK_RV convert_to_objlog(const char *data_store, const char *token_group)
+{
+    char iname[PATH_MAX], lname[PATH_MAX], tmpname[PATH_MAX];
+    char fname[PATH_MAX], tmp[PATH_MAX];
+    struct objlog_header hdr;
+    struct objlog_record rec;
+    unsigned char *data = NULL;
+    uint32_t len;
+    FILE *fp_idx = NULL, *fp_log = NULL;
+    CK_RV ret;
+
+    TRACE_INFO("Converting token objects to an object log ...\n");
+
+    if (get_tokobj_path(iname, sizeof(iname), data_store,
+                        PK_LITE_OBJ_IDX) != CKR_OK ||
+        get_tokobj_path(lname, sizeof(lname), data_store,
+                        PK_LITE_OBJ_LOG) != CKR_OK ||
+        get_tokobj_path(tmpname, sizeof(tmpname), data_store,
+                        PK_LITE_OBJ_LOG ".TMP") != CKR_OK)
+        return CKR_FUNCTION_FAILED;
+
+    memcpy(hdr.magic, OBJLOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = htobe32(OBJLOG_VERSION);
+    if (RAND_bytes((unsigned char *)&hdr.generation,
+                   sizeof(hdr.generation)) != 1) {
+        TRACE_ERROR("RAND_bytes failed\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    fp_log = fopen(tmpname, "w");
+    if (!fp_log) {
+        TRACE_ERROR("fopen(%s) failed, errno=%s\n", tmpname, strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    ret = set_perm(fileno(fp_log), token_group);
+    if (ret != CKR_OK)
+        goto done;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp_log) != 1)
+        goto write_err;
+
+    /* No index file means no token objects */
+    fp_idx = fopen(iname, "r");
+    while (fp_idx != NULL && fgets(tmp, sizeof(tmp), fp_idx)) {
+        tmp[strlen(tmp) - 1] = 0;
+        if (strlen(tmp) != 8) {
+            TRACE_ERROR("obj name %s does not have 8 chars, OBJ.IDX probably "
+                        "corrupted.\n", tmp);
+            ret = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+
+        ret = get_tokobj_path(fname, sizeof(fname), data_store, tmp);
+        if (ret != CKR_OK)
+            goto done;
+        ret = read_whole_file(fname, &data, &len);
+        if (ret != CKR_OK)
+            goto done;
+
+        memcpy(rec.name, tmp, 8);
+        rec.type = htobe32(OBJLOG_RECORD_OBJ);
+        rec.len = htobe32(len);
+        if (fwrite(&rec, sizeof(rec), 1, fp_log) != 1 ||
+            (len != 0 && fwrite(data, len, 1, fp_log) != 1))
+            goto write_err;
+
+        free(data);
+        data = NULL;
+    }
+
+    if (fclose(fp_log) != 0) {
+        fp_log = NULL;
+        goto write_err;
+    }
+    fp_log = NULL;
+
+    if (rename(tmpname, lname) != 0) {
+        TRACE_ERROR("Cannot rename %s, errno=%s.\n", tmpname, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    /* The objects are in the log now, remove the object files */
+    if (fp_idx != NULL) {
+        rewind(fp_idx);
+        while (fgets(tmp, sizeof(tmp), fp_idx)) {
+            tmp[strlen(tmp) - 1] = 0;
+            if (get_tokobj_path(fname, sizeof(fname), data_store,
+                                tmp) == CKR_OK)
+                remove(fname);
+        }
+        remove(iname);
+    }
+
+    ret = CKR_OK;
+    goto done;
+
+write_err:
+    TRACE_ERROR("fwrite(%s) failed, errno=%s\n", tmpname, strerror(errno));
+    ret = CKR_FUNCTION_FAILED;
+done:
+    if (fp_log != NULL)
+        fclose(fp_log);
+    if (ret != CKR_OK)
+        remove(tmpname);
+    if (fp_idx != NULL)
+        fclose(fp_idx);
+    free(data);
+
+    return ret;
+}
+
+/**
+ * Converts the token objects of the given 3.12 format data store from the
+ * object log OBJ.LOG back to one file per object plus OBJ.IDX, by replaying
+ * the records of the log.
+ */
+static CK_RV convert_to_objfiles(const char *data_store,
+                                 const char *token_group)
+{
+    char iname[PATH_MAX], lname[PATH_MAX], fname[PATH_MAX], name[9];
+    struct objlog_header hdr;
+    struct objlog_record rec;
+    unsigned char *data = NULL;
+    uint32_t len;
+    DIR *dir = NULL;
+    struct dirent *ent;
+    FILE *fp_log = NULL, *fp = NULL;
+    CK_RV ret;
+
+    TRACE_INFO("Converting the object log to token object files ...\n");
+
+    if (get_tokobj_path(iname, sizeof(iname), data_store,
+                        PK_LITE_OBJ_IDX) != CKR_OK ||
+        get_tokobj_path(lname, sizeof(lname), data_store,
+                        PK_LITE_OBJ_LOG) != CKR_OK)
+        return CKR_FUNCTION_FAILED;
+
+    fp_log = fopen(lname, "r");
+    if (!fp_log) {
+        TRACE_ERROR("fopen(%s) failed, errno=%s\n", lname, strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp_log) != 1 ||
+        memcmp(hdr.magic, OBJLOG_MAGIC, sizeof(hdr.magic)) != 0 ||
+        be32toh(hdr.version) != OBJLOG_VERSION) {
+        TRACE_ERROR("%s is not a valid object log\n", lname);
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    /* An incomplete record at the end is from an interrupted append */
+    while (fread(&rec, sizeof(rec), 1, fp_log) == 1) {
+        len = be32toh(rec.len);
+        memcpy(name, rec.name, 8);
+        name[8] = 0;
+        ret = get_tokobj_path(fname, sizeof(fname), data_store, name);
+        if (ret != CKR_OK)
+            goto done;
+
+        switch (be32toh(rec.type)) {
+        case OBJLOG_RECORD_OBJ:
+            data = malloc(len != 0 ? len : 1);
+            if (data == NULL) {
+                TRACE_ERROR("malloc failed\n");
+                ret = CKR_HOST_MEMORY;
+                goto done;
+            }
+            if (len != 0 && fread(data, len, 1, fp_log) != 1) {
+                TRACE_WARN("Ignoring incomplete record of object %.8s\n",
+                           rec.name);
+                free(data);
+                data = NULL;
+                goto records_done;
+            }
+
+            fp = fopen(fname, "w");
+            if (!fp) {
+                TRACE_ERROR("fopen(%s) failed, errno=%s\n", fname,
+                            strerror(errno));
+                ret = CKR_FUNCTION_FAILED;
+                goto done;
+            }
+            ret = set_perm(fileno(fp), token_group);
+            if (ret != CKR_OK)
+                goto done;
+            if (len != 0 && fwrite(data, len, 1, fp) != 1) {
+                TRACE_ERROR("fwrite(%s) failed, errno=%s\n", fname,
+                            strerror(errno));
+                ret = CKR_FUNCTION_FAILED;
+                goto done;
+            }
+            fclose(fp);
+            fp = NULL;
+            free(data);
+            data = NULL;
+            break;
+        case OBJLOG_RECORD_DEL:
+            remove(fname);
+            break;
+        default:
+            TRACE_ERROR("Invalid record type %u in %s\n", be32toh(rec.type),
+                        lname);
+            ret = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+    }
+
+records_done:
+    /* Create the index from the object files */
+    fp = fopen(iname, "w");
+    if (!fp) {
+        TRACE_ERROR("fopen(%s) failed, errno=%s\n", iname, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+    ret = set_perm(fileno(fp), token_group);
+    if (ret != CKR_OK)
+        goto done;
+
+    ret = get_tokobj_path(fname, sizeof(fname), data_store, "");
+    if (ret != CKR_OK)
+        goto done;
+    dir = opendir(fname);
+    if (!dir) {
+        TRACE_ERROR("opendir(%s) failed, errno=%s\n", fname, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        /* OBJ.IDX and OBJ.LOG have 7 chars */
+        if (strlen(ent->d_name) != 8)
+            continue;
+        fprintf(fp, "%s\n", ent->d_name);
+    }
+
+    if (fclose(fp) != 0) {
+        fp = NULL;
+        TRACE_ERROR("fclose(%s) failed, errno=%s\n", iname, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+    fp = NULL;
+
+    remove(lname);
+    ret = CKR_OK;
+
+done:
+    if (dir != NULL)
+        closedir(dir);
+    if (fp != NULL)
+        fclose(fp);
+    fclose(fp_log);
+    free(data);
+
+    return ret;
+}
+
+/**
+ * Converts the token objects of the given 3.12 format data store from the
+ * object store it currently uses to the given one (OBJSTORE_FILES or
+ * OBJSTORE_LOG).
+ */
+static CK_RV convert_object_store(const char *data_store, int from, int to,
+                                  const char *token_group)
+{
+    if (from == to) {
+        TRACE_INFO("Token objects are already in the requested object "
+                   "store.\n");
+        return CKR_OK;
+    }
+
+    if (to == OBJSTORE_LOG)
+        return convert_to_objlog(data_store, token_group);
+    else
+        return convert_to_objfiles(data_store, token_group);
+}
+
 /**
  * Switch to new repository by deleting the old repository and renaming
  * the backup folder to the original data store name.
@@ -2084,9 +2442,14 @@ done:
  *     stdll = libpkcs11_cca.so
  *     tokversion = 3.12
  *   }
+ *
+ * If objstore is not negative, the objstore parm is set as well.
  */
-static CK_RV update_opencryptoki_conf(CK_SLOT_ID slot_id, char *location)
+static CK_RV update_opencryptoki_conf(CK_SLOT_ID slot_id, char *location,
+                                      int objstore)
 {
+    const char *objstore_str = objstore == OBJSTORE_LOG ? "log" : "files";
+    struct ConfigBareValNode *b;
     char dst_file[PATH_MAX], src_file[PATH_MAX], fname[PATH_MAX+20];
     struct ConfigBaseNode *config = NULL, *c;
     struct ConfigVersionValNode *v;
@@ -2149,6 +2512,45 @@ static CK_RV update_opencryptoki_conf(CK_SLOT_ID slot_id, char *location)
         confignode_append(slot->value, &v->base);
     }
 
+    c = objstore >= 0 ? confignode_find(slot->value, "objstore") : NULL;
+    if (c != NULL) {
+        /* modify existing objstore */
+        if (confignode_hastype(c, CT_BAREVAL)) {
+            free(confignode_to_bareval(c)->value);
+            confignode_to_bareval(c)->value = strdup(objstore_str);
+            if (confignode_to_bareval(c)->value == NULL) {
+                TRACE_ERROR("strdup failed\n");
+                ret = CKR_HOST_MEMORY;
+                goto done;
+            }
+        } else if (confignode_hastype(c, CT_STRINGVAL)) {
+            free(confignode_to_stringval(c)->value);
+            confignode_to_stringval(c)->value = strdup(objstore_str);
+            if (confignode_to_stringval(c)->value == NULL) {
+                TRACE_ERROR("strdup failed\n");
+                ret = CKR_HOST_MEMORY;
+                goto done;
+            }
+        } else {
+            TRACE_ERROR("objstore is invalid in slot %lu in config file %s\n",
+                        slot_id, src_file);
+            ret = CKR_FUNCTION_FAILED;
+            goto done;
+        }
+    } else if (objstore >= 0) {
+        /* add new objstore */
+        b = confignode_allocbarevaldumpable("objstore", (char *)objstore_str,
+                                            0, " added by pkcstok_migrate");
+        if (b == NULL) {
+            TRACE_ERROR("failed to allocate config node for config file %s\n",
+                        src_file);
+            ret = CKR_HOST_MEMORY;
+            goto done;
+        }
+
+        confignode_append(slot->value, &b->base);
+    }
+
     /* Open new conf file for write */
     snprintf(dst_file, PATH_MAX, "%s/%s", location, "opencryptoki.conf_new");
     fp_w = fopen(dst_file, "w");
@@ -2191,11 +2593,15 @@ done:
 }
 
 /**
- * Removes the token_s shared memory from /dev/shm
+ * Removes the token_s shared memory from /dev/shm, including the SHM segments
+ * of its token object table (<name>.tok_obj_table.<generation>)
  */
 static CK_RV remove_shared_memory(char *location)
 {
-    char shm_name[PATH_MAX];
+    char shm_name[PATH_MAX], tab_name[PATH_MAX];
+    struct dirent *ent;
+    size_t len;
+    DIR *dir;
     int i, k, rc;
 
     i = k = 0;
@@ -2217,6 +2623,27 @@ static CK_RV remove_shared_memory(char *location)
         return CKR_FUNCTION_FAILED;
     }
 
+    dir = opendir("/dev/shm");
+    if (dir == NULL)
+        return CKR_OK;
+
+    len = strlen(shm_name + 1);
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, shm_name + 1, len) != 0 ||
+            strncmp(ent->d_name + len, ".tok_obj_table.", 15) != 0)
+            continue;
+
+        snprintf(tab_name, sizeof(tab_name), "/%s", ent->d_name);
+        rc = shm_unlink(tab_name);
+        if (rc != 0 && errno != ENOENT) {
+            warnx("shm_unlink(%s) failed, errno=%s", tab_name,
+                  strerror(errno));
+            closedir(dir);
+            return CKR_FUNCTION_FAILED;
+        }
+    }
+    closedir(dir);
+
     return CKR_OK;
 }
 
@@ -2614,6 +3041,8 @@ static void usage(char *progname)
     printf(" -c, --confdir CONFDIR\t\tlocation of opencryptoki.conf (required)\n");
     printf(" -u, --userpin USERPIN\t\ttoken user pin (prompted if not specified)\n");
     printf(" -p, --sopin SOPIN\t\ttoken SO pin (prompted if not specified)\n");
+    printf(" -o, --objstore STORE\t\tconvert the token objects (optional):\n");
+    printf("\t\t\t\tfiles, log\n");
     printf(" -v, --verbose LEVEL\t\tset verbose level (optional):\n");
     printf("\t\t\t\tnone (default), error, warn, info, devel, debug\n");
     return;
@@ -2622,7 +3051,7 @@ static void usage(char *progname)
 int main(int argc, char **argv)
 {
     CK_RV ret = 0;
-    int opt = 0, vlevel = -1;
+    int opt = 0, vlevel = -1, objstore = -1, objstore_cur;
     CK_SLOT_ID slot_id = 0;
     CK_BBOOL slot_id_specified = CK_FALSE;
     size_t buflen = 0;
@@ -2645,11 +3074,12 @@ int main(int argc, char **argv)
         {"userpin", required_argument, NULL, 'u'},
         {"sopin", required_argument, NULL, 'p'},
         {"verbose", required_argument, NULL, 'v'},
+        {"objstore", required_argument, NULL, 'o'},
         {"help", no_argument, NULL, 'h'},
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "d:c:s:u:p:v:h", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "d:c:s:u:p:v:o:h", long_opts, NULL)) != -1) {
         switch (opt) {
         case 'd':
             data_store = strdup(optarg);
@@ -2688,6 +3118,17 @@ int main(int argc, char **argv)
                 exit(1);
             }
             break;
+        case 'o':
+            if (strcmp(optarg, "files") == 0) {
+                objstore = OBJSTORE_FILES;
+            } else if (strcmp(optarg, "log") == 0) {
+                objstore = OBJSTORE_LOG;
+            } else {
+                warnx("Invalid object store '%s' specified.", optarg);
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
         case 'h':
             usage(argv[0]);
             exit(0);
@@ -2728,6 +3169,9 @@ int main(int argc, char **argv)
         trace_level = vlevel;
         printf("  verbose level = %s\n", verbose);
     }
+    if (objstore >= 0)
+        printf("  object store = %s\n",
+               objstore == OBJSTORE_LOG ? "log" : "files");
     printf("\n");
 
     /* Slot ID must be given */
@@ -2793,7 +3237,7 @@ int main(int argc, char **argv)
 
     /* Identify token related to given slot ID */
     ret = identify_token(slot_id, conf_dir, dll_name, sizeof(dll_name),
-                         token_group, sizeof(token_group));
+                         token_group, sizeof(token_group), &objstore_cur);
     if (ret != CKR_OK) {
         warnx("Cannot identify a token related to given slot ID %ld", slot_id);
         goto done;
@@ -2858,9 +3302,12 @@ int main(int argc, char **argv)
 
     /* Check if data store is already new */
     ret = datastore_is_312(data_store, sopin, userpin, &new);
-    if (ret == 0 && new) {
+    if (ret != 0)
+        new = FALSE;
+    if (new) {
         printf("Data store %s is already in new format.\n", data_store);
-        goto finalize;
+        if (objstore < 0)
+            goto finalize;
     }
 
     /* Backup repository if not already done */
@@ -2874,19 +3321,32 @@ int main(int argc, char **argv)
     data_store_old = data_store;
     snprintf(data_store_new, PATH_MAX, "%s_PKCSTOK_MIGRATE_TMP", data_store_old);
 
-    /* Create new temp token keys, which exist in parallel to the old ones
-     * until the migration is fully completed. */
-    ret = create_token_keys_312(data_store_new, sopin, userpin, token_group);
-    if (ret != CKR_OK) {
-        warnx("Failed to create new token keys.");
-        goto done;
+    if (!new) {
+        /* Create new temp token keys, which exist in parallel to the old ones
+         * until the migration is fully completed. */
+        ret = create_token_keys_312(data_store_new, sopin, userpin,
+                                    token_group);
+        if (ret != CKR_OK) {
+            warnx("Failed to create new token keys.");
+            goto done;
+        }
+
+        /* Migrate repository */
+        ret = migrate_repository(data_store_new, sopin, userpin, token_group);
+        if (ret != CKR_OK) {
+            warnx("Failed to migrate repository.");
+            goto done;
+        }
     }
 
-    /* Migrate repository */
-    ret = migrate_repository(data_store_new, sopin, userpin, token_group);
-    if (ret != CKR_OK) {
-        warnx("Failed to migrate repository.");
-        goto done;
+    /* Convert the token objects to the requested object store */
+    if (objstore >= 0) {
+        ret = convert_object_store(data_store_new, objstore_cur, objstore,
+                                   token_group);
+        if (ret != CKR_OK) {
+            warnx("Failed to convert the token objects.");
+            goto done;
+        }
     }
 
     /* Switch to new repository */
@@ -2905,7 +3365,7 @@ finalize:
     }
 
     /* Now insert new 'tokversion=3.12' parm in opencryptoki.conf */
-    ret = update_opencryptoki_conf(slot_id, conf_dir);
+    ret = update_opencryptoki_conf(slot_id, conf_dir, objstore);
     if (ret != CKR_OK) {
         warnx("Failed to update opencryptoki.conf, you must do this manually.");
         goto done;